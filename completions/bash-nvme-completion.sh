@@ -445,6 +445,33 @@ nvme_list_opts () {
 		"show-topology")
 		opts+=" --output-format= -o --verbose -v --ranking= -r"
 			;;
+		"snapshot")
+		opts+=" --watch -w --invalidate -i"
+			;;
+		"metrics")
+		opts+=" --verbose -v"
+			;;
+		"batch")
+		opts+=" --status-file= -s --stop-on-error -e --verbose -v"
+			;;
+		"serve")
+		opts+=" --socket= -S --jobs= -j --verbose -v"
+			;;
+		"watch")
+		opts+=" --interval= -i --count= -c --ocp -O --endurance -E \
+			--output-format= -o --verbose -v"
+			;;
+		"monitor")
+		opts+=" --no-arm -N --output-format= -o --verbose -v"
+			;;
+		"fleet")
+		opts+=" --all -A --sanact= -a --no-dealloc -d --oipbp -i \
+			--owpass= -n --ause -u --ovrpat= -p --self-test-code= -s \
+			--namespace-id= -N --output-format= -o --verbose -v"
+			;;
+		"collect")
+		opts+=" --output= -O --logs= -l --verbose -v"
+			;;
 		"nvme-mi-recv")
 		opts+=" --opcode= -O --namespace-id= -n --data-len= -l \
 			--nmimt= -m --nmd0= -0 --nmd1= -1 --input-file= -i"
@@ -671,7 +698,8 @@ plugin_wdc_opts () {
 			;;
 		"vs-internal-log")
 		opts+=" --output-file= -o --transfer-size= -s --data-area= -d \
-			--file-size= -f --offset= -e --type= -t --verbose -v"
+			--file-size= -f --offset= -e --type= -t --verbose -v \
+			--direct-io -D"
 			;;
 		"vs-nand-stats")
 		opts+=" --output-format= -o"
@@ -1257,15 +1285,18 @@ plugin_zns_opts () {
 		"report-zones")
 		opts+=" --namespace-id= -n --start-lba= -s \
 			--descs= -d --state= -S --output-format= -o \
-			--human-readable -H --extended -e --partial -p"
+			--human-readable -H --extended -e --partial -p \
+			--zone-map= -m"
 			;;
 		"close-zone")
 		opts+=" --namespace-id= -n --start-lba= -s \
-			--select-all -a --timeout= -t"
+			--select-all -a --timeout= -t --state= -S \
+			--end-lba= -e --zone-list= -l --jobs= -j"
 			;;
 		"finish-zone")
 		opts+=" --namespace-id= -n --start-lba= -s \
-			--select-all -a --timeout= -t"
+			--select-all -a --timeout= -t --state= -S \
+			--end-lba= -e --zone-list= -l --jobs= -j"
 			;;
 		"open-zone")
 		opts+=" --namespace-id= -n --start-lba= -s \
@@ -1273,11 +1304,13 @@ plugin_zns_opts () {
 			;;
 		"reset-zone")
 		opts+=" --namespace-id= -n --start-lba= -s \
-			--select-all -a --timeout= -t"
+			--select-all -a --timeout= -t --state= -S \
+			--end-lba= -e --zone-list= -l --jobs= -j"
 			;;
 		"offline-zone")
 		opts+=" --namespace-id= -n --start-lba= -s \
-			--select-all -a --timeout= -t"
+			--select-all -a --timeout= -t --state= -S \
+			--end-lba= -e --zone-list= -l --jobs= -j"
 			;;
 		"set-zone-desc")
 		opts+=" --namespace-id= -n --start-lba= -s \
@@ -1291,11 +1324,15 @@ plugin_zns_opts () {
 			--metadata-size= -y --data= -d --metadata= -M \
 			--limited-retry -l --force-unit-access -f --ref-tag= -r
 			--app-tag-mask= -m --app-tag= -a --prinfo= -p \
-			--piremap -P --latency -t"
+			--piremap -P --latency -t --stream -S --open-zones= -o \
+			--queue-depth= -q --extent-map= -e"
 			;;
 		"changed-zone-list")
 		opts+=" --namespace-id= -n --output-format= -o --rae -r"
 			;;
+		"zone-map")
+		opts+=" --namespace-id= -n --rescan -r --output-format= -o"
+			;;
 		"help")
 		opts+=$NO_OPTS
 			;;
@@ -1536,7 +1573,7 @@ _nvme_subcmds () {
 		[zns]="id-ctrl id-ns zone-mgmt-recv \
 			zone-mgmt-send report-zones close-zone \
 			finish-zone open-zone reset-zone offline-zone \
-			set-zone-desc zone-append changed-zone-list"
+			set-zone-desc zone-append changed-zone-list zone-map"
 		[nvidia]="id-ctrl"
 		[ymtc]="smart-log-add"
 		[inspur]="nvme-vendor-log"
@@ -1598,7 +1635,7 @@ _nvme_subcmds () {
 		show-hostnqn dir-receive dir-send virt-mgmt \
 		rpmb boot-part-log fid-support-effects-log \
 		supported-log-pages lockdown media-unit-stat-log \
-		supported-cap-config-log dim show-topology list-endgrp \
+		supported-cap-config-log dim show-topology snapshot metrics batch serve watch monitor fleet collect list-endgrp \
 		nvme-mi-recv nvme-mi-send get-reg set-reg"
 
 	# Add plugins:
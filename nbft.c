@@ -30,8 +30,7 @@ static void json_connect_msg(nvme_ctrl_t c)
 	root = json_create_object();
 	json_object_add_value_string(root, "device", nvme_ctrl_get_name(c));
 
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 	json_free_object(root);
 #endif
 }
@@ -139,7 +138,7 @@ static int do_connect(nvme_root_t r,
 
 	if (flags == NORMAL)
 		print_connect_msg(c);
-	else if (flags == JSON)
+	else if (flags & JSON)
 		json_connect_msg(c);
 
 	return 0;
@@ -111,6 +111,14 @@ COMMAND_LIST(
 	ENTRY("lockdown", "Submit a Lockdown command,return result", lockdown_cmd)
 	ENTRY("dim", "Send Discovery Information Management command to a Discovery Controller", dim_cmd) \
 	ENTRY("show-topology", "Show the topology", show_topology_cmd) \
+	ENTRY("snapshot", "Save or refresh the topology snapshot", snapshot_cmd) \
+	ENTRY("metrics", "Print the health logs of all controllers as OpenMetrics", metrics_cmd) \
+	ENTRY("batch", "Run the commands of a file in one process", batch_cmd) \
+	ENTRY("serve", "Run commands for local clients over a Unix socket", serve_cmd) \
+	ENTRY("watch", "Print health and throughput rates of devices at an interval", watch_cmd) \
+	ENTRY("monitor", "Print the asynchronous events of controllers as they occur", monitor_cmd) \
+	ENTRY("fleet", "Sanitize or self-test many controllers at once", fleet_cmd) \
+	ENTRY("collect", "Gather the diagnostic data of all controllers into an archive", collect_cmd) \
 	ENTRY("io-mgmt-recv", "I/O Management Receive", io_mgmt_recv)
 	ENTRY("io-mgmt-send", "I/O Management Send", io_mgmt_send)
 	ENTRY("nvme-mi-recv", "Submit a NVMe-MI Receive command, return results", nmi_recv)
@@ -0,0 +1,521 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * nvme fleet: runs a sanitize or device self-test operation on many
+ * controllers at once and follows their progress.
+ *
+ * Each controller has at most one admin command in flight. The operations
+ * are started together, after which the sanitize status or self-test log
+ * of every controller is read on its own schedule: often while it makes
+ * progress and is close to completion, less and less often while it does
+ * not. Completion is estimated from the progress so far, or from the
+ * estimate the controller reports until there is progress.
+ */
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libnvme.h>
+
+#include "common.h"
+#include "nvme-fleet.h"
+#include "nvme-print.h"
+#include "nvme-scan.h"
+#include "util/cleanup.h"
+#include "util/json-stream.h"
+#include "util/mem.h"
+#include "util/parallel.h"
+
+/* seconds between two polls of a controller */
+#define FLEET_POLL_MIN			1
+#define FLEET_POLL_MAX			60
+/* the progress line is redrawn at this interval, in seconds */
+#define FLEET_REDRAW			1
+/* a short device self-test takes at most two minutes */
+#define FLEET_SHORT_SELF_TEST		120
+
+enum fleet_state {
+	FLEET_RUNNING,
+	FLEET_DONE,
+	FLEET_FAILED,
+};
+
+static const char * const fleet_states[] = {
+	[FLEET_RUNNING]	= "running",
+	[FLEET_DONE]	= "done",
+	[FLEET_FAILED]	= "failed",
+};
+
+struct fleet_dev {
+	struct nvme_fleet_dev *dev;
+	enum fleet_state state;
+	bool reported;		/* the completion was printed */
+	bool polled;		/* since it was last printed */
+	double progress;	/* 0 to 1 */
+	double estimate;	/* seconds the controller expects, < 0 if unknown */
+	double remaining;	/* seconds, < 0 if unknown */
+	double elapsed;
+	unsigned int backoff;
+	struct timespec start;
+	struct timespec next;
+	int err;		/* of a command, negative errno or NVMe status */
+	char result[96];
+	bool logged;		/* a self-test result was in the log at the start */
+	struct nvme_st_result last;	/* the newest one */
+};
+
+struct fleet {
+	const struct nvme_fleet_cfg *cfg;
+	struct fleet_dev *devs;
+	int nr;
+	int *due;
+	struct json_stream *s;
+	bool tty;
+};
+
+static volatile sig_atomic_t fleet_stop;
+
+static void fleet_signal(int sig)
+{
+	fleet_stop = 1;
+}
+
+static double fleet_elapsed(const struct timespec *from, const struct timespec *to)
+{
+	return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+static void fleet_fmt_time(char *buf, size_t len, double secs)
+{
+	unsigned long s = secs + 0.5;
+
+	if (secs < 0)
+		snprintf(buf, len, "--:--:--");
+	else
+		snprintf(buf, len, "%02lu:%02lu:%02lu", s / 3600, s / 60 % 60, s % 60);
+}
+
+static void fleet_fail(struct fleet_dev *fd, int err, const char *what)
+{
+	fd->state = FLEET_FAILED;
+	fd->err = err;
+	snprintf(fd->result, sizeof(fd->result), "%s: %s", what,
+		 err < 0 ? nvme_strerror(-err) : nvme_status_to_string(err, false));
+}
+
+/* The estimate the controller reports for the sanitize action */
+static double fleet_sanitize_estimate(struct nvme_sanitize_log_page *log,
+				      const struct nvme_sanitize_nvm_args *args)
+{
+	__u32 est, nd = 0xffffffff;
+
+	switch (args->sanact) {
+	case NVME_SANITIZE_SANACT_START_OVERWRITE:
+		est = le32_to_cpu(log->eto);
+		nd = le32_to_cpu(log->etond);
+		break;
+	case NVME_SANITIZE_SANACT_START_BLOCK_ERASE:
+		est = le32_to_cpu(log->etbe);
+		nd = le32_to_cpu(log->etbend);
+		break;
+	case NVME_SANITIZE_SANACT_START_CRYPTO_ERASE:
+		est = le32_to_cpu(log->etce);
+		nd = le32_to_cpu(log->etcend);
+		break;
+	default:
+		return -1;
+	}
+
+	if (args->nodas && nd != 0xffffffff && nd)
+		est = nd;
+
+	return est == 0xffffffff || !est ? -1 : est;
+}
+
+static void fleet_start(int i, void *arg)
+{
+	struct fleet *f = arg;
+	struct fleet_dev *fd = &f->devs[i];
+	struct nvme_sanitize_nvm_args sanitize = f->cfg->sanitize;
+	struct nvme_dev_self_test_args self_test = f->cfg->self_test;
+	_cleanup_free_ struct nvme_sanitize_log_page *log = NULL;
+	_cleanup_free_ struct nvme_self_test_log *st_log = NULL;
+	_cleanup_free_ struct nvme_id_ctrl *ctrl = NULL;
+	int err;
+
+	fd->estimate = -1;
+	fd->remaining = -1;
+	fd->backoff = FLEET_POLL_MIN;
+
+	if (f->cfg->op == NVME_FLEET_SANITIZE) {
+		log = nvme_alloc(sizeof(*log));
+		if (!log) {
+			fleet_fail(fd, -ENOMEM, "sanitize");
+			return;
+		}
+		if (!nvme_get_log_sanitize(fd->dev->fd, false, log))
+			fd->estimate = fleet_sanitize_estimate(log, &sanitize);
+
+		sanitize.fd = fd->dev->fd;
+		err = nvme_sanitize_nvm(&sanitize);
+		if (err) {
+			fleet_fail(fd, err < 0 ? -errno : err, "sanitize");
+			return;
+		}
+	} else {
+		ctrl = nvme_alloc(sizeof(*ctrl));
+		st_log = nvme_alloc(sizeof(*st_log));
+		if (!ctrl || !st_log) {
+			fleet_fail(fd, -ENOMEM, "self-test");
+			return;
+		}
+		if (self_test.stc == NVME_DST_STC_LONG) {
+			if (!nvme_identify_ctrl(fd->dev->fd, ctrl) && ctrl->edstt)
+				fd->estimate = le16_to_cpu(ctrl->edstt) * 60;
+		} else if (self_test.stc == NVME_DST_STC_SHORT) {
+			fd->estimate = FLEET_SHORT_SELF_TEST;
+		}
+
+		/* tells the result of this operation from the earlier ones */
+		if (!nvme_get_log_device_self_test(fd->dev->fd, st_log) &&
+		    (st_log->result[0].dsts & NVME_ST_RESULT_MASK) != NVME_ST_RESULT_NOT_USED) {
+			fd->logged = true;
+			fd->last = st_log->result[0];
+		}
+
+		self_test.fd = fd->dev->fd;
+		err = nvme_dev_self_test(&self_test);
+		if (err) {
+			fleet_fail(fd, err < 0 ? -errno : err, "self-test");
+			return;
+		}
+	}
+
+	fd->state = FLEET_RUNNING;
+	fd->remaining = fd->estimate;
+	clock_gettime(CLOCK_MONOTONIC, &fd->start);
+	fd->next = fd->start;
+	fd->next.tv_sec += FLEET_POLL_MIN;
+}
+
+static void fleet_poll_sanitize(struct fleet_dev *fd, double *progress)
+{
+	_cleanup_free_ struct nvme_sanitize_log_page *log = NULL;
+	__u16 sstat;
+	int err;
+
+	log = nvme_alloc(sizeof(*log));
+	if (!log)
+		return;
+
+	err = nvme_get_log_sanitize(fd->dev->fd, false, log);
+	if (err) {
+		fleet_fail(fd, err < 0 ? -errno : err, "sanitize log");
+		return;
+	}
+
+	sstat = le16_to_cpu(log->sstat);
+	switch (sstat & NVME_SANITIZE_SSTAT_STATUS_MASK) {
+	case NVME_SANITIZE_SSTAT_STATUS_IN_PROGESS:
+		*progress = le16_to_cpu(log->sprog) / 65536.0;
+		return;
+	case NVME_SANITIZE_SSTAT_STATUS_COMPLETE_SUCCESS:
+	case NVME_SANITIZE_SSTAT_STATUS_ND_COMPLETE_SUCCESS:
+		fd->state = FLEET_DONE;
+		break;
+	case NVME_SANITIZE_SSTAT_STATUS_COMPLETED_FAILED:
+		fd->state = FLEET_FAILED;
+		fd->err = -EIO;
+		break;
+	default:
+		/* not started yet */
+		return;
+	}
+
+	snprintf(fd->result, sizeof(fd->result), "%s", nvme_sstat_status_to_string(sstat));
+}
+
+static void fleet_poll_self_test(struct fleet_dev *fd, __u8 stc, double *progress)
+{
+	_cleanup_free_ struct nvme_self_test_log *log = NULL;
+	struct nvme_st_result *newest;
+	__u8 res;
+	int err;
+
+	log = nvme_alloc(sizeof(*log));
+	if (!log)
+		return;
+
+	err = nvme_get_log_device_self_test(fd->dev->fd, log);
+	if (err) {
+		fleet_fail(fd, err < 0 ? -errno : err, "self-test log");
+		return;
+	}
+
+	if (log->current_operation & 0xf) {
+		*progress = (log->completion & 0x7f) / 100.0;
+		return;
+	}
+
+	/*
+	 * The newest result is the one of the operation if it is of the same
+	 * kind and the one which was the newest at the start comes right
+	 * after it.
+	 */
+	newest = &log->result[0];
+	res = newest->dsts & NVME_ST_RESULT_MASK;
+	if (res == NVME_ST_RESULT_NOT_USED || newest->dsts >> NVME_ST_CODE_SHIFT != stc ||
+	    (fd->logged && memcmp(&log->result[1], &fd->last, sizeof(fd->last)))) {
+		fd->state = FLEET_FAILED;
+		fd->err = -EIO;
+		snprintf(fd->result, sizeof(fd->result), "no result of the self-test in the log");
+	} else if (res == NVME_ST_RESULT_NO_ERR) {
+		fd->state = FLEET_DONE;
+		snprintf(fd->result, sizeof(fd->result), "completed without error");
+	} else {
+		fd->state = FLEET_FAILED;
+		fd->err = -EIO;
+		snprintf(fd->result, sizeof(fd->result), "completed with result %#x", res);
+	}
+}
+
+static void fleet_poll(int i, void *arg)
+{
+	struct fleet *f = arg;
+	struct fleet_dev *fd = &f->devs[f->due[i]];
+	double progress = fd->progress, rem;
+	struct timespec now;
+
+	if (f->cfg->op == NVME_FLEET_SANITIZE)
+		fleet_poll_sanitize(fd, &progress);
+	else
+		fleet_poll_self_test(fd, f->cfg->self_test.stc, &progress);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	fd->elapsed = fleet_elapsed(&fd->start, &now);
+	fd->polled = true;
+	if (fd->state != FLEET_RUNNING) {
+		fd->remaining = 0;
+		if (fd->state == FLEET_DONE)
+			fd->progress = 1;
+		return;
+	}
+
+	/* the progress so far is the better estimate, once there is some */
+	if (progress > 0.01)
+		fd->remaining = fd->elapsed * (1 - progress) / progress;
+	else if (fd->estimate >= 0)
+		fd->remaining = fd->estimate > fd->elapsed ? fd->estimate - fd->elapsed : 0;
+
+	if (progress > fd->progress) {
+		fd->progress = progress;
+		rem = fd->remaining >= 0 ? fd->remaining / 10 : fd->backoff;
+		fd->backoff = rem < FLEET_POLL_MIN ? FLEET_POLL_MIN :
+			      rem > FLEET_POLL_MAX ? FLEET_POLL_MAX : rem;
+	} else if (fd->backoff < FLEET_POLL_MAX) {
+		fd->backoff = fd->backoff * 2 > FLEET_POLL_MAX ? FLEET_POLL_MAX :
+			      fd->backoff * 2;
+	}
+
+	fd->next = now;
+	fd->next.tv_sec += fd->backoff;
+}
+
+static void fleet_json(struct fleet *f, struct fleet_dev *fd)
+{
+	json_stream_begin_object(f->s, NULL);
+	json_stream_add_uint(f->s, "timestamp", time(NULL));
+	json_stream_add_str(f->s, "device", fd->dev->name);
+	json_stream_add_str(f->s, "operation",
+			    f->cfg->op == NVME_FLEET_SANITIZE ? "sanitize" : "self-test");
+	json_stream_add_str(f->s, "state", fleet_states[fd->state]);
+	json_stream_add_double(f->s, "progress", fd->progress * 100);
+	json_stream_add_double(f->s, "elapsed", fd->elapsed);
+	if (fd->state == FLEET_RUNNING && fd->remaining >= 0)
+		json_stream_add_double(f->s, "remaining", fd->remaining);
+	if (fd->state != FLEET_RUNNING) {
+		json_stream_add_int(f->s, "status", fd->err);
+		json_stream_add_str(f->s, "result", fd->result);
+	}
+	json_stream_end_object(f->s);
+}
+
+/* Prints the finished controllers and the progress of all of them */
+static void fleet_show(struct fleet *f, bool final)
+{
+	int running = 0, done = 0, failed = 0, i;
+	double progress = 0, eta = 0;
+	char elapsed[16], remaining[16];
+	struct fleet_dev *fd;
+
+	for (i = 0; i < f->nr; i++) {
+		fd = &f->devs[i];
+		switch (fd->state) {
+		case FLEET_RUNNING:
+			running++;
+			if (fd->remaining < 0 || eta < 0)
+				eta = -1;
+			else if (fd->remaining > eta)
+				eta = fd->remaining;
+			progress += fd->progress;
+			break;
+		case FLEET_DONE:
+			done++;
+			progress += 1;
+			break;
+		case FLEET_FAILED:
+			failed++;
+			break;
+		}
+
+		/* JSON has a record for every poll, the progress line sums them up */
+		if (f->s && (fd->polled || fd->state != FLEET_RUNNING) && !fd->reported)
+			fleet_json(f, fd);
+		fd->polled = false;
+
+		if (fd->state == FLEET_RUNNING || fd->reported)
+			continue;
+		fd->reported = true;
+
+		if (f->s)
+			continue;
+		fleet_fmt_time(elapsed, sizeof(elapsed), fd->elapsed);
+		printf("%s%-12s %-6s %s  %s\n", f->tty ? "\r" : "", fd->dev->name,
+		       fleet_states[fd->state], elapsed, fd->result);
+	}
+
+	if (f->s) {
+		json_stream_flush(f->s);
+		return;
+	}
+
+	if (!f->tty && !final)
+		return;
+
+	progress = f->nr - failed ? progress * 100 / (f->nr - failed) : 0;
+	fleet_fmt_time(remaining, sizeof(remaining), running ? eta : 0);
+	printf("%s%3.0f%%  running %d, done %d, failed %d, remaining %s%s",
+	       f->tty ? "\r" : "", progress, running, done, failed, remaining,
+	       final ? "\n" : "   ");
+	fflush(stdout);
+}
+
+/* Running self-tests are aborted when interrupted, a sanitize cannot be */
+static void fleet_abort(int i, void *arg)
+{
+	struct fleet *f = arg;
+	struct fleet_dev *fd = &f->devs[i];
+	struct nvme_dev_self_test_args args = f->cfg->self_test;
+
+	if (fd->state != FLEET_RUNNING)
+		return;
+
+	if (f->cfg->op == NVME_FLEET_SELF_TEST) {
+		args.fd = fd->dev->fd;
+		args.stc = NVME_DST_STC_ABORT;
+		nvme_dev_self_test(&args);
+		snprintf(fd->result, sizeof(fd->result), "aborted");
+	} else {
+		snprintf(fd->result, sizeof(fd->result), "still in progress");
+	}
+	fd->state = FLEET_FAILED;
+	fd->err = -EINTR;
+}
+
+int nvme_fleet(struct nvme_fleet_dev *devs, int nr, const struct nvme_fleet_cfg *cfg)
+{
+	struct sigaction sa = {
+		.sa_handler	= fleet_signal,
+	};
+	struct sigaction old_int, old_term;
+	struct timespec now, wake;
+	struct fleet f = {
+		.cfg	= cfg,
+		.nr	= nr,
+		.tty	= !cfg->json && isatty(STDOUT_FILENO),
+	};
+	int i, n, err = 0;
+
+	f.devs = calloc(nr, sizeof(*f.devs));
+	f.due = calloc(nr, sizeof(*f.due));
+	if (!f.devs || !f.due) {
+		err = -ENOMEM;
+		goto free;
+	}
+	for (i = 0; i < nr; i++)
+		f.devs[i].dev = &devs[i];
+
+	if (cfg->json) {
+		f.s = json_stream_open(stdout, JSON_STREAM_PLAIN);
+		if (!f.s) {
+			err = -ENOMEM;
+			goto free;
+		}
+	}
+
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, &old_int);
+	sigaction(SIGTERM, &sa, &old_term);
+	fleet_stop = 0;
+
+	nvme_parallel_for(nr, NVME_SCAN_JOBS, fleet_start, &f);
+
+	for (;;) {
+		fleet_show(&f, false);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		wake = now;
+		wake.tv_sec += FLEET_REDRAW;
+
+		for (i = 0, n = 0; i < nr; i++) {
+			if (f.devs[i].state != FLEET_RUNNING)
+				continue;
+			if (fleet_elapsed(&f.devs[i].next, &now) >= 0)
+				f.due[n++] = i;
+			else if (fleet_elapsed(&f.devs[i].next, &wake) > 0)
+				wake = f.devs[i].next;
+		}
+
+		if (n) {
+			nvme_parallel_for(n, NVME_SCAN_JOBS, fleet_poll, &f);
+			continue;
+		}
+
+		for (i = 0; i < nr; i++) {
+			if (f.devs[i].state == FLEET_RUNNING)
+				break;
+		}
+		if (i == nr)
+			break;
+
+		if (fleet_stop) {
+			nvme_parallel_for(nr, NVME_SCAN_JOBS, fleet_abort, &f);
+			break;
+		}
+
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+	}
+
+	fleet_show(&f, true);
+
+	sigaction(SIGINT, &old_int, NULL);
+	sigaction(SIGTERM, &old_term, NULL);
+
+	for (i = 0; i < nr; i++) {
+		if (f.devs[i].err) {
+			err = f.devs[i].err;
+			break;
+		}
+	}
+
+	if (f.s)
+		json_stream_close(f.s);
+free:
+	free(f.devs);
+	free(f.due);
+
+	return err;
+}
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef NVME_FLEET_H
+#define NVME_FLEET_H
+
+#include <stdbool.h>
+
+#include <libnvme.h>
+
+enum nvme_fleet_op {
+	NVME_FLEET_SANITIZE,
+	NVME_FLEET_SELF_TEST,
+};
+
+struct nvme_fleet_dev {
+	const char	*name;
+	int		fd;
+};
+
+struct nvme_fleet_cfg {
+	enum nvme_fleet_op		op;
+	/* the fd is set for each device */
+	struct nvme_sanitize_nvm_args	sanitize;
+	struct nvme_dev_self_test_args	self_test;
+	bool				json;
+};
+
+int nvme_fleet(struct nvme_fleet_dev *devs, int nr, const struct nvme_fleet_cfg *cfg);
+
+#endif
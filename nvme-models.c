@@ -2,9 +2,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
@@ -22,243 +26,472 @@ static char fmt3[78];
 static char fmt4[78];
 static char fmt5[78];
 
-static char *device_top;
-static char *device_mid;
-static char *device_final;
-static char *class_top;
-static char *class_mid;
-static char *class_final;
+/*
+ * pci.ids is compiled once into an index of sorted arrays, so that a lookup
+ * is a few binary searches instead of a scan of the whole file. The index is
+ * cached in the rundir and reused as long as pci.ids has not changed.
+ *
+ * Layout: hdr | vendors | devices | subsystems | classes | subclasses | names
+ *
+ * Vendors and classes are top level nodes. The children of a node are the
+ * entries [first, first + nr) of the next level, sorted by id.
+ */
+#define PCI_IDS_INDEX_DIR	RUNDIR "/nvme"
+#define PCI_IDS_INDEX_PATH	PCI_IDS_INDEX_DIR "/pci.ids.idx"
+#define PCI_IDS_INDEX_MAGIC	"PCIIDX01"
+
+struct pci_ids_hdr {
+	char magic[8];
+	/* identity of the pci.ids file the index was built from */
+	uint64_t dev;
+	uint64_t ino;
+	int64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint32_t nr_vendors;
+	uint32_t nr_devices;
+	uint32_t nr_subsys;
+	uint32_t nr_classes;
+	uint32_t nr_subclasses;
+	uint32_t names_len;
+};
+
+struct pci_ids_node {
+	uint32_t id;
+	uint32_t name;
+	uint32_t first;
+	uint32_t nr;
+};
+
+struct pci_ids_subsys {
+	uint16_t vendor;
+	uint16_t device;
+	uint32_t name;
+};
+
+struct pci_ids_index {
+	void *buf;
+	size_t len;
+	bool mapped;
+	const struct pci_ids_node *vendors;
+	const struct pci_ids_node *devices;
+	const struct pci_ids_subsys *subsys;
+	const struct pci_ids_node *classes;
+	const struct pci_ids_node *subclasses;
+	const char *names;
+};
+
+/* growable array used while compiling pci.ids */
+struct pci_ids_array {
+	void *data;
+	size_t nr;
+	size_t alloc;
+	size_t size;
+};
+
+struct pci_ids_builder {
+	struct pci_ids_array vendors;
+	struct pci_ids_array devices;
+	struct pci_ids_array subsys;
+	struct pci_ids_array classes;
+	struct pci_ids_array subclasses;
+	struct pci_ids_array names;
+};
+
+/* memo of formatted names, devices of the same model show up repeatedly */
+struct product_name_memo {
+	struct product_name_memo *next;
+	char *key;
+	char *name;
+};
+
+static struct pci_ids_index *pci_ids;
+static bool pci_ids_tried;
+static struct product_name_memo *product_names;
+
+static void *pci_ids_array_add(struct pci_ids_array *a, size_t nr)
+{
+	size_t alloc;
+	void *data;
+
+	if (a->nr + nr > a->alloc) {
+		alloc = a->alloc ? a->alloc * 2 : 1024;
+		while (alloc < a->nr + nr)
+			alloc *= 2;
+		data = realloc(a->data, alloc * a->size);
+		if (!data)
+			return NULL;
+		a->data = data;
+		a->alloc = alloc;
+	}
 
+	data = (char *)a->data + a->nr * a->size;
+	a->nr += nr;
 
+	return data;
+}
 
-static void free_all(void)
+static int pci_ids_add_name(struct pci_ids_builder *b, const char *name,
+			    uint32_t *ofst)
 {
-	free(device_top);
-	device_top = NULL;
-	free(device_mid);
-	device_mid = NULL;
-	free(device_final);
-	device_final = NULL;
-	free(class_top);
-	class_top = NULL;
-	free(class_mid);
-	class_mid = NULL;
-	free(class_final);
-	class_final = NULL;
+	size_t len = strlen(name) + 1;
+	char *p;
+
+	*ofst = b->names.nr;
+	p = pci_ids_array_add(&b->names, len);
+	if (!p)
+		return -ENOMEM;
+	memcpy(p, name, len);
+
+	return 0;
 }
 
-static char *find_data(char *data)
+static int pci_ids_add_node(struct pci_ids_builder *b, struct pci_ids_array *a,
+			    struct pci_ids_array *children, uint32_t id,
+			    const char *name)
 {
-	while (*data != '\0') {
-		if (*data >= '0' && *data <= '9')
-			return data;
-		data++;
-	}
-	return NULL;
+	struct pci_ids_node *node = pci_ids_array_add(a, 1);
+
+	if (!node)
+		return -ENOMEM;
+
+	node->id = id;
+	node->first = children ? children->nr : 0;
+	node->nr = 0;
+
+	return pci_ids_add_name(b, name, &node->name);
 }
 
-static char *locate_info(char *data, bool is_inner, bool is_class)
+static struct pci_ids_node *pci_ids_last(struct pci_ids_array *a)
 {
-	char *orig = data;
-	char *locate;
-	if (!data)
-		return orig;
-
-	locate = find_data(data);
-	if (!locate)
-		return orig;
-	if (is_class)
-		return locate + 4;
-	if (!is_inner)
-		/* 4 to get over the number, 2 for spaces */
-		return locate + 4 + 2;
-
-	/* Inner data, has "sub_ven(space)sub_dev(space)(space)string */
-	return locate + 4 + 1 + 4 + 2;
+	if (!a->nr)
+		return NULL;
+
+	return (struct pci_ids_node *)a->data + a->nr - 1;
 }
 
-static void format_and_print(char *save)
+/*
+ * Parses "<hex id><spaces><name>" and returns the name, or NULL if the line
+ * does not start with exactly digits hex digits.
+ */
+static char *pci_ids_parse_id(char *line, int digits, uint32_t *id)
 {
+	char *end;
 
-	if (!class_mid) {
-		if (device_final)
-			snprintf(save, 1024, "%s %s %s",
-				 locate_info(device_top, false, false),
-				 locate_info(device_mid, false, false),
-				 locate_info(device_final, true, false));
-		else
-			snprintf(save, 1024, "%s %s",
-				 locate_info(device_top, false, false),
-				 locate_info(device_mid, false, false));
-	} else {
-		if (device_final)
-			snprintf(save, 1024, "%s: %s %s %s",
-				 locate_info(class_mid, false, true),
-				 locate_info(device_top, false, false),
-				 locate_info(device_mid, false, false),
-				 locate_info(device_final, true, false));
-		else
-			snprintf(save, 1024, "%s: %s %s",
-				 locate_info(class_mid, false, true),
-				 locate_info(device_top, false, false),
-				 locate_info(device_mid, false, false));
-	}
+	*id = strtoul(line, &end, 16);
+	if (end - line != digits || (*end != ' ' && *end != '\t'))
+		return NULL;
+	while (*end == ' ' || *end == '\t')
+		end++;
+
+	return end;
 }
 
-static void format_all(char *save, char *vendor, char *device)
+static int pci_ids_parse_line(struct pci_ids_builder *b, char *line,
+			      bool *in_class)
 {
-	if (device_top && device_mid)
-		format_and_print(save);
-
-	else if (device_top && !device_mid && class_mid)
-		snprintf(save, 1024, "%s: %s Device %s",
-			 locate_info(class_mid, false, true),
-			 locate_info(device_top, false, false),
-			 device);
-
-	else if (!device_top && class_mid)
-		snprintf(save, 1024, "%s: Vendor %s Device %s",
-			 locate_info(class_mid, false, true),
-			 vendor,
-			 device);
-	else
-		snprintf(save, 1024, "Unknown device");
+	struct pci_ids_subsys *sub;
+	struct pci_ids_node *parent;
+	uint32_t id, subdev;
+	char *name;
+
+	if (line[0] != '\t') {
+		*in_class = line[0] == 'C' && line[1] == ' ';
+		if (*in_class) {
+			name = pci_ids_parse_id(&line[2], 2, &id);
+			return name ? pci_ids_add_node(b, &b->classes, &b->subclasses,
+						       id, name) : 0;
+		}
+		name = pci_ids_parse_id(line, 4, &id);
+		return name ? pci_ids_add_node(b, &b->vendors, &b->devices,
+					       id, name) : 0;
+	}
+
+	if (line[1] != '\t') {
+		if (*in_class) {
+			parent = pci_ids_last(&b->classes);
+			name = pci_ids_parse_id(&line[1], 2, &id);
+			if (!parent || !name)
+				return 0;
+			parent->nr++;
+			return pci_ids_add_node(b, &b->subclasses, NULL, id, name);
+		}
+		parent = pci_ids_last(&b->vendors);
+		name = pci_ids_parse_id(&line[1], 4, &id);
+		if (!parent || !name)
+			return 0;
+		parent->nr++;
+		return pci_ids_add_node(b, &b->devices, &b->subsys, id, name);
+	}
+
+	/* programming interfaces of a class are not part of the product name */
+	if (*in_class)
+		return 0;
+
+	parent = pci_ids_last(&b->devices);
+	if (!parent || !pci_ids_parse_id(&line[2], 4, &id))
+		return 0;
+	name = pci_ids_parse_id(&line[7], 4, &subdev);
+	if (!name)
+		return 0;
+
+	sub = pci_ids_array_add(&b->subsys, 1);
+	if (!sub)
+		return -ENOMEM;
+	sub->vendor = id;
+	sub->device = subdev;
+	parent->nr++;
+
+	return pci_ids_add_name(b, name, &sub->name);
 }
 
-static int is_final_match(char *line, char *search)
+static int pci_ids_node_cmp(const void *a, const void *b)
 {
-	return !memcmp(&line[2], search, 2);
+	const struct pci_ids_node *na = a, *nb = b;
+
+	return (na->id > nb->id) - (na->id < nb->id);
 }
 
-static int is_inner_sub_vendev(char *line, char *search, char *search2)
+static uint32_t pci_ids_subsys_key(const struct pci_ids_subsys *sub)
 {
-	char combine[10];
-	snprintf(combine, sizeof(combine), "%s %s", &search[2], &search2[2]);
-       	if (line[0] != '\t' && line[1] != '\t')
-		return 0;
-
-	return !memcmp(combine, &line[2], 9);
+	return (uint32_t)sub->vendor << 16 | sub->device;
 }
 
-static int is_mid_level_match(char *line, char *device, bool class)
+static int pci_ids_subsys_cmp(const void *a, const void *b)
 {
-	if (!class)
-		return !memcmp(&line[1], &device[2], 4);
+	uint32_t ka = pci_ids_subsys_key(a), kb = pci_ids_subsys_key(b);
 
-	return !memcmp(&line[1], device, 2);
+	return (ka > kb) - (ka < kb);
 }
 
-static inline bool is_comment(char *line)
+/*
+ * pci.ids is mostly sorted already, but sort each level anyway. The nodes
+ * carry their child ranges along, so sorting does not break the links.
+ */
+static void pci_ids_sort(struct pci_ids_builder *b)
 {
-	return line[0] == '#';
+	struct pci_ids_node *vendors = b->vendors.data;
+	struct pci_ids_node *devices = b->devices.data;
+	struct pci_ids_node *classes = b->classes.data;
+	struct pci_ids_node *subclasses = b->subclasses.data;
+	struct pci_ids_subsys *subsys = b->subsys.data;
+	size_t i;
+
+	for (i = 0; i < b->devices.nr; i++)
+		qsort(&subsys[devices[i].first], devices[i].nr, sizeof(*subsys),
+		      pci_ids_subsys_cmp);
+	for (i = 0; i < b->vendors.nr; i++)
+		qsort(&devices[vendors[i].first], vendors[i].nr, sizeof(*devices),
+		      pci_ids_node_cmp);
+	for (i = 0; i < b->classes.nr; i++)
+		qsort(&subclasses[classes[i].first], classes[i].nr,
+		      sizeof(*subclasses), pci_ids_node_cmp);
+	qsort(vendors, b->vendors.nr, sizeof(*vendors), pci_ids_node_cmp);
+	qsort(classes, b->classes.nr, sizeof(*classes), pci_ids_node_cmp);
 }
 
-static int is_top_level_match(char *line, const char* device, bool class)
+static void *pci_ids_copy(void *dst, struct pci_ids_array *a)
 {
-	if (line[0] == '\t')
-		return false;
-	if (line[0] == '#')
-		return false;
-	if (!class)
-		return !memcmp(line, &device[2], 4);
-	if (line[0] != 'C')
-		return false;
-	/* Skipping    C(SPACE)  0x */
-	return !memcmp(&line[2], &device[2], 2);
+	if (a->nr)
+		memcpy(dst, a->data, a->nr * a->size);
+
+	return (char *)dst + a->nr * a->size;
 }
 
-static inline int is_tab(char *line)
+static int pci_ids_index_setup(struct pci_ids_index *idx)
 {
-	return line[0] == '\t';
+	struct pci_ids_hdr *hdr = idx->buf;
+	size_t len = sizeof(*hdr);
+	char *p = idx->buf;
+
+	if (idx->len < sizeof(*hdr) ||
+	    memcmp(hdr->magic, PCI_IDS_INDEX_MAGIC, sizeof(hdr->magic)))
+		return -EINVAL;
+
+	len += ((size_t)hdr->nr_vendors + hdr->nr_devices + hdr->nr_classes +
+		hdr->nr_subclasses) * sizeof(struct pci_ids_node);
+	len += (size_t)hdr->nr_subsys * sizeof(struct pci_ids_subsys);
+	len += hdr->names_len;
+	if (len != idx->len || !hdr->names_len || p[len - 1] != '\0')
+		return -EINVAL;
+
+	p += sizeof(*hdr);
+	idx->vendors = (const struct pci_ids_node *)p;
+	p += hdr->nr_vendors * sizeof(struct pci_ids_node);
+	idx->devices = (const struct pci_ids_node *)p;
+	p += hdr->nr_devices * sizeof(struct pci_ids_node);
+	idx->subsys = (const struct pci_ids_subsys *)p;
+	p += hdr->nr_subsys * sizeof(struct pci_ids_subsys);
+	idx->classes = (const struct pci_ids_node *)p;
+	p += hdr->nr_classes * sizeof(struct pci_ids_node);
+	idx->subclasses = (const struct pci_ids_node *)p;
+	p += hdr->nr_subclasses * sizeof(struct pci_ids_node);
+	idx->names = p;
+
+	return 0;
 }
 
-static inline int is_class_info(char *line)
+static void pci_ids_set_identity(struct pci_ids_hdr *hdr, struct stat *st)
 {
-	return !memcmp(line, "# C class", 9);
+	hdr->dev = st->st_dev;
+	hdr->ino = st->st_ino;
+	hdr->size = st->st_size;
+	hdr->mtime_sec = st->st_mtim.tv_sec;
+	hdr->mtime_nsec = st->st_mtim.tv_nsec;
 }
 
-static void parse_vendor_device(char **line, FILE *file,
-			       char *device, char *subdev,
-			       char *subven)
+static struct pci_ids_index *pci_ids_index_build(FILE *file, struct stat *st)
 {
-	bool device_single_found = false;
-	size_t amnt = 1024;
-	size_t found = 0;
-	char *newline;
-
-	while ((found = getline(line, &amnt, file)) != -1) {
-		newline = *line;
-		if (is_comment(newline))
-			continue;
-		if (!is_tab(newline))
-			return;
+	struct pci_ids_builder b = {
+		.vendors = { .size = sizeof(struct pci_ids_node) },
+		.devices = { .size = sizeof(struct pci_ids_node) },
+		.subsys = { .size = sizeof(struct pci_ids_subsys) },
+		.classes = { .size = sizeof(struct pci_ids_node) },
+		.subclasses = { .size = sizeof(struct pci_ids_node) },
+		.names = { .size = 1 },
+	};
+	struct pci_ids_index *idx = NULL;
+	struct pci_ids_hdr *hdr;
+	bool in_class = false;
+	char *line = NULL;
+	size_t size = 0;
+	uint32_t empty;
+	ssize_t amnt;
+	void *p;
+
+	/* offset 0 is the empty name */
+	if (pci_ids_add_name(&b, "", &empty))
+		goto free;
 
-		newline[found - 1] = '\0';
-		if (!device_single_found && is_mid_level_match(newline, device, false)) {
-			device_single_found = true;
-			device_mid = strdup(newline);
+	while ((amnt = getline(&line, &size, file)) != -1) {
+		if (amnt && line[amnt - 1] == '\n')
+			line[--amnt] = '\0';
+		if (!amnt || line[0] == '#')
 			continue;
-		}
+		if (pci_ids_parse_line(&b, line, &in_class))
+			goto free;
+	}
 
-		if (device_single_found && is_inner_sub_vendev(newline, subven, subdev)) {
-			device_final = strdup(newline);
-			break;
-		}
+	pci_ids_sort(&b);
+
+	idx = calloc(1, sizeof(*idx));
+	if (!idx)
+		goto free;
+
+	idx->len = sizeof(*hdr) +
+		(b.vendors.nr + b.devices.nr + b.classes.nr + b.subclasses.nr) *
+		sizeof(struct pci_ids_node) +
+		b.subsys.nr * sizeof(struct pci_ids_subsys) + b.names.nr;
+	idx->buf = calloc(1, idx->len);
+	if (!idx->buf) {
+		free(idx);
+		idx = NULL;
+		goto free;
 	}
+
+	hdr = idx->buf;
+	memcpy(hdr->magic, PCI_IDS_INDEX_MAGIC, sizeof(hdr->magic));
+	pci_ids_set_identity(hdr, st);
+	hdr->nr_vendors = b.vendors.nr;
+	hdr->nr_devices = b.devices.nr;
+	hdr->nr_subsys = b.subsys.nr;
+	hdr->nr_classes = b.classes.nr;
+	hdr->nr_subclasses = b.subclasses.nr;
+	hdr->names_len = b.names.nr;
+
+	p = hdr + 1;
+	p = pci_ids_copy(p, &b.vendors);
+	p = pci_ids_copy(p, &b.devices);
+	p = pci_ids_copy(p, &b.subsys);
+	p = pci_ids_copy(p, &b.classes);
+	p = pci_ids_copy(p, &b.subclasses);
+	pci_ids_copy(p, &b.names);
+
+	pci_ids_index_setup(idx);
+
+free:
+	free(line);
+	free(b.vendors.data);
+	free(b.devices.data);
+	free(b.subsys.data);
+	free(b.classes.data);
+	free(b.subclasses.data);
+	free(b.names.data);
+	return idx;
 }
 
-static void pull_class_info(char **_newline, FILE *file, char *class)
+static struct pci_ids_index *pci_ids_index_load(struct stat *st)
 {
-	size_t amnt;
-	size_t size = 1024;
-	bool top_found = false;
-	bool mid_found = false;
-	char *newline;
-
-	while ((amnt = getline(_newline, &size, file)) != -1) {
-		newline = *_newline;
-		newline[amnt - 1] = '\0';
-		if (!top_found && is_top_level_match(newline, class, true)) {
-			class_top = strdup(newline);
-			top_found = true;
-			continue;
-		}
-		if (!mid_found && top_found &&
-		    is_mid_level_match(newline,  &class[4], true)) {
-			class_mid = strdup(newline);
-			mid_found = true;
-			continue;
-		}
-		if (top_found && mid_found &&
-		    is_final_match(newline, &class[6])) {
-			class_final = strdup(newline);
-			break;
-		}
+	struct pci_ids_index *idx;
+	struct pci_ids_hdr cur;
+	struct stat idx_st;
+	int fd;
+
+	fd = open(PCI_IDS_INDEX_PATH, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	idx = calloc(1, sizeof(*idx));
+	if (!idx || fstat(fd, &idx_st) || idx_st.st_size < sizeof(cur))
+		goto close_fd;
+
+	idx->len = idx_st.st_size;
+	idx->buf = mmap(NULL, idx->len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (idx->buf == MAP_FAILED)
+		goto close_fd;
+	idx->mapped = true;
+	close(fd);
+
+	/* rebuild when pci.ids has been updated or replaced */
+	pci_ids_set_identity(&cur, st);
+	if (memcmp(&((struct pci_ids_hdr *)idx->buf)->dev, &cur.dev,
+		   offsetof(struct pci_ids_hdr, nr_vendors) -
+		   offsetof(struct pci_ids_hdr, dev)) ||
+	    pci_ids_index_setup(idx)) {
+		munmap(idx->buf, idx->len);
+		free(idx);
+		return NULL;
 	}
+
+	return idx;
+
+close_fd:
+	free(idx);
+	close(fd);
+	return NULL;
 }
 
-static int read_sys_node(char *where, char *save, size_t savesz)
+static void pci_ids_index_store(struct pci_ids_index *idx)
 {
-	char *new;
-	int fd, ret = 0, len;
-	fd = open(where, O_RDONLY);
-	if (fd < 0) {
-		fprintf(stderr, "Failed to open %s with errno %s\n",
-			where, strerror(errno));
-		return 1;
-	}
-	/* -1 so we can safely use strstr below */
-	len = read(fd, save, savesz - 1);
-	if (!len)
-		ret = 1;
-	else {
-		save[len] = '\0';
-		new = strstr(save, "\n");
-		if (new)
-			new[0] = '\0';
+	char tmp[sizeof(PCI_IDS_INDEX_PATH) + 16];
+	const char *p = idx->buf;
+	size_t len = idx->len;
+	ssize_t ret;
+	int fd;
+
+	/* the cache is best effort, e.g. the rundir is not writable for users */
+	if (mkdir(PCI_IDS_INDEX_DIR, 0755) && errno != EEXIST)
+		return;
+
+	snprintf(tmp, sizeof(tmp), "%s.%d", PCI_IDS_INDEX_PATH, getpid());
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return;
+
+	while (len) {
+		ret = write(fd, p, len);
+		if (ret <= 0) {
+			if (ret < 0 && errno == EINTR)
+				continue;
+			break;
+		}
+		p += ret;
+		len -= ret;
 	}
-	close(fd);
-	return ret;
+
+	/* rename so that concurrent readers never see a partial index */
+	if (close(fd) || len || rename(tmp, PCI_IDS_INDEX_PATH))
+		unlink(tmp);
 }
 
 static FILE *open_pci_ids(void)
@@ -295,21 +528,182 @@ static FILE *open_pci_ids(void)
 	return NULL;
 }
 
+/* Returns the index of pci.ids, loading or compiling it on first use */
+static struct pci_ids_index *pci_ids_index_get(void)
+{
+	struct stat st;
+	FILE *file;
+
+	if (pci_ids_tried)
+		return pci_ids;
+	pci_ids_tried = true;
+
+	file = open_pci_ids();
+	if (!file)
+		return NULL;
+
+	if (!fstat(fileno(file), &st)) {
+		pci_ids = pci_ids_index_load(&st);
+		if (!pci_ids) {
+			pci_ids = pci_ids_index_build(file, &st);
+			if (pci_ids)
+				pci_ids_index_store(pci_ids);
+		}
+	}
+	fclose(file);
+
+	return pci_ids;
+}
+
+static const char *pci_ids_name(struct pci_ids_index *idx, uint32_t ofst)
+{
+	struct pci_ids_hdr *hdr = idx->buf;
+
+	return ofst < hdr->names_len ? &idx->names[ofst] : "";
+}
+
+static const struct pci_ids_node *pci_ids_find(const struct pci_ids_node *nodes,
+					       uint32_t total, uint32_t first,
+					       uint32_t nr, uint32_t id)
+{
+	struct pci_ids_node key = { .id = id };
+
+	if (first > total || nr > total - first)
+		return NULL;
+
+	return bsearch(&key, &nodes[first], nr, sizeof(*nodes), pci_ids_node_cmp);
+}
+
+static const struct pci_ids_subsys *pci_ids_find_subsys(struct pci_ids_index *idx,
+							const struct pci_ids_node *dev,
+							uint16_t vendor,
+							uint16_t device)
+{
+	struct pci_ids_hdr *hdr = idx->buf;
+	struct pci_ids_subsys key = { .vendor = vendor, .device = device };
+
+	if (dev->first > hdr->nr_subsys || dev->nr > hdr->nr_subsys - dev->first)
+		return NULL;
+
+	return bsearch(&key, &idx->subsys[dev->first], dev->nr,
+		       sizeof(*idx->subsys), pci_ids_subsys_cmp);
+}
+
+static void format_all(struct pci_ids_index *idx, char *save, char *vendor,
+		       char *device, char *sub_vendor, char *sub_device,
+		       char *class)
+{
+	const struct pci_ids_node *ven, *dev = NULL, *cls, *subcls = NULL;
+	struct pci_ids_hdr *hdr = idx->buf;
+	const struct pci_ids_subsys *sub = NULL;
+	unsigned long class_code = strtoul(class, NULL, 16);
+	const char *class_name = "", *sep = "";
+
+	ven = pci_ids_find(idx->vendors, hdr->nr_vendors, 0, hdr->nr_vendors,
+			   strtoul(vendor, NULL, 16));
+	if (ven)
+		dev = pci_ids_find(idx->devices, hdr->nr_devices, ven->first,
+				   ven->nr, strtoul(device, NULL, 16));
+	if (dev)
+		sub = pci_ids_find_subsys(idx, dev, strtoul(sub_vendor, NULL, 16),
+					  strtoul(sub_device, NULL, 16));
+
+	cls = pci_ids_find(idx->classes, hdr->nr_classes, 0, hdr->nr_classes,
+			   (class_code >> 16) & 0xff);
+	if (cls)
+		subcls = pci_ids_find(idx->subclasses, hdr->nr_subclasses,
+				      cls->first, cls->nr, (class_code >> 8) & 0xff);
+	if (subcls) {
+		class_name = pci_ids_name(idx, subcls->name);
+		sep = ": ";
+	}
+
+	if (ven && dev && sub)
+		snprintf(save, 1024, "%s%s%s %s %s", class_name, sep,
+			 pci_ids_name(idx, ven->name),
+			 pci_ids_name(idx, dev->name),
+			 pci_ids_name(idx, sub->name));
+	else if (ven && dev)
+		snprintf(save, 1024, "%s%s%s %s", class_name, sep,
+			 pci_ids_name(idx, ven->name),
+			 pci_ids_name(idx, dev->name));
+	else if (ven && subcls)
+		snprintf(save, 1024, "%s%s%s Device %s", class_name, sep,
+			 pci_ids_name(idx, ven->name), device);
+	else if (subcls)
+		snprintf(save, 1024, "%s%sVendor %s Device %s", class_name, sep,
+			 vendor, device);
+	else
+		snprintf(save, 1024, "Unknown device");
+}
+
+static int read_sys_node(char *where, char *save, size_t savesz)
+{
+	char *new;
+	int fd, ret = 0, len;
+	fd = open(where, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open %s with errno %s\n",
+			where, strerror(errno));
+		return 1;
+	}
+	/* -1 so we can safely use strstr below */
+	len = read(fd, save, savesz - 1);
+	if (!len)
+		ret = 1;
+	else {
+		save[len] = '\0';
+		new = strstr(save, "\n");
+		if (new)
+			new[0] = '\0';
+	}
+	close(fd);
+	return ret;
+}
+
+static char *product_name_memo_get(const char *key)
+{
+	struct product_name_memo *m;
+
+	for (m = product_names; m; m = m->next) {
+		if (!strcmp(m->key, key))
+			return strdup(m->name);
+	}
+
+	return NULL;
+}
+
+static void product_name_memo_add(const char *key, const char *name)
+{
+	struct product_name_memo *m = calloc(1, sizeof(*m));
+
+	if (!m)
+		return;
+
+	m->key = strdup(key);
+	m->name = strdup(name);
+	if (!m->key || !m->name) {
+		free(m->key);
+		free(m->name);
+		free(m);
+		return;
+	}
+
+	m->next = product_names;
+	product_names = m;
+}
+
 char *nvme_product_name(int id)
 {
-	char *line = NULL;
-	ssize_t amnt;
+	struct pci_ids_index *idx;
+	char *line;
 	char vendor[7] = { 0 };
 	char device[7] = { 0 };
 	char sub_device[7] = { 0 };
 	char sub_vendor[7] = { 0 };
 	char class[13] = { 0 };
-	size_t size = 1024;
+	char key[64];
 	char ret;
-	FILE *file = open_pci_ids();
-
-	if (!file)
-		goto error1;
 
 	snprintf(fmt1, 78, _fmt1, id);
 	snprintf(fmt2, 78, _fmt2, id);
@@ -323,35 +717,27 @@ char *nvme_product_name(int id)
 	ret |= read_sys_node(fmt4, device, 7);
 	ret |= read_sys_node(fmt5, class, 13);
 	if (ret)
-		goto error0;
+		goto error;
+
+	snprintf(key, sizeof(key), "%s %s %s %s %s", vendor, device,
+		 sub_vendor, sub_device, class);
+	line = product_name_memo_get(key);
+	if (line)
+		return line;
+
+	idx = pci_ids_index_get();
+	if (!idx)
+		goto error;
 
 	line = malloc(1024);
 	if (!line) {
 		fprintf(stderr, "malloc: %s\n", strerror(errno));
-		goto error0;
+		goto error;
 	}
 
-	while ((amnt = getline(&line, &size, file)) != -1) {
-		if (is_comment(line) && !is_class_info(line))
-			continue;
-		if (is_top_level_match(line, vendor, false)) {
-			line[amnt - 1] = '\0';
-			free(device_top);
-			device_top = strdup(line);
-			parse_vendor_device(&line, file,
-						device,
-						sub_device,
-						sub_vendor);
-		}
-		if (is_class_info(line))
-			pull_class_info(&line, file, class);
-	}
-	fclose(file);
-	format_all(line, vendor, device);
-	free_all();
+	format_all(idx, line, vendor, device, sub_vendor, sub_device, class);
+	product_name_memo_add(key, line);
 	return line;
-error0:
-	fclose(file);
-error1:
+error:
 	return strdup("NULL");
 }
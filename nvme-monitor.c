@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * nvme monitor: waits for the events of NVMe controllers instead of polling
+ * their log pages.
+ *
+ * The kernel driver keeps the Asynchronous Event Requests outstanding. It
+ * handles namespace and ANA changes itself and passes the other events on
+ * to user space as uevents of the controller, with the completion of the
+ * request in NVME_AEN. Those are read from the kobject uevent netlink
+ * socket, as are the uevents of the namespace block devices.
+ */
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#include "common.h"
+#include "nvme-monitor.h"
+
+/* the group of the kernel's uevents, udev forwards them on the next one */
+#define MONITOR_UEVENT_GROUP		1
+#define MONITOR_UEVENT_LEN		8192
+#define MONITOR_RCVBUF			(1 << 20)
+
+static volatile sig_atomic_t monitor_stop;
+
+struct monitor_uevent {
+	const char *action;
+	const char *subsystem;
+	const char *devname;
+	const char *devtype;
+	const char *aen;
+	const char *event;
+};
+
+static const char * const monitor_aen_types[] = {
+	[NVME_AER_ERROR]	= "error",
+	[NVME_AER_SMART]	= "smart",
+	[NVME_AER_NOTICE]	= "notice",
+	[NVME_AER_CSS]		= "io command specific status",
+	[NVME_AER_VS]		= "vendor specific",
+};
+
+static const char * const monitor_aen_smart[] = {
+	"subsystem reliability",
+	"temperature threshold",
+	"spare below threshold",
+};
+
+static const char * const monitor_aen_notice[] = {
+	"namespace attribute changed",
+	"firmware activation starting",
+	"telemetry log changed",
+	"asymmetric namespace access change",
+	"predictable latency event aggregate log change",
+	"lba status information alert",
+	"endurance group event aggregate log page change",
+	"normal nvm subsystem shutdown",
+};
+
+const char *nvme_monitor_aen_str(__u32 result)
+{
+	__u8 type = NVME_MONITOR_AEN_TYPE(result);
+	__u8 info = NVME_MONITOR_AEN_INFO(result);
+
+	switch (type) {
+	case NVME_AER_SMART:
+		if (info < ARRAY_SIZE(monitor_aen_smart))
+			return monitor_aen_smart[info];
+		break;
+	case NVME_AER_NOTICE:
+		if (info < ARRAY_SIZE(monitor_aen_notice))
+			return monitor_aen_notice[info];
+		if (info == 0xf0)
+			return "discovery log page change";
+		break;
+	}
+
+	if (type < ARRAY_SIZE(monitor_aen_types) && monitor_aen_types[type])
+		return monitor_aen_types[type];
+
+	return "reserved";
+}
+
+static void monitor_signal(int sig)
+{
+	monitor_stop = 1;
+}
+
+static void monitor_parse(char *buf, ssize_t len, struct monitor_uevent *ev)
+{
+	char *p, *end = buf + len;
+
+	memset(ev, 0, sizeof(*ev));
+
+	/* "action@devpath" followed by KEY=value strings */
+	for (p = buf + strlen(buf) + 1; p < end; p += strlen(p) + 1) {
+		if (!strncmp(p, "ACTION=", 7))
+			ev->action = p + 7;
+		else if (!strncmp(p, "SUBSYSTEM=", 10))
+			ev->subsystem = p + 10;
+		else if (!strncmp(p, "DEVNAME=", 8))
+			ev->devname = p + 8;
+		else if (!strncmp(p, "DEVTYPE=", 8))
+			ev->devtype = p + 8;
+		else if (!strncmp(p, "NVME_AEN=", 9))
+			ev->aen = p + 9;
+		else if (!strncmp(p, "NVME_EVENT=", 11))
+			ev->event = p + 11;
+	}
+}
+
+static void monitor_dispatch(const struct nvme_monitor_ops *ops, void *arg,
+			     struct monitor_uevent *ev)
+{
+	const char *name;
+
+	if (!ev->action || !ev->subsystem || !ev->devname)
+		return;
+
+	/* DEVNAME is relative to /dev */
+	name = strrchr(ev->devname, '/');
+	name = name ? name + 1 : ev->devname;
+	if (strncmp(name, "nvme", 4))
+		return;
+
+	if (!strcmp(ev->subsystem, "nvme")) {
+		if (ev->aen && ops->aen)
+			ops->aen(name, strtoul(ev->aen, NULL, 0), arg);
+		else if (ev->event && !strcmp(ev->event, "connected") && ops->connected)
+			ops->connected(name, arg);
+	} else if (!strcmp(ev->subsystem, "block") && ev->devtype &&
+		   !strcmp(ev->devtype, "disk") && ops->ns) {
+		ops->ns(name, ev->action, arg);
+	}
+}
+
+/* Returns when interrupted by SIGINT or SIGTERM */
+int nvme_monitor(const struct nvme_monitor_ops *ops, void *arg)
+{
+	struct sockaddr_nl addr = {
+		.nl_family	= AF_NETLINK,
+		.nl_groups	= MONITOR_UEVENT_GROUP,
+	};
+	struct sigaction sa = {
+		.sa_handler	= monitor_signal,
+	};
+	struct sigaction old_int, old_term;
+	struct pollfd pfd = { .events = POLLIN };
+	struct monitor_uevent ev;
+	sigset_t mask, orig;
+	int rcvbuf = MONITOR_RCVBUF;
+	char *buf;
+	ssize_t len;
+	int err = 0;
+
+	buf = malloc(MONITOR_UEVENT_LEN);
+	if (!buf)
+		return -ENOMEM;
+
+	pfd.fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+			NETLINK_KOBJECT_UEVENT);
+	if (pfd.fd < 0) {
+		err = -errno;
+		goto free;
+	}
+
+	/* events come in bursts, e.g. when a subsystem with many namespaces connects */
+	setsockopt(pfd.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	if (bind(pfd.fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		err = -errno;
+		goto close_fd;
+	}
+
+	/* the signals are only delivered while waiting, so none gets lost */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigprocmask(SIG_BLOCK, &mask, &orig);
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, &old_int);
+	sigaction(SIGTERM, &sa, &old_term);
+	monitor_stop = 0;
+
+	while (!monitor_stop) {
+		if (ppoll(&pfd, 1, NULL, &orig) < 0) {
+			if (errno == EINTR)
+				continue;
+			err = -errno;
+			break;
+		}
+
+		while ((len = recv(pfd.fd, buf, MONITOR_UEVENT_LEN - 1, 0)) > 0) {
+			buf[len] = '\0';
+			monitor_parse(buf, len, &ev);
+			monitor_dispatch(ops, arg, &ev);
+		}
+		if (len < 0 && errno != EAGAIN && errno != EINTR) {
+			/* ENOBUFS: events were dropped, the next ones are still of use */
+			if (errno == ENOBUFS) {
+				fprintf(stderr, "monitor: uevents lost\n");
+				continue;
+			}
+			err = -errno;
+			break;
+		}
+	}
+
+	sigaction(SIGINT, &old_int, NULL);
+	sigaction(SIGTERM, &old_term, NULL);
+	sigprocmask(SIG_SETMASK, &orig, NULL);
+close_fd:
+	close(pfd.fd);
+free:
+	free(buf);
+
+	return err;
+}
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef NVME_MONITOR_H
+#define NVME_MONITOR_H
+
+#include <libnvme.h>
+
+/* Fields of the completion of an Asynchronous Event Request */
+#define NVME_MONITOR_AEN_TYPE(r)	((r) & 0x7)
+#define NVME_MONITOR_AEN_INFO(r)	(((r) >> 8) & 0xff)
+#define NVME_MONITOR_AEN_LID(r)		(((r) >> 16) & 0xff)
+
+/*
+ * Called for the events of the kernel. Controllers and namespaces are
+ * named as in /dev, e.g. nvme0 and nvme0n1.
+ */
+struct nvme_monitor_ops {
+	/* an asynchronous event the driver passed on */
+	void (*aen)(const char *ctrl, __u32 result, void *arg);
+	/* a namespace was added, removed or changed */
+	void (*ns)(const char *ns, const char *action, void *arg);
+	/* the controller is (re)connected, e.g. after a reset */
+	void (*connected)(const char *ctrl, void *arg);
+};
+
+const char *nvme_monitor_aen_str(__u32 result);
+int nvme_monitor(const struct nvme_monitor_ops *ops, void *arg);
+
+#endif
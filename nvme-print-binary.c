@@ -171,7 +171,7 @@ static void binary_zns_changed(struct nvme_zns_changed_zone_log *log)
 }
 
 static void binary_zns_report_zones(void *report, __u32 descs,
-	__u8 ext_size, __u32 report_size,
+	__u32 ext_size, __u32 report_size,
 	struct json_object *zone_list)
 {
 	d_raw((unsigned char *)report, report_size);
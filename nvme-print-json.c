@@ -7,6 +7,7 @@
 #include "nvme-print.h"
 
 #include "util/json.h"
+#include "util/json-stream.h"
 #include "nvme.h"
 #include "common.h"
 
@@ -34,6 +35,7 @@
 static const uint8_t zero_uuid[16] = { 0 };
 static struct print_ops json_print_ops;
 static struct json_object *json_r;
+static struct json_stream *zone_stream;
 
 static void json_feature_show_fields(enum nvme_features_id fid, unsigned int result,
 				     unsigned char *buf);
@@ -190,13 +192,99 @@ static struct json_object *obj_create(const char *k)
 	return obj;
 }
 
+static bool ndjson(void)
+{
+	return json_print_ops.flags & NDJSON;
+}
+
+static bool cbor(void)
+{
+	return json_print_ops.flags & CBOR;
+}
+
+static enum json_stream_format json_stream_format(void)
+{
+	if (cbor())
+		return JSON_STREAM_CBOR;
+	if (ndjson())
+		return JSON_STREAM_PLAIN;
+	return JSON_STREAM_PRETTY;
+}
+
+static void json_print_cbor(struct json_object *r)
+{
+	struct json_stream *s = json_stream_open(stdout, JSON_STREAM_CBOR);
+
+	if (!s) {
+		fprintf(stderr, "Failed to allocate CBOR output: %s\n", strerror(ENOMEM));
+		return;
+	}
+
+	json_stream_add_object(s, NULL, r);
+	json_stream_close(s);
+}
+
 static void json_print(struct json_object *r)
 {
-	json_print_object(r, NULL);
+	if (cbor()) {
+		json_print_cbor(r);
+		json_free_object(r);
+		return;
+	}
+
+	if (ndjson())
+		printf("%s", json_object_to_json_string_ext(r, JSON_C_TO_STRING_PLAIN |
+							     JSON_C_TO_STRING_NOSLASHESCAPE));
+	else
+		json_print_object(r, NULL);
 	printf("\n");
 	json_free_object(r);
 }
 
+/*
+ * List-shaped outputs are streamed entry by entry instead of building the
+ * whole document first, the output is the same as json_print() would give.
+ *
+ * In NDJSON mode the entries are not wrapped into a document, each one is
+ * printed as a compact record on a line of its own. CBOR output keeps the
+ * document layout using indefinite length maps and arrays.
+ */
+static struct json_stream *json_stream_start(void)
+{
+	struct json_stream *s = json_stream_open(stdout, json_stream_format());
+
+	if (!s)
+		fprintf(stderr, "Failed to allocate JSON output: %s\n", strerror(ENOMEM));
+
+	return s;
+}
+
+static void stream_add_obj(struct json_stream *s, const char *k, struct json_object *o)
+{
+	json_stream_add_object(s, k, o);
+	json_free_object(o);
+}
+
+static void stream_begin_list(struct json_stream *s, const char *k)
+{
+	if (ndjson())
+		return;
+
+	json_stream_begin_object(s, NULL);
+	json_stream_begin_array(s, k);
+}
+
+/* Records printed on their own carry the host they belong to */
+static void obj_add_host(struct json_object *o, nvme_host_t h)
+{
+	const char *hostid;
+
+	obj_add_str(o, "HostNQN", nvme_host_get_hostnqn(h));
+	hostid = nvme_host_get_hostid(h);
+	if (hostid)
+		obj_add_str(o, "HostID", hostid);
+}
+
 static void obj_print(struct json_object *o)
 {
 	if (!json_r)
@@ -460,33 +548,35 @@ void json_nvme_id_ctrl(struct nvme_id_ctrl *ctrl,
 static void json_error_log(struct nvme_error_log_page *err_log, int entries,
 			   const char *devname)
 {
-	struct json_object *r = json_create_object();
-	struct json_object *errors = json_create_array();
+	struct json_stream *s = json_stream_start();
 	int i;
 
-	obj_add_array(r, "errors", errors);
+	if (!s)
+		return;
+
+	stream_begin_list(s, "errors");
 
 	for (i = 0; i < entries; i++) {
-		struct json_object *error = json_create_object();
-
-		obj_add_uint64(error, "error_count", le64_to_cpu(err_log[i].error_count));
-		obj_add_int(error, "sqid", le16_to_cpu(err_log[i].sqid));
-		obj_add_int(error, "cmdid", le16_to_cpu(err_log[i].cmdid));
-		obj_add_int(error, "status_field", le16_to_cpu(err_log[i].status_field >> 0x1));
-		obj_add_int(error, "phase_tag", le16_to_cpu(err_log[i].status_field & 0x1));
-		obj_add_int(error, "parm_error_location",
-			    le16_to_cpu(err_log[i].parm_error_location));
-		obj_add_uint64(error, "lba", le64_to_cpu(err_log[i].lba));
-		obj_add_uint(error, "nsid", le32_to_cpu(err_log[i].nsid));
-		obj_add_int(error, "vs", err_log[i].vs);
-		obj_add_int(error, "trtype", err_log[i].trtype);
-		obj_add_uint64(error, "cs", le64_to_cpu(err_log[i].cs));
-		obj_add_int(error, "trtype_spec_info", le16_to_cpu(err_log[i].trtype_spec_info));
-
-		array_add_obj(errors, error);
+		json_stream_begin_object(s, NULL);
+		json_stream_add_uint(s, "error_count", le64_to_cpu(err_log[i].error_count));
+		json_stream_add_int(s, "sqid", le16_to_cpu(err_log[i].sqid));
+		json_stream_add_int(s, "cmdid", le16_to_cpu(err_log[i].cmdid));
+		json_stream_add_int(s, "status_field",
+				    le16_to_cpu(err_log[i].status_field >> 0x1));
+		json_stream_add_int(s, "phase_tag", le16_to_cpu(err_log[i].status_field & 0x1));
+		json_stream_add_int(s, "parm_error_location",
+				    le16_to_cpu(err_log[i].parm_error_location));
+		json_stream_add_uint(s, "lba", le64_to_cpu(err_log[i].lba));
+		json_stream_add_uint(s, "nsid", le32_to_cpu(err_log[i].nsid));
+		json_stream_add_int(s, "vs", err_log[i].vs);
+		json_stream_add_int(s, "trtype", err_log[i].trtype);
+		json_stream_add_uint(s, "cs", le64_to_cpu(err_log[i].cs));
+		json_stream_add_int(s, "trtype_spec_info",
+				    le16_to_cpu(err_log[i].trtype_spec_info));
+		json_stream_end_object(s);
 	}
 
-	json_print(r);
+	json_stream_close(s);
 }
 
 void json_nvme_resv_report(struct nvme_resv_status *status,
@@ -1713,7 +1803,7 @@ static void json_pel_thermal_excursion(void *pevent_log_info, __u32 offset,
 }
 
 static void json_pevent_entry(void *pevent_log_info, __u8 action, __u32 size, const char *devname,
-			      __u32 offset, struct json_object *valid)
+			      __u32 offset, struct json_stream *valid)
 {
 	int i;
 	struct nvme_persistent_event_log *pevent_log_head = pevent_log_info;
@@ -1792,7 +1882,7 @@ static void json_pevent_entry(void *pevent_log_info, __u8 action, __u32 size, co
 			break;
 		}
 
-		array_add_obj(valid, valid_attrs);
+		stream_add_obj(valid, NULL, valid_attrs);
 		offset += le16_to_cpu(pevent_entry_head->el);
 	}
 }
@@ -1801,20 +1891,34 @@ static void json_persistent_event_log(void *pevent_log_info, __u8 action,
 				      __u32 size, const char *devname)
 {
 	struct json_object *r = json_create_object();
-	struct json_object *valid = json_create_array();
 	__u32 offset = sizeof(struct nvme_persistent_event_log);
+	struct json_stream *s;
 
-	if (size >= offset) {
-		json_pevent_log_head(pevent_log_info, r);
-		json_pevent_entry(pevent_log_info, action, size, devname, offset, valid);
-		obj_add_array(r, "list_of_event_entries", valid);
-	} else {
+	if (size < offset) {
 		obj_add_result(r, "No log data can be shown with this log len at least " \
 				"512 bytes is required or can be 0 to read the complete "\
 				"log page after context established");
+		json_print(r);
+		return;
 	}
 
-	json_print(r);
+	s = json_stream_start();
+	if (!s) {
+		json_free_object(r);
+		return;
+	}
+
+	json_pevent_log_head(pevent_log_info, r);
+	if (ndjson()) {
+		stream_add_obj(s, NULL, r);
+	} else {
+		json_stream_begin_object(s, NULL);
+		json_stream_add_members(s, r);
+		json_free_object(r);
+		json_stream_begin_array(s, "list_of_event_entries");
+	}
+	json_pevent_entry(pevent_log_info, action, size, devname, offset, s);
+	json_stream_close(s);
 }
 
 static void json_endurance_group_event_agg_log(
@@ -3133,7 +3237,18 @@ static void json_nvme_list_ns(struct nvme_ns_list *ns_list)
 
 static void json_zns_start_zone_list(__u64 nr_zones, struct json_object **zone_list)
 {
-	*zone_list = json_create_array();
+	*zone_list = NULL;
+
+	zone_stream = json_stream_start();
+	if (!zone_stream)
+		return;
+
+	if (ndjson())
+		return;
+
+	json_stream_begin_object(zone_stream, NULL);
+	json_stream_add_uint(zone_stream, "nr_zones", nr_zones);
+	json_stream_begin_array(zone_stream, "zone_list");
 }
 
 static void json_zns_changed(struct nvme_zns_changed_zone_log *log)
@@ -3159,16 +3274,12 @@ static void json_zns_changed(struct nvme_zns_changed_zone_log *log)
 static void json_zns_finish_zone_list(__u64 nr_zones,
 				      struct json_object *zone_list)
 {
-	struct json_object *r = json_create_object();
-
-	obj_add_uint(r, "nr_zones", nr_zones);
-	obj_add_array(r, "zone_list", zone_list);
-
-	json_print(r);
+	json_stream_close(zone_stream);
+	zone_stream = NULL;
 }
 
 static void json_nvme_zns_report_zones(void *report, __u32 descs,
-				       __u8 ext_size, __u32 report_size,
+				       __u32 ext_size, __u32 report_size,
 				       struct json_object *zone_list)
 {
 	struct json_object *zone;
@@ -3201,8 +3312,15 @@ static void json_nvme_zns_report_zones(void *report, __u32 descs,
 			}
 		}
 
-		array_add_obj(zone_list, zone);
+		if (zone_stream)
+			stream_add_obj(zone_stream, NULL, zone);
+		else
+			json_free_object(zone);
 	}
+
+	/* print the zones of this report before fetching the next one */
+	if (zone_stream)
+		json_stream_flush(zone_stream);
 }
 
 static void json_feature_show_fields_arbitration(struct json_object *r, unsigned int result)
@@ -4067,110 +4185,129 @@ static void json_support_log(struct nvme_supported_log_pages *support_log,
 	json_print(r);
 }
 
-static void json_detail_list(nvme_root_t t)
+static struct json_object *json_detail_list_subsys(nvme_host_t h, nvme_subsystem_t s)
 {
-	struct json_object *r = json_create_object();
-	struct json_object *jdev = json_create_array();
+	struct json_object *jss = json_create_object();
+	struct json_object *jctrls = json_create_array();
+	struct json_object *jnss = json_create_array();
 
-	nvme_host_t h;
-	nvme_subsystem_t s;
 	nvme_ctrl_t c;
 	nvme_path_t p;
 	nvme_ns_t n;
 
-	nvme_for_each_host(t, h) {
-		struct json_object *hss = json_create_object();
-		struct json_object *jsslist = json_create_array();
-		const char *hostid;
+	if (ndjson())
+		obj_add_host(jss, h);
+	obj_add_str(jss, "Subsystem", nvme_subsystem_get_name(s));
+	obj_add_str(jss, "SubsystemNQN", nvme_subsystem_get_nqn(s));
 
-		obj_add_str(hss, "HostNQN", nvme_host_get_hostnqn(h));
-		hostid = nvme_host_get_hostid(h);
-		if (hostid)
-			obj_add_str(hss, "HostID", hostid);
+	nvme_subsystem_for_each_ctrl(s, c) {
+		struct json_object *jctrl = json_create_object();
+		struct json_object *jnss = json_create_array();
+		struct json_object *jpaths = json_create_array();
+
+		obj_add_str(jctrl, "Controller", nvme_ctrl_get_name(c));
+		obj_add_str(jctrl, "Cntlid", nvme_ctrl_get_cntlid(c));
+		obj_add_str(jctrl, "SerialNumber", nvme_ctrl_get_serial(c));
+		obj_add_str(jctrl, "ModelNumber", nvme_ctrl_get_model(c));
+		obj_add_str(jctrl, "Firmware", nvme_ctrl_get_firmware(c));
+		obj_add_str(jctrl, "Transport", nvme_ctrl_get_transport(c));
+		obj_add_str(jctrl, "Address", nvme_ctrl_get_address(c));
+		obj_add_str(jctrl, "Slot", nvme_ctrl_get_phy_slot(c));
 
-		nvme_for_each_subsystem(h, s) {
-			struct json_object *jss = json_create_object();
-			struct json_object *jctrls = json_create_array();
-			struct json_object *jnss = json_create_array();
+		nvme_ctrl_for_each_ns(c, n) {
+			struct json_object *jns = json_create_object();
+			int lba = nvme_ns_get_lba_size(n);
+			uint64_t nsze = nvme_ns_get_lba_count(n) * lba;
+			uint64_t nuse = nvme_ns_get_lba_util(n) * lba;
+
+			obj_add_str(jns, "NameSpace", nvme_ns_get_name(n));
+			obj_add_str(jns, "Generic", nvme_ns_get_generic_name(n));
+			obj_add_int(jns, "NSID", nvme_ns_get_nsid(n));
+			obj_add_uint64(jns, "UsedBytes", nuse);
+			obj_add_uint64(jns, "MaximumLBA", nvme_ns_get_lba_count(n));
+			obj_add_uint64(jns, "PhysicalSize", nsze);
+			obj_add_int(jns, "SectorSize", lba);
+
+			array_add_obj(jnss, jns);
+		}
+		obj_add_obj(jctrl, "Namespaces", jnss);
 
-			obj_add_str(jss, "Subsystem", nvme_subsystem_get_name(s));
-			obj_add_str(jss, "SubsystemNQN", nvme_subsystem_get_nqn(s));
+		nvme_ctrl_for_each_path(c, p) {
+			struct json_object *jpath = json_create_object();
 
-			nvme_subsystem_for_each_ctrl(s, c) {
-				struct json_object *jctrl = json_create_object();
-				struct json_object *jnss = json_create_array();
-				struct json_object *jpaths = json_create_array();
-
-				obj_add_str(jctrl, "Controller", nvme_ctrl_get_name(c));
-				obj_add_str(jctrl, "Cntlid", nvme_ctrl_get_cntlid(c));
-				obj_add_str(jctrl, "SerialNumber", nvme_ctrl_get_serial(c));
-				obj_add_str(jctrl, "ModelNumber", nvme_ctrl_get_model(c));
-				obj_add_str(jctrl, "Firmware", nvme_ctrl_get_firmware(c));
-				obj_add_str(jctrl, "Transport", nvme_ctrl_get_transport(c));
-				obj_add_str(jctrl, "Address", nvme_ctrl_get_address(c));
-				obj_add_str(jctrl, "Slot", nvme_ctrl_get_phy_slot(c));
-
-				nvme_ctrl_for_each_ns(c, n) {
-					struct json_object *jns = json_create_object();
-					int lba = nvme_ns_get_lba_size(n);
-					uint64_t nsze = nvme_ns_get_lba_count(n) * lba;
-					uint64_t nuse = nvme_ns_get_lba_util(n) * lba;
-
-					obj_add_str(jns, "NameSpace", nvme_ns_get_name(n));
-					obj_add_str(jns, "Generic", nvme_ns_get_generic_name(n));
-					obj_add_int(jns, "NSID", nvme_ns_get_nsid(n));
-					obj_add_uint64(jns, "UsedBytes", nuse);
-					obj_add_uint64(jns, "MaximumLBA", nvme_ns_get_lba_count(n));
-					obj_add_uint64(jns, "PhysicalSize", nsze);
-					obj_add_int(jns, "SectorSize", lba);
-
-					array_add_obj(jnss, jns);
-				}
-				obj_add_obj(jctrl, "Namespaces", jnss);
+			obj_add_str(jpath, "Path", nvme_path_get_name(p));
+			obj_add_str(jpath, "ANAState", nvme_path_get_ana_state(p));
 
-				nvme_ctrl_for_each_path(c, p) {
-					struct json_object *jpath = json_create_object();
+			array_add_obj(jpaths, jpath);
+		}
+		obj_add_obj(jctrl, "Paths", jpaths);
 
-					obj_add_str(jpath, "Path", nvme_path_get_name(p));
-					obj_add_str(jpath, "ANAState", nvme_path_get_ana_state(p));
+		array_add_obj(jctrls, jctrl);
+	}
+	obj_add_obj(jss, "Controllers", jctrls);
 
-					array_add_obj(jpaths, jpath);
-				}
-				obj_add_obj(jctrl, "Paths", jpaths);
+	nvme_subsystem_for_each_ns(s, n) {
+		struct json_object *jns = json_create_object();
 
-				array_add_obj(jctrls, jctrl);
-			}
-			obj_add_obj(jss, "Controllers", jctrls);
+		int lba = nvme_ns_get_lba_size(n);
+		uint64_t nsze = nvme_ns_get_lba_count(n) * lba;
+		uint64_t nuse = nvme_ns_get_lba_util(n) * lba;
 
-			nvme_subsystem_for_each_ns(s, n) {
-				struct json_object *jns = json_create_object();
+		obj_add_str(jns, "NameSpace", nvme_ns_get_name(n));
+		obj_add_str(jns, "Generic", nvme_ns_get_generic_name(n));
+		obj_add_int(jns, "NSID", nvme_ns_get_nsid(n));
+		obj_add_uint64(jns, "UsedBytes", nuse);
+		obj_add_uint64(jns, "MaximumLBA", nvme_ns_get_lba_count(n));
+		obj_add_uint64(jns, "PhysicalSize", nsze);
+		obj_add_int(jns, "SectorSize", lba);
 
-				int lba = nvme_ns_get_lba_size(n);
-				uint64_t nsze = nvme_ns_get_lba_count(n) * lba;
-				uint64_t nuse = nvme_ns_get_lba_util(n) * lba;
+		array_add_obj(jnss, jns);
+	}
+	obj_add_obj(jss, "Namespaces", jnss);
 
-				obj_add_str(jns, "NameSpace", nvme_ns_get_name(n));
-				obj_add_str(jns, "Generic", nvme_ns_get_generic_name(n));
-				obj_add_int(jns, "NSID", nvme_ns_get_nsid(n));
-				obj_add_uint64(jns, "UsedBytes", nuse);
-				obj_add_uint64(jns, "MaximumLBA", nvme_ns_get_lba_count(n));
-				obj_add_uint64(jns, "PhysicalSize", nsze);
-				obj_add_int(jns, "SectorSize", lba);
+	return jss;
+}
 
-				array_add_obj(jnss, jns);
-			}
-			obj_add_obj(jss, "Namespaces", jnss);
+static void json_detail_list(nvme_root_t t)
+{
+	struct json_stream *r = json_stream_start();
 
-			array_add_obj(jsslist, jss);
-		}
+	nvme_host_t h;
+	nvme_subsystem_t s;
+
+	if (!r)
+		return;
 
-		obj_add_obj(hss, "Subsystems", jsslist);
-		array_add_obj(jdev, hss);
+	if (ndjson()) {
+		nvme_for_each_host(t, h) {
+			nvme_for_each_subsystem(h, s)
+				stream_add_obj(r, NULL, json_detail_list_subsys(h, s));
+		}
+		json_stream_close(r);
+		return;
 	}
 
-	obj_add_array(r, "Devices", jdev);
+	json_stream_begin_object(r, NULL);
+	json_stream_begin_array(r, "Devices");
 
-	json_print(r);
+	nvme_for_each_host(t, h) {
+		const char *hostid;
+
+		json_stream_begin_object(r, NULL);
+		json_stream_add_str(r, "HostNQN", nvme_host_get_hostnqn(h));
+		hostid = nvme_host_get_hostid(h);
+		if (hostid)
+			json_stream_add_str(r, "HostID", hostid);
+
+		json_stream_begin_array(r, "Subsystems");
+		nvme_for_each_subsystem(h, s)
+			stream_add_obj(r, NULL, json_detail_list_subsys(h, s));
+		json_stream_end_array(r);
+
+		json_stream_end_object(r);
+	}
+
+	json_stream_close(r);
 }
 
 static struct json_object *json_list_item_obj(nvme_ns_t n)
@@ -4201,29 +4338,31 @@ static struct json_object *json_list_item_obj(nvme_ns_t n)
 
 static void json_simple_list(nvme_root_t t)
 {
-	struct json_object *r = json_create_object();
-	struct json_object *jdevices = json_create_array();
+	struct json_stream *r = json_stream_start();
 
 	nvme_host_t h;
 	nvme_subsystem_t s;
 	nvme_ctrl_t c;
 	nvme_ns_t n;
 
+	if (!r)
+		return;
+
+	stream_begin_list(r, "Devices");
+
 	nvme_for_each_host(t, h) {
 		nvme_for_each_subsystem(h, s) {
 			nvme_subsystem_for_each_ns(s, n)
-				array_add_obj(jdevices, json_list_item_obj(n));
+				stream_add_obj(r, NULL, json_list_item_obj(n));
 
 			nvme_subsystem_for_each_ctrl(s, c) {
 				nvme_ctrl_for_each_ns(c, n)
-					array_add_obj(jdevices, json_list_item_obj(n));
+					stream_add_obj(r, NULL, json_list_item_obj(n));
 			}
 		}
 	}
 
-	obj_add_array(r, "Devices", jdevices);
-
-	json_print(r);
+	json_stream_close(r);
 }
 
 static void json_list_item(nvme_ns_t n)
@@ -4312,40 +4451,51 @@ static void json_print_nvme_subsystem_topology(nvme_subsystem_t s,
 
 static void json_simple_topology(nvme_root_t r)
 {
-	struct json_object *host_attrs, *subsystem_attrs;
-	struct json_object *subsystems, *namespaces;
-	struct json_object *a = json_create_array();
+	struct json_object *subsystem_attrs, *namespaces;
+	struct json_stream *a = json_stream_start();
 	nvme_host_t h;
 
+	if (!a)
+		return;
+
+	if (!ndjson())
+		json_stream_begin_array(a, NULL);
+
 	nvme_for_each_host(r, h) {
 		nvme_subsystem_t s;
 		const char *hostid;
 
-		host_attrs = json_create_object();
-		obj_add_str(host_attrs, "HostNQN", nvme_host_get_hostnqn(h));
-		hostid = nvme_host_get_hostid(h);
-		if (hostid)
-			obj_add_str(host_attrs, "HostID", hostid);
-		subsystems = json_create_array();
+		if (!ndjson()) {
+			json_stream_begin_object(a, NULL);
+			json_stream_add_str(a, "HostNQN", nvme_host_get_hostnqn(h));
+			hostid = nvme_host_get_hostid(h);
+			if (hostid)
+				json_stream_add_str(a, "HostID", hostid);
+			json_stream_begin_array(a, "Subsystems");
+		}
 		nvme_for_each_subsystem(h, s) {
 			subsystem_attrs = json_create_object();
+			if (ndjson())
+				obj_add_host(subsystem_attrs, h);
 			obj_add_str(subsystem_attrs, "Name", nvme_subsystem_get_name(s));
 			obj_add_str(subsystem_attrs, "NQN", nvme_subsystem_get_nqn(s));
 			obj_add_str(subsystem_attrs, "IOPolicy", nvme_subsystem_get_iopolicy(s));
 
-			array_add_obj(subsystems, subsystem_attrs);
 			namespaces = json_create_array();
 
 			if (!json_subsystem_topology_multipath(s, namespaces))
 				json_print_nvme_subsystem_topology(s, namespaces);
 
 			obj_add_array(subsystem_attrs, "Namespaces", namespaces);
+			stream_add_obj(a, NULL, subsystem_attrs);
+		}
+		if (!ndjson()) {
+			json_stream_end_array(a);
+			json_stream_end_object(a);
 		}
-		obj_add_array(host_attrs, "Subsystems", subsystems);
-		array_add_obj(a, host_attrs);
 	}
 
-	json_print(a);
+	json_stream_close(a);
 }
 
 static void json_directive_show_fields_identify(__u8 doper, __u8 *field, struct json_object *r)
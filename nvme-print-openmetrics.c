@@ -0,0 +1,535 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "nvme-print.h"
+#include "util/openmetrics.h"
+#include "plugins/ocp/ocp-smart-extended-log.h"
+
+#define OM_FIELD(s, m, name, type, help) \
+	{ name, type, help, offsetof(s, m), sizeof(((s *)0)->m), 1, NULL }
+#define OM_ARRAY(s, m, name, type, help, index) \
+	{ name, type, help, offsetof(s, m), sizeof(((s *)0)->m[0]), \
+	  ARRAY_SIZE(((s *)0)->m), index }
+
+#define SMART(m, name, type, help) \
+	OM_FIELD(struct nvme_smart_log, m, name, type, help)
+#define ENDURANCE(m, name, type, help) \
+	OM_FIELD(struct nvme_endurance_group_log, m, name, type, help)
+
+static struct print_ops openmetrics_print_ops;
+
+static const struct om_field smart_fields[] = {
+	SMART(critical_warning, "nvme_critical_warning", OM_GAUGE,
+	      "Critical warning bits of the SMART log"),
+	SMART(temperature, "nvme_temperature_kelvin", OM_GAUGE,
+	      "Composite temperature"),
+	SMART(avail_spare, "nvme_available_spare_percent", OM_GAUGE,
+	      "Remaining spare capacity"),
+	SMART(spare_thresh, "nvme_available_spare_threshold_percent", OM_GAUGE,
+	      "Spare capacity below which a critical warning is raised"),
+	SMART(percent_used, "nvme_percentage_used_percent", OM_GAUGE,
+	      "Estimate of the life used, may exceed 100"),
+	SMART(endu_grp_crit_warn_sumry, "nvme_endurance_group_critical_warning_summary",
+	      OM_GAUGE, "Critical warning bits of all endurance groups"),
+	SMART(data_units_read, "nvme_data_units_read", OM_COUNTER,
+	      "Data read by the host in units of 512000 bytes"),
+	SMART(data_units_written, "nvme_data_units_written", OM_COUNTER,
+	      "Data written by the host in units of 512000 bytes"),
+	SMART(host_reads, "nvme_host_read_commands", OM_COUNTER,
+	      "Read commands completed"),
+	SMART(host_writes, "nvme_host_write_commands", OM_COUNTER,
+	      "Write commands completed"),
+	SMART(ctrl_busy_time, "nvme_controller_busy_time_minutes", OM_COUNTER,
+	      "Time the controller was busy with I/O commands"),
+	SMART(power_cycles, "nvme_power_cycles", OM_COUNTER,
+	      "Power cycles"),
+	SMART(power_on_hours, "nvme_power_on_hours", OM_COUNTER,
+	      "Power on hours"),
+	SMART(unsafe_shutdowns, "nvme_unsafe_shutdowns", OM_COUNTER,
+	      "Unsafe shutdowns"),
+	SMART(media_errors, "nvme_media_errors", OM_COUNTER,
+	      "Unrecovered data integrity errors"),
+	SMART(num_err_log_entries, "nvme_error_log_entries", OM_COUNTER,
+	      "Error information log entries over the life of the controller"),
+	SMART(warning_temp_time, "nvme_warning_temperature_time_minutes", OM_COUNTER,
+	      "Time above the warning composite temperature threshold"),
+	SMART(critical_comp_time, "nvme_critical_temperature_time_minutes", OM_COUNTER,
+	      "Time above the critical composite temperature threshold"),
+	OM_ARRAY(struct nvme_smart_log, temp_sensor, "nvme_temperature_sensor_kelvin",
+		 OM_GAUGE, "Temperature sensor readings", "sensor"),
+	SMART(thm_temp1_trans_count, "nvme_thermal_management_t1_transitions",
+	      OM_COUNTER, "Transitions to thermal management temperature 1"),
+	SMART(thm_temp2_trans_count, "nvme_thermal_management_t2_transitions",
+	      OM_COUNTER, "Transitions to thermal management temperature 2"),
+	SMART(thm_temp1_total_time, "nvme_thermal_management_t1_time_seconds",
+	      OM_COUNTER, "Time spent at thermal management temperature 1"),
+	SMART(thm_temp2_total_time, "nvme_thermal_management_t2_time_seconds",
+	      OM_COUNTER, "Time spent at thermal management temperature 2"),
+};
+
+static const struct om_field endurance_fields[] = {
+	ENDURANCE(critical_warning, "nvme_endurance_group_critical_warning",
+		  OM_GAUGE, "Critical warning bits of the endurance group"),
+	ENDURANCE(avl_spare, "nvme_endurance_group_available_spare_percent",
+		  OM_GAUGE, "Remaining spare capacity"),
+	ENDURANCE(avl_spare_threshold,
+		  "nvme_endurance_group_available_spare_threshold_percent",
+		  OM_GAUGE, "Spare capacity below which a critical warning is raised"),
+	ENDURANCE(percent_used, "nvme_endurance_group_percentage_used_percent",
+		  OM_GAUGE, "Estimate of the life used, may exceed 100"),
+	ENDURANCE(endurance_estimate, "nvme_endurance_group_endurance_estimate",
+		  OM_GAUGE, "Data that may be written over the life in units of 1000000000 bytes"),
+	ENDURANCE(data_units_read, "nvme_endurance_group_data_units_read",
+		  OM_COUNTER, "Data read by the host in units of 512000 bytes"),
+	ENDURANCE(data_units_written, "nvme_endurance_group_data_units_written",
+		  OM_COUNTER, "Data written by the host in units of 512000 bytes"),
+	ENDURANCE(media_units_written, "nvme_endurance_group_media_units_written",
+		  OM_COUNTER, "Data written to the media in units of 512000 bytes"),
+	ENDURANCE(host_read_cmds, "nvme_endurance_group_host_read_commands",
+		  OM_COUNTER, "Read commands completed"),
+	ENDURANCE(host_write_cmds, "nvme_endurance_group_host_write_commands",
+		  OM_COUNTER, "Write commands completed"),
+	ENDURANCE(media_data_integrity_err, "nvme_endurance_group_media_errors",
+		  OM_COUNTER, "Unrecovered data integrity errors"),
+	ENDURANCE(num_err_info_log_entries, "nvme_endurance_group_error_log_entries",
+		  OM_COUNTER, "Error information log entries over the life of the group"),
+	ENDURANCE(total_end_grp_cap, "nvme_endurance_group_capacity_bytes",
+		  OM_GAUGE, "Total capacity"),
+	ENDURANCE(unalloc_end_grp_cap, "nvme_endurance_group_unallocated_capacity_bytes",
+		  OM_GAUGE, "Unallocated capacity"),
+};
+
+static bool om_has_log(const struct om_source *src, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (src[i].log)
+			return true;
+	}
+
+	return false;
+}
+
+/* Summarizes the entries returned, the log itself is a ring of events */
+/* OCP SMART / Health Information Extended log (C0h) */
+#define SCAO(off, size, name, type, help) \
+	{ name, type, help, off, size, 1, NULL }
+
+static const struct om_field scao_fields[] = {
+	SCAO(SCAO_PMUW, 16, "nvme_ocp_physical_media_units_written", OM_COUNTER,
+	     "Bytes written to the media"),
+	SCAO(SCAO_PMUR, 16, "nvme_ocp_physical_media_units_read", OM_COUNTER,
+	     "Bytes read from the media"),
+	SCAO(SCAO_BUNBR, 6, "nvme_ocp_bad_user_nand_blocks", OM_GAUGE,
+	     "Bad user NAND blocks"),
+	SCAO(SCAO_BUNBN, 2, "nvme_ocp_bad_user_nand_blocks_normalized", OM_GAUGE,
+	     "Bad user NAND blocks, normalized"),
+	SCAO(SCAO_BSNBR, 6, "nvme_ocp_bad_system_nand_blocks", OM_GAUGE,
+	     "Bad system NAND blocks"),
+	SCAO(SCAO_BSNBN, 2, "nvme_ocp_bad_system_nand_blocks_normalized", OM_GAUGE,
+	     "Bad system NAND blocks, normalized"),
+	SCAO(SCAO_XRC, 8, "nvme_ocp_xor_recoveries", OM_COUNTER,
+	     "XOR recoveries"),
+	SCAO(SCAO_UREC, 8, "nvme_ocp_uncorrectable_read_errors", OM_COUNTER,
+	     "Uncorrectable read errors"),
+	SCAO(SCAO_SEEC, 8, "nvme_ocp_soft_ecc_errors", OM_COUNTER,
+	     "Soft ECC errors"),
+	SCAO(SCAO_EEDC, 4, "nvme_ocp_end_to_end_detected_errors", OM_COUNTER,
+	     "End to end detected errors"),
+	SCAO(SCAO_EECE, 4, "nvme_ocp_end_to_end_corrected_errors", OM_COUNTER,
+	     "End to end corrected errors"),
+	SCAO(SCAO_SDPU, 1, "nvme_ocp_system_data_used_percent", OM_GAUGE,
+	     "Life of the system data used"),
+	SCAO(SCAO_RFSC, 7, "nvme_ocp_refreshes", OM_COUNTER,
+	     "Refreshes"),
+	SCAO(SCAO_MXUDEC, 4, "nvme_ocp_max_user_data_erases", OM_GAUGE,
+	     "Maximum erase count of a user data block"),
+	SCAO(SCAO_MNUDEC, 4, "nvme_ocp_min_user_data_erases", OM_GAUGE,
+	     "Minimum erase count of a user data block"),
+	SCAO(SCAO_NTTE, 1, "nvme_ocp_thermal_throttling_events", OM_COUNTER,
+	     "Thermal throttling events"),
+	SCAO(SCAO_CTS, 1, "nvme_ocp_throttling_status", OM_GAUGE,
+	     "Current throttling status"),
+	SCAO(SCAO_PCEC, 8, "nvme_ocp_pcie_correctable_errors", OM_COUNTER,
+	     "PCIe correctable errors"),
+	SCAO(SCAO_ICS, 4, "nvme_ocp_incomplete_shutdowns", OM_COUNTER,
+	     "Incomplete shutdowns"),
+	SCAO(SCAO_PFB, 1, "nvme_ocp_free_blocks_percent", OM_GAUGE,
+	     "Free blocks"),
+	SCAO(SCAO_CPH, 2, "nvme_ocp_capacitor_health_percent", OM_GAUGE,
+	     "Capacitor health"),
+	SCAO(SCAO_UIO, 8, "nvme_ocp_unaligned_io", OM_COUNTER,
+	     "Unaligned I/O commands"),
+	SCAO(SCAO_SVN, 8, "nvme_ocp_security_version", OM_GAUGE,
+	     "Security version number"),
+	SCAO(SCAO_NUSE, 8, "nvme_ocp_namespace_utilization", OM_GAUGE,
+	     "Namespace utilization"),
+	SCAO(SCAO_PSC, 16, "nvme_ocp_plp_starts", OM_COUNTER,
+	     "Power loss protection starts"),
+	SCAO(SCAO_EEST, 16, "nvme_ocp_endurance_estimate", OM_GAUGE,
+	     "Bytes that may be written over the life"),
+	SCAO(SCAO_LPV, 2, "nvme_ocp_log_page_version", OM_GAUGE,
+	     "Version of the log page"),
+};
+
+/* Fields added by version 3 of the log page */
+static const struct om_field scao_v3_fields[] = {
+	SCAO(SCAO_PLRC, 8, "nvme_ocp_pcie_link_retrainings", OM_COUNTER,
+	     "PCIe link retrainings"),
+	SCAO(SCAO_PSCC, 8, "nvme_ocp_power_state_changes", OM_COUNTER,
+	     "Power state changes"),
+};
+
+static void om_error_log(const struct om_source *src, int nr)
+{
+	const struct nvme_error_log_page *log;
+	char labels[OM_LABELS_MAX];
+	char value[32], code[8];
+	__u64 count, last;
+	__u16 status;
+	int i, j, k;
+
+	if (!om_has_log(src, nr))
+		return;
+
+	om_family(stdout, "nvme_error_log_valid_entries", OM_GAUGE,
+		  "Entries of the error information log page in use");
+	for (i = 0; i < nr; i++) {
+		log = src[i].log;
+		if (!log)
+			continue;
+		for (j = 0, count = 0; j < src[i].entries; j++)
+			count += !!log[j].error_count;
+		sprintf(value, "%" PRIu64, (uint64_t)count);
+		om_sample(stdout, "nvme_error_log_valid_entries", OM_GAUGE,
+			  src[i].labels, value);
+	}
+
+	om_family(stdout, "nvme_error_log_error_count", OM_COUNTER,
+		  "Error count of the most recent entry");
+	for (i = 0; i < nr; i++) {
+		log = src[i].log;
+		if (!log)
+			continue;
+		for (j = 0, last = 0; j < src[i].entries; j++)
+			last = max(last, le64_to_cpu(log[j].error_count));
+		sprintf(value, "%" PRIu64, (uint64_t)last);
+		om_sample(stdout, "nvme_error_log_error_count", OM_COUNTER,
+			  src[i].labels, value);
+	}
+
+	om_family(stdout, "nvme_error_log_status_entries", OM_GAUGE,
+		  "Entries of the error information log page by status code");
+	for (i = 0; i < nr; i++) {
+		log = src[i].log;
+		if (!log)
+			continue;
+		for (j = 0; j < src[i].entries; j++) {
+			if (!log[j].error_count)
+				continue;
+
+			/* one sample per status, at its first entry */
+			status = le16_to_cpu(log[j].status_field) >> 1;
+			for (k = 0; k < j; k++) {
+				if (log[k].error_count &&
+				    le16_to_cpu(log[k].status_field) >> 1 == status)
+					break;
+			}
+			if (k < j)
+				continue;
+
+			for (k = j, count = 0; k < src[i].entries; k++)
+				count += log[k].error_count &&
+					 le16_to_cpu(log[k].status_field) >> 1 == status;
+
+			strcpy(labels, src[i].labels);
+			sprintf(code, "%#x", status);
+			om_add_label(labels, "status", code, sizeof(code));
+			sprintf(value, "%" PRIu64, (uint64_t)count);
+			om_sample(stdout, "nvme_error_log_status_entries", OM_GAUGE,
+				  labels, value);
+		}
+	}
+}
+
+static void om_fw_log(const struct om_source *src, int nr)
+{
+	const struct nvme_firmware_slot *log;
+	char labels[OM_LABELS_MAX];
+	char value[8];
+	int i, j;
+
+	if (!om_has_log(src, nr))
+		return;
+
+	om_family(stdout, "nvme_firmware_active_slot", OM_GAUGE,
+		  "Slot of the running firmware");
+	for (i = 0; i < nr; i++) {
+		log = src[i].log;
+		if (!log)
+			continue;
+		sprintf(value, "%u", log->afi & 0x7);
+		om_sample(stdout, "nvme_firmware_active_slot", OM_GAUGE,
+			  src[i].labels, value);
+	}
+
+	om_family(stdout, "nvme_firmware_next_slot", OM_GAUGE,
+		  "Slot activated at the next reset, 0 if unchanged");
+	for (i = 0; i < nr; i++) {
+		log = src[i].log;
+		if (!log)
+			continue;
+		sprintf(value, "%u", (log->afi >> 4) & 0x7);
+		om_sample(stdout, "nvme_firmware_next_slot", OM_GAUGE,
+			  src[i].labels, value);
+	}
+
+	om_family(stdout, "nvme_firmware_slot", OM_INFO,
+		  "Firmware revision stored in a slot");
+	for (i = 0; i < nr; i++) {
+		log = src[i].log;
+		if (!log)
+			continue;
+		for (j = 0; j < ARRAY_SIZE(log->frs); j++) {
+			if (!log->frs[j][0])
+				continue;
+
+			strcpy(labels, src[i].labels);
+			sprintf(value, "%d", j + 1);
+			om_add_label(labels, "slot", value, sizeof(value));
+			om_add_label(labels, "revision", log->frs[j], sizeof(log->frs[j]));
+			om_sample(stdout, "nvme_firmware_slot", OM_INFO, labels, "1");
+		}
+	}
+}
+
+/* The fields added by version 3 are only printed for logs of that version */
+static void om_ocp_smart(struct om_source *src, int nr)
+{
+	const __u8 *log;
+	int i;
+
+	om_fields(stdout, scao_fields, ARRAY_SIZE(scao_fields), src, nr);
+
+	for (i = 0; i < nr; i++) {
+		log = src[i].log;
+		if (log && le16_to_cpu(*(uint16_t *)&log[SCAO_LPV]) < 3)
+			src[i].log = NULL;
+	}
+	om_fields(stdout, scao_v3_fields, ARRAY_SIZE(scao_v3_fields), src, nr);
+}
+
+static void openmetrics_smart_log(struct nvme_smart_log *smart, unsigned int nsid,
+				  const char *devname)
+{
+	char labels[OM_LABELS_MAX] = { 0 };
+	struct om_source src = { labels, smart };
+	char str[16];
+
+	om_add_label(labels, "device", devname, strlen(devname));
+	if (nsid != NVME_NSID_ALL) {
+		sprintf(str, "%u", nsid);
+		om_add_label(labels, "nsid", str, sizeof(str));
+	}
+
+	om_fields(stdout, smart_fields, ARRAY_SIZE(smart_fields), &src, 1);
+	om_eof(stdout);
+}
+
+static void openmetrics_endurance_log(struct nvme_endurance_group_log *endurance_log,
+				      __u16 group_id, const char *devname)
+{
+	char labels[OM_LABELS_MAX] = { 0 };
+	struct om_source src = { labels, endurance_log };
+	char str[8];
+
+	om_add_label(labels, "device", devname, strlen(devname));
+	sprintf(str, "%u", group_id);
+	om_add_label(labels, "endgid", str, sizeof(str));
+
+	om_fields(stdout, endurance_fields, ARRAY_SIZE(endurance_fields), &src, 1);
+	om_eof(stdout);
+}
+
+static void openmetrics_error_log(struct nvme_error_log_page *err_log, int entries,
+				  const char *devname)
+{
+	char labels[OM_LABELS_MAX] = { 0 };
+	struct om_source src = { labels, err_log, entries };
+
+	om_add_label(labels, "device", devname, strlen(devname));
+
+	om_error_log(&src, 1);
+	om_eof(stdout);
+}
+
+static void openmetrics_fw_log(struct nvme_firmware_slot *fw_log, const char *devname)
+{
+	char labels[OM_LABELS_MAX] = { 0 };
+	struct om_source src = { labels, fw_log };
+
+	om_add_label(labels, "device", devname, strlen(devname));
+
+	om_fw_log(&src, 1);
+	om_eof(stdout);
+}
+
+void nvme_show_ocp_smart_openmetrics(void *log, const char *devname)
+{
+	char labels[OM_LABELS_MAX] = { 0 };
+	struct om_source src = { labels, log };
+
+	om_add_label(labels, "device", devname, strlen(devname));
+
+	om_ocp_smart(&src, 1);
+	om_eof(stdout);
+}
+
+int nvme_show_metrics(struct nvme_metrics *metrics, int nr)
+{
+	_cleanup_free_ struct om_source *src = NULL;
+	_cleanup_free_ char *labels = NULL;
+	int i, j, n = 0;
+
+	src = calloc(nr, sizeof(*src));
+	if (nr && !src)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++)
+		src[i] = (struct om_source){ metrics[i].labels, metrics[i].smart };
+	om_fields(stdout, smart_fields, ARRAY_SIZE(smart_fields), src, nr);
+
+	for (i = 0; i < nr; i++)
+		src[i] = (struct om_source){ metrics[i].labels, metrics[i].err_log,
+					     metrics[i].err_entries };
+	om_error_log(src, nr);
+
+	for (i = 0; i < nr; i++)
+		src[i] = (struct om_source){ metrics[i].labels, metrics[i].fw_log };
+	om_fw_log(src, nr);
+
+	for (i = 0; i < nr; i++)
+		src[i] = (struct om_source){ metrics[i].labels, metrics[i].ocp_smart };
+	om_ocp_smart(src, nr);
+
+	/* endurance groups are sources of their own, labelled by their id */
+	for (i = 0; i < nr; i++)
+		n += metrics[i].nr_endurance;
+	if (n) {
+		free(src);
+		src = calloc(n, sizeof(*src));
+		labels = calloc(n, OM_LABELS_MAX);
+		if (!src || !labels)
+			return -ENOMEM;
+
+		for (i = 0, n = 0; i < nr; i++) {
+			for (j = 0; j < metrics[i].nr_endurance; j++, n++) {
+				char *l = labels + n * OM_LABELS_MAX;
+				char str[8];
+
+				strcpy(l, metrics[i].labels);
+				sprintf(str, "%u", j + 1);
+				om_add_label(l, "endgid", str, sizeof(str));
+				src[n] = (struct om_source){ l, &metrics[i].endurance[j] };
+			}
+		}
+		om_fields(stdout, endurance_fields, ARRAY_SIZE(endurance_fields), src, n);
+	}
+
+	om_eof(stdout);
+
+	return 0;
+}
+
+static struct print_ops openmetrics_print_ops = {
+	/* libnvme types.h print functions */
+	.ana_log			= NULL,
+	.boot_part_log			= NULL,
+	.phy_rx_eom_log			= NULL,
+	.ctrl_list			= NULL,
+	.ctrl_registers			= NULL,
+	.directive			= NULL,
+	.discovery_log			= NULL,
+	.effects_log_list		= NULL,
+	.endurance_group_event_agg_log	= NULL,
+	.endurance_group_list		= NULL,
+	.endurance_log			= openmetrics_endurance_log,
+	.error_log			= openmetrics_error_log,
+	.fdp_config_log			= NULL,
+	.fdp_event_log			= NULL,
+	.fdp_ruh_status			= NULL,
+	.fdp_stats_log			= NULL,
+	.fdp_usage_log			= NULL,
+	.fid_supported_effects_log	= NULL,
+	.fw_log				= openmetrics_fw_log,
+	.id_ctrl			= NULL,
+	.id_ctrl_nvm			= NULL,
+	.id_domain_list			= NULL,
+	.id_independent_id_ns		= NULL,
+	.id_iocs			= NULL,
+	.id_ns				= NULL,
+	.id_ns_descs			= NULL,
+	.id_ns_granularity_list		= NULL,
+	.id_nvmset_list			= NULL,
+	.id_uuid_list			= NULL,
+	.lba_status			= NULL,
+	.lba_status_log			= NULL,
+	.media_unit_stat_log		= NULL,
+	.mi_cmd_support_effects_log	= NULL,
+	.ns_list			= NULL,
+	.ns_list_log			= NULL,
+	.nvm_id_ns			= NULL,
+	.persistent_event_log		= NULL,
+	.predictable_latency_event_agg_log = NULL,
+	.predictable_latency_per_nvmset	= NULL,
+	.primary_ctrl_cap		= NULL,
+	.resv_notification_log		= NULL,
+	.resv_report			= NULL,
+	.sanitize_log_page		= NULL,
+	.secondary_ctrl_list		= NULL,
+	.select_result			= NULL,
+	.self_test_log 			= NULL,
+	.single_property		= NULL,
+	.smart_log			= openmetrics_smart_log,
+	.supported_cap_config_list_log	= NULL,
+	.supported_log_pages		= NULL,
+	.zns_start_zone_list		= NULL,
+	.zns_changed_zone_log		= NULL,
+	.zns_finish_zone_list		= NULL,
+	.zns_id_ctrl			= NULL,
+	.zns_id_ns			= NULL,
+	.zns_report_zones		= NULL,
+	.show_feature			= NULL,
+	.show_feature_fields		= NULL,
+	.id_ctrl_rpmbs			= NULL,
+	.lba_range			= NULL,
+	.lba_status_info		= NULL,
+	.d				= NULL,
+	.show_init			= NULL,
+	.show_finish			= NULL,
+
+	/* libnvme tree print functions */
+	.list_item			= NULL,
+	.list_items			= NULL,
+	.print_nvme_subsystem_list	= NULL,
+	.topology_ctrl			= NULL,
+	.topology_namespace		= NULL,
+
+	/* status and error messages */
+	.connect_msg			= NULL,
+	.show_message			= NULL,
+	.show_perror			= NULL,
+	.show_status			= NULL,
+	.show_error_status		= NULL,
+};
+
+struct print_ops *nvme_get_openmetrics_print_ops(enum nvme_print_flags flags)
+{
+	openmetrics_print_ops.flags = flags;
+	return &openmetrics_print_ops;
+}
@@ -16,6 +16,7 @@
 #include "libnvme.h"
 #include "nvme-print.h"
 #include "nvme-models.h"
+#include "util/hexdump.h"
 #include "util/suffix.h"
 #include "util/types.h"
 #include "common.h"
@@ -3284,7 +3285,7 @@ static void stdout_zns_report_zone_attributes(__u8 za, __u8 zai)
 }
 
 static void stdout_zns_report_zones(void *report, __u32 descs,
-				    __u8 ext_size, __u32 report_size,
+				    __u32 ext_size, __u32 report_size,
 				    struct json_object *zone_list)
 {
 	struct nvme_zone_report *r = report;
@@ -4300,38 +4301,7 @@ static void stdout_lba_status_info(__u32 result)
 
 void stdout_d(unsigned char *buf, int len, int width, int group)
 {
-	int i, offset = 0;
-	char ascii[32 + 1] = { 0 };
-
-	assert(width < sizeof(ascii));
-
-	printf("     ");
-
-	for (i = 0; i <= 15; i++)
-		printf("%3x", i);
-
-	for (i = 0; i < len; i++) {
-		if (!(i % width))
-			printf("\n%04x:", offset);
-		if (i % group)
-			printf("%02x", buf[i]);
-		else
-			printf(" %02x", buf[i]);
-		ascii[i % width] = (buf[i] >= '!' && buf[i] <= '~') ? buf[i] : '.';
-		if (!((i + 1) % width)) {
-			printf(" \"%.*s\"", width, ascii);
-			offset += width;
-			memset(ascii, 0, sizeof(ascii));
-		}
-	}
-
-	if (strlen(ascii)) {
-		unsigned int b = width - (i % width);
-
-		printf(" %*s \"%.*s\"", 2 * b + b / group + (b % group ? 1 : 0), "", width, ascii);
-	}
-
-	printf("\n");
+	util_hexdump(stdout, buf, len, width, group);
 }
 
 static void stdout_plm_config(struct nvme_plm_config *plmcfg)
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
 #include "nvme.h"
@@ -29,10 +30,17 @@ static struct print_ops *nvme_print_ops(enum nvme_print_flags flags)
 {
 	struct print_ops *ops = NULL;
 
-	if (flags & JSON || nvme_is_output_format_json())
+	if (flags & JSON || nvme_is_output_format_json()) {
+		if (nvme_is_output_format_ndjson())
+			flags |= NDJSON;
+		else if (nvme_is_output_format_cbor())
+			flags |= CBOR;
 		ops = nvme_get_json_print_ops(flags);
+	}
 	else if (flags & BINARY)
 		ops = nvme_get_binary_print_ops(flags);
+	else if (flags & OPENMETRICS)
+		ops = nvme_get_openmetrics_print_ops(flags);
 	else
 		ops = nvme_get_stdout_print_ops(flags);
 
@@ -436,9 +444,21 @@ void d(unsigned char *buf, int len, int width, int group)
 
 void d_raw(unsigned char *buf, unsigned len)
 {
-	unsigned i;
-	for (i = 0; i < len; i++)
-		putchar(*(buf+i));
+	ssize_t ret;
+
+	/* anything printed before goes out first */
+	fflush(stdout);
+
+	while (len) {
+		ret = write(STDOUT_FILENO, buf, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		buf += ret;
+		len -= ret;
+	}
 }
 
 void nvme_show_status(int status)
@@ -580,7 +600,7 @@ const char *nvme_zone_state_to_string(__u8 state)
 }
 
 void nvme_show_zns_report_zones(void *report, __u32 descs,
-				__u8 ext_size, __u32 report_size,
+				__u32 ext_size, __u32 report_size,
 				struct json_object *zone_list,
 				enum nvme_print_flags flags)
 {
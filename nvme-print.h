@@ -7,6 +7,8 @@
 
 #include <ccan/list/list.h>
 
+#include "util/openmetrics.h"
+
 typedef struct nvme_effects_log_node {
 	struct nvme_cmd_effects_log effects; /* needs to be first member because of alignment requirement. */
 	enum nvme_csi csi;
@@ -18,6 +20,9 @@ typedef struct nvme_effects_log_node {
 
 #define POWER_OF_TWO(exponent) (1 << (exponent))
 
+/* stdout buffer used when the output does not go to a terminal */
+#define NVME_STDOUT_BUF_SIZE	0x40000
+
 void d(unsigned char *buf, int len, int width, int group);
 void d_raw(unsigned char *buf, unsigned len);
 
@@ -79,7 +84,7 @@ struct print_ops {
 	void (*zns_finish_zone_list)(__u64 nr_zones, struct json_object *zone_list);
 	void (*zns_id_ctrl)(struct nvme_zns_id_ctrl *ctrl);
 	void (*zns_id_ns)(struct nvme_zns_id_ns *ns, struct nvme_id_ns *id_ns);
-	void (*zns_report_zones)(void *report, __u32 descs, __u8 ext_size, __u32 report_size, struct json_object *zone_list);
+	void (*zns_report_zones)(void *report, __u32 descs, __u32 ext_size, __u32 report_size, struct json_object *zone_list);
 	void (*show_feature)(enum nvme_features_id fid, int sel, unsigned int result);
 	void (*show_feature_fields)(enum nvme_features_id fid, unsigned int result, unsigned char *buf);
 	void (*id_ctrl_rpmbs)(__le32 ctrl_rpmbs);
@@ -139,6 +144,22 @@ static inline struct print_ops *nvme_get_json_print_ops(enum nvme_print_flags fl
 
 struct print_ops *nvme_get_stdout_print_ops(enum nvme_print_flags flags);
 struct print_ops *nvme_get_binary_print_ops(enum nvme_print_flags flags);
+struct print_ops *nvme_get_openmetrics_print_ops(enum nvme_print_flags flags);
+
+/* Health logs of one controller for 'nvme metrics', NULL if not available */
+struct nvme_metrics {
+	char labels[OM_LABELS_MAX];
+	struct nvme_smart_log *smart;
+	struct nvme_error_log_page *err_log;
+	int err_entries;
+	struct nvme_firmware_slot *fw_log;
+	struct nvme_endurance_group_log *endurance;	/* groups 1 to nr_endurance */
+	int nr_endurance;
+	void *ocp_smart;	/* OCP SMART / Health Information Extended log */
+};
+
+int nvme_show_metrics(struct nvme_metrics *metrics, int nr);
+void nvme_show_ocp_smart_openmetrics(void *log, const char *devname);
 
 void nvme_show_status(int status);
 void nvme_show_lba_status_info(__u32 result);
@@ -260,7 +281,7 @@ void nvme_show_zns_changed(struct nvme_zns_changed_zone_log *log,
 void nvme_zns_finish_zone_list(__u64 nr_zones, struct json_object *zone_list,
 			       enum nvme_print_flags flags);
 void nvme_show_zns_report_zones(void *report, __u32 descs,
-				__u8 ext_size, __u32 report_size,
+				__u32 ext_size, __u32 report_size,
 				struct json_object *zone_list,
 				enum nvme_print_flags flags);
 void json_nvme_finish_zone_list(__u64 nr_zones, 
@@ -0,0 +1,391 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Topology scan for hosts with many namespaces.
+ *
+ * libnvme scans the topology one namespace after another and, unless the
+ * kernel exports the namespace attributes in sysfs, issues identify commands
+ * for each of them. On fabrics hosts with thousands of namespaces the round
+ * trips dominate. The identify data is therefore fetched by a bounded pool
+ * of workers first and libnvme's scan is answered from the command memo,
+ * building the very same tree.
+ *
+ * The namespace identification descriptors, which do not change while the
+ * namespace exists, can also be saved to a snapshot file under the rundir,
+ * which 'nvme snapshot' keeps current. A snapshot is used as long as the set
+ * of namespace devices is unchanged and it is younger than
+ * NVME_SNAPSHOT_MAX_AGE. Identify Namespace data holds the utilization and
+ * is always read from the devices.
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syslog.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libnvme.h>
+
+#include "common.h"
+#include "nvme-scan.h"
+#include "util/cleanup.h"
+#include "util/cmd-cache.h"
+#include "util/logging.h"
+#include "util/parallel.h"
+
+#define NVME_SCAN_SYSFS_BLOCK	"/sys/block"
+
+#define NVME_SNAPSHOT_MAGIC	"NVMESNAP"
+#define NVME_SNAPSHOT_VERSION	2
+
+struct nvme_snapshot_hdr {
+	char	magic[8];
+	__u32	version;
+	__u32	nr_ns;
+	__u64	created;	/* seconds since the epoch */
+	__u64	fingerprint;	/* of the namespace devices */
+};
+
+struct scan_ctx {
+	struct dirent **ents;
+	int nr;
+	__u64 fingerprint;
+	void *snapshot;		/* mapping backing the memo, if loaded */
+	size_t snapshot_len;
+};
+
+/*
+ * Issues the commands libnvme issues when it initializes a namespace, the
+ * descriptors only for a snapshot.
+ */
+static void scan_prefetch(struct dirent *ent, bool snapshot)
+{
+	_cleanup_free_ struct nvme_ns_id_desc *descs = NULL;
+	_cleanup_free_ struct nvme_id_ns *ns = NULL;
+	_cleanup_file_ int fd = -1;
+	char path[PATH_MAX];
+	__u32 nsid;
+
+	/* newer kernels export everything the scan needs */
+	snprintf(path, sizeof(path), "%s/%s/csi", NVME_SCAN_SYSFS_BLOCK, ent->d_name);
+	if (!access(path, F_OK))
+		return;
+
+	snprintf(path, sizeof(path), "/dev/%s", ent->d_name);
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || nvme_get_nsid(fd, &nsid))
+		return;
+
+	ns = nvme_alloc(sizeof(*ns));
+	descs = nvme_alloc(NVME_IDENTIFY_DATA_SIZE);
+	if (!ns || !descs)
+		return;
+
+	if (snapshot || !nvme_identify_ns(fd, nsid, ns))
+		nvme_identify_ns_descs(fd, nsid, descs);
+}
+
+static void scan_prefetch_ns(int i, void *arg)
+{
+	struct dirent **ents = arg;
+
+	scan_prefetch(ents[i], false);
+}
+
+static void scan_snapshot_ns(int i, void *arg)
+{
+	struct dirent **ents = arg;
+
+	scan_prefetch(ents[i], true);
+}
+
+/* FNV-1a over the names and device numbers of the namespaces */
+static __u64 scan_fingerprint(struct dirent **ents, int nr)
+{
+	__u64 h = 0xcbf29ce484222325ULL;
+	char path[PATH_MAX];
+	struct stat st;
+	const char *c;
+	__u64 rdev;
+	int i, j;
+
+	for (i = 0; i < nr; i++) {
+		snprintf(path, sizeof(path), "/dev/%s", ents[i]->d_name);
+		rdev = stat(path, &st) ? 0 : st.st_rdev;
+
+		for (c = ents[i]->d_name; *c; c++)
+			h = (h ^ (unsigned char)*c) * 0x100000001b3ULL;
+		for (j = 0; j < sizeof(rdev); j++)
+			h = (h ^ ((rdev >> (j * 8)) & 0xff)) * 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+static int scan_ctx_init(struct scan_ctx *ctx)
+{
+	memset(ctx, 0, sizeof(*ctx));
+
+	ctx->nr = scandir(NVME_SCAN_SYSFS_BLOCK, &ctx->ents, nvme_namespace_filter,
+			  alphasort);
+	if (ctx->nr < 0) {
+		ctx->nr = 0;
+		return -errno;
+	}
+	ctx->fingerprint = scan_fingerprint(ctx->ents, ctx->nr);
+
+	return 0;
+}
+
+/* The memo has to be disabled first, loaded records point into the snapshot */
+static void scan_ctx_free(struct scan_ctx *ctx)
+{
+	int i;
+
+	if (ctx->snapshot)
+		munmap(ctx->snapshot, ctx->snapshot_len);
+
+	for (i = 0; i < ctx->nr; i++)
+		free(ctx->ents[i]);
+	free(ctx->ents);
+}
+
+/* Fills the memo from the snapshot if it matches the current namespaces */
+static bool scan_snapshot_load(struct scan_ctx *ctx)
+{
+	struct nvme_snapshot_hdr *hdr;
+	_cleanup_file_ int fd = -1;
+	struct stat st;
+	time_t now;
+
+	fd = open(NVME_SNAPSHOT_PATH, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) || st.st_size < sizeof(*hdr))
+		return false;
+
+	ctx->snapshot = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (ctx->snapshot == MAP_FAILED) {
+		ctx->snapshot = NULL;
+		return false;
+	}
+	ctx->snapshot_len = st.st_size;
+
+	hdr = ctx->snapshot;
+	now = time(NULL);
+	if (memcmp(hdr->magic, NVME_SNAPSHOT_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != NVME_SNAPSHOT_VERSION ||
+	    hdr->nr_ns != ctx->nr || hdr->fingerprint != ctx->fingerprint ||
+	    hdr->created > now || now - hdr->created > NVME_SNAPSHOT_MAX_AGE)
+		goto unmap;
+
+	if (nvme_cmd_cache_load(hdr + 1, ctx->snapshot_len - sizeof(*hdr))) {
+		/* drop what was loaded of a corrupted snapshot */
+		nvme_cmd_cache_disable();
+		nvme_cmd_cache_enable();
+		goto unmap;
+	}
+
+	return true;
+
+unmap:
+	munmap(ctx->snapshot, ctx->snapshot_len);
+	ctx->snapshot = NULL;
+	return false;
+}
+
+static unsigned long long scan_elapsed(struct timeval *start, struct timeval *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000ULL +
+		(end->tv_usec - start->tv_usec);
+}
+
+/*
+ * Drop-in replacement of nvme_scan_topology() which loads the descriptors of
+ * all namespaces from the snapshot and prefetches the rest of their identify
+ * data concurrently. The prefetch is skipped for filtered scans, which
+ * usually cover a single device. With LOG_INFO the time spent in commands and in the rest of the
+ * scan, mostly sysfs, is reported.
+ *
+ * If the memo is held already, e.g. by nvme batch, the snapshot is not
+ * needed, the data of earlier scans is still in the memo.
+ */
+int nvme_cli_scan_topology(nvme_root_t r, nvme_scan_filter_t f, void *f_args)
+{
+	struct nvme_ioctl_stats before, after;
+	struct timeval start, prefetched, end;
+	struct scan_ctx ctx;
+	bool snapshot = false, held;
+	unsigned long hits = 0;
+	int err;
+
+	gettimeofday(&start, NULL);
+	nvme_ioctl_stats_get(&before);
+
+	held = nvme_cmd_cache_enabled();
+	if (!scan_ctx_init(&ctx) && ctx.nr) {
+		nvme_cmd_cache_enable();
+		if (!held)
+			snapshot = scan_snapshot_load(&ctx);
+		if (!f)
+			nvme_parallel_for(ctx.nr, NVME_SCAN_JOBS, scan_prefetch_ns, ctx.ents);
+		hits = nvme_cmd_cache_hits();
+	}
+	gettimeofday(&prefetched, NULL);
+
+	nvme_ioctl_stats_get(&after);
+	err = nvme_scan_topology(r, f, f_args);
+	gettimeofday(&end, NULL);
+
+	if (ctx.nr) {
+		hits = nvme_cmd_cache_hits() - hits;
+		nvme_cmd_cache_disable();
+	}
+	scan_ctx_free(&ctx);
+
+	if (log_level >= LOG_INFO) {
+		unsigned long long scan = scan_elapsed(&prefetched, &end);
+		struct nvme_ioctl_stats now;
+
+		nvme_ioctl_stats_get(&now);
+		fprintf(stderr, "%s: %d namespaces, %lu commands, %llu us\n",
+			snapshot ? "snapshot" : "prefetch", ctx.nr,
+			after.nr - before.nr, scan_elapsed(&start, &prefetched));
+		fprintf(stderr, "scan: %llu us, ioctl: %lu commands %llu us (%lu prefetched), sysfs and other: %llu us\n",
+			scan, now.nr - after.nr, now.usecs - after.usecs, hits,
+			scan - min(scan, now.usecs - after.usecs));
+	}
+
+	return err;
+}
+
+/* Reads the descriptors of all namespaces and saves them atomically */
+int nvme_cli_snapshot_update(void)
+{
+	struct nvme_snapshot_hdr hdr = {
+		.magic = NVME_SNAPSHOT_MAGIC,
+		.version = NVME_SNAPSHOT_VERSION,
+	};
+	char tmp[sizeof(NVME_SNAPSHOT_PATH) + 16];
+	struct scan_ctx ctx;
+	FILE *f;
+	int err;
+
+	err = scan_ctx_init(&ctx);
+	if (err)
+		return err;
+
+	nvme_cmd_cache_enable();
+	nvme_parallel_for(ctx.nr, NVME_SCAN_JOBS, scan_snapshot_ns, ctx.ents);
+
+	hdr.nr_ns = ctx.nr;
+	hdr.created = time(NULL);
+	hdr.fingerprint = ctx.fingerprint;
+
+	if (mkdir(RUNDIR "/nvme", 0755) && errno != EEXIST) {
+		err = -errno;
+		goto free;
+	}
+
+	snprintf(tmp, sizeof(tmp), "%s.%d", NVME_SNAPSHOT_PATH, getpid());
+	f = fopen(tmp, "w");
+	if (!f) {
+		err = -errno;
+		goto free;
+	}
+
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1)
+		err = -EIO;
+	if (!err)
+		err = nvme_cmd_cache_save(f);
+	if (fclose(f) && !err)
+		err = -EIO;
+
+	/* readers map the file, never let them see a partial snapshot */
+	if (!err && rename(tmp, NVME_SNAPSHOT_PATH))
+		err = -errno;
+	if (err)
+		unlink(tmp);
+
+free:
+	nvme_cmd_cache_disable();
+	scan_ctx_free(&ctx);
+	return err;
+}
+
+int nvme_cli_snapshot_invalidate(void)
+{
+	if (unlink(NVME_SNAPSHOT_PATH) && errno != ENOENT)
+		return -errno;
+
+	return 0;
+}
+
+static bool snapshot_watch_event(int fd)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ev;
+	bool changed = false;
+	ssize_t len;
+	char *p;
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + len; p += sizeof(*ev) + ev->len) {
+			ev = (struct inotify_event *)p;
+			if (ev->len && !strncmp(ev->name, "nvme", 4))
+				changed = true;
+		}
+	}
+
+	return changed;
+}
+
+/*
+ * Keeps the snapshot current until interrupted. It is refreshed when NVMe
+ * device nodes come and go, and before it ages out. A failed refresh, e.g.
+ * of a device going away during the scan, is reported and retried later.
+ */
+int nvme_cli_snapshot_watch(void)
+{
+	struct pollfd pfd = { .events = POLLIN };
+	int err, ret;
+
+	pfd.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (pfd.fd < 0)
+		return -errno;
+
+	if (inotify_add_watch(pfd.fd, "/dev", IN_CREATE | IN_DELETE) < 0) {
+		err = -errno;
+		goto close_fd;
+	}
+
+	for (;;) {
+		err = nvme_cli_snapshot_update();
+		if (err)
+			fprintf(stderr, "snapshot: %s\n", strerror(-err));
+
+		do {
+			ret = poll(&pfd, 1, NVME_SNAPSHOT_MAX_AGE / 2 * 1000);
+			if (ret < 0 && errno != EINTR) {
+				err = -errno;
+				goto close_fd;
+			}
+		} while (ret > 0 && !snapshot_watch_event(pfd.fd));
+
+		/* namespaces of a new controller show up in bursts */
+		if (ret > 0) {
+			sleep(1);
+			snapshot_watch_event(pfd.fd);
+		}
+	}
+
+close_fd:
+	close(pfd.fd);
+	return err;
+}
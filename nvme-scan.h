@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef NVME_SCAN_H
+#define NVME_SCAN_H
+
+#include <libnvme.h>
+
+#define NVME_SCAN_JOBS			16
+
+#define NVME_SNAPSHOT_PATH		RUNDIR "/nvme/topology.snap"
+/* identify data such as the namespace utilization changes over time */
+#define NVME_SNAPSHOT_MAX_AGE		300
+
+int nvme_cli_scan_topology(nvme_root_t r, nvme_scan_filter_t f, void *f_args);
+int nvme_cli_snapshot_update(void);
+int nvme_cli_snapshot_invalidate(void);
+int nvme_cli_snapshot_watch(void);
+
+#endif
@@ -0,0 +1,742 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * nvme serve: runs nvme commands for local clients over a Unix socket.
+ *
+ * The server keeps the devices open and the identify data in the memo.
+ * Each request runs in a worker forked from the server, so it starts
+ * with all of that at hand and without paying for a new process. The
+ * commands rely on global state, getopt and stdout, which is why the
+ * workers are processes and not threads. Requests for the same device
+ * run one after the other, in the order they came in.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "common.h"
+#include "nvme-serve.h"
+#include "nvme-scan.h"
+#include "util/cleanup.h"
+#include "util/cmd-cache.h"
+
+/* requests waiting for a worker */
+#define NVME_SERVE_MAX_QUEUE		1024
+/* clients still sending their request */
+#define NVME_SERVE_MAX_CONNS		64
+/* time a client gets to send its request */
+#define NVME_SERVE_RECV_TIMEOUT		1
+
+struct serve_req {
+	struct serve_req *next;
+	int fd;
+	pid_t pid;		/* of the worker, once started */
+	int argc;
+	char *argv[NVME_SERVE_MAX_ARGS + 1];
+	dev_t rdev;		/* requests for the device are serialized */
+	const char *mi;		/* as are those for the MI endpoint */
+	char buf[];		/* the arguments */
+};
+
+/* A client whose request is still coming in */
+struct serve_conn {
+	struct serve_conn *next;
+	int fd;
+	time_t accepted;
+	size_t received;	/* of the header and the arguments */
+	struct nvme_serve_req_hdr hdr;
+	struct serve_req *req;	/* once the header is in */
+};
+
+struct serve {
+	const struct nvme_serve_ops *ops;
+	int sock;
+	int wakeup[2];
+	int jobs;
+	int running;
+	int queued;
+	int nr_conns;
+	bool stale;
+	time_t refreshed;
+	__u64 changes;		/* counted in the stamp when last looked at */
+	struct serve_conn *conns;
+	struct serve_req *queue;
+	struct serve_req *workers;
+};
+
+/* Commands which only read. Clients forward them, and the memo stays valid. */
+static const char * const serve_read_only_cmds[] = {
+	"list",
+	"list-subsys",
+	"show-topology",
+	"id-ctrl",
+	"id-ns",
+	"list-ns",
+	"list-ctrl",
+	"smart-log",
+	"error-log",
+	"fw-log",
+	"endurance-log",
+	"ana-log",
+	"effects-log",
+	"supported-log-pages",
+	"get-feature",
+	"metrics",
+};
+
+static volatile sig_atomic_t serve_stop;
+static int serve_wakeup_fd = -1;
+
+bool nvme_serve_read_only(const char *cmd)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(serve_read_only_cmds); i++) {
+		if (!strcmp(cmd, serve_read_only_cmds[i]))
+			return true;
+	}
+
+	return false;
+}
+
+static int serve_read(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+	ssize_t n;
+
+	while (len) {
+		n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -errno;
+		if (!n)
+			return -EPIPE;
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* Writes to a socket, a client which went away does not raise SIGPIPE */
+static int serve_send(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len) {
+		n = send(fd, p, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -errno;
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int serve_write(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len) {
+		n = write(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -errno;
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static void serve_reply(int fd, int error)
+{
+	struct nvme_serve_resp_hdr hdr = {
+		.error = error,
+	};
+
+	serve_send(fd, &hdr, sizeof(hdr));
+}
+
+static void serve_signal(int sig)
+{
+	int saved = errno;
+	ssize_t ret;
+
+	if (sig != SIGCHLD)
+		serve_stop = 1;
+	ret = write(serve_wakeup_fd, "", 1);
+	(void)ret;
+	errno = saved;
+}
+
+static void serve_signals(void (*handler)(int))
+{
+	struct sigaction sa = {
+		.sa_handler = handler,
+	};
+
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGCHLD, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+}
+
+/* Whether the other end of the socket runs as root or as ourselves */
+static bool serve_peer_allowed(int fd)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len))
+		return false;
+
+	return !cred.uid || cred.uid == geteuid();
+}
+
+/* Notes the device an argument names, by any path, or the MI endpoint */
+static void serve_req_dev(struct serve_req *req, const char *arg)
+{
+	struct stat st;
+
+	if (!strncmp(arg, "mctp:", 5))
+		req->mi = arg;
+	else if (!stat(arg, &st) && (S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode)))
+		req->rdev = st.st_rdev;
+}
+
+/* Splits the arguments of a request which came in completely */
+static int serve_parse(struct serve_req *req, size_t len)
+{
+	char *p, *end;
+
+	if (req->buf[len - 1])
+		return -EINVAL;
+
+	for (p = req->buf, end = p + len; p < end; p += strlen(p) + 1) {
+		if (req->argc == NVME_SERVE_MAX_ARGS)
+			return -EINVAL;
+		req->argv[req->argc++] = p;
+		if (!req->rdev && !req->mi)
+			serve_req_dev(req, p);
+	}
+
+	return 0;
+}
+
+/*
+ * Reads what the client sent so far without blocking. Returns 1 once the
+ * request is complete, 0 while more is to come and an error otherwise.
+ */
+static int serve_conn_recv(struct serve_conn *conn)
+{
+	size_t hdr_len = sizeof(conn->hdr), len;
+	char *p;
+	ssize_t n;
+
+	for (;;) {
+		if (conn->received < hdr_len) {
+			p = (char *)&conn->hdr + conn->received;
+			len = hdr_len - conn->received;
+		} else {
+			if (!conn->req) {
+				if (!conn->hdr.len || conn->hdr.len > NVME_SERVE_MAX_LEN)
+					return -EINVAL;
+				conn->req = calloc(1, sizeof(*conn->req) + conn->hdr.len);
+				if (!conn->req)
+					return -ENOMEM;
+			}
+			len = conn->hdr.len - (conn->received - hdr_len);
+			if (!len)
+				return 1;
+			p = conn->req->buf + conn->received - hdr_len;
+		}
+
+		n = recv(conn->fd, p, len, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -errno;
+		if (!n)
+			return -EPIPE;
+		conn->received += n;
+	}
+}
+
+static void serve_conn_close(struct serve *sv, struct serve_conn *conn, int error)
+{
+	if (conn->fd >= 0) {
+		serve_reply(conn->fd, error);
+		close(conn->fd);
+	}
+	free(conn->req);
+	free(conn);
+	sv->nr_conns--;
+}
+
+/*
+ * Queues the request of the client once it came in completely. Returns true
+ * if the client is done with, and then it has been freed.
+ */
+static bool serve_conn_ready(struct serve *sv, struct serve_conn *conn)
+{
+	struct serve_req *req, **pp;
+	int err;
+
+	err = serve_conn_recv(conn);
+	if (!err)
+		return false;
+	if (err > 0)
+		err = serve_parse(conn->req, conn->hdr.len);
+	if (!err && sv->queued == NVME_SERVE_MAX_QUEUE)
+		err = -EBUSY;
+	if (err) {
+		serve_conn_close(sv, conn, err);
+		return true;
+	}
+
+	/* the worker writes the output as fast as the client takes it */
+	fcntl(conn->fd, F_SETFL, 0);
+	req = conn->req;
+	req->fd = conn->fd;
+	conn->req = NULL;
+	conn->fd = -1;
+	serve_conn_close(sv, conn, 0);
+
+	for (pp = &sv->queue; *pp; pp = &(*pp)->next)
+		;
+	*pp = req;
+	sv->queued++;
+
+	return true;
+}
+
+/* The request is read by the loop, a slow client keeps nobody else waiting */
+static void serve_accept(struct serve *sv)
+{
+	struct serve_conn *conn = NULL;
+	int fd, err = 0;
+
+	fd = accept4(sv->sock, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	if (fd < 0)
+		return;
+
+	if (!serve_peer_allowed(fd))
+		err = -EACCES;
+	else if (sv->nr_conns == NVME_SERVE_MAX_CONNS)
+		err = -EBUSY;
+	else if (!(conn = calloc(1, sizeof(*conn))))
+		err = -ENOMEM;
+	if (err) {
+		serve_reply(fd, err);
+		close(fd);
+		return;
+	}
+	conn->fd = fd;
+	conn->accepted = time(NULL);
+	conn->next = sv->conns;
+	sv->conns = conn;
+	sv->nr_conns++;
+}
+
+/* Copies len bytes of the file from its start to the socket */
+static int serve_send_file(int sock, int fd, size_t len)
+{
+	char buf[0x4000];
+	off_t off = 0;
+	ssize_t n;
+	int err;
+
+	while (len) {
+		n = pread(fd, buf, len < sizeof(buf) ? len : sizeof(buf), off);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return n ? -errno : -EIO;
+		err = serve_send(sock, buf, n);
+		if (err)
+			return err;
+		off += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* Runs in the forked worker, the output of the command goes to the client */
+static void serve_worker(struct serve *sv, struct serve_req *req)
+{
+	struct nvme_serve_resp_hdr hdr = { 0 };
+	FILE *out, *err;
+
+	serve_signals(SIG_DFL);
+	close(sv->sock);
+	close(sv->wakeup[0]);
+	close(sv->wakeup[1]);
+
+	out = tmpfile();
+	err = tmpfile();
+	if (!out || !err ||
+	    dup2(fileno(out), STDOUT_FILENO) < 0 || dup2(fileno(err), STDERR_FILENO) < 0) {
+		serve_reply(req->fd, -errno);
+		_exit(1);
+	}
+
+	hdr.status = sv->ops->run(req->argc, req->argv);
+	fflush(stdout);
+	fflush(stderr);
+
+	hdr.out_len = lseek(fileno(out), 0, SEEK_END);
+	hdr.err_len = lseek(fileno(err), 0, SEEK_END);
+	if (serve_send(req->fd, &hdr, sizeof(hdr)) ||
+	    serve_send_file(req->fd, fileno(out), hdr.out_len) ||
+	    serve_send_file(req->fd, fileno(err), hdr.err_len))
+		_exit(1);
+
+	_exit(0);
+}
+
+static void serve_start(struct serve *sv, struct serve_req *req)
+{
+	/* nothing buffered may end up in the output of the worker */
+	fflush(stdout);
+	fflush(stderr);
+
+	req->pid = fork();
+	if (!req->pid)
+		serve_worker(sv, req);
+
+	if (req->pid < 0) {
+		serve_reply(req->fd, -errno);
+		close(req->fd);
+		free(req);
+		return;
+	}
+
+	close(req->fd);
+	req->fd = -1;
+	req->next = sv->workers;
+	sv->workers = req;
+	sv->running++;
+}
+
+static bool serve_dev_busy(struct serve *sv, struct serve_req *req)
+{
+	struct serve_req *w;
+
+	for (w = sv->workers; w; w = w->next) {
+		if (req->rdev && w->rdev == req->rdev)
+			return true;
+		if (req->mi && w->mi && !strcmp(w->mi, req->mi))
+			return true;
+	}
+
+	return false;
+}
+
+/* Whether a command run by any nvme process may have changed the data */
+static bool serve_changed(struct serve *sv)
+{
+	__u64 changes = nvme_cmd_cache_changes();
+
+	if (changes == sv->changes)
+		return false;
+
+	sv->changes = changes;
+	return true;
+}
+
+/* Starts the queued requests whose device is idle, in the order they came */
+static void serve_dispatch(struct serve *sv)
+{
+	struct serve_req **pp = &sv->queue, *req;
+
+	if (serve_changed(sv))
+		sv->stale = true;
+	if (sv->stale) {
+		/* workers would see the data being replaced */
+		if (sv->workers)
+			return;
+		sv->ops->refresh();
+		sv->stale = false;
+		sv->refreshed = time(NULL);
+	}
+
+	while ((req = *pp) && sv->running < sv->jobs) {
+		if (serve_dev_busy(sv, req)) {
+			pp = &req->next;
+			continue;
+		}
+		*pp = req->next;
+		sv->queued--;
+		serve_start(sv, req);
+	}
+}
+
+static void serve_reap(struct serve *sv, int options)
+{
+	struct serve_req **pp, *req;
+	pid_t pid;
+
+	while ((pid = waitpid(-1, NULL, options)) > 0) {
+		for (pp = &sv->workers; (req = *pp); pp = &req->next) {
+			if (req->pid != pid)
+				continue;
+			*pp = req->next;
+			sv->running--;
+			/* e.g. a namespace may have been created */
+			if (!nvme_serve_read_only(req->argv[0]))
+				sv->stale = true;
+			free(req);
+			break;
+		}
+		if (!sv->workers)
+			break;
+	}
+}
+
+static void serve_drain(int fd)
+{
+	char buf[64];
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+}
+
+static int serve_listen(const char *path)
+{
+	struct sockaddr_un addr = {
+		.sun_family = AF_UNIX,
+	};
+	_cleanup_file_ int probe = -1;
+	mode_t mask;
+	int sock, err;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -ENAMETOOLONG;
+	strcpy(addr.sun_path, path);
+
+	/* a socket left behind by a server which is gone is replaced */
+	probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (probe < 0)
+		return -errno;
+	if (!connect(probe, (struct sockaddr *)&addr, sizeof(addr)))
+		return -EADDRINUSE;
+	unlink(path);
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return -errno;
+
+	/* only clients allowed to use the devices may connect */
+	mask = umask(0177);
+	err = bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+	if (err || listen(sock, SOMAXCONN)) {
+		err = -errno;
+		close(sock);
+		return err;
+	}
+
+	return sock;
+}
+
+/*
+ * Serves requests until interrupted. The data the workers start with is
+ * refreshed before the first request, after any command which may have
+ * changed it and as often as the topology snapshot is.
+ */
+int nvme_serve(const char *path, int jobs, const struct nvme_serve_ops *ops)
+{
+	struct serve sv = {
+		.ops = ops,
+		.jobs = jobs,
+		.stale = true,
+	};
+	struct pollfd fds[2 + NVME_SERVE_MAX_CONNS];
+	struct serve_conn *conn, *next, **pp;
+	struct serve_req *req;
+	int i, nfds, err = 0;
+	time_t now;
+
+	sv.sock = serve_listen(path);
+	if (sv.sock < 0)
+		return sv.sock;
+
+	if (pipe2(sv.wakeup, O_CLOEXEC | O_NONBLOCK)) {
+		err = -errno;
+		goto close_sock;
+	}
+	serve_wakeup_fd = sv.wakeup[1];
+	serve_signals(serve_signal);
+
+	/* the data is read before the first request anyway */
+	serve_changed(&sv);
+
+	while (!serve_stop) {
+		if (time(NULL) - sv.refreshed >= NVME_SNAPSHOT_MAX_AGE)
+			sv.stale = true;
+		serve_dispatch(&sv);
+
+		fds[0].fd = sv.sock;
+		fds[0].events = POLLIN;
+		fds[1].fd = sv.wakeup[0];
+		fds[1].events = POLLIN;
+		for (conn = sv.conns, nfds = 2; conn; conn = conn->next, nfds++) {
+			fds[nfds].fd = conn->fd;
+			fds[nfds].events = POLLIN;
+		}
+		if (poll(fds, nfds, sv.conns ? NVME_SERVE_RECV_TIMEOUT * 1000 :
+			 NVME_SNAPSHOT_MAX_AGE * 1000) < 0) {
+			if (errno == EINTR)
+				continue;
+			err = -errno;
+			break;
+		}
+
+		if (fds[1].revents & POLLIN) {
+			serve_drain(sv.wakeup[0]);
+			serve_reap(&sv, WNOHANG);
+		}
+
+		/* fds follow the list of clients, which only grows below */
+		now = time(NULL);
+		for (pp = &sv.conns, i = 2; (conn = *pp); i++) {
+			next = conn->next;
+			if (fds[i].revents && serve_conn_ready(&sv, conn)) {
+				*pp = next;
+			} else if (now - conn->accepted > NVME_SERVE_RECV_TIMEOUT) {
+				*pp = next;
+				serve_conn_close(&sv, conn, -ETIMEDOUT);
+			} else {
+				pp = &conn->next;
+			}
+		}
+
+		if (fds[0].revents & POLLIN)
+			serve_accept(&sv);
+	}
+
+	while ((conn = sv.conns)) {
+		sv.conns = conn->next;
+		serve_conn_close(&sv, conn, -ESHUTDOWN);
+	}
+
+	while ((req = sv.queue)) {
+		sv.queue = req->next;
+		serve_reply(req->fd, -ESHUTDOWN);
+		close(req->fd);
+		free(req);
+	}
+	if (sv.workers)
+		serve_reap(&sv, 0);
+
+	serve_signals(SIG_DFL);
+	close(sv.wakeup[0]);
+	close(sv.wakeup[1]);
+close_sock:
+	close(sv.sock);
+	unlink(path);
+
+	return err;
+}
+
+/* Copies len bytes from the socket to fd */
+static int serve_copy(int sock, int fd, size_t len)
+{
+	char buf[0x4000];
+	size_t n;
+	int err;
+
+	while (len) {
+		n = len < sizeof(buf) ? len : sizeof(buf);
+		err = serve_read(sock, buf, n);
+		if (!err)
+			err = serve_write(fd, buf, n);
+		if (err)
+			return err;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Runs a read only command on the server at path. Returns 0 with the status
+ * of the command once the server took the request. Otherwise the command has
+ * not run and the error is returned.
+ */
+int nvme_serve_forward(const char *path, int argc, char **argv, int *status)
+{
+	struct sockaddr_un addr = {
+		.sun_family = AF_UNIX,
+	};
+	struct nvme_serve_req_hdr req = { 0 };
+	struct nvme_serve_resp_hdr resp;
+	_cleanup_free_ char *buf = NULL;
+	_cleanup_file_ int fd = -1;
+	char *p;
+	int i, err;
+
+	if (!argc || argc > NVME_SERVE_MAX_ARGS || !nvme_serve_read_only(argv[0]))
+		return -EOPNOTSUPP;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -ENAMETOOLONG;
+	strcpy(addr.sun_path, path);
+
+	for (i = 0; i < argc; i++)
+		req.len += strlen(argv[i]) + 1;
+	if (req.len > NVME_SERVE_MAX_LEN)
+		return -E2BIG;
+
+	buf = malloc(req.len);
+	if (!buf)
+		return -ENOMEM;
+	for (i = 0, p = buf; i < argc; i++)
+		p = stpcpy(p, argv[i]) + 1;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		return -errno;
+	/* its output is passed on as ours, so the server has to be trusted */
+	if (!serve_peer_allowed(fd))
+		return -EACCES;
+
+	err = serve_send(fd, &req, sizeof(req));
+	if (!err)
+		err = serve_send(fd, buf, req.len);
+	if (!err)
+		err = serve_read(fd, &resp, sizeof(resp));
+	if (!err)
+		err = resp.error;
+	if (err)
+		return err;
+
+	*status = resp.status;
+	err = serve_copy(fd, STDOUT_FILENO, resp.out_len);
+	if (!err)
+		err = serve_copy(fd, STDERR_FILENO, resp.err_len);
+	if (err && !*status)
+		*status = err;
+
+	return 0;
+}
@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef NVME_SERVE_H
+#define NVME_SERVE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define NVME_SERVE_SOCKET		RUNDIR "/nvme/serve.sock"
+
+/* limits of a request */
+#define NVME_SERVE_MAX_LEN		0x10000
+#define NVME_SERVE_MAX_ARGS		256
+
+/*
+ * A request is the length of the arguments followed by the arguments, each
+ * terminated by a NUL, the command name first. The response is the status
+ * the command returned and the lengths of its standard output and error,
+ * followed by both. If the server could not run the command, error is set
+ * instead.
+ */
+struct nvme_serve_req_hdr {
+	uint32_t	len;
+};
+
+struct nvme_serve_resp_hdr {
+	int32_t		error;
+	int32_t		status;
+	uint32_t	out_len;
+	uint32_t	err_len;
+};
+
+struct nvme_serve_ops {
+	/* runs a command in a worker, returns its status */
+	int (*run)(int argc, char **argv);
+	/* reopens the devices and rereads the identify data */
+	void (*refresh)(void);
+};
+
+bool nvme_serve_read_only(const char *cmd);
+int nvme_serve(const char *path, int jobs, const struct nvme_serve_ops *ops);
+int nvme_serve_forward(const char *path, int argc, char **argv, int *status);
+
+#endif
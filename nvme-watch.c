@@ -0,0 +1,302 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * nvme watch: samples the health logs of many devices on a fixed schedule
+ * and reports what changed from one sample to the next as rates.
+ *
+ * The samples of a round are taken in parallel, so a slow device does not
+ * delay the others. Rates are computed over the time between the samples of
+ * each device, so late samples do not skew them, and the schedule is kept
+ * with absolute deadlines, so it does not drift.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libnvme.h>
+
+#include "common.h"
+#include "nvme-scan.h"
+#include "nvme-watch.h"
+#include "util/json-stream.h"
+#include "util/mem.h"
+#include "util/parallel.h"
+#include "util/types.h"
+
+/* data units of the SMART and endurance group logs */
+#define WATCH_DATA_UNIT			512000.0
+
+/* OCP SMART / health information extended log */
+#define WATCH_OCP_LID			0xc0
+#define WATCH_OCP_LEN			512
+#define WATCH_OCP_PMUW			0	/* physical media units written, bytes */
+#define WATCH_OCP_GUID			496
+
+static const __u8 watch_ocp_guid[16] = {
+	0xc5, 0xaf, 0x10, 0x28, 0xea, 0xbf, 0xf2, 0xa4,
+	0x9c, 0x4f, 0x6f, 0x7c, 0xc9, 0x14, 0xd5, 0xaf,
+};
+
+/* the column header is repeated after this many lines */
+#define WATCH_HEADER_LINES		24
+
+struct watch_sample {
+	struct timespec ts;
+	bool smart_valid;
+	struct nvme_smart_log smart;
+	bool ocp_valid;
+	long double media_written;	/* bytes */
+	bool endurance_valid;
+	struct nvme_endurance_group_log endurance;
+};
+
+struct watch_state {
+	struct nvme_watch_dev *dev;
+	struct watch_sample samples[2];
+	int cur;
+};
+
+struct watch_ctx {
+	struct watch_state *states;
+	unsigned int logs;
+};
+
+struct watch_rates {
+	double interval;		/* seconds */
+	double read_mbps;
+	double write_mbps;
+	double read_iops;
+	double write_iops;
+	double media_errors_per_hour;
+	long temperature;		/* Celsius */
+	int percent_used;
+	double waf;			/* < 0 if unknown */
+};
+
+static void watch_read_ocp(int fd, struct watch_sample *s)
+{
+	__u8 *log;
+
+	log = nvme_alloc(WATCH_OCP_LEN);
+	if (!log)
+		return;
+
+	if (!nvme_get_log_simple(fd, WATCH_OCP_LID, WATCH_OCP_LEN, log) &&
+	    !memcmp(&log[WATCH_OCP_GUID], watch_ocp_guid, sizeof(watch_ocp_guid))) {
+		s->media_written = int128_to_double(&log[WATCH_OCP_PMUW]);
+		s->ocp_valid = true;
+	}
+
+	free(log);
+}
+
+static void watch_sample_dev(int i, void *arg)
+{
+	struct watch_ctx *ctx = arg;
+	struct watch_state *st = &ctx->states[i];
+	struct watch_sample *s = &st->samples[st->cur];
+	struct nvme_watch_dev *dev = st->dev;
+
+	s->smart_valid = !nvme_get_log_smart(dev->fd, NVME_NSID_ALL, false, &s->smart);
+	clock_gettime(CLOCK_MONOTONIC, &s->ts);
+
+	s->ocp_valid = false;
+	if (ctx->logs & NVME_WATCH_OCP)
+		watch_read_ocp(dev->fd, s);
+
+	s->endurance_valid = false;
+	if ((ctx->logs & NVME_WATCH_ENDURANCE) && dev->endgid)
+		s->endurance_valid = !nvme_get_log_endurance_group(dev->fd, dev->endgid,
+								   &s->endurance);
+}
+
+static double watch_delta(__u8 *cur, __u8 *prev)
+{
+	return int128_to_double(cur) - int128_to_double(prev);
+}
+
+static double watch_elapsed(const struct timespec *from, const struct timespec *to)
+{
+	return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+/* Returns false if the two samples cannot be compared */
+static bool watch_rates(struct watch_sample *prev, struct watch_sample *cur,
+			struct watch_rates *r)
+{
+	double host, media;
+
+	if (!prev->smart_valid || !cur->smart_valid)
+		return false;
+
+	r->interval = watch_elapsed(&prev->ts, &cur->ts);
+	if (r->interval <= 0)
+		return false;
+
+	r->read_mbps = watch_delta(cur->smart.data_units_read, prev->smart.data_units_read) *
+		WATCH_DATA_UNIT / 1e6 / r->interval;
+	r->write_mbps = watch_delta(cur->smart.data_units_written,
+				    prev->smart.data_units_written) *
+		WATCH_DATA_UNIT / 1e6 / r->interval;
+	r->read_iops = watch_delta(cur->smart.host_reads, prev->smart.host_reads) /
+		r->interval;
+	r->write_iops = watch_delta(cur->smart.host_writes, prev->smart.host_writes) /
+		r->interval;
+	r->media_errors_per_hour = watch_delta(cur->smart.media_errors,
+					       prev->smart.media_errors) * 3600 / r->interval;
+	r->temperature = kelvin_to_celsius(le16_to_cpu(*(__le16 *)cur->smart.temperature));
+	r->percent_used = cur->smart.percent_used;
+
+	/* write amplification, the data written to the media per host write */
+	r->waf = -1;
+	if (prev->ocp_valid && cur->ocp_valid) {
+		host = watch_delta(cur->smart.data_units_written,
+				   prev->smart.data_units_written) * WATCH_DATA_UNIT;
+		media = cur->media_written - prev->media_written;
+		if (host > 0)
+			r->waf = media / host;
+	} else if (prev->endurance_valid && cur->endurance_valid) {
+		host = watch_delta(cur->endurance.data_units_written,
+				   prev->endurance.data_units_written);
+		media = watch_delta(cur->endurance.media_units_written,
+				    prev->endurance.media_units_written);
+		if (host > 0)
+			r->waf = media / host;
+	}
+
+	return true;
+}
+
+static void watch_header(void)
+{
+	printf("%-8s  %-12s %9s %9s %9s %9s %5s %8s %6s %5s\n",
+	       "Time", "Device", "rMB/s", "wMB/s", "r/s", "w/s", "Temp", "MErr/h",
+	       "WAF", "Used");
+}
+
+static void watch_print(const char *time, const char *name, struct watch_rates *r)
+{
+	char waf[16] = "-";
+
+	if (r->waf >= 0)
+		snprintf(waf, sizeof(waf), "%.2f", r->waf);
+
+	printf("%-8s  %-12s %9.2f %9.2f %9.0f %9.0f %5ld %8.2f %6s %4d%%\n",
+	       time, name, r->read_mbps, r->write_mbps, r->read_iops, r->write_iops,
+	       r->temperature, r->media_errors_per_hour, waf, r->percent_used);
+}
+
+static void watch_json(struct json_stream *s, time_t now, const char *name,
+		       struct watch_rates *r)
+{
+	json_stream_begin_object(s, NULL);
+	json_stream_add_uint(s, "timestamp", now);
+	json_stream_add_str(s, "device", name);
+	json_stream_add_double(s, "interval", r->interval);
+	json_stream_add_double(s, "read_mb_per_sec", r->read_mbps);
+	json_stream_add_double(s, "write_mb_per_sec", r->write_mbps);
+	json_stream_add_double(s, "reads_per_sec", r->read_iops);
+	json_stream_add_double(s, "writes_per_sec", r->write_iops);
+	json_stream_add_int(s, "temperature", r->temperature);
+	json_stream_add_double(s, "media_errors_per_hour", r->media_errors_per_hour);
+	if (r->waf >= 0)
+		json_stream_add_double(s, "waf", r->waf);
+	else
+		json_stream_add_null(s, "waf");
+	json_stream_add_int(s, "percent_used", r->percent_used);
+	json_stream_end_object(s);
+}
+
+/* Moves the deadline to the next multiple of the interval after now */
+static void watch_next(struct timespec *next, unsigned int interval_ms)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	do {
+		next->tv_sec += interval_ms / 1000;
+		next->tv_nsec += (interval_ms % 1000) * 1000000L;
+		if (next->tv_nsec >= 1000000000L) {
+			next->tv_sec++;
+			next->tv_nsec -= 1000000000L;
+		}
+	} while (watch_elapsed(next, &now) >= 0);
+}
+
+int nvme_watch(struct nvme_watch_dev *devs, int nr, const struct nvme_watch_cfg *cfg)
+{
+	struct json_stream *s = NULL;
+	struct watch_state *states;
+	struct watch_sample *prev, *cur;
+	struct watch_ctx ctx;
+	struct watch_rates r;
+	struct timespec next;
+	unsigned int reports = 0, lines = 0;
+	char stamp[16];
+	time_t now;
+	int i, err = 0;
+
+	states = calloc(nr, sizeof(*states));
+	if (!states)
+		return -ENOMEM;
+	for (i = 0; i < nr; i++)
+		states[i].dev = &devs[i];
+
+	if (cfg->json) {
+		s = json_stream_open(stdout, JSON_STREAM_PLAIN);
+		if (!s) {
+			free(states);
+			return -ENOMEM;
+		}
+	}
+
+	ctx.states = states;
+	ctx.logs = cfg->logs;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (;;) {
+		nvme_parallel_for(nr, NVME_SCAN_JOBS, watch_sample_dev, &ctx);
+
+		/* the first round only provides the base of the rates */
+		if (reports++) {
+			now = time(NULL);
+			strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime(&now));
+
+			for (i = 0; i < nr; i++) {
+				cur = &states[i].samples[states[i].cur];
+				prev = &states[i].samples[!states[i].cur];
+				if (!watch_rates(prev, cur, &r))
+					continue;
+
+				if (s) {
+					watch_json(s, now, devs[i].name, &r);
+					continue;
+				}
+				if (!(lines++ % WATCH_HEADER_LINES))
+					watch_header();
+				watch_print(stamp, devs[i].name, &r);
+			}
+
+			if (s)
+				err = json_stream_flush(s);
+			else if (fflush(stdout))
+				err = -errno;
+			if (err || (cfg->count && reports > cfg->count))
+				break;
+		}
+
+		for (i = 0; i < nr; i++)
+			states[i].cur = !states[i].cur;
+
+		watch_next(&next, cfg->interval_ms);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+			;
+	}
+
+	if (s && json_stream_close(s) && !err)
+		err = -EIO;
+	free(states);
+
+	return err;
+}
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef NVME_WATCH_H
+#define NVME_WATCH_H
+
+#include <stdbool.h>
+
+#include <libnvme.h>
+
+/* logs read in addition to the SMART log */
+#define NVME_WATCH_OCP			(1 << 0)
+#define NVME_WATCH_ENDURANCE		(1 << 1)
+
+struct nvme_watch_dev {
+	const char	*name;
+	int		fd;
+	__u16		endgid;		/* 0 if there is no endurance group */
+};
+
+struct nvme_watch_cfg {
+	unsigned int	interval_ms;
+	unsigned int	count;		/* reports, 0 until interrupted */
+	unsigned int	logs;
+	bool		json;		/* a JSON line per device and report */
+};
+
+int nvme_watch(struct nvme_watch_dev *devs, int nr, const struct nvme_watch_cfg *cfg);
+
+#endif
@@ -32,6 +32,7 @@
 #include <getopt.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <locale.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -40,14 +41,17 @@
 #include <unistd.h>
 #include <math.h>
 #include <dirent.h>
+#include <ftw.h>
 #include <libgen.h>
 #include <signal.h>
+#include <time.h>
 
 #include <linux/fs.h>
 
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 
 #if HAVE_SYS_RANDOM
 	#include <sys/random.h>
@@ -60,12 +64,23 @@
 #include "nvme-print.h"
 #include "plugin.h"
 #include "util/base64.h"
+#include "util/cmd-cache.h"
+#include "util/cmdline.h"
 #include "util/crc32.h"
+#include "util/json-stream.h"
 #include "nvme-wrap.h"
+#include "nvme-scan.h"
+#include "nvme-fleet.h"
+#include "nvme-monitor.h"
+#include "nvme-serve.h"
+#include "nvme-watch.h"
 #include "util/argconfig.h"
 #include "util/suffix.h"
+#include "util/tar.h"
 #include "util/logging.h"
+#include "util/parallel.h"
 #include "fabrics.h"
+#include "plugins/ocp/ocp-smart-extended-log.h"
 #define CREATE_CMD
 #include "nvme-builtin.h"
 #include "malloc.h"
@@ -193,7 +208,7 @@ static struct program nvme = {
 	.extensions = &builtin,
 };
 
-const char *output_format = "Output format: normal|json|binary";
+const char *output_format = "Output format: normal|json|ndjson|cbor|binary";
 static const char *app_tag = "app tag for end-to-end PI";
 static const char *app_tag_mask = "app tag mask for end-to-end PI";
 static const char *block_count = "number of blocks (zeroes based) on device to access";
@@ -263,6 +278,7 @@ static char *output_format_val = "normal";
 int verbose_level;
 
 static void *mmap_registers(struct nvme_dev *dev, bool writable);
+static int run_cmd(int argc, char **argv);
 
 const char *nvme_strerror(int errnum)
 {
@@ -301,11 +317,90 @@ static bool is_blkdev(struct nvme_dev *dev)
 	return S_ISBLK(dev->direct.stat.st_mode);
 }
 
+/*
+ * Devices opened read only while running a batch of commands stay open
+ * until the batch ends, dev_close() leaves them alone.
+ */
+#define NVME_DEV_CACHE_MAX	256
+
+static struct {
+	bool enabled;
+	int nr;
+	struct nvme_dev *devs[NVME_DEV_CACHE_MAX];
+	char *paths[NVME_DEV_CACHE_MAX];
+} dev_cache;
+
+static struct nvme_dev *dev_cache_lookup(const char *devstr)
+{
+	int i;
+
+	for (i = 0; i < dev_cache.nr; i++) {
+		if (!strcmp(dev_cache.paths[i], devstr))
+			return dev_cache.devs[i];
+	}
+
+	return NULL;
+}
+
+/* The name of a cached device must outlive the command line */
+static void dev_cache_add(struct nvme_dev *dev, const char *devstr)
+{
+	char *path;
+
+	if (dev_cache.nr == NVME_DEV_CACHE_MAX)
+		return;
+
+	path = strdup(devstr);
+	if (!path)
+		return;
+
+	dev->name = basename(path);
+	dev_cache.paths[dev_cache.nr] = path;
+	dev_cache.devs[dev_cache.nr++] = dev;
+}
+
+static bool dev_cache_contains(struct nvme_dev *dev)
+{
+	int i;
+
+	for (i = 0; i < dev_cache.nr; i++) {
+		if (dev_cache.devs[i] == dev)
+			return true;
+	}
+
+	return false;
+}
+
+static void dev_cache_enable(void)
+{
+	dev_cache.enabled = true;
+}
+
+static void dev_cache_release(void)
+{
+	int i;
+
+	dev_cache.enabled = false;
+	for (i = 0; i < dev_cache.nr; i++) {
+		dev_close(dev_cache.devs[i]);
+		free(dev_cache.paths[i]);
+	}
+	dev_cache.nr = 0;
+}
+
 static int open_dev_direct(struct nvme_dev **devp, char *devstr, int flags)
 {
 	struct nvme_dev *dev;
 	int err;
 
+	if (dev_cache.enabled && flags == O_RDONLY) {
+		dev = dev_cache_lookup(devstr);
+		if (dev) {
+			*devp = dev;
+			return 0;
+		}
+	}
+
 	dev = calloc(1, sizeof(*dev));
 	if (!dev)
 		return -1;
@@ -330,6 +425,8 @@ static int open_dev_direct(struct nvme_dev **devp, char *devstr, int flags)
 		err = -1;
 		goto err_close;
 	}
+	if (dev_cache.enabled && flags == O_RDONLY)
+		dev_cache_add(dev, devstr);
 	*devp = dev;
 	return 0;
 
@@ -476,7 +573,7 @@ int open_exclusive(struct nvme_dev **dev, int argc, char **argv,
 	return get_dev(dev, argc, argv, flags);
 }
 
-int validate_output_format(const char *format, enum nvme_print_flags *flags)
+static int output_format_flags(const char *format, enum nvme_print_flags *flags)
 {
 	enum nvme_print_flags f;
 
@@ -487,8 +584,14 @@ int validate_output_format(const char *format, enum nvme_print_flags *flags)
 		f = NORMAL;
 	else if (!strcmp(format, "json"))
 		f = JSON;
+	else if (!strcmp(format, "ndjson"))
+		f = JSON | NDJSON;
+	else if (!strcmp(format, "cbor"))
+		f = JSON | CBOR;
 	else if (!strcmp(format, "binary"))
 		f = BINARY;
+	else if (!strcmp(format, "openmetrics"))
+		f = OPENMETRICS;
 	else
 		return -EINVAL;
 
@@ -497,18 +600,66 @@ int validate_output_format(const char *format, enum nvme_print_flags *flags)
 	return 0;
 }
 
+/*
+ * Parses the output format of a command. It also selects the encoding of
+ * JSON documents printed directly with json_print_object(), e.g. by the
+ * plugins.
+ */
+int validate_output_format(const char *format, enum nvme_print_flags *flags)
+{
+	int err;
+
+	err = output_format_flags(format, flags);
+	if (err)
+		return err;
+
+#ifdef CONFIG_JSONC
+	if (*flags & CBOR)
+		util_json_set_print_format(JSON_STREAM_CBOR);
+	else if (*flags & NDJSON)
+		util_json_set_print_format(JSON_STREAM_PLAIN);
+	else
+		util_json_set_print_format(JSON_STREAM_PRETTY);
+#endif
+
+	return 0;
+}
+
 bool nvme_is_output_format_json(void)
 {
 	enum nvme_print_flags flags;
 
-	if (validate_output_format(output_format_val, &flags))
+	if (output_format_flags(output_format_val, &flags))
+		return false;
+
+	return flags & JSON;
+}
+
+bool nvme_is_output_format_ndjson(void)
+{
+	enum nvme_print_flags flags;
+
+	if (output_format_flags(output_format_val, &flags))
 		return false;
 
-	return flags == JSON;
+	return flags & NDJSON;
+}
+
+bool nvme_is_output_format_cbor(void)
+{
+	enum nvme_print_flags flags;
+
+	if (output_format_flags(output_format_val, &flags))
+		return false;
+
+	return flags & CBOR;
 }
 
 void dev_close(struct nvme_dev *dev)
 {
+	if (dev_cache.enabled && dev_cache_contains(dev))
+		return;
+
 	switch (dev->type) {
 	case NVME_DEV_DIRECT:
 		close(dev_fd(dev));
@@ -2609,7 +2760,7 @@ static int list_ns(int argc, char **argv, struct command *cmd, struct plugin *pl
 		return err;
 
 	err = validate_output_format(output_format_val, &flags);
-	if (err < 0 || (flags != JSON && flags != NORMAL)) {
+	if (err < 0 || flags == BINARY) {
 		nvme_show_error("Invalid output format");
 		return -EINVAL;
 	}
@@ -2731,7 +2882,7 @@ static int id_endurance_grp_list(int argc, char **argv, struct command *cmd,
 		return err;
 
 	err = validate_output_format(output_format_val, &flags);
-	if (err < 0 || (flags != JSON && flags != NORMAL)) {
+	if (err < 0 || flags == BINARY) {
 		nvme_show_error("invalid output format");
 		return -EINVAL;
 	}
@@ -2791,9 +2942,10 @@ static int delete_ns(int argc, char **argv, struct command *cmd, struct plugin *
 	}
 
 	err = nvme_cli_ns_mgmt_delete(dev, cfg.namespace_id);
-	if (!err)
+	if (!err) {
 		printf("%s: Success, deleted nsid:%d\n", cmd->name, cfg.namespace_id);
-	else if (err > 0)
+		nvme_cli_snapshot_invalidate();
+	} else if (err > 0)
 		nvme_show_status(err);
 	else
 		nvme_show_error("delete namespace: %s", nvme_strerror(errno));
@@ -2863,12 +3015,14 @@ static int nvme_attach_ns(int argc, char **argv, int attach, const char *desc, s
 		err = nvme_cli_ns_detach_ctrls(dev, cfg.namespace_id,
 					       cntlist);
 
-	if (!err)
+	if (!err) {
 		printf("%s: Success, nsid:%d\n", cmd->name, cfg.namespace_id);
-	else if (err > 0)
+		nvme_cli_snapshot_invalidate();
+	} else if (err > 0) {
 		nvme_show_status(err);
-	else
+	} else {
 		nvme_show_perror(attach ? "attach namespace" : "detach namespace");
+	}
 
 	return err;
 }
@@ -3235,9 +3389,10 @@ parse_lba:
 		data->phndl[i] = cpu_to_le16(phndl[i]);
 
 	err = nvme_cli_ns_mgmt_create(dev, data, &nsid, cfg.timeout, cfg.csi);
-	if (!err)
+	if (!err) {
 		printf("%s: Success, created nsid:%d\n", cmd->name, nsid);
-	else if (err > 0)
+		nvme_cli_snapshot_invalidate();
+	} else if (err > 0)
 		nvme_show_status(err);
 	else
 		nvme_show_error("create namespace: %s", nvme_strerror(errno));
@@ -3302,7 +3457,7 @@ static int list_subsys(int argc, char **argv, struct command *cmd,
 		devname = basename(argv[optind++]);
 
 	err = validate_output_format(output_format_val, &flags);
-	if (err < 0 || (flags != JSON && flags != NORMAL)) {
+	if (err < 0 || flags == BINARY) {
 		nvme_show_error("Invalid output format");
 		return -EINVAL;
 	}
@@ -3330,7 +3485,7 @@ static int list_subsys(int argc, char **argv, struct command *cmd,
 		filter = nvme_match_device_filter;
 	}
 
-	err = nvme_scan_topology(r, filter, (void *)devname);
+	err = nvme_cli_scan_topology(r, filter, (void *)devname);
 	if (err) {
 		if (errno != ENOENT)
 			nvme_show_error("Failed to scan topology: %s", nvme_strerror(errno));
@@ -3356,7 +3511,7 @@ static int list(int argc, char **argv, struct command *cmd, struct plugin *plugi
 		return err;
 
 	err = validate_output_format(output_format_val, &flags);
-	if (err < 0 || (flags != JSON && flags != NORMAL)) {
+	if (err < 0 || flags == BINARY) {
 		nvme_show_error("Invalid output format");
 		return -EINVAL;
 	}
@@ -3369,7 +3524,7 @@ static int list(int argc, char **argv, struct command *cmd, struct plugin *plugi
 		nvme_show_error("Failed to create topology root: %s", nvme_strerror(errno));
 		return -errno;
 	}
-	err = nvme_scan_topology(r, NULL, NULL);
+	err = nvme_cli_scan_topology(r, NULL, NULL);
 	if (err < 0) {
 		if (errno != ENOENT)
 			nvme_show_error("Failed to scan topology: %s", nvme_strerror(errno));
@@ -4040,7 +4195,7 @@ static int id_domain(int argc, char **argv, struct command *cmd, struct plugin *
 {
 	const char *desc = "Send an Identify Domain List command to the "
 		"given device, returns properties of the specified domain "
-		"in either normal|json|binary format.";
+		"in either normal|json|ndjson|cbor|binary format.";
 	const char *domain_id = "identifier of desired domain";
 
 	_cleanup_free_ struct nvme_id_domain_list *id_domain = NULL;
@@ -5117,6 +5272,7 @@ static int fw_commit(int argc, char **argv, struct command *cmd, struct plugin *
 			printf(" bpid:%d", cfg.bpid);
 		printf("\n");
 		fw_commit_print_mud(dev, result);
+		nvme_cli_snapshot_invalidate();
 	}
 
 	return err;
@@ -5282,6 +5438,8 @@ static int sanitize_cmd(int argc, char **argv, struct command *cmd, struct plugi
 		nvme_show_error("sanitize: %s", nvme_strerror(errno));
 	else if (err > 0)
 		nvme_show_status(err);
+	else
+		nvme_cli_snapshot_invalidate();
 
 	return err;
 }
@@ -6292,6 +6450,7 @@ static int format_cmd(int argc, char **argv, struct command *cmd, struct plugin
 		nvme_show_status(err);
 	} else {
 		printf("Success formatting namespace:%x\n", cfg.namespace_id);
+		nvme_cli_snapshot_invalidate();
 		if (dev->type == NVME_DEV_DIRECT && cfg.lbaf != prev_lbaf) {
 			if (is_chardev(dev)) {
 				if (ioctl(dev_fd(dev), NVME_IOCTL_RESCAN) < 0) {
@@ -9558,7 +9717,7 @@ static int show_topology_cmd(int argc, char **argv, struct command *command, str
 		return -errno;
 	}
 
-	err = nvme_scan_topology(r, NULL, NULL);
+	err = nvme_cli_scan_topology(r, NULL, NULL);
 	if (err < 0) {
 		if (errno != ENOENT)
 			nvme_show_error("Failed to scan topology: %s", nvme_strerror(errno));
@@ -9571,160 +9730,2346 @@ static int show_topology_cmd(int argc, char **argv, struct command *command, str
 	return err;
 }
 
-static int discover_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
+static int snapshot_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
 {
-	const char *desc = "Send Get Log Page request to Discovery Controller.";
+	const char *desc = "Save the identification descriptors of all namespaces "
+		"to a snapshot which list, list-subsys and show-topology use instead "
+		"of querying them, as long as no namespace was added or removed and "
+		"the snapshot is recent. The utilization is always read anew.";
+	const char *watch = "keep the snapshot up to date until interrupted";
+	const char *invalidate = "remove the snapshot";
+	int err;
 
-	return nvmf_discover(desc, argc, argv, false);
-}
+	struct config {
+		bool	watch;
+		bool	invalidate;
+	};
 
-static int connect_all_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
-{
-	const char *desc = "Discover NVMeoF subsystems and connect to them";
+	struct config cfg = {
+		.watch		= false,
+		.invalidate	= false,
+	};
 
-	return nvmf_discover(desc, argc, argv, true);
-}
+	NVME_ARGS(opts,
+		  OPT_FLAG("watch",      'w', &cfg.watch,      watch),
+		  OPT_FLAG("invalidate", 'i', &cfg.invalidate, invalidate));
 
-static int connect_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
-{
-	const char *desc = "Connect to NVMeoF subsystem";
+	err = parse_args(argc, argv, desc, opts);
+	if (err)
+		return err;
 
-	return nvmf_connect(desc, argc, argv);
-}
+	if (cfg.invalidate)
+		err = nvme_cli_snapshot_invalidate();
+	else if (cfg.watch)
+		err = nvme_cli_snapshot_watch();
+	else
+		err = nvme_cli_snapshot_update();
 
-static int disconnect_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
-{
-	const char *desc = "Disconnect from NVMeoF subsystem";
+	if (err)
+		nvme_show_error("snapshot: %s", nvme_strerror(-err));
 
-	return nvmf_disconnect(desc, argc, argv);
+	return err;
 }
 
-int disconnect_all_cmd(int argc, char **argv, struct command *command,
-	struct plugin *plugin)
+struct metrics_ctx {
+	nvme_ctrl_t *ctrls;
+	struct nvme_metrics *metrics;
+};
+
+/* The OCP extended SMART log, if the controller lists it and it has the OCP GUID */
+static void *metrics_ocp_smart(int fd)
 {
-	const char *desc = "Disconnect from all connected NVMeoF subsystems";
+	_cleanup_free_ struct nvme_supported_log_pages *supported = NULL;
+	static const __u8 guid[C0_GUID_LENGTH] = C0_SMART_CLOUD_ATTR_GUID;
+	__u8 *log;
 
-	return nvmf_disconnect_all(desc, argc, argv);
-}
+	supported = nvme_alloc(sizeof(*supported));
+	if (!supported || nvme_get_log_supported_log_pages(fd, false, supported) ||
+	    !(le32_to_cpu(supported->lid_support[C0_SMART_CLOUD_ATTR_OPCODE]) & 0x1))
+		return NULL;
 
-static int config_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
-{
-	const char *desc = "Configuration of NVMeoF subsystems";
+	log = nvme_alloc(C0_SMART_CLOUD_ATTR_LEN);
+	if (log && (nvme_get_log_simple(fd, C0_SMART_CLOUD_ATTR_OPCODE,
+					C0_SMART_CLOUD_ATTR_LEN, log) ||
+		    memcmp(&log[SCAO_LPG], guid, sizeof(guid)))) {
+		free(log);
+		log = NULL;
+	}
 
-	return nvmf_config(desc, argc, argv);
+	return log;
 }
 
-static int dim_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
+/* Logs which cannot be read are left out of the exposition */
+static void metrics_fetch(int i, void *arg)
 {
-	const char *desc =
-	    "Send Discovery Information Management command to a Discovery Controller (DC)";
+	struct metrics_ctx *ctx = arg;
+	struct nvme_metrics *m = &ctx->metrics[i];
+	_cleanup_free_ struct nvme_id_ctrl *ctrl = NULL;
+	_cleanup_file_ int fd = -1;
+	char path[PATH_MAX];
+	int nr;
 
-	return nvmf_dim(desc, argc, argv);
-}
+	snprintf(path, sizeof(path), "/dev/%s", nvme_ctrl_get_name(ctx->ctrls[i]));
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return;
 
-static int nvme_mi(int argc, char **argv, __u8 admin_opcode, const char *desc)
-{
-	const char *opcode = "opcode (required)";
-	const char *data_len = "data I/O length (bytes)";
-	const char *nmimt = "nvme-mi message type";
-	const char *nmd0 = "nvme management dword 0 value";
-	const char *nmd1 = "nvme management dword 1 value";
-	const char *input = "data input or output file";
+	ctrl = nvme_alloc(sizeof(*ctrl));
+	if (!ctrl || nvme_identify_ctrl(fd, ctrl))
+		return;
 
-	int mode = 0644;
-	void *data = NULL;
-	int err = 0;
-	bool send;
-	_cleanup_file_ int fd = -1;
-	int flags;
-	_cleanup_huge_ struct nvme_mem_huge mh = { 0, };
-	_cleanup_nvme_dev_ struct nvme_dev *dev = NULL;
-	__u32 result;
+	m->smart = nvme_alloc(sizeof(*m->smart));
+	if (m->smart && nvme_get_log_smart(fd, NVME_NSID_ALL, false, m->smart)) {
+		free(m->smart);
+		m->smart = NULL;
+	}
 
-	struct config {
-		__u8 opcode;
-		__u32 namespace_id;
-		__u32 data_len;
-		__u32 nmimt;
-		__u32 nmd0;
-		__u32 nmd1;
-		char *input_file;
-	};
+	m->fw_log = nvme_alloc(sizeof(*m->fw_log));
+	if (m->fw_log && nvme_get_log_fw_slot(fd, false, m->fw_log)) {
+		free(m->fw_log);
+		m->fw_log = NULL;
+	}
 
-	struct config cfg = {
-		.opcode = 0,
-		.namespace_id = 0,
-		.data_len = 0,
-		.nmimt = 0,
-		.nmd0 = 0,
-		.nmd1 = 0,
-		.input_file = "",
-	};
+	nr = ctrl->elpe + 1;
+	m->err_log = nvme_alloc(nr * sizeof(*m->err_log));
+	if (m->err_log && !nvme_get_log_error(fd, nr, false, m->err_log)) {
+		m->err_entries = nr;
+	} else {
+		free(m->err_log);
+		m->err_log = NULL;
+	}
 
-	NVME_ARGS(opts,
-		  OPT_BYTE("opcode", 'O', &cfg.opcode, opcode),
-		  OPT_UINT("namespace-id", 'n', &cfg.namespace_id, namespace_desired),
-		  OPT_UINT("data-len", 'l', &cfg.data_len, data_len),
-		  OPT_UINT("nmimt", 'm', &cfg.nmimt, nmimt),
-		  OPT_UINT("nmd0", '0', &cfg.nmd0, nmd0),
-		  OPT_UINT("nmd1", '1', &cfg.nmd1, nmd1),
-		  OPT_FILE("input-file", 'i', &cfg.input_file, input));
+	m->ocp_smart = metrics_ocp_smart(fd);
 
-	err = parse_and_open(&dev, argc, argv, desc, opts);
+	if (!(le32_to_cpu(ctrl->ctratt) & NVME_CTRL_CTRATT_ENDURANCE_GROUPS))
+		return;
+
+	nr = le16_to_cpu(ctrl->endgidmax);
+	m->endurance = nvme_alloc(nr * sizeof(*m->endurance));
+	if (!m->endurance)
+		return;
+	while (m->nr_endurance < nr &&
+	       !nvme_get_log_endurance_group(fd, m->nr_endurance + 1,
+					     &m->endurance[m->nr_endurance]))
+		m->nr_endurance++;
+}
+
+static int metrics_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
+{
+	const char *desc = "Print the health logs of all NVMe controllers as one "
+		"OpenMetrics exposition, with the device, serial and model as labels.";
+	_cleanup_nvme_root_ nvme_root_t r = NULL;
+	_cleanup_free_ struct nvme_metrics *metrics = NULL;
+	_cleanup_free_ nvme_ctrl_t *ctrls = NULL;
+	struct metrics_ctx ctx;
+	nvme_subsystem_t s;
+	nvme_host_t h;
+	nvme_ctrl_t c;
+	int err, i, nr = 0;
+
+	NVME_ARGS(opts);
+
+	err = parse_args(argc, argv, desc, opts);
 	if (err)
 		return err;
 
-	if (admin_opcode == nvme_admin_nvme_mi_send) {
-		flags = O_RDONLY;
-		fd = STDIN_FILENO;
-		send = true;
-	} else {
-		flags = O_WRONLY | O_CREAT;
-		fd = STDOUT_FILENO;
-		send = false;
+	r = nvme_create_root(stderr, log_level);
+	if (!r) {
+		nvme_show_error("Failed to create topology root: %s", nvme_strerror(errno));
+		return -errno;
 	}
 
-	if (strlen(cfg.input_file)) {
-		fd = open(cfg.input_file, flags, mode);
-		if (fd < 0) {
-			nvme_show_perror(cfg.input_file);
-			return -EINVAL;
-		}
+	err = nvme_cli_scan_topology(r, NULL, NULL);
+	if (err < 0) {
+		if (errno != ENOENT)
+			nvme_show_error("Failed to scan topology: %s", nvme_strerror(errno));
+		return err;
 	}
 
-	if (cfg.data_len) {
-		data = nvme_alloc_huge(cfg.data_len, &mh);
-		if (!data)
-			return -ENOMEM;
+	nvme_for_each_host(r, h)
+		nvme_for_each_subsystem(h, s)
+			nvme_subsystem_for_each_ctrl(s, c)
+				nr++;
 
-		if (send) {
-			if (read(fd, data, cfg.data_len) < 0) {
-				err = -errno;
-				nvme_show_error("failed to read write buffer %s", strerror(errno));
-				return err;
+	ctrls = calloc(nr, sizeof(*ctrls));
+	metrics = calloc(nr, sizeof(*metrics));
+	if (nr && (!ctrls || !metrics))
+		return -ENOMEM;
+
+	i = 0;
+	nvme_for_each_host(r, h) {
+		nvme_for_each_subsystem(h, s) {
+			nvme_subsystem_for_each_ctrl(s, c) {
+				const char *serial = nvme_ctrl_get_serial(c);
+				const char *model = nvme_ctrl_get_model(c);
+				char *labels = metrics[i].labels;
+
+				om_add_label(labels, "device", nvme_ctrl_get_name(c),
+					     strlen(nvme_ctrl_get_name(c)));
+				if (serial)
+					om_add_label(labels, "serial", serial, strlen(serial));
+				if (model)
+					om_add_label(labels, "model", model, strlen(model));
+				ctrls[i++] = c;
 			}
 		}
 	}
 
-	err = nvme_cli_admin_passthru(dev, admin_opcode, 0, 0, cfg.namespace_id, 0, 0,
-				      cfg.nmimt << 11 | 4, cfg.opcode, cfg.nmd0, cfg.nmd1, 0, 0,
-				      cfg.data_len, data, 0, NULL, 0, &result);
-	if (err < 0) {
-		nvme_show_error("nmi_recv: %s", nvme_strerror(errno));
-	} else if (err) {
-		nvme_show_status(err);
-	} else  {
-		printf(
-		    "%s Command is Success and result: 0x%08x (status: 0x%02x, response: 0x%06x)\n",
-		    nvme_cmd_to_string(true, admin_opcode), result, result & 0xff, result >> 8);
-		if (result & 0xff)
-			printf("status: %s\n", nvme_mi_status_to_string(result & 0xff));
-		if (!send && strlen(cfg.input_file)) {
-			if (write(fd, (void *)data, cfg.data_len) < 0)
-				perror("failed to write data buffer");
-		} else if (data && !send && !err) {
-			d((unsigned char *)data, cfg.data_len, 16, 1);
-		}
+	ctx.ctrls = ctrls;
+	ctx.metrics = metrics;
+	nvme_parallel_for(nr, NVME_SCAN_JOBS, metrics_fetch, &ctx);
+
+	err = nvme_show_metrics(metrics, nr);
+	if (err)
+		nvme_show_error("metrics: %s", nvme_strerror(-err));
+
+	for (i = 0; i < nr; i++) {
+		free(metrics[i].smart);
+		free(metrics[i].err_log);
+		free(metrics[i].fw_log);
+		free(metrics[i].endurance);
+		free(metrics[i].ocp_smart);
+	}
+
+	return err;
+}
+
+/* Opens a device for nvme watch and finds its endurance group */
+static int watch_open(struct nvme_watch_dev *dev, const char *path)
+{
+	_cleanup_free_ struct nvme_id_ctrl *ctrl = NULL;
+
+	dev->fd = open(path, O_RDONLY);
+	if (dev->fd < 0)
+		return -errno;
+
+	ctrl = nvme_alloc(sizeof(*ctrl));
+	if (!ctrl)
+		return -ENOMEM;
+
+	/* the first endurance group covers the whole device in most cases */
+	if (!nvme_identify_ctrl(dev->fd, ctrl) &&
+	    (le32_to_cpu(ctrl->ctratt) & NVME_CTRL_CTRATT_ENDURANCE_GROUPS))
+		dev->endgid = 1;
+
+	return 0;
+}
+
+static int watch_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
+{
+	const char *desc = "Sample the SMART log of the given devices, or of all "
+		"controllers, at a fixed interval and print the throughput, "
+		"temperature, media error and write amplification rates between "
+		"two samples. JSON output prints a line per device and sample.";
+	const char *interval = "seconds between two samples";
+	const char *count = "number of reports, 0 until interrupted";
+	const char *ocp = "read the OCP SMART log for the write amplification";
+	const char *endurance = "read the endurance group log for the write amplification";
+	_cleanup_nvme_root_ nvme_root_t r = NULL;
+	_cleanup_free_ struct nvme_watch_dev *devs = NULL;
+	struct nvme_watch_cfg watch = { 0 };
+	enum nvme_print_flags flags;
+	char path[PATH_MAX], *name;
+	nvme_subsystem_t s;
+	nvme_host_t h;
+	nvme_ctrl_t c;
+	int err, i, nr = 0;
+
+	struct config {
+		unsigned int	interval;
+		unsigned int	count;
+		bool		ocp;
+		bool		endurance;
+	};
+
+	struct config cfg = {
+		.interval	= 1,
+		.count		= 0,
+		.ocp		= false,
+		.endurance	= false,
+	};
+
+	NVME_ARGS(opts,
+		  OPT_UINT("interval",  'i', &cfg.interval,  interval),
+		  OPT_UINT("count",     'c', &cfg.count,     count),
+		  OPT_FLAG("ocp",       'O', &cfg.ocp,       ocp),
+		  OPT_FLAG("endurance", 'E', &cfg.endurance, endurance));
+
+	err = parse_args(argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	err = validate_output_format(output_format_val, &flags);
+	if (err < 0 || (flags != NORMAL && (flags & ~NDJSON) != JSON)) {
+		nvme_show_error("Invalid output format");
+		return -EINVAL;
+	}
+
+	if (!cfg.interval) {
+		nvme_show_error("watch: interval must be at least 1 second");
+		return -EINVAL;
+	}
+
+	if (optind < argc) {
+		nr = argc - optind;
+		devs = calloc(nr, sizeof(*devs));
+		if (!devs)
+			return -ENOMEM;
+		for (i = 0; i < nr; i++) {
+			name = strrchr(argv[optind + i], '/');
+			devs[i].name = name ? name + 1 : argv[optind + i];
+		}
+	} else {
+		r = nvme_create_root(stderr, log_level);
+		if (!r) {
+			nvme_show_error("Failed to create topology root: %s",
+					nvme_strerror(errno));
+			return -errno;
+		}
+
+		err = nvme_cli_scan_topology(r, NULL, NULL);
+		if (err < 0) {
+			if (errno != ENOENT)
+				nvme_show_error("Failed to scan topology: %s",
+						nvme_strerror(errno));
+			return err;
+		}
+
+		nvme_for_each_host(r, h)
+			nvme_for_each_subsystem(h, s)
+				nvme_subsystem_for_each_ctrl(s, c)
+					nr++;
+		if (!nr) {
+			nvme_show_error("watch: no controllers found");
+			return -ENODEV;
+		}
+
+		devs = calloc(nr, sizeof(*devs));
+		if (!devs)
+			return -ENOMEM;
+
+		i = 0;
+		nvme_for_each_host(r, h)
+			nvme_for_each_subsystem(h, s)
+				nvme_subsystem_for_each_ctrl(s, c)
+					devs[i++].name = nvme_ctrl_get_name(c);
+	}
+
+	for (i = 0; i < nr; i++)
+		devs[i].fd = -1;
+
+	for (i = 0; i < nr; i++) {
+		if (optind < argc)
+			snprintf(path, sizeof(path), "%s", argv[optind + i]);
+		else
+			snprintf(path, sizeof(path), "/dev/%s", devs[i].name);
+		err = watch_open(&devs[i], path);
+		if (err) {
+			nvme_show_error("watch: %s: %s", path, nvme_strerror(-err));
+			goto close;
+		}
+	}
+
+	watch.interval_ms = cfg.interval * 1000;
+	watch.count = cfg.count;
+	watch.json = flags & JSON;
+	if (cfg.ocp)
+		watch.logs |= NVME_WATCH_OCP;
+	if (cfg.endurance)
+		watch.logs |= NVME_WATCH_ENDURANCE;
+
+	err = nvme_watch(devs, nr, &watch);
+	if (err)
+		nvme_show_error("watch: %s", nvme_strerror(-err));
+
+close:
+	for (i = 0; i < nr; i++) {
+		if (devs[i].fd >= 0)
+			close(devs[i].fd);
+	}
+
+	return err;
+}
+
+/* SMART / health critical warnings, the only events the kernel does not arm */
+#define MONITOR_AEC_SMART	0x3f
+
+struct monitor_ctrl {
+	const char *name;
+	int fd;
+	__u8 elpe;
+	__u32 aec;		/* the configuration found when arming */
+	bool armed;
+};
+
+struct monitor_ctx {
+	struct monitor_ctrl *ctrls;
+	int nr;
+	bool arm;
+	enum nvme_print_flags flags;
+	struct json_stream *s;
+};
+
+static struct monitor_ctrl *monitor_find(struct monitor_ctx *ctx, const char *name)
+{
+	int i;
+
+	for (i = 0; i < ctx->nr; i++) {
+		if (!strcmp(ctx->ctrls[i].name, name))
+			return &ctx->ctrls[i];
+	}
+
+	return NULL;
+}
+
+/* Enables the SMART / health events in the Asynchronous Event Configuration */
+static void monitor_arm(struct monitor_ctrl *c)
+{
+	__u32 aec, result;
+	int err;
+
+	err = nvme_get_features_simple(c->fd, NVME_FEAT_FID_ASYNC_EVENT, 0, &aec);
+	if (err) {
+		nvme_show_error("monitor: %s: get async event configuration: %s", c->name,
+				err < 0 ? nvme_strerror(errno) : nvme_status_to_string(err, false));
+		return;
+	}
+
+	if ((aec & MONITOR_AEC_SMART) == MONITOR_AEC_SMART)
+		return;
+
+	err = nvme_set_features_simple(c->fd, NVME_FEAT_FID_ASYNC_EVENT, 0,
+				       aec | MONITOR_AEC_SMART, false, &result);
+	if (err) {
+		nvme_show_error("monitor: %s: set async event configuration: %s", c->name,
+				err < 0 ? nvme_strerror(errno) : nvme_status_to_string(err, false));
+		return;
+	}
+
+	c->aec = aec;
+	c->armed = true;
+}
+
+static void monitor_disarm(struct monitor_ctrl *c)
+{
+	__u32 result;
+
+	if (c->armed && nvme_set_features_simple(c->fd, NVME_FEAT_FID_ASYNC_EVENT, 0,
+						 c->aec, false, &result))
+		nvme_show_error("monitor: %s: failed to restore the async event configuration",
+				c->name);
+	c->armed = false;
+}
+
+static void monitor_event(struct monitor_ctx *ctx, const char *name, const char *event,
+			  const char *desc)
+{
+	if (!ctx->s) {
+		printf("%s: %s: %s\n", name, event, desc);
+		fflush(stdout);
+		return;
+	}
+
+	json_stream_begin_object(ctx->s, NULL);
+	json_stream_add_uint(ctx->s, "timestamp", time(NULL));
+	json_stream_add_str(ctx->s, "device", name);
+	json_stream_add_str(ctx->s, "event", event);
+	json_stream_add_str(ctx->s, "description", desc);
+	json_stream_end_object(ctx->s);
+	json_stream_flush(ctx->s);
+}
+
+/*
+ * Reads the log page named by an event. Reading it with RAE cleared lets
+ * the controller report events of the same type again.
+ */
+static void monitor_log(struct monitor_ctrl *c, __u8 lid, enum nvme_print_flags flags)
+{
+	_cleanup_free_ void *log = NULL;
+	size_t len;
+	int err = 0;
+
+	switch (lid) {
+	case NVME_LOG_LID_ERROR:
+		len = (c->elpe + 1) * sizeof(struct nvme_error_log_page);
+		break;
+	case NVME_LOG_LID_SMART:
+		len = sizeof(struct nvme_smart_log);
+		break;
+	case NVME_LOG_LID_CHANGED_NS:
+		len = sizeof(struct nvme_ns_list);
+		break;
+	case NVME_LOG_LID_TELEMETRY_CTRL:
+		len = sizeof(struct nvme_telemetry_log);
+		break;
+	case NVME_LOG_LID_RESERVATION:
+		len = sizeof(struct nvme_resv_notification_log);
+		break;
+	case NVME_LOG_LID_SANITIZE:
+		len = sizeof(struct nvme_sanitize_log_page);
+		break;
+	default:
+		return;
+	}
+
+	log = nvme_alloc(len);
+	if (!log)
+		return;
+
+	switch (lid) {
+	case NVME_LOG_LID_ERROR:
+		err = nvme_get_log_error(c->fd, c->elpe + 1, false, log);
+		if (!err)
+			nvme_show_error_log(log, c->elpe + 1, c->name, flags);
+		break;
+	case NVME_LOG_LID_SMART:
+		err = nvme_get_log_smart(c->fd, NVME_NSID_ALL, false, log);
+		if (!err)
+			nvme_show_smart_log(log, NVME_NSID_ALL, c->name, flags);
+		break;
+	case NVME_LOG_LID_CHANGED_NS:
+		err = nvme_get_log_changed_ns_list(c->fd, false, log);
+		if (!err)
+			nvme_show_changed_ns_list_log(log, c->name, flags);
+		break;
+	case NVME_LOG_LID_TELEMETRY_CTRL:
+		/* the header clears the event, the data is for 'nvme telemetry-log' */
+		err = nvme_get_log_telemetry_ctrl(c->fd, false, 0, len, log);
+		break;
+	case NVME_LOG_LID_RESERVATION:
+		err = nvme_get_log_reservation(c->fd, false, log);
+		if (!err)
+			nvme_show_resv_notif_log(log, c->name, flags);
+		break;
+	case NVME_LOG_LID_SANITIZE:
+		err = nvme_get_log_sanitize(c->fd, false, log);
+		if (!err)
+			nvme_show_sanitize_log(log, c->name, flags);
+		break;
+	}
+
+	if (err)
+		nvme_show_error("monitor: %s: log page %#x: %s", c->name, lid,
+				err < 0 ? nvme_strerror(errno) : nvme_status_to_string(err, false));
+}
+
+static void monitor_aen(const char *name, __u32 result, void *arg)
+{
+	struct monitor_ctx *ctx = arg;
+	struct monitor_ctrl *c = monitor_find(ctx, name);
+	char desc[128];
+
+	if (!c)
+		return;
+
+	snprintf(desc, sizeof(desc), "%s (result %#010x, log page %#x)",
+		 nvme_monitor_aen_str(result), result, NVME_MONITOR_AEN_LID(result));
+	monitor_event(ctx, name, "aen", desc);
+	monitor_log(c, NVME_MONITOR_AEN_LID(result), ctx->flags);
+	fflush(stdout);
+}
+
+static void monitor_ns(const char *name, const char *action, void *arg)
+{
+	monitor_event(arg, name, "namespace", action);
+}
+
+/* The configuration is reset with the controller, so it is armed again */
+static void monitor_connected(const char *name, void *arg)
+{
+	struct monitor_ctx *ctx = arg;
+	struct monitor_ctrl *c = monitor_find(ctx, name);
+
+	if (!c)
+		return;
+
+	monitor_event(ctx, name, "connected", "controller connected");
+	if (ctx->arm) {
+		c->armed = false;
+		monitor_arm(c);
+	}
+}
+
+static int monitor_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
+{
+	const char *desc = "Wait for the asynchronous events of the given controllers, "
+		"or of all controllers, and print each event with the log page it "
+		"names. The SMART / health events are enabled while monitoring. "
+		"Namespaces coming and going are reported as well.";
+	const char *no_arm = "leave the async event configuration as it is";
+	const struct nvme_monitor_ops ops = {
+		.aen		= monitor_aen,
+		.ns		= monitor_ns,
+		.connected	= monitor_connected,
+	};
+	_cleanup_nvme_root_ nvme_root_t r = NULL;
+	_cleanup_free_ struct monitor_ctrl *ctrls = NULL;
+	_cleanup_free_ struct nvme_id_ctrl *id = NULL;
+	struct monitor_ctx ctx = { 0 };
+	enum nvme_print_flags flags;
+	char path[PATH_MAX], *name;
+	nvme_subsystem_t s;
+	nvme_host_t h;
+	nvme_ctrl_t c;
+	int err, i, nr = 0;
+
+	struct config {
+		bool	no_arm;
+	};
+
+	struct config cfg = {
+		.no_arm	= false,
+	};
+
+	NVME_ARGS(opts,
+		  OPT_FLAG("no-arm", 'N', &cfg.no_arm, no_arm));
+
+	err = parse_args(argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	err = validate_output_format(output_format_val, &flags);
+	if (err < 0 || (flags != NORMAL && (flags & ~NDJSON) != JSON)) {
+		nvme_show_error("Invalid output format");
+		return -EINVAL;
+	}
+
+	if (optind < argc) {
+		nr = argc - optind;
+		ctrls = calloc(nr, sizeof(*ctrls));
+		if (!ctrls)
+			return -ENOMEM;
+		for (i = 0; i < nr; i++) {
+			name = strrchr(argv[optind + i], '/');
+			ctrls[i].name = name ? name + 1 : argv[optind + i];
+		}
+	} else {
+		r = nvme_create_root(stderr, log_level);
+		if (!r) {
+			nvme_show_error("Failed to create topology root: %s",
+					nvme_strerror(errno));
+			return -errno;
+		}
+
+		err = nvme_cli_scan_topology(r, NULL, NULL);
+		if (err < 0) {
+			if (errno != ENOENT)
+				nvme_show_error("Failed to scan topology: %s",
+						nvme_strerror(errno));
+			return err;
+		}
+
+		nvme_for_each_host(r, h)
+			nvme_for_each_subsystem(h, s)
+				nvme_subsystem_for_each_ctrl(s, c)
+					nr++;
+
+		ctrls = calloc(nr, sizeof(*ctrls));
+		if (nr && !ctrls)
+			return -ENOMEM;
+
+		i = 0;
+		nvme_for_each_host(r, h)
+			nvme_for_each_subsystem(h, s)
+				nvme_subsystem_for_each_ctrl(s, c)
+					ctrls[i++].name = nvme_ctrl_get_name(c);
+	}
+
+	id = nvme_alloc(sizeof(*id));
+	if (!id)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++)
+		ctrls[i].fd = -1;
+
+	for (i = 0; i < nr; i++) {
+		if (optind < argc)
+			snprintf(path, sizeof(path), "%s", argv[optind + i]);
+		else
+			snprintf(path, sizeof(path), "/dev/%s", ctrls[i].name);
+		ctrls[i].fd = open(path, O_RDONLY);
+		if (ctrls[i].fd < 0) {
+			err = -errno;
+			nvme_show_error("monitor: %s: %s", path, nvme_strerror(errno));
+			goto close;
+		}
+		if (!nvme_identify_ctrl(ctrls[i].fd, id))
+			ctrls[i].elpe = id->elpe;
+		if (!cfg.no_arm)
+			monitor_arm(&ctrls[i]);
+	}
+
+	if (flags & JSON) {
+		ctx.s = json_stream_open(stdout, JSON_STREAM_PLAIN);
+		if (!ctx.s) {
+			err = -ENOMEM;
+			goto close;
+		}
+	}
+
+	ctx.ctrls = ctrls;
+	ctx.nr = nr;
+	ctx.arm = !cfg.no_arm;
+	ctx.flags = flags;
+
+	err = nvme_monitor(&ops, &ctx);
+	if (err)
+		nvme_show_error("monitor: %s", nvme_strerror(-err));
+
+	if (ctx.s)
+		json_stream_close(ctx.s);
+close:
+	for (i = 0; i < nr; i++) {
+		if (ctrls[i].fd < 0)
+			continue;
+		monitor_disarm(&ctrls[i]);
+		close(ctrls[i].fd);
+	}
+
+	return err;
+}
+
+/* Closes the controllers of an NVM subsystem after the first one given */
+static int fleet_one_per_subsys(struct nvme_fleet_dev *devs, int *nr)
+{
+	_cleanup_free_ struct nvme_id_ctrl *id = NULL;
+	_cleanup_free_ char *nqns = NULL;
+	size_t len = sizeof(id->subnqn);
+	int i, j, n = 0;
+
+	id = nvme_alloc(sizeof(*id));
+	nqns = calloc(*nr, len);
+	if (!id || !nqns)
+		return -ENOMEM;
+
+	for (i = 0; i < *nr; i++) {
+		/* without an NQN it cannot be told apart from the others */
+		if (!nvme_identify_ctrl(devs[i].fd, id))
+			memcpy(&nqns[n * len], id->subnqn, len - 1);
+
+		for (j = 0; nqns[n * len] && j < n; j++) {
+			if (!strcmp(&nqns[j * len], &nqns[n * len]))
+				break;
+		}
+		if (nqns[n * len] && j < n) {
+			fprintf(stderr, "fleet: %s: skipped, %s is sanitized through %s\n",
+				devs[i].name, &nqns[n * len], devs[j].name);
+			close(devs[i].fd);
+			memset(&nqns[n * len], 0, len);
+			continue;
+		}
+		devs[n++] = devs[i];
+	}
+	*nr = n;
+
+	return 0;
+}
+
+static int fleet_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
+{
+	const char *desc = "Start a sanitize or device self-test operation on many "
+		"controllers at once and wait for all of them to complete, with the "
+		"progress of all of them summed up. The controllers are given as "
+		"arguments, or --all selects every controller.";
+	const char *all = "run the operation on all controllers";
+	const char *sanact_desc = "Sanitize action: 2 = Start block erase, 3 = Start overwrite, 4 = Start crypto erase";
+	const char *no_dealloc_desc = "No deallocate after sanitize.";
+	const char *oipbp_desc = "Overwrite invert pattern between passes.";
+	const char *owpass_desc = "Overwrite pass count.";
+	const char *ause_desc = "Allow unrestricted sanitize exit.";
+	const char *ovrpat_desc = "Overwrite pattern.";
+	const char *self_test_code = "Device self-test: 1 = Short, 2 = Extended, e = Vendor specific";
+	const char *namespace_id = "namespace of the device self-test";
+	_cleanup_nvme_root_ nvme_root_t r = NULL;
+	_cleanup_free_ struct nvme_fleet_dev *devs = NULL;
+	struct nvme_fleet_cfg fleet = { 0 };
+	enum nvme_print_flags flags;
+	char path[PATH_MAX], *name;
+	nvme_subsystem_t s;
+	nvme_host_t h;
+	nvme_ctrl_t c;
+	int err, i, nr = 0;
+
+	struct config {
+		bool	all;
+		__u8	sanact;
+		bool	no_dealloc;
+		bool	oipbp;
+		__u8	owpass;
+		bool	ause;
+		__u32	ovrpat;
+		__u8	stc;
+		__u32	namespace_id;
+	};
+
+	struct config cfg = {
+		.all		= false,
+		.sanact		= 0,
+		.no_dealloc	= false,
+		.oipbp		= false,
+		.owpass		= 0,
+		.ause		= false,
+		.ovrpat		= 0,
+		.stc		= NVME_ST_CODE_RESERVED,
+		.namespace_id	= NVME_NSID_ALL,
+	};
+
+	OPT_VALS(sanact) = {
+		VAL_BYTE("start-block-erase", NVME_SANITIZE_SANACT_START_BLOCK_ERASE),
+		VAL_BYTE("start-overwrite", NVME_SANITIZE_SANACT_START_OVERWRITE),
+		VAL_BYTE("start-crypto-erase", NVME_SANITIZE_SANACT_START_CRYPTO_ERASE),
+		VAL_END()
+	};
+
+	NVME_ARGS(opts,
+		  OPT_FLAG("all",            'A', &cfg.all,          all),
+		  OPT_BYTE("sanact",         'a', &cfg.sanact,       sanact_desc, sanact),
+		  OPT_FLAG("no-dealloc",     'd', &cfg.no_dealloc,   no_dealloc_desc),
+		  OPT_FLAG("oipbp",          'i', &cfg.oipbp,        oipbp_desc),
+		  OPT_BYTE("owpass",         'n', &cfg.owpass,       owpass_desc),
+		  OPT_FLAG("ause",           'u', &cfg.ause,         ause_desc),
+		  OPT_UINT("ovrpat",         'p', &cfg.ovrpat,       ovrpat_desc),
+		  OPT_BYTE("self-test-code", 's', &cfg.stc,          self_test_code),
+		  OPT_UINT("namespace-id",   'N', &cfg.namespace_id, namespace_id));
+
+	err = parse_args(argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	err = validate_output_format(output_format_val, &flags);
+	if (err < 0 || (flags != NORMAL && (flags & ~NDJSON) != JSON)) {
+		nvme_show_error("Invalid output format");
+		return -EINVAL;
+	}
+
+	if (!cfg.sanact == (cfg.stc == NVME_ST_CODE_RESERVED)) {
+		nvme_show_error("Either a sanitize action or a self-test code is required");
+		return -EINVAL;
+	}
+
+	if (cfg.sanact) {
+		switch (cfg.sanact) {
+		case NVME_SANITIZE_SANACT_START_BLOCK_ERASE:
+		case NVME_SANITIZE_SANACT_START_OVERWRITE:
+		case NVME_SANITIZE_SANACT_START_CRYPTO_ERASE:
+			break;
+		default:
+			nvme_show_error("Invalid Sanitize Action");
+			return -EINVAL;
+		}
+
+		if (cfg.sanact == NVME_SANITIZE_SANACT_START_OVERWRITE) {
+			if (cfg.owpass > 15) {
+				nvme_show_error("OWPASS out of range [0-15]");
+				return -EINVAL;
+			}
+		} else if (cfg.owpass || cfg.oipbp || cfg.ovrpat) {
+			nvme_show_error("SANACT is not Overwrite");
+			return -EINVAL;
+		}
+	} else {
+		switch (cfg.stc) {
+		case NVME_ST_CODE_SHORT:
+		case NVME_ST_CODE_EXTENDED:
+		case NVME_ST_CODE_VS:
+			break;
+		default:
+			nvme_show_error("Invalid self-test code");
+			return -EINVAL;
+		}
+	}
+
+	/* erasing every controller is not something to do by default */
+	if ((optind < argc) == cfg.all) {
+		nvme_show_error("Either controllers or --all are required");
+		return -EINVAL;
+	}
+
+	if (optind < argc) {
+		nr = argc - optind;
+		devs = calloc(nr, sizeof(*devs));
+		if (!devs)
+			return -ENOMEM;
+		for (i = 0; i < nr; i++) {
+			name = strrchr(argv[optind + i], '/');
+			devs[i].name = name ? name + 1 : argv[optind + i];
+		}
+	} else {
+		r = nvme_create_root(stderr, log_level);
+		if (!r) {
+			nvme_show_error("Failed to create topology root: %s",
+					nvme_strerror(errno));
+			return -errno;
+		}
+
+		err = nvme_cli_scan_topology(r, NULL, NULL);
+		if (err < 0) {
+			if (errno != ENOENT)
+				nvme_show_error("Failed to scan topology: %s",
+						nvme_strerror(errno));
+			return err;
+		}
+
+		nvme_for_each_host(r, h)
+			nvme_for_each_subsystem(h, s)
+				nvme_subsystem_for_each_ctrl(s, c)
+					nr++;
+		if (!nr) {
+			nvme_show_error("fleet: no controllers found");
+			return -ENODEV;
+		}
+
+		devs = calloc(nr, sizeof(*devs));
+		if (!devs)
+			return -ENOMEM;
+
+		i = 0;
+		nvme_for_each_host(r, h)
+			nvme_for_each_subsystem(h, s)
+				nvme_subsystem_for_each_ctrl(s, c)
+					devs[i++].name = nvme_ctrl_get_name(c);
+	}
+
+	for (i = 0; i < nr; i++)
+		devs[i].fd = -1;
+
+	for (i = 0; i < nr; i++) {
+		if (optind < argc)
+			snprintf(path, sizeof(path), "%s", argv[optind + i]);
+		else
+			snprintf(path, sizeof(path), "/dev/%s", devs[i].name);
+		devs[i].fd = open(path, O_RDONLY);
+		if (devs[i].fd < 0) {
+			err = -errno;
+			nvme_show_error("fleet: %s: %s", path, nvme_strerror(errno));
+			goto close;
+		}
+	}
+
+	/* a sanitize acts on the whole NVM subsystem, it is started once for each */
+	if (cfg.sanact) {
+		err = fleet_one_per_subsys(devs, &nr);
+		if (err)
+			goto close;
+	}
+
+	fleet.json = flags & JSON;
+	if (cfg.sanact) {
+		fleet.op = NVME_FLEET_SANITIZE;
+		fleet.sanitize = (struct nvme_sanitize_nvm_args) {
+			.args_size	= sizeof(fleet.sanitize),
+			.sanact		= cfg.sanact,
+			.ause		= cfg.ause,
+			.owpass		= cfg.owpass,
+			.oipbp		= cfg.oipbp,
+			.nodas		= cfg.no_dealloc,
+			.ovrpat		= cfg.ovrpat,
+			.timeout	= NVME_DEFAULT_IOCTL_TIMEOUT,
+			.result		= NULL,
+		};
+	} else {
+		fleet.op = NVME_FLEET_SELF_TEST;
+		fleet.self_test = (struct nvme_dev_self_test_args) {
+			.args_size	= sizeof(fleet.self_test),
+			.nsid		= cfg.namespace_id,
+			.stc		= cfg.stc,
+			.timeout	= NVME_DEFAULT_IOCTL_TIMEOUT,
+			.result		= NULL,
+		};
+	}
+
+	err = nvme_fleet(devs, nr, &fleet);
+	if (err < 0 && err != -EIO && err != -EINTR)
+		nvme_show_error("fleet: %s", nvme_strerror(-err));
+
+close:
+	for (i = 0; i < nr; i++) {
+		if (devs[i].fd >= 0)
+			close(devs[i].fd);
+	}
+
+	return err;
+}
+
+/* Log pages nvme collect can gather, named after the commands printing them */
+enum bundle_log {
+	BUNDLE_ID_CTRL		= 1 << 0,
+	BUNDLE_SMART		= 1 << 1,
+	BUNDLE_ERROR		= 1 << 2,
+	BUNDLE_FW		= 1 << 3,
+	BUNDLE_EFFECTS		= 1 << 4,
+	BUNDLE_SUPPORTED	= 1 << 5,
+	BUNDLE_TELEMETRY	= 1 << 6,
+	BUNDLE_VENDOR		= 1 << 7,
+	BUNDLE_INTERNAL		= 1 << 8,
+};
+
+static const struct {
+	const char *name;
+	enum bundle_log log;
+} bundle_logs[] = {
+	{ "id-ctrl",		BUNDLE_ID_CTRL },
+	{ "smart-log",		BUNDLE_SMART },
+	{ "error-log",		BUNDLE_ERROR },
+	{ "fw-log",		BUNDLE_FW },
+	{ "effects-log",	BUNDLE_EFFECTS },
+	{ "supported-log-pages", BUNDLE_SUPPORTED },
+	{ "telemetry-log",	BUNDLE_TELEMETRY },
+	{ "vendor",		BUNDLE_VENDOR },
+	{ "internal-log",	BUNDLE_INTERNAL },
+};
+
+/* The plugin that decodes the vendor specific log pages, by PCI vendor id */
+static const struct {
+	__u16 vid;
+	const char *plugin;
+} bundle_vendors[] = {
+	{ 0x025e, "solidigm" },
+	{ 0x1179, "toshiba" },
+	{ 0x1344, "micron" },
+	{ 0x15b7, "wdc" },
+	{ 0x19e5, "huawei" },
+	{ 0x1b96, "wdc" },
+	{ 0x1bb1, "seagate" },
+	{ 0x1c58, "wdc" },
+	{ 0x1c5f, "memblaze" },
+	{ 0x1cb0, "shannon" },
+	{ 0x1dcf, "scaleflux" },
+	{ 0x1e0f, "toshiba" },
+	{ 0x1e49, "ymtc" },
+	{ 0x8086, "intel" },
+};
+
+/*
+ * The command of the plugin saving the internal log of a controller, with
+ * the option naming the file it goes to if it does not pick one itself.
+ */
+static const struct {
+	const char *plugin;
+	const char *cmd;
+	const char *opt;
+	const char *file;
+} bundle_internal_cmds[] = {
+	{ "intel",	"internal-log",		"-o",	"internal-log.bin" },
+	{ "micron",	"vs-internal-log",	"-p",	"internal-log.zip" },
+	{ "seagate",	"vs-internal-log",	"-f",	"internal-log.bin" },
+	{ "solidigm",	"vs-internal-log" },
+	{ "toshiba",	"vs-internal-log",	"-o",	"internal-log.bin" },
+	{ "wdc",	"vs-internal-log" },
+};
+
+/*
+ * Vendor specific log pages are read in chunks of this size, up to the
+ * limit, as they do not tell their length in a common way.
+ */
+#define BUNDLE_VENDOR_LOG_CHUNK	4096
+#define BUNDLE_VENDOR_LOG_MAX	(16 << 20)
+
+struct bundle_file {
+	char name[128];
+	void *data;
+	size_t len;
+	int err;
+	bool saved;		/* by a plugin, the name is that of the file */
+};
+
+struct bundle_ctrl {
+	const char *name;
+	struct nvme_id_ctrl *id;
+	const char *plugin;
+	struct bundle_file *files;
+	int nr_files;
+	pid_t pid;		/* saving the internal log */
+	char *dir;		/* the internal log is saved to */
+};
+
+struct bundle_ctx {
+	struct bundle_ctrl *ctrls;
+	unsigned int logs;
+};
+
+/* Takes the data, which is freed if the log could not be read */
+static struct bundle_file *bundle_add(struct bundle_ctrl *c, const char *name, void *data,
+				      size_t len, int err)
+{
+	struct bundle_file *files, *f;
+
+	files = realloc(c->files, (c->nr_files + 1) * sizeof(*files));
+	if (!files) {
+		free(data);
+		return NULL;
+	}
+	c->files = files;
+
+	f = &c->files[c->nr_files++];
+	snprintf(f->name, sizeof(f->name), "%s", name);
+	f->err = err;
+	f->data = err ? NULL : data;
+	f->len = err ? 0 : len;
+	f->saved = false;
+	if (err)
+		free(data);
+
+	return f;
+}
+
+static int bundle_err(int err)
+{
+	return err < 0 ? -errno : err;
+}
+
+static void bundle_log(struct nvme_dev *dev, struct bundle_ctrl *c, enum bundle_log log)
+{
+	void *buf = NULL;
+	size_t len = 0;
+	int err = -ENOMEM;
+	const char *name;
+
+	switch (log) {
+	case BUNDLE_SMART:
+		name = "smart-log";
+		len = sizeof(struct nvme_smart_log);
+		buf = nvme_alloc(len);
+		if (buf)
+			err = bundle_err(nvme_cli_get_log_smart(dev, NVME_NSID_ALL, true, buf));
+		break;
+	case BUNDLE_ERROR:
+		name = "error-log";
+		len = (c->id->elpe + 1) * sizeof(struct nvme_error_log_page);
+		buf = nvme_alloc(len);
+		if (buf)
+			err = bundle_err(nvme_cli_get_log_error(dev, c->id->elpe + 1, true, buf));
+		break;
+	case BUNDLE_FW:
+		name = "fw-log";
+		len = sizeof(struct nvme_firmware_slot);
+		buf = nvme_alloc(len);
+		if (buf)
+			err = bundle_err(nvme_cli_get_log_fw_slot(dev, true, buf));
+		break;
+	case BUNDLE_EFFECTS:
+		name = "effects-log";
+		len = sizeof(struct nvme_cmd_effects_log);
+		buf = nvme_alloc(len);
+		if (buf)
+			err = bundle_err(nvme_cli_get_log_cmd_effects(dev, NVME_CSI_NVM, buf));
+		break;
+	case BUNDLE_TELEMETRY:
+		/* a new host initiated report with data areas 1 to 3 */
+		name = "telemetry-log";
+		err = __create_telemetry_log_host(dev, NVME_TELEMETRY_DA_3, &len,
+						  (struct nvme_telemetry_log **)&buf);
+		break;
+	default:
+		return;
+	}
+
+	bundle_add(c, name, buf, len, err);
+}
+
+static bool bundle_zeroes(const void *buf, size_t len)
+{
+	const __u8 *p = buf;
+
+	return !p[0] && !memcmp(p, p + 1, len - 1);
+}
+
+/*
+ * Reads a vendor specific log page as far as it goes. If the controller
+ * takes log page offsets, chunks are read until it rejects the offset as
+ * past the end of the log, or returns nothing but zeroes from there on.
+ */
+static int bundle_vendor_log(struct nvme_dev *dev, bool offsets, __u8 lid, __u8 uuidx,
+			     void **log, size_t *len)
+{
+	_cleanup_free_ void *chunk = NULL;
+	struct nvme_get_log_args args = {
+		.args_size	= sizeof(args),
+		.lid		= lid,
+		.nsid		= NVME_NSID_ALL,
+		.rae		= true,
+		.uuidx		= uuidx,
+		.csi		= NVME_CSI_NVM,
+		.len		= BUNDLE_VENDOR_LOG_CHUNK,
+		.timeout	= NVME_DEFAULT_IOCTL_TIMEOUT,
+		.result		= NULL,
+	};
+	void *buf;
+	int err;
+
+	*log = NULL;
+	*len = 0;
+
+	chunk = nvme_alloc(BUNDLE_VENDOR_LOG_CHUNK);
+	if (!chunk)
+		return -ENOMEM;
+	args.log = chunk;
+
+	while (*len < BUNDLE_VENDOR_LOG_MAX) {
+		args.lpo = *len;
+		err = bundle_err(nvme_cli_get_log(dev, &args));
+		if (err && *len)
+			break;
+		/* not every controller accepts a read past the end of a log */
+		if (err > 0 && args.len != NVME_LOG_TELEM_BLOCK_SIZE) {
+			args.len = NVME_LOG_TELEM_BLOCK_SIZE;
+			continue;
+		}
+		if (err) {
+			free(*log);
+			*log = NULL;
+			return err;
+		}
+		if (*len && bundle_zeroes(chunk, args.len))
+			break;
+
+		buf = realloc(*log, *len + args.len);
+		if (!buf) {
+			free(*log);
+			*log = NULL;
+			return -ENOMEM;
+		}
+		memcpy((char *)buf + *len, chunk, args.len);
+		*log = buf;
+		*len += args.len;
+
+		if (!offsets)
+			break;
+	}
+
+	return 0;
+}
+
+/* The vendor specific log pages the controller supports for the UUID index */
+static void bundle_vendor_logs(struct nvme_dev *dev, struct bundle_ctrl *c,
+			       struct nvme_supported_log_pages *supported, __u8 uuidx)
+{
+	bool offsets = c->id->lpa & NVME_CTRL_LPA_EXTENDED;
+	char name[32];
+	size_t len;
+	void *buf;
+	int lid, err;
+
+	for (lid = 0xc0; lid < 0x100; lid++) {
+		if (!(le32_to_cpu(supported->lid_support[lid]) & 0x1))
+			continue;
+
+		if (uuidx)
+			snprintf(name, sizeof(name), "log-%02x-uuid%u", lid, uuidx);
+		else
+			snprintf(name, sizeof(name), "log-%02x", lid);
+		err = bundle_vendor_log(dev, offsets, lid, uuidx, &buf, &len);
+		bundle_add(c, name, buf, len, err);
+	}
+}
+
+/* Vendor specific log pages may be told apart by the UUID of the vendor */
+static void bundle_uuid_logs(struct nvme_dev *dev, struct bundle_ctrl *c)
+{
+	_cleanup_free_ struct nvme_supported_log_pages *supported = NULL;
+	_cleanup_free_ struct nvme_id_uuid_list *uuids = NULL;
+	struct nvme_get_log_args args = {
+		.args_size	= sizeof(args),
+		.lid		= NVME_LOG_LID_SUPPORTED_LOG_PAGES,
+		.nsid		= NVME_NSID_ALL,
+		.rae		= true,
+		.csi		= NVME_CSI_NVM,
+		.len		= sizeof(*supported),
+		.timeout	= NVME_DEFAULT_IOCTL_TIMEOUT,
+		.result		= NULL,
+	};
+	__u8 zero[NVME_UUID_LEN] = { 0 };
+	char name[32];
+	int i, err;
+
+	if (!(le32_to_cpu(c->id->ctratt) & NVME_CTRL_CTRATT_UUID_LIST))
+		return;
+
+	uuids = nvme_alloc(sizeof(*uuids));
+	supported = nvme_alloc(sizeof(*supported));
+	if (!uuids || !supported) {
+		bundle_add(c, "id-uuid", NULL, 0, -ENOMEM);
+		return;
+	}
+
+	err = nvme_identify_uuid(dev_fd(dev), uuids);
+	if (err) {
+		bundle_add(c, "id-uuid", NULL, 0, bundle_err(err));
+		return;
+	}
+
+	/* the list ends with a zero UUID, the indexes start at 1 */
+	for (i = 0; i < NVME_ID_UUID_LIST_MAX; i++) {
+		if (!memcmp(uuids->entry[i].uuid, zero, sizeof(zero)))
+			break;
+
+		args.uuidx = i + 1;
+		args.log = supported;
+		err = bundle_err(nvme_cli_get_log(dev, &args));
+		if (err) {
+			snprintf(name, sizeof(name), "supported-log-pages-uuid%d", i + 1);
+			bundle_add(c, name, NULL, 0, err);
+			continue;
+		}
+		bundle_vendor_logs(dev, c, supported, i + 1);
+	}
+}
+
+/* The commands for a controller are sent one after the other */
+static void bundle_ctrl(int i, void *arg)
+{
+	struct bundle_ctx *ctx = arg;
+	struct bundle_ctrl *c = &ctx->ctrls[i];
+	struct nvme_supported_log_pages *supported = NULL;
+	struct nvme_dev dev = {
+		.type	= NVME_DEV_DIRECT,
+		.name	= c->name,
+	};
+	char path[PATH_MAX];
+	size_t j;
+	int err;
+
+	snprintf(path, sizeof(path), "/dev/%s", c->name);
+	dev.direct.fd = open(path, O_RDONLY);
+	if (dev.direct.fd < 0) {
+		bundle_add(c, "open", NULL, 0, -errno);
+		return;
+	}
+
+	c->id = nvme_alloc(sizeof(*c->id));
+	if (!c->id) {
+		bundle_add(c, "id-ctrl", NULL, 0, -ENOMEM);
+		goto close;
+	}
+	err = nvme_cli_identify_ctrl(&dev, c->id);
+	if (err) {
+		bundle_add(c, "id-ctrl", NULL, 0, bundle_err(err));
+		free(c->id);
+		c->id = NULL;
+		goto close;
+	}
+
+	for (j = 0; j < ARRAY_SIZE(bundle_vendors); j++) {
+		if (bundle_vendors[j].vid == le16_to_cpu(c->id->vid))
+			c->plugin = bundle_vendors[j].plugin;
+	}
+
+	if (ctx->logs & BUNDLE_ID_CTRL) {
+		void *id = nvme_alloc(sizeof(*c->id));
+
+		if (id)
+			memcpy(id, c->id, sizeof(*c->id));
+		bundle_add(c, "id-ctrl", id, sizeof(*c->id), id ? 0 : -ENOMEM);
+	}
+
+	for (j = 0; j < ARRAY_SIZE(bundle_logs); j++) {
+		if (ctx->logs & bundle_logs[j].log)
+			bundle_log(&dev, c, bundle_logs[j].log);
+	}
+
+	if (!(ctx->logs & (BUNDLE_SUPPORTED | BUNDLE_VENDOR)))
+		goto close;
+
+	supported = nvme_alloc(sizeof(*supported));
+	err = supported ? bundle_err(nvme_cli_get_log_supported_log_pages(&dev, true,
+									  supported)) : -ENOMEM;
+	if (err) {
+		bundle_add(c, "supported-log-pages", supported, 0, err);
+		goto close;
+	}
+
+	if (ctx->logs & BUNDLE_VENDOR) {
+		bundle_vendor_logs(&dev, c, supported, 0);
+		bundle_uuid_logs(&dev, c);
+	}
+
+	if (ctx->logs & BUNDLE_SUPPORTED)
+		bundle_add(c, "supported-log-pages", supported, sizeof(*supported), 0);
+	else
+		free(supported);
+
+close:
+	close(dev.direct.fd);
+}
+
+static int bundle_read_file(const char *path, void **data, size_t *len)
+{
+	_cleanup_file_ int fd = -1;
+	struct stat st;
+	ssize_t n;
+	char *buf;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st))
+		return -errno;
+
+	buf = malloc(st.st_size ? st.st_size : 1);
+	if (!buf)
+		return -ENOMEM;
+
+	for (*len = 0; *len < (size_t)st.st_size; *len += n) {
+		n = read(fd, buf + *len, st.st_size - *len);
+		if (n < 0 && errno == EINTR) {
+			n = 0;
+			continue;
+		}
+		if (n <= 0)
+			break;
+	}
+	*data = buf;
+
+	return 0;
+}
+
+/* nftw() takes no argument for its callback */
+static struct bundle_ctrl *bundle_walk_ctrl;
+static size_t bundle_walk_root;
+
+/* Takes the files the plugin saved into the bundle and removes them */
+static int bundle_walk(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+	struct bundle_ctrl *c = bundle_walk_ctrl;
+	struct bundle_file *f;
+	char name[128];
+	void *data = NULL;
+	size_t len = 0;
+	int err;
+
+	if (type == FTW_DP) {
+		rmdir(path);
+		return 0;
+	}
+
+	if (type == FTW_F && st->st_size) {
+		snprintf(name, sizeof(name), "%s/%s", c->plugin, path + bundle_walk_root);
+		err = bundle_read_file(path, &data, &len);
+		f = bundle_add(c, name, data, len, err);
+		if (f)
+			f->saved = true;
+	}
+	unlink(path);
+
+	return 0;
+}
+
+/*
+ * Runs the command of the plugin in a child, as plugins keep state in
+ * static variables and are not meant to run concurrently. It runs in a
+ * directory of its own, where its output goes as well.
+ */
+static void bundle_internal_start(struct bundle_ctrl *c, int k, int *status)
+{
+	char dir[PATH_MAX], path[PATH_MAX];
+	char *argv[5];
+	int argc = 0, fd;
+	const char *tmp;
+
+	tmp = getenv("TMPDIR");
+	snprintf(dir, sizeof(dir), "%s/nvme-collect-XXXXXX", tmp ? tmp : "/tmp");
+	if (!mkdtemp(dir)) {
+		*status = -errno;
+		return;
+	}
+	c->dir = strdup(dir);
+	if (!c->dir) {
+		rmdir(dir);
+		*status = -ENOMEM;
+		return;
+	}
+
+	snprintf(path, sizeof(path), "/dev/%s", c->name);
+	argv[argc++] = (char *)bundle_internal_cmds[k].plugin;
+	argv[argc++] = (char *)bundle_internal_cmds[k].cmd;
+	argv[argc++] = path;
+	if (bundle_internal_cmds[k].opt) {
+		argv[argc++] = (char *)bundle_internal_cmds[k].opt;
+		argv[argc++] = (char *)bundle_internal_cmds[k].file;
+	}
+
+	/* nothing buffered may be written twice */
+	fflush(stdout);
+	fflush(stderr);
+
+	c->pid = fork();
+	if (c->pid < 0) {
+		*status = -errno;
+		return;
+	}
+	if (c->pid)
+		return;
+
+	fd = open("/dev/null", O_RDONLY);
+	if (fd < 0 || dup2(fd, STDIN_FILENO) < 0 || chdir(dir))
+		_exit(1);
+	fd = open("stdout.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0)
+		_exit(1);
+	fd = open("stderr.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || dup2(fd, STDERR_FILENO) < 0)
+		_exit(1);
+
+	*status = run_cmd(argc, argv);
+	fflush(stdout);
+	fflush(stderr);
+	_exit(0);
+}
+
+static void bundle_internal_finish(struct bundle_ctrl *c, int k, int status)
+{
+	char name[64];
+
+	if (status) {
+		snprintf(name, sizeof(name), "%s/%s", c->plugin, bundle_internal_cmds[k].cmd);
+		bundle_add(c, name, NULL, 0, status);
+	}
+
+	if (c->dir) {
+		bundle_walk_ctrl = c;
+		bundle_walk_root = strlen(c->dir) + 1;
+		nftw(c->dir, bundle_walk, 16, FTW_DEPTH | FTW_PHYS);
+		free(c->dir);
+		c->dir = NULL;
+	}
+}
+
+static int bundle_internal_cmd(struct bundle_ctrl *c)
+{
+	int k;
+
+	if (!c->id || !c->plugin)
+		return -1;
+
+	for (k = 0; k < ARRAY_SIZE(bundle_internal_cmds); k++) {
+		if (!strcmp(c->plugin, bundle_internal_cmds[k].plugin))
+			return k;
+	}
+
+	return -1;
+}
+
+/* The plugins save the internal logs, up to NVME_SCAN_JOBS at a time */
+static void bundle_internal_logs(struct bundle_ctrl *ctrls, int nr)
+{
+	int *status, running = 0, i, j, k, err;
+	pid_t pid;
+
+	if (!nr)
+		return;
+
+	/* the children tell the status of the command through it */
+	status = mmap(NULL, nr * sizeof(*status), PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (status == MAP_FAILED) {
+		err = -errno;
+		for (i = 0; i < nr; i++) {
+			k = bundle_internal_cmd(&ctrls[i]);
+			if (k >= 0)
+				bundle_internal_finish(&ctrls[i], k, err);
+		}
+		return;
+	}
+
+	for (i = 0; i <= nr; i++) {
+		/* once all are started, the rest are waited for */
+		while (running && (running == NVME_SCAN_JOBS || i == nr)) {
+			pid = waitpid(-1, NULL, 0);
+			if (pid < 0 && errno == EINTR)
+				continue;
+			if (pid < 0)
+				break;
+			for (j = 0; j < i; j++) {
+				if (ctrls[j].pid != pid)
+					continue;
+				ctrls[j].pid = 0;
+				bundle_internal_finish(&ctrls[j], bundle_internal_cmd(&ctrls[j]),
+						       status[j]);
+				running--;
+			}
+		}
+
+		k = i < nr ? bundle_internal_cmd(&ctrls[i]) : -1;
+		if (k < 0)
+			continue;
+
+		/* a child which crashed did not tell */
+		status[i] = -ECHILD;
+		bundle_internal_start(&ctrls[i], k, &status[i]);
+		if (ctrls[i].pid > 0)
+			running++;
+		else
+			bundle_internal_finish(&ctrls[i], k, status[i]);
+	}
+
+	munmap(status, nr * sizeof(*status));
+}
+
+static void bundle_str(struct json_stream *s, const char *k, const char *v, size_t len)
+{
+	char buf[64];
+
+	len = strnlen(v, len < sizeof(buf) ? len : sizeof(buf) - 1);
+	while (len && v[len - 1] == ' ')
+		len--;
+	memcpy(buf, v, len);
+	buf[len] = '\0';
+
+	json_stream_add_str(s, k, buf);
+}
+
+/* The manifest lists every file with its checksum and the logs that failed */
+static int bundle_manifest(struct bundle_ctrl *ctrls, int nr, const char *host, time_t now,
+			   char **buf, size_t *len)
+{
+	struct json_stream *s;
+	struct bundle_file *f;
+	char crc[16];
+	FILE *out;
+	int i, j;
+
+	out = open_memstream(buf, len);
+	if (!out)
+		return -errno;
+
+	s = json_stream_open(out, JSON_STREAM_PRETTY);
+	if (!s) {
+		fclose(out);
+		return -ENOMEM;
+	}
+
+	json_stream_begin_object(s, NULL);
+	json_stream_add_str(s, "version", nvme_version_string);
+	json_stream_add_str(s, "host", host);
+	json_stream_add_uint(s, "timestamp", now);
+	json_stream_begin_array(s, "controllers");
+	for (i = 0; i < nr; i++) {
+		json_stream_begin_object(s, NULL);
+		json_stream_add_str(s, "name", ctrls[i].name);
+		if (ctrls[i].id) {
+			bundle_str(s, "model", ctrls[i].id->mn, sizeof(ctrls[i].id->mn));
+			bundle_str(s, "serial", ctrls[i].id->sn, sizeof(ctrls[i].id->sn));
+			bundle_str(s, "firmware", ctrls[i].id->fr, sizeof(ctrls[i].id->fr));
+			json_stream_add_uint(s, "vendor_id", le16_to_cpu(ctrls[i].id->vid));
+		}
+		if (ctrls[i].plugin)
+			json_stream_add_str(s, "plugin", ctrls[i].plugin);
+
+		json_stream_begin_array(s, "files");
+		for (j = 0; j < ctrls[i].nr_files; j++) {
+			f = &ctrls[i].files[j];
+			if (f->err)
+				continue;
+			json_stream_begin_object(s, NULL);
+			json_stream_add_str(s, "name", f->name);
+			json_stream_add_uint(s, "size", f->len);
+			snprintf(crc, sizeof(crc), "%08x", crc32(0, f->data, f->len));
+			json_stream_add_str(s, "crc32", crc);
+			json_stream_end_object(s);
+		}
+		json_stream_end_array(s);
+
+		json_stream_begin_array(s, "errors");
+		for (j = 0; j < ctrls[i].nr_files; j++) {
+			f = &ctrls[i].files[j];
+			if (!f->err)
+				continue;
+			json_stream_begin_object(s, NULL);
+			json_stream_add_str(s, "name", f->name);
+			json_stream_add_int(s, "status", f->err);
+			json_stream_add_str(s, "error", f->err < 0 ? nvme_strerror(-f->err) :
+					    nvme_status_to_string(f->err, false));
+			json_stream_end_object(s);
+		}
+		json_stream_end_array(s);
+		json_stream_end_object(s);
+	}
+	json_stream_end_array(s);
+	json_stream_end_object(s);
+
+	json_stream_close(s);
+	if (fclose(out))
+		return -errno;
+
+	return 0;
+}
+
+static int bundle_write(FILE *out, const char *prefix, struct bundle_ctrl *ctrls, int nr,
+			char *manifest, size_t manifest_len, time_t now)
+{
+	char path[PATH_MAX];
+	struct bundle_file *f;
+	int i, j, err;
+
+	snprintf(path, sizeof(path), "%s/manifest.json", prefix);
+	err = tar_add(out, path, manifest, manifest_len, now);
+
+	for (i = 0; i < nr && !err; i++) {
+		for (j = 0; j < ctrls[i].nr_files && !err; j++) {
+			f = &ctrls[i].files[j];
+			if (f->err)
+				continue;
+			snprintf(path, sizeof(path), "%s/%s/%s%s", prefix, ctrls[i].name,
+				 f->name, f->saved ? "" : ".bin");
+			err = tar_add(out, path, f->data, f->len, now);
+		}
+	}
+
+	if (!err)
+		err = tar_finish(out);
+	if (!err && fflush(out))
+		err = -errno;
+
+	return err;
+}
+
+static int collect_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
+{
+	const char *desc = "Gather the identify data and log pages of all controllers "
+		"into a single tar archive, with a manifest listing the files, their "
+		"checksums and the logs that could not be read. The controllers are "
+		"queried in parallel, the commands for each one after the other.";
+	const char *output = "archive to write, - for stdout, default "
+		"nvme-collect-<host>-<time>.tar";
+	const char *logs = "comma separated logs to gather: id-ctrl, smart-log, "
+		"error-log, fw-log, effects-log, supported-log-pages, telemetry-log, "
+		"vendor, internal-log; all but telemetry-log and internal-log by default";
+	_cleanup_nvme_root_ nvme_root_t r = NULL;
+	_cleanup_free_ struct bundle_ctrl *ctrls = NULL;
+	_cleanup_free_ char *manifest = NULL;
+	_cleanup_free_ char *names = NULL;
+	char host[HOST_NAME_MAX + 1] = "localhost";
+	char prefix[PATH_MAX], path[PATH_MAX];
+	struct bundle_ctx ctx;
+	size_t manifest_len = 0, j;
+	nvme_subsystem_t s;
+	nvme_host_t h;
+	nvme_ctrl_t c;
+	char *list, *tok;
+	FILE *out;
+	time_t now;
+	int err, i, nr = 0, failed = 0;
+
+	struct config {
+		char	*output;
+		char	*logs;
+	};
+
+	struct config cfg = {
+		.output	= NULL,
+		.logs	= "id-ctrl,smart-log,error-log,fw-log,effects-log,"
+			  "supported-log-pages,vendor",
+	};
+
+	NVME_ARGS(opts,
+		  OPT_FILE("output", 'O', &cfg.output, output),
+		  OPT_LIST("logs",   'l', &cfg.logs,   logs));
+
+	err = parse_args(argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	ctx.logs = 0;
+	names = strdup(cfg.logs);
+	if (!names)
+		return -ENOMEM;
+	list = names;
+	while ((tok = strsep(&list, ","))) {
+		for (j = 0; j < ARRAY_SIZE(bundle_logs); j++) {
+			if (!strcmp(tok, bundle_logs[j].name))
+				break;
+		}
+		if (j == ARRAY_SIZE(bundle_logs)) {
+			nvme_show_error("collect: unknown log %s", tok);
+			return -EINVAL;
+		}
+		ctx.logs |= bundle_logs[j].log;
+	}
+
+	r = nvme_create_root(stderr, log_level);
+	if (!r) {
+		nvme_show_error("Failed to create topology root: %s", nvme_strerror(errno));
+		return -errno;
+	}
+
+	err = nvme_cli_scan_topology(r, NULL, NULL);
+	if (err < 0) {
+		if (errno != ENOENT)
+			nvme_show_error("Failed to scan topology: %s", nvme_strerror(errno));
+		return err;
+	}
+
+	nvme_for_each_host(r, h)
+		nvme_for_each_subsystem(h, s)
+			nvme_subsystem_for_each_ctrl(s, c)
+				nr++;
+
+	ctrls = calloc(nr, sizeof(*ctrls));
+	if (nr && !ctrls)
+		return -ENOMEM;
+
+	i = 0;
+	nvme_for_each_host(r, h)
+		nvme_for_each_subsystem(h, s)
+			nvme_subsystem_for_each_ctrl(s, c)
+				ctrls[i++].name = nvme_ctrl_get_name(c);
+
+	ctx.ctrls = ctrls;
+	nvme_parallel_for(nr, NVME_SCAN_JOBS, bundle_ctrl, &ctx);
+	if (ctx.logs & BUNDLE_INTERNAL)
+		bundle_internal_logs(ctrls, nr);
+
+	now = time(NULL);
+	gethostname(host, sizeof(host) - 1);
+	strftime(path, sizeof(path), "%Y%m%d-%H%M%S", localtime(&now));
+	snprintf(prefix, sizeof(prefix), "nvme-collect-%s-%s", host, path);
+
+	err = bundle_manifest(ctrls, nr, host, now, &manifest, &manifest_len);
+	if (err) {
+		nvme_show_error("collect: manifest: %s", nvme_strerror(-err));
+		goto free;
+	}
+
+	if (!cfg.output) {
+		snprintf(path, sizeof(path), "%s.tar", prefix);
+		cfg.output = path;
+	}
+
+	out = strcmp(cfg.output, "-") ? fopen(cfg.output, "w") : stdout;
+	if (!out) {
+		err = -errno;
+		nvme_show_perror(cfg.output);
+		goto free;
+	}
+
+	err = bundle_write(out, prefix, ctrls, nr, manifest, manifest_len, now);
+	if (out != stdout && fclose(out) && !err)
+		err = -errno;
+	if (err) {
+		nvme_show_error("collect: %s: %s", cfg.output, nvme_strerror(-err));
+		goto free;
+	}
+
+	for (i = 0; i < nr; i++) {
+		for (j = 0; j < ctrls[i].nr_files; j++)
+			failed += !!ctrls[i].files[j].err;
+	}
+	if (out != stdout)
+		printf("%s: %d controllers\n", cfg.output, nr);
+	if (failed)
+		fprintf(stderr, "collect: %d logs could not be read, see the manifest\n",
+			failed);
+
+free:
+	for (i = 0; i < nr; i++) {
+		for (j = 0; j < ctrls[i].nr_files; j++)
+			free(ctrls[i].files[j].data);
+		free(ctrls[i].files);
+		free(ctrls[i].id);
+	}
+
+	return err;
+}
+
+/* Arguments of a single command of a batch */
+#define NVME_BATCH_MAX_ARGS	256
+
+static void batch_status(struct json_stream *s, unsigned long line, const char *cmd,
+			 int err, unsigned long long usecs)
+{
+	json_stream_begin_object(s, NULL);
+	json_stream_add_uint(s, "line", line);
+	json_stream_add_str(s, "command", cmd);
+	json_stream_add_int(s, "status", err);
+	if (err < 0)
+		json_stream_add_str(s, "error", nvme_strerror(-err));
+	else if (err > 0)
+		json_stream_add_str(s, "error", nvme_status_to_string(err, false));
+	json_stream_add_uint(s, "usecs", usecs);
+	json_stream_end_object(s);
+	json_stream_flush(s);
+}
+
+/* Runs a command of a batch or for a client of nvme serve */
+static int run_cmd(int argc, char **argv)
+{
+	/* the defaults of the options every command shares */
+	output_format_val = "normal";
+	verbose_level = 0;
+
+	if (!strcmp(argv[0], "batch") || !strcmp(argv[0], "serve")) {
+		nvme_show_error("%s: cannot be run by another command", argv[0]);
+		return -EINVAL;
+	}
+
+	return handle_plugin(argc, argv, nvme.extensions);
+}
+
+/* Whether handle_plugin() runs the command from a plugin */
+static bool plugin_cmd(const char *name)
+{
+	struct command **cmd;
+	struct plugin *ext;
+
+	for (cmd = nvme.extensions->commands; *cmd; cmd++) {
+		if (!strcmp(name, (*cmd)->name) ||
+		    ((*cmd)->alias && !strcmp(name, (*cmd)->alias)))
+			return false;
+	}
+
+	for (ext = nvme.extensions->next; ext; ext = ext->next) {
+		if (!strncmp(name, ext->name, strlen(ext->name)))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Plugins keep what they learned about a device in static variables, which
+ * would carry over to the next command. Their commands run in a child. The
+ * status is passed back through a pipe, as it does not fit an exit code.
+ */
+static int run_cmd_forked(int argc, char **argv)
+{
+	int fds[2], status = -EIO, err;
+	ssize_t n;
+	pid_t pid;
+
+	if (pipe2(fds, O_CLOEXEC))
+		return -errno;
+
+	/* nothing buffered may be written twice */
+	fflush(stdout);
+	fflush(stderr);
+
+	pid = fork();
+	if (pid < 0) {
+		err = -errno;
+		close(fds[0]);
+		close(fds[1]);
+		return err;
+	}
+
+	if (!pid) {
+		close(fds[0]);
+		status = run_cmd(argc, argv);
+		fflush(stdout);
+		fflush(stderr);
+		n = write(fds[1], &status, sizeof(status));
+		_exit(n == sizeof(status) ? 0 : 1);
+	}
+
+	close(fds[1]);
+	do {
+		n = read(fds[0], &status, sizeof(status));
+	} while (n < 0 && errno == EINTR);
+	close(fds[0]);
+	while (waitpid(pid, NULL, 0) < 0 && errno == EINTR)
+		;
+
+	/* the child crashed or was killed */
+	if (n != sizeof(status))
+		status = -ECHILD;
+
+	return status;
+}
+
+static int batch_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
+{
+	const char *desc = "Run the nvme commands read from a file, one command "
+		"line per line, in a single process. Devices stay open and identify "
+		"data is reused from one command to the next. A status record is "
+		"written as a JSON line after each command.";
+	const char *status_file = "file for the status records, default stdout";
+	const char *stop_on_error = "stop at the first failing command";
+	_cleanup_free_ char *line = NULL;
+	char *args[NVME_BATCH_MAX_ARGS + 1], **cmd;
+	const char *name;
+	struct timeval start, end;
+	struct json_stream *s;
+	unsigned long nr = 0;
+	FILE *in = stdin, *out = stdout;
+	size_t len = 0;
+	int err, ret = 0, n, fd, null;
+
+	struct config {
+		char	*status_file;
+		bool	stop_on_error;
+	};
+
+	struct config cfg = {
+		.status_file	= NULL,
+		.stop_on_error	= false,
+	};
+
+	NVME_ARGS(opts,
+		  OPT_FILE("status-file",   's', &cfg.status_file,   status_file),
+		  OPT_FLAG("stop-on-error", 'e', &cfg.stop_on_error, stop_on_error));
+
+	err = parse_args(argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	if (optind < argc && strcmp(argv[optind], "-")) {
+		in = fopen(argv[optind], "r");
+		if (!in) {
+			err = -errno;
+			nvme_show_perror(argv[optind]);
+			return err;
+		}
+	} else {
+		/*
+		 * Commands which read their data from stdin would consume the
+		 * script. Their reads fail instead, as stdin is replaced by
+		 * /dev/null opened for writing.
+		 */
+		null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+		fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+		if (null < 0 || fd < 0 || dup2(null, STDIN_FILENO) < 0 ||
+		    !(in = fdopen(fd, "r"))) {
+			err = -errno;
+			nvme_show_perror("batch");
+			if (fd >= 0)
+				close(fd);
+			if (null >= 0)
+				close(null);
+			return err;
+		}
+		close(null);
+	}
+
+	if (cfg.status_file) {
+		out = fopen(cfg.status_file, "w");
+		if (!out) {
+			err = -errno;
+			nvme_show_perror(cfg.status_file);
+			goto close_in;
+		}
+	}
+
+	s = json_stream_open(out, JSON_STREAM_PLAIN);
+	if (!s) {
+		err = -ENOMEM;
+		goto close_out;
+	}
+
+	dev_cache_enable();
+	nvme_cmd_cache_enable();
+
+	while (getline(&line, &len, in) > 0) {
+		nr++;
+		n = cmdline_split(line, args, NVME_BATCH_MAX_ARGS);
+		cmd = args;
+		/* the lines may be copied from a shell script */
+		if (n > 0 && !strcmp(cmd[0], nvme.name)) {
+			cmd++;
+			n--;
+		}
+		if (!n)
+			continue;
+
+		/* plugin commands may advance argv[0] past the plugin name */
+		name = n > 0 ? cmd[0] : "";
+		gettimeofday(&start, NULL);
+		if (n < 0)
+			err = n;
+		else if (plugin_cmd(cmd[0]))
+			err = run_cmd_forked(n, cmd);
+		else
+			err = run_cmd(n, cmd);
+		gettimeofday(&end, NULL);
+
+		/* the utilization read by this command may be outdated by the next */
+		nvme_cmd_cache_forget_usage();
+
+		/* keep the status after the output of the command */
+		fflush(stdout);
+		batch_status(s, nr, name, err,
+			     (end.tv_sec - start.tv_sec) * 1000000ULL +
+			     (end.tv_usec - start.tv_usec));
+
+		if (err && !ret)
+			ret = err;
+		if (err && cfg.stop_on_error)
+			break;
+	}
+
+	nvme_cmd_cache_disable();
+	dev_cache_release();
+
+	err = json_stream_close(s);
+	if (err)
+		nvme_show_error("batch: failed to write the status: %s", nvme_strerror(-err));
+	if (!ret)
+		ret = err;
+	err = ret;
+
+close_out:
+	if (out != stdout)
+		fclose(out);
+close_in:
+	if (in != stdin)
+		fclose(in);
+
+	return err;
+}
+
+/* Opens all controllers and namespaces and fills the memo with their identify data */
+static void serve_refresh(void)
+{
+	_cleanup_nvme_root_ nvme_root_t r = NULL;
+	struct nvme_dev *dev;
+	char path[PATH_MAX];
+	nvme_subsystem_t s;
+	nvme_host_t h;
+	nvme_ctrl_t c;
+	nvme_ns_t n;
+	int err;
+
+	dev_cache_release();
+	nvme_cmd_cache_disable();
+	dev_cache_enable();
+	nvme_cmd_cache_enable();
+
+	r = nvme_create_root(stderr, log_level);
+	if (!r) {
+		nvme_show_error("Failed to create topology root: %s", nvme_strerror(errno));
+		return;
+	}
+
+	err = nvme_cli_scan_topology(r, NULL, NULL);
+	/* the utilization changes with every write, workers read it themselves */
+	nvme_cmd_cache_forget_usage();
+	if (err < 0) {
+		if (errno != ENOENT)
+			nvme_show_error("Failed to scan topology: %s", nvme_strerror(errno));
+		return;
+	}
+
+	nvme_for_each_host(r, h) {
+		nvme_for_each_subsystem(h, s) {
+			nvme_subsystem_for_each_ctrl(s, c) {
+				snprintf(path, sizeof(path), "/dev/%s", nvme_ctrl_get_name(c));
+				open_dev_direct(&dev, path, O_RDONLY);
+				nvme_ctrl_for_each_ns(c, n) {
+					snprintf(path, sizeof(path), "/dev/%s", nvme_ns_get_name(n));
+					open_dev_direct(&dev, path, O_RDONLY);
+				}
+			}
+			nvme_subsystem_for_each_ns(s, n) {
+				snprintf(path, sizeof(path), "/dev/%s", nvme_ns_get_name(n));
+				open_dev_direct(&dev, path, O_RDONLY);
+			}
+		}
+	}
+}
+
+static int serve_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
+{
+	const char *desc = "Run nvme commands for local clients over a Unix socket, "
+		"with the devices kept open and their identify data at hand. While "
+		"the server runs, nvme sends read only commands to it.";
+	const char *socket_path = "path of the socket";
+	const char *jobs = "number of commands run at the same time";
+	const struct nvme_serve_ops ops = {
+		.run		= run_cmd,
+		.refresh	= serve_refresh,
+	};
+	int err;
+
+	struct config {
+		char		*socket;
+		unsigned int	jobs;
+	};
+
+	struct config cfg = {
+		.socket		= NVME_SERVE_SOCKET,
+		.jobs		= NVME_SCAN_JOBS,
+	};
+
+	NVME_ARGS(opts,
+		  OPT_FILE("socket", 'S', &cfg.socket, socket_path),
+		  OPT_UINT("jobs",   'j', &cfg.jobs,   jobs));
+
+	err = parse_args(argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	if (!cfg.jobs) {
+		nvme_show_error("serve: jobs must be at least 1");
+		return -EINVAL;
+	}
+
+	if (!strcmp(cfg.socket, NVME_SERVE_SOCKET) &&
+	    mkdir(RUNDIR "/nvme", 0755) && errno != EEXIST) {
+		err = -errno;
+		nvme_show_error("serve: %s", nvme_strerror(-err));
+		return err;
+	}
+
+	err = nvme_serve(cfg.socket, cfg.jobs, &ops);
+	if (err)
+		nvme_show_error("serve: %s: %s", cfg.socket, nvme_strerror(-err));
+
+	nvme_cmd_cache_disable();
+	dev_cache_release();
+
+	return err;
+}
+
+static int discover_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
+{
+	const char *desc = "Send Get Log Page request to Discovery Controller.";
+
+	return nvmf_discover(desc, argc, argv, false);
+}
+
+static int connect_all_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
+{
+	const char *desc = "Discover NVMeoF subsystems and connect to them";
+
+	return nvmf_discover(desc, argc, argv, true);
+}
+
+static int connect_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
+{
+	const char *desc = "Connect to NVMeoF subsystem";
+
+	return nvmf_connect(desc, argc, argv);
+}
+
+static int disconnect_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
+{
+	const char *desc = "Disconnect from NVMeoF subsystem";
+
+	return nvmf_disconnect(desc, argc, argv);
+}
+
+int disconnect_all_cmd(int argc, char **argv, struct command *command,
+	struct plugin *plugin)
+{
+	const char *desc = "Disconnect from all connected NVMeoF subsystems";
+
+	return nvmf_disconnect_all(desc, argc, argv);
+}
+
+static int config_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
+{
+	const char *desc = "Configuration of NVMeoF subsystems";
+
+	return nvmf_config(desc, argc, argv);
+}
+
+static int dim_cmd(int argc, char **argv, struct command *command, struct plugin *plugin)
+{
+	const char *desc =
+	    "Send Discovery Information Management command to a Discovery Controller (DC)";
+
+	return nvmf_dim(desc, argc, argv);
+}
+
+static int nvme_mi(int argc, char **argv, __u8 admin_opcode, const char *desc)
+{
+	const char *opcode = "opcode (required)";
+	const char *data_len = "data I/O length (bytes)";
+	const char *nmimt = "nvme-mi message type";
+	const char *nmd0 = "nvme management dword 0 value";
+	const char *nmd1 = "nvme management dword 1 value";
+	const char *input = "data input or output file";
+
+	int mode = 0644;
+	void *data = NULL;
+	int err = 0;
+	bool send;
+	_cleanup_file_ int fd = -1;
+	int flags;
+	_cleanup_huge_ struct nvme_mem_huge mh = { 0, };
+	_cleanup_nvme_dev_ struct nvme_dev *dev = NULL;
+	__u32 result;
+
+	struct config {
+		__u8 opcode;
+		__u32 namespace_id;
+		__u32 data_len;
+		__u32 nmimt;
+		__u32 nmd0;
+		__u32 nmd1;
+		char *input_file;
+	};
+
+	struct config cfg = {
+		.opcode = 0,
+		.namespace_id = 0,
+		.data_len = 0,
+		.nmimt = 0,
+		.nmd0 = 0,
+		.nmd1 = 0,
+		.input_file = "",
+	};
+
+	NVME_ARGS(opts,
+		  OPT_BYTE("opcode", 'O', &cfg.opcode, opcode),
+		  OPT_UINT("namespace-id", 'n', &cfg.namespace_id, namespace_desired),
+		  OPT_UINT("data-len", 'l', &cfg.data_len, data_len),
+		  OPT_UINT("nmimt", 'm', &cfg.nmimt, nmimt),
+		  OPT_UINT("nmd0", '0', &cfg.nmd0, nmd0),
+		  OPT_UINT("nmd1", '1', &cfg.nmd1, nmd1),
+		  OPT_FILE("input-file", 'i', &cfg.input_file, input));
+
+	err = parse_and_open(&dev, argc, argv, desc, opts);
+	if (err)
+		return err;
+
+	if (admin_opcode == nvme_admin_nvme_mi_send) {
+		flags = O_RDONLY;
+		fd = STDIN_FILENO;
+		send = true;
+	} else {
+		flags = O_WRONLY | O_CREAT;
+		fd = STDOUT_FILENO;
+		send = false;
+	}
+
+	if (strlen(cfg.input_file)) {
+		fd = open(cfg.input_file, flags, mode);
+		if (fd < 0) {
+			nvme_show_perror(cfg.input_file);
+			return -EINVAL;
+		}
+	}
+
+	if (cfg.data_len) {
+		data = nvme_alloc_huge(cfg.data_len, &mh);
+		if (!data)
+			return -ENOMEM;
+
+		if (send) {
+			if (read(fd, data, cfg.data_len) < 0) {
+				err = -errno;
+				nvme_show_error("failed to read write buffer %s", strerror(errno));
+				return err;
+			}
+		}
+	}
+
+	err = nvme_cli_admin_passthru(dev, admin_opcode, 0, 0, cfg.namespace_id, 0, 0,
+				      cfg.nmimt << 11 | 4, cfg.opcode, cfg.nmd0, cfg.nmd1, 0, 0,
+				      cfg.data_len, data, 0, NULL, 0, &result);
+	if (err < 0) {
+		nvme_show_error("nmi_recv: %s", nvme_strerror(errno));
+	} else if (err) {
+		nvme_show_status(err);
+	} else  {
+		printf(
+		    "%s Command is Success and result: 0x%08x (status: 0x%02x, response: 0x%06x)\n",
+		    nvme_cmd_to_string(true, admin_opcode), result, result & 0xff, result >> 8);
+		if (result & 0xff)
+			printf("status: %s\n", nvme_mi_status_to_string(result & 0xff));
+		if (!send && strlen(cfg.input_file)) {
+			if (write(fd, (void *)data, cfg.data_len) < 0)
+				perror("failed to write data buffer");
+		} else if (data && !send && !err) {
+			d((unsigned char *)data, cfg.data_len, 16, 1);
+		}
 	}
 
 	return err;
@@ -9763,6 +12108,22 @@ int main(int argc, char **argv)
 	}
 	setlocale(LC_ALL, "");
 
+	/*
+	 * Read only commands are answered by nvme serve while it is running.
+	 * NVME_NO_SERVE makes them run in this process.
+	 */
+	if (!getenv("NVME_NO_SERVE") &&
+	    !nvme_serve_forward(NVME_SERVE_SOCKET, argc - 1, &argv[1], &err))
+		return err ? 1 : 0;
+
+	/*
+	 * Decoded output is printed field by field. When it goes to a file or
+	 * a pipe, collect it in a large buffer instead of writing it out in
+	 * small pieces. Terminals keep line buffering.
+	 */
+	if (!isatty(STDOUT_FILENO))
+		setvbuf(stdout, NULL, _IOFBF, NVME_STDOUT_BUF_SIZE);
+
 	err = handle_plugin(argc - 1, &argv[1], nvme.extensions);
 	if (err == -ENOTTY)
 		general_help(&builtin);
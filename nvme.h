@@ -38,8 +38,14 @@ enum nvme_print_flags {
 	JSON	= 1 << 1,	/* display in json format */
 	VS	= 1 << 2,	/* hex dump vendor specific data areas */
 	BINARY	= 1 << 3,	/* binary dump raw bytes */
+	NDJSON	= 1 << 4,	/* json, one compact record per line */
+	CBOR	= 1 << 5,	/* json data model, CBOR encoded */
+	OPENMETRICS = 1 << 6,	/* OpenMetrics text exposition */
 };
 
+/* Encodings of the JSON output, which json_print_object() applies itself */
+#define JSON_ENCODINGS	(NDJSON | CBOR)
+
 enum nvme_cli_topo_ranking {
 	NVME_CLI_TOPO_NAMESPACE,
 	NVME_CLI_TOPO_CTRL,
@@ -110,6 +116,8 @@ extern const char *output_format;
 
 int validate_output_format(const char *format, enum nvme_print_flags *flags);
 bool nvme_is_output_format_json(void);
+bool nvme_is_output_format_ndjson(void);
+bool nvme_is_output_format_cbor(void);
 int __id_ctrl(int argc, char **argv, struct command *cmd,
 	struct plugin *plugin, void (*vs)(uint8_t *vs, struct json_object *root));
 
@@ -173,8 +173,7 @@ static void huawei_json_print_list_items(struct huawei_list_item *list_items,
 		json_array_add_value_object(devices, device_attrs);
 	}
 	json_object_add_value_array(root, "Devices", devices);
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 	json_free_object(root);
 }
 
@@ -316,7 +315,7 @@ static int huawei_list(int argc, char **argv, struct command *command,
 		return ret;
 
 	ret = validate_output_format(cfg.output_format, &fmt);
-	if (ret < 0 || (fmt != JSON && fmt != NORMAL))
+	if (ret < 0 || (!(fmt & JSON) && fmt != NORMAL))
 		return ret;
 
 	n = scandir("/dev", &devices, nvme_namespace_filter, alphasort);
@@ -351,7 +350,7 @@ static int huawei_list(int argc, char **argv, struct command *command,
 	}
 
 	if (huawei_num > 0) {
-		if (fmt == JSON)
+		if (fmt & JSON)
 			huawei_json_print_list_items(list_items, huawei_num);
 		else
 			huawei_print_list_items(list_items, huawei_num);
@@ -707,7 +707,7 @@ static int micron_smbus_option(int argc, char **argv,
 		return -1;
 	}
 
-	close(dev_fd(dev));
+	dev_close(dev);
 	return err;
 }
 
@@ -771,8 +771,7 @@ static int micron_temp_stats(int argc, char **argv, struct command *cmd,
 				json_object_add_value_string(stats, sensor_str, datastr);
 			}
 			json_array_add_value_object(logPages, stats);
-			json_print_object(root, NULL);
-			printf("\n");
+			json_print_line(root);
 			json_free_object(root);
 		} else {
 			printf("Micron temperature information:\n");
@@ -994,8 +993,7 @@ print_stats:
 			json_object_add_value_int(stats, pcie_uncorrectable_errors[i].err, val);
 		}
 		json_array_add_value_object(pcieErrors, stats);
-		json_print_object(root, NULL);
-		printf("\n");
+		json_print_line(root);
 		json_free_object(root);
 	} else if (counters == true) {
 		__u8 *pcounter = (__u8 *)&pcie_error_counters;
@@ -1412,8 +1410,7 @@ static void print_smart_cloud_health_log(__u8 *buf, bool is_json)
 
 	if (is_json) {
 		json_array_add_value_object(logPages, stats);
-		json_print_object(root, NULL);
-		printf("\n");
+		json_print_line(root);
 		json_free_object(root);
 	}
 }
@@ -1452,8 +1449,7 @@ static void print_nand_stats_fb(__u8 *buf, __u8 *buf2, __u8 nsze, bool is_json,
 
 	if (is_json) {
 		json_array_add_value_object(logPages, stats);
-		json_print_object(root, NULL);
-		printf("\n");
+		json_print_line(root);
 		json_free_object(root);
 	}
 }
@@ -1477,8 +1473,7 @@ static void print_nand_stats_d0(__u8 *buf, __u8 oacs, bool is_json)
 						     d0_log_page[i].datastr);
 
 		json_array_add_value_object(logPages, stats);
-		json_print_object(root, NULL);
-		printf("\n");
+		json_print_line(root);
 		json_free_object(root);
 	} else {
 		for (int i = 0; i < 7; i++)
@@ -1591,8 +1586,7 @@ static void print_ext_smart_logs_e1(__u8 *buf, bool is_json)
 
 	if (is_json) {
 		json_array_add_value_object(logPages, stats);
-		json_print_object(root, NULL);
-		printf("\n");
+		json_print_line(root);
 		json_free_object(root);
 	}
 }
@@ -2094,8 +2088,7 @@ static int micron_drive_info(int argc, char **argv, struct command *cmd,
 		}
 
 		json_array_add_value_object(driveInfo, pinfo);
-		json_print_object(root, NULL);
-		printf("\n");
+		json_print_line(root);
 		json_free_object(root);
 	} else {
 		printf("Drive Hardware Version: %u.%u\n",
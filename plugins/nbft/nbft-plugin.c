@@ -340,8 +340,7 @@ static int json_show_nbfts(struct list_head *nbft_list, bool show_subsys,
 		}
 	}
 
-	json_print_object(nbft_json_array, NULL);
-	printf("\n");
+	json_print_line(nbft_json_array);
 	json_free_object(nbft_json_array);
 	return 0;
 fail:
@@ -568,7 +567,7 @@ int show_nbft(int argc, char **argv, struct command *cmd, struct plugin *plugin)
 	if (!ret) {
 		if (flags == NORMAL)
 			normal_show_nbfts(&nbft_list, show_subsys, show_hfi, show_discovery);
-		else if (flags == JSON)
+		else if (flags & JSON)
 			ret = json_show_nbfts(&nbft_list, show_subsys, show_hfi, show_discovery);
 		free_nbfts(&nbft_list);
 	}
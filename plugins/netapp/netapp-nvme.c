@@ -25,8 +25,10 @@
 
 #include "common.h"
 #include "nvme.h"
+#include "nvme-scan.h"
 #include "libnvme.h"
 
+#include "util/parallel.h"
 #include "util/suffix.h"
 
 #define CREATE_CMD
@@ -67,7 +69,6 @@ struct smdevice_info {
 
 struct ontapdevice_info {
 	unsigned int		nsid;
-	struct nvme_id_ctrl	ctrl;
 	struct nvme_id_ns	ns;
 	unsigned char		uuid[NVME_UUID_LEN];
 	unsigned char		log_data[ONTAP_C2_LOG_SIZE];
@@ -310,8 +311,7 @@ static void netapp_smdevices_print(struct smdevice_info *devices, int count, int
 	if (format == NJSON) {
 		/* complete the json output */
 		json_object_add_value_array(root, "SMdevices", json_devices);
-		json_print_object(root, NULL);
-		printf("\n");
+		json_print_line(root);
 		json_free_object(root);
 	}
 }
@@ -370,8 +370,7 @@ static void netapp_ontapdevices_print(struct ontapdevice_info *devices,
 	if (format == NJSON) {
 		/* complete the json output */
 		json_object_add_value_array(root, "ONTAPdevices", json_devices);
-		json_print_object(root, NULL);
-		printf("\n");
+		json_print_line(root);
 		json_free_object(root);
 	}
 }
@@ -437,24 +436,13 @@ static int netapp_smdevices_get_info(int fd, struct smdevice_info *item,
 	return 1;
 }
 
+/* the controller has been identified as an ONTAP controller already */
 static int netapp_ontapdevices_get_info(int fd, struct ontapdevice_info *item,
 		const char *dev)
 {
 	int err;
 	void *nsdescs;
 
-	err = nvme_identify_ctrl(fd, &item->ctrl);
-	if (err) {
-		fprintf(stderr, "Identify Controller failed to %s (%s)\n",
-			dev, err < 0 ? strerror(-err) :
-			nvme_status_to_string(err, false));
-		return 0;
-	}
-
-	if (strncmp("NetApp ONTAP Controller", item->ctrl.mn, 23) != 0)
-		/* not the right controller model */
-		return 0;
-
 	err = nvme_get_nsid(fd, &item->nsid);
 
 	err = nvme_identify_ns(fd, item->nsid, &item->ns);
@@ -517,6 +505,130 @@ static int netapp_nvme_filter(const struct dirent *d)
 	return 0;
 }
 
+/*
+ * Devices are probed in parallel, each into the slot of its index in the
+ * sorted directory listing. The slots of the devices found are moved
+ * together afterwards, so the output keeps the order of the listing.
+ */
+struct smdevices_probe {
+	struct dirent		**devices;
+	struct smdevice_info	*items;
+	int			*found;
+};
+
+static void netapp_smdevices_probe(int i, void *arg)
+{
+	struct smdevices_probe *probe = arg;
+	char path[264];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s%s", dev_path,
+		probe->devices[i]->d_name);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to open %s: %s\n", path,
+			strerror(errno));
+		return;
+	}
+
+	probe->found[i] = netapp_smdevices_get_info(fd, &probe->items[i], path);
+	close(fd);
+}
+
+/*
+ * ONTAP controllers expose many namespaces, identify every controller once
+ * through its first namespace instead of once per namespace.
+ */
+struct ontap_ctrl {
+	int			instance;
+	int			dev;	/* first namespace of the controller */
+	bool			ontap;
+};
+
+struct ontapdevices_probe {
+	struct dirent		**devices;
+	struct ontapdevice_info	*items;
+	struct ontap_ctrl	*ctrls;
+	int			*ctrl;	/* controller of each namespace */
+	int			*found;
+};
+
+static void netapp_ontap_ctrl_probe(int i, void *arg)
+{
+	struct ontapdevices_probe *probe = arg;
+	struct ontap_ctrl *ctrl = &probe->ctrls[i];
+	struct nvme_id_ctrl id;
+	char path[264];
+	int fd, err;
+
+	snprintf(path, sizeof(path), "%s%s", dev_path,
+		probe->devices[ctrl->dev]->d_name);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to open %s: %s\n", path,
+			strerror(errno));
+		return;
+	}
+
+	err = nvme_identify_ctrl(fd, &id);
+	close(fd);
+	if (err) {
+		fprintf(stderr, "Identify Controller failed to %s (%s)\n",
+			path, err < 0 ? strerror(-err) :
+			nvme_status_to_string(err, false));
+		return;
+	}
+
+	/* not the right controller model otherwise */
+	ctrl->ontap = !strncmp("NetApp ONTAP Controller", id.mn, 23);
+}
+
+static void netapp_ontapdevices_probe(int i, void *arg)
+{
+	struct ontapdevices_probe *probe = arg;
+	char path[264];
+	int fd;
+
+	if (!probe->ctrls[probe->ctrl[i]].ontap)
+		return;
+
+	snprintf(path, sizeof(path), "%s%s", dev_path,
+		probe->devices[i]->d_name);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to open %s: %s\n", path,
+			strerror(errno));
+		return;
+	}
+
+	probe->found[i] = netapp_ontapdevices_get_info(fd, &probe->items[i], path);
+	close(fd);
+}
+
+/* groups the namespaces by controller, returns the number of controllers */
+static int netapp_ontap_ctrls(struct ontapdevices_probe *probe, int num)
+{
+	int i, j, nr = 0, instance, ns;
+
+	for (i = 0; i < num; i++) {
+		/* the filter only passes names of this form */
+		sscanf(probe->devices[i]->d_name, "nvme%dn%d", &instance, &ns);
+
+		for (j = 0; j < nr; j++) {
+			if (probe->ctrls[j].instance == instance)
+				break;
+		}
+		if (j == nr) {
+			probe->ctrls[nr].instance = instance;
+			probe->ctrls[nr].dev = i;
+			nr++;
+		}
+		probe->ctrl[i] = j;
+	}
+
+	return nr;
+}
+
 static int netapp_output_format(char *format)
 {
 	if (!format)
@@ -537,9 +649,10 @@ static int netapp_smdevices(int argc, char **argv, struct command *command,
 	const char *desc = "Display information about E-Series volumes.";
 
 	struct dirent **devices;
-	int num, i, fd, ret, fmt;
+	int num, i, ret, fmt;
 	struct smdevice_info *smdevices;
-	char path[264];
+	struct smdevices_probe probe;
+	int *found;
 	int num_smdevices = 0;
 
 	struct config {
@@ -572,34 +685,36 @@ static int netapp_smdevices(int argc, char **argv, struct command *command,
 	}
 
 	smdevices = calloc(num, sizeof(*smdevices));
-	if (!smdevices) {
+	found = calloc(num, sizeof(*found));
+	if (!smdevices || !found) {
 		fprintf(stderr, "Unable to allocate memory for devices.\n");
-		return -ENOMEM;
+		ret = -ENOMEM;
+		goto out;
 	}
 
+	probe.devices = devices;
+	probe.items = smdevices;
+	probe.found = found;
+	nvme_parallel_for(num, NVME_SCAN_JOBS, netapp_smdevices_probe, &probe);
+
 	for (i = 0; i < num; i++) {
-		snprintf(path, sizeof(path), "%s%s", dev_path,
-			devices[i]->d_name);
-		fd = open(path, O_RDONLY);
-		if (fd < 0) {
-			fprintf(stderr, "Unable to open %s: %s\n", path,
-				strerror(errno));
+		if (!found[i])
 			continue;
-		}
-
-		num_smdevices += netapp_smdevices_get_info(fd,
-						&smdevices[num_smdevices], path);
-		close(fd);
+		if (i != num_smdevices)
+			smdevices[num_smdevices] = smdevices[i];
+		num_smdevices++;
 	}
 
 	if (num_smdevices)
 		netapp_smdevices_print(smdevices, num_smdevices, fmt);
 
+out:
 	for (i = 0; i < num; i++)
 		free(devices[i]);
 	free(devices);
 	free(smdevices);
-	return 0;
+	free(found);
+	return ret;
 }
 
 /* handler for 'nvme netapp ontapdevices' */
@@ -608,9 +723,9 @@ static int netapp_ontapdevices(int argc, char **argv, struct command *command,
 {
 	const char *desc = "Display information about ONTAP devices.";
 	struct dirent **devices;
-	int num, i, fd, ret, fmt;
+	int num, i, ret, fmt, nr_ctrls;
 	struct ontapdevice_info *ontapdevices;
-	char path[264];
+	struct ontapdevices_probe probe = { 0 };
 	int num_ontapdevices = 0;
 
 	struct config {
@@ -643,33 +758,39 @@ static int netapp_ontapdevices(int argc, char **argv, struct command *command,
 	}
 
 	ontapdevices = calloc(num, sizeof(*ontapdevices));
-	if (!ontapdevices) {
+	probe.ctrls = calloc(num, sizeof(*probe.ctrls));
+	probe.ctrl = calloc(num, sizeof(*probe.ctrl));
+	probe.found = calloc(num, sizeof(*probe.found));
+	if (!ontapdevices || !probe.ctrls || !probe.ctrl || !probe.found) {
 		fprintf(stderr, "Unable to allocate memory for devices.\n");
-		return -ENOMEM;
+		ret = -ENOMEM;
+		goto out;
 	}
 
+	probe.devices = devices;
+	probe.items = ontapdevices;
+	nr_ctrls = netapp_ontap_ctrls(&probe, num);
+	nvme_parallel_for(nr_ctrls, NVME_SCAN_JOBS, netapp_ontap_ctrl_probe, &probe);
+	nvme_parallel_for(num, NVME_SCAN_JOBS, netapp_ontapdevices_probe, &probe);
+
 	for (i = 0; i < num; i++) {
-		snprintf(path, sizeof(path), "%s%s", dev_path,
-				devices[i]->d_name);
-		fd = open(path, O_RDONLY);
-		if (fd < 0) {
-			fprintf(stderr, "Unable to open %s: %s\n", path,
-					strerror(errno));
+		if (!probe.found[i])
 			continue;
-		}
-
-		num_ontapdevices += netapp_ontapdevices_get_info(fd,
-				&ontapdevices[num_ontapdevices], path);
-
-		close(fd);
+		if (i != num_ontapdevices)
+			ontapdevices[num_ontapdevices] = ontapdevices[i];
+		num_ontapdevices++;
 	}
 
 	if (num_ontapdevices)
 		netapp_ontapdevices_print(ontapdevices, num_ontapdevices, fmt);
 
+out:
 	for (i = 0; i < num; i++)
 		free(devices[i]);
 	free(devices);
 	free(ontapdevices);
-	return 0;
+	free(probe.ctrls);
+	free(probe.ctrl);
+	free(probe.found);
+	return ret;
 }
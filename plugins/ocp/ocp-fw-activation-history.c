@@ -215,7 +215,7 @@ int ocp_fw_activation_history_log(int argc, char **argv, struct command *cmd,
 			return err;
 		}
 
-		if (print_flag == JSON)
+		if (print_flag & JSON)
 			ocp_fw_activation_history_json(&fw_history);
 		else if (print_flag == NORMAL)
 			ocp_fw_activation_history_normal(&fw_history);
@@ -15,13 +15,17 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "common.h"
 #include "nvme.h"
 #include "libnvme.h"
 #include "plugin.h"
 #include "linux/types.h"
+#include "util/mem.h"
 #include "util/types.h"
+#include "util/writer.h"
 #include "nvme-print.h"
 
 #include "ocp-smart-extended-log.h"
@@ -388,8 +392,7 @@ static void ocp_print_C3_log_json(struct ssd_latency_monitor_log *log_data)
 
 	json_object_add_value_string(root, "Log Page GUID", guid);
 
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 
 	json_free_object(root);
 }
@@ -455,7 +458,7 @@ static int get_c3_log_page(struct nvme_dev *dev, char *format)
 			}
 		}
 
-		switch (fmt) {
+		switch (fmt & ~JSON_ENCODINGS) {
 		case NORMAL:
 			ocp_print_C3_log_normal(dev, log_data);
 			break;
@@ -807,7 +810,11 @@ static int eol_plp_failure_mode(int argc, char **argv, struct command *cmd,
 
 #define TELEMETRY_HEADER_SIZE 512
 #define TELEMETRY_BYTE_PER_BLOCK 512
-#define TELEMETRY_TRANSFER_SIZE 1024
+#define TELEMETRY_DA1_HEADER_SIZE 1536
+#define TELEMETRY_MAX_TRANSFER_SIZE 0x40000
+#define TELEMETRY_EVENT_FIFO_NUM 16
+#define TELEMETRY_STAT_DESC_SIZE 8
+#define TELEMETRY_FIFO_DESC_SIZE 4
 #define FILE_NAME_SIZE 2048
 
 enum TELEMETRY_TYPE {
@@ -849,9 +856,9 @@ struct telemetry_data_area_1 {
 	__le16  da2_stat_start;
 	__le16  da2_stat_size;
 	__u8  reserved5[32];
-	__u8    event_fifo_da[16];
-	__le64	event_fifo_start[16];
-	__le64	event_fifo_size[16];
+	__u8    event_fifo_da[TELEMETRY_EVENT_FIFO_NUM];
+	__le64	event_fifo_start[TELEMETRY_EVENT_FIFO_NUM];
+	__le64	event_fifo_size[TELEMETRY_EVENT_FIFO_NUM];
 	__u8  reserved6[80];
 	__u8  smart_health_info[512];
 	__u8  smart_health_info_extended[512];
@@ -956,8 +963,8 @@ static void print_telemetry_data_area_1(struct telemetry_data_area_1 *da1,
 		for (i = 0; i < 4; i++)
 			printf("reserved1         : 0x%x\n", da1->reserved1[i]);
 		printf("Timestamp         : %"PRIu64"\n", le64_to_cpu(da1->timestamp));
-		for (i = 15; i >= 0; i--)
-			printf("%x", da1->log_page_guid[i]);
+		for (i = 16; i > 0; i--)
+			printf("%x", da1->log_page_guid[i - 1]);
 		printf("Number Telemetry Profiles Supported         : 0x%x\n", da1->no_of_tps_supp);
 		printf("Telemetry Profile Selected (TPS)         : 0x%x\n", da1->tps);
 		for (i = 0; i < 6; i++)
@@ -974,7 +981,7 @@ static void print_telemetry_data_area_1(struct telemetry_data_area_1 *da1,
 		printf("Data Area 2 Statistic Size         : 0x%x\n", le16_to_cpu(da1->da2_stat_size));
 		for (i = 0; i < 32; i++)
 			printf("reserved5         : 0x%x\n", da1->reserved5[i]);
-		for (i = 0; i < 17; i++){
+		for (i = 0; i < TELEMETRY_EVENT_FIFO_NUM; i++) {
 			printf("Event FIFO %d Data Area         : 0x%x\n", i, da1->event_fifo_da[i]);
 			printf("Event FIFO %d Start         : %"PRIu64"\n", i, le64_to_cpu(da1->event_fifo_start[i]));
 			printf("Event FIFO %d Size         : %"PRIu64"\n", i, le64_to_cpu(da1->event_fifo_size[i]));
@@ -988,112 +995,315 @@ static void print_telemetry_data_area_1(struct telemetry_data_area_1 *da1,
 		printf("===============================================\n\n");
 	}
 }
-static void print_telemetry_da1_stat(__u8 *da1_stat, int tele_type, __u16 buf_size)
+/* Telemetry String Log (LID C9h) index used to name identifiers, see below */
+enum telemetry_str_table {
+	TELEMETRY_STR_STAT,
+	TELEMETRY_STR_EVENT,
+	TELEMETRY_STR_VU_EVENT,
+	TELEMETRY_STR_TABLE_NUM,
+};
+
+struct telemetry_str_index;
+
+static struct telemetry_str_index *telemetry_str_index_get(struct nvme_dev *dev,
+							   struct nvme_id_ctrl *ctrl);
+static void telemetry_str_index_free(struct telemetry_str_index *idx);
+static const char *telemetry_str_lookup(struct telemetry_str_index *idx,
+					enum telemetry_str_table table, __u32 id,
+					__u32 *len);
+
+/*
+ * Incremental decoder for the Data Area 1 header and the statistic and
+ * event FIFO sections it describes. The telemetry log is fed through it
+ * chunk by chunk as it is read from the device, so the report is complete
+ * when the last chunk lands and no section has to be buffered as a whole.
+ */
+enum telemetry_section_type {
+	TELEMETRY_SECTION_STAT,
+	TELEMETRY_SECTION_FIFO,
+};
+
+struct telemetry_section {
+	enum telemetry_section_type type;
+	int data_area;
+	__u64 start;		/* byte offset into the telemetry log */
+	__u64 end;
+	__u64 pos;		/* next byte offset to decode */
+	__u8 desc[TELEMETRY_STAT_DESC_SIZE];
+	__u32 desc_len;		/* bytes of a descriptor split across chunks */
+	__u64 skip;		/* payload bytes left of the current descriptor */
+};
+
+struct telemetry_decoder {
+	int tele_type;
+	struct telemetry_str_index *strs;	/* may be NULL */
+	__u32 da1_len;
+	__u8 da1[TELEMETRY_DA1_HEADER_SIZE];
+	int nr_sections;
+	struct telemetry_section sections[2 + 2 * TELEMETRY_EVENT_FIFO_NUM];
+};
+
+static void print_telemetry_section_begin(struct telemetry_section *sec, int tele_type)
 {
-	if (da1_stat) {
-		unsigned int i = 0;
-		if (tele_type == TELEMETRY_TYPE_HOST)
-			printf("============ Telemetry Host Data area 1 Statistics ============\n");
-		else
-			printf("========= Telemetry Controller Data area 1 Statistics =========\n");
-		while((i + 8) < buf_size) {
-			printf("Statistics Identifier         : 0x%x\n", (da1_stat[i] | da1_stat[i+1] << 8));
-			printf("Statistics info         : 0x%x\n", da1_stat[i+2]);
-			printf("NS info         : 0x%x\n", da1_stat[i+3]);
-			printf("Statistic Data Size         : 0x%x\n", (da1_stat[i+4] | da1_stat[i+5] << 8));
-			printf("Reserved         : 0x%x\n", (da1_stat[i+6] | da1_stat[i+7] << 8));
-			i = 8 + ((da1_stat[i+4] | da1_stat[i+5] << 8) * 4);
-		}
-		printf("===============================================\n\n");
+	const char *name = sec->type == TELEMETRY_SECTION_STAT ? "Statistics" : "FIFO";
+
+	if (tele_type == TELEMETRY_TYPE_HOST)
+		printf("============ Telemetry Host Data area %d %s ============\n",
+		       sec->data_area, name);
+	else
+		printf("========= Telemetry Controller Data area %d %s =========\n",
+		       sec->data_area, name);
+}
+
+static void print_telemetry_section_end(struct telemetry_section *sec)
+{
+	printf("===============================================\n\n");
+}
+
+static void print_telemetry_stat_desc(struct telemetry_decoder *dec, __u8 *desc)
+{
+	__u32 id = desc[0] | desc[1] << 8;
+	const char *name;
+	__u32 len;
+
+	printf("Statistics Identifier         : 0x%x\n", id);
+	name = telemetry_str_lookup(dec->strs, TELEMETRY_STR_STAT, id, &len);
+	if (name)
+		printf("Statistics Name         : %.*s\n", (int)len, name);
+	printf("Statistics info         : 0x%x\n", desc[2]);
+	printf("NS info         : 0x%x\n", desc[3]);
+	printf("Statistic Data Size         : 0x%x\n", desc[4] | desc[5] << 8);
+	printf("Reserved         : 0x%x\n", desc[6] | desc[7] << 8);
+}
+
+static void print_telemetry_fifo_desc(struct telemetry_decoder *dec, __u8 *desc)
+{
+	__u32 id = desc[0] << 16 | desc[1] | desc[2] << 8;
+	const char *name;
+	__u32 len;
+
+	printf("Debug Event Class Type         : 0x%x\n", desc[0]);
+	printf("Event ID         : 0x%x\n", desc[1] | desc[2] << 8);
+	name = telemetry_str_lookup(dec->strs, TELEMETRY_STR_EVENT, id, &len);
+	if (!name)
+		name = telemetry_str_lookup(dec->strs, TELEMETRY_STR_VU_EVENT, id, &len);
+	if (name)
+		printf("Event Name         : %.*s\n", (int)len, name);
+	printf("Event Data Size         : 0x%x\n", desc[3]);
+}
+
+static void telemetry_add_section(struct telemetry_decoder *dec,
+				  enum telemetry_section_type type, int data_area,
+				  __u64 start, __u64 size)
+{
+	struct telemetry_section *sec;
+
+	if (!size || dec->nr_sections >= ARRAY_SIZE(dec->sections))
+		return;
+
+	sec = &dec->sections[dec->nr_sections++];
+	memset(sec, 0, sizeof(*sec));
+	sec->type = type;
+	sec->data_area = data_area;
+	sec->start = start;
+	sec->end = start + size;
+	sec->pos = start;
+}
+
+static void telemetry_decode_da1(struct telemetry_decoder *dec)
+{
+	struct telemetry_data_area_1 *da1 = (struct telemetry_data_area_1 *)dec->da1;
+	int i;
+
+	print_telemetry_data_area_1(da1, dec->tele_type);
+
+	/* offsets and sizes are in dwords */
+	telemetry_add_section(dec, TELEMETRY_SECTION_STAT, 1,
+			      (__u64)le16_to_cpu(da1->da1_stat_start) * 4,
+			      (__u64)le16_to_cpu(da1->da1_stat_size) * 4);
+	telemetry_add_section(dec, TELEMETRY_SECTION_STAT, 2,
+			      (__u64)le16_to_cpu(da1->da2_stat_start) * 4,
+			      (__u64)le16_to_cpu(da1->da2_stat_size) * 4);
+
+	for (i = 0; i < TELEMETRY_EVENT_FIFO_NUM; i++) {
+		if (da1->event_fifo_da[i] != 1 && da1->event_fifo_da[i] != 2)
+			continue;
+		telemetry_add_section(dec, TELEMETRY_SECTION_FIFO, da1->event_fifo_da[i],
+				      le64_to_cpu(da1->event_fifo_start[i]) * 4,
+				      le64_to_cpu(da1->event_fifo_size[i]) * 4);
 	}
 }
-static void print_telemetry_da1_fifo(__u8 *da1_fifo, int tele_type, __u16 buf_size)
+
+static void telemetry_decode_section(struct telemetry_decoder *dec,
+				     struct telemetry_section *sec, __u64 offset,
+				     __u8 *buf, __u32 len)
 {
-	if (da1_fifo) {
-		unsigned int i = 0;
-		if (tele_type == TELEMETRY_TYPE_HOST)
-			printf("============ Telemetry Host Data area 1 FIFO ============\n");
-		else
-			printf("========= Telemetry Controller Data area 1 FIFO =========\n");
-		while((i + 4) < buf_size) {
-			printf("Debug Event Class Type         : 0x%x\n", da1_fifo[i]);
-			printf("Event ID         : 0x%x\n", (da1_fifo[i+1] | da1_fifo[i+2] << 8));
-			printf("Event Data Size         : 0x%x\n", da1_fifo[3]);
-			i = 4 + ((da1_fifo[3]) * 4);
+	__u32 desc_size = sec->type == TELEMETRY_SECTION_STAT ?
+		TELEMETRY_STAT_DESC_SIZE : TELEMETRY_FIFO_DESC_SIZE;
+	__u64 begin = max(offset, sec->pos);
+	__u64 end = min(offset + len, sec->end);
+	__u64 n;
+
+	/* chunks arrive in order, anything else is not ours to decode */
+	if (begin >= end || begin != sec->pos)
+		return;
+
+	if (sec->pos == sec->start)
+		print_telemetry_section_begin(sec, dec->tele_type);
+
+	while (begin < end) {
+		if (sec->skip) {
+			n = min(sec->skip, end - begin);
+			sec->skip -= n;
+			begin += n;
+			continue;
+		}
+
+		n = min(desc_size - sec->desc_len, end - begin);
+		memcpy(sec->desc + sec->desc_len, buf + (begin - offset), n);
+		sec->desc_len += n;
+		begin += n;
+		if (sec->desc_len < desc_size)
+			break;
+		sec->desc_len = 0;
+
+		if (sec->type == TELEMETRY_SECTION_STAT) {
+			/* an empty descriptor pads the rest of the section */
+			if (!(sec->desc[0] | sec->desc[1] | sec->desc[4] | sec->desc[5])) {
+				begin = sec->end;
+				break;
+			}
+			print_telemetry_stat_desc(dec, sec->desc);
+			sec->skip = (__u64)(sec->desc[4] | sec->desc[5] << 8) * 4;
+		} else {
+			print_telemetry_fifo_desc(dec, sec->desc);
+			sec->skip = (__u64)sec->desc[3] * 4;
 		}
-		printf("===============================================\n\n");
 	}
+
+	sec->pos = begin;
+	if (sec->pos == sec->end)
+		print_telemetry_section_end(sec);
 }
-static void print_telemetry_da2_stat(__u8 *da1_stat, int tele_type, __u16 buf_size)
+
+/* Feeds a chunk of the telemetry log starting at byte offset into the decoder */
+static void telemetry_decode(struct telemetry_decoder *dec, __u64 offset, __u8 *buf,
+			     __u32 len)
 {
-	if (da1_stat) {
-		unsigned int i = 0;
-		if (tele_type == TELEMETRY_TYPE_HOST)
-			printf("============ Telemetry Host Data area 1 Statistics ============\n");
-		else
-			printf("========= Telemetry Controller Data area 1 Statistics =========\n");
-		while((i + 8) < buf_size) {
-			printf("Statistics Identifier         : 0x%x\n", (da1_stat[i] | da1_stat[i+1] << 8));
-			printf("Statistics info         : 0x%x\n", da1_stat[i+2]);
-			printf("NS info         : 0x%x\n", da1_stat[i+3]);
-			printf("Statistic Data Size         : 0x%x\n", (da1_stat[i+4] | da1_stat[i+5] << 8));
-			printf("Reserved         : 0x%x\n", (da1_stat[i+6] | da1_stat[i+7] << 8));
-			i = 8 + ((da1_stat[i+4] | da1_stat[i+5] << 8) * 4);
-		}
-		printf("===============================================\n\n");
+	__u64 begin, end;
+	int i;
+
+	begin = max(offset, (__u64)TELEMETRY_HEADER_SIZE + dec->da1_len);
+	end = min(offset + len, (__u64)TELEMETRY_HEADER_SIZE + TELEMETRY_DA1_HEADER_SIZE);
+	if (dec->da1_len < TELEMETRY_DA1_HEADER_SIZE && begin < end &&
+	    begin == TELEMETRY_HEADER_SIZE + dec->da1_len) {
+		memcpy(dec->da1 + dec->da1_len, buf + (begin - offset), end - begin);
+		dec->da1_len += end - begin;
+		if (dec->da1_len == TELEMETRY_DA1_HEADER_SIZE)
+			telemetry_decode_da1(dec);
+	}
+
+	for (i = 0; i < dec->nr_sections; i++)
+		telemetry_decode_section(dec, &dec->sections[i], offset, buf, len);
+}
+
+/*
+ * Reads the parts of [offset, offset + len) the decoder still needs and that
+ * were not covered by the dumped data area, xfer_size bytes at a time.
+ */
+static int telemetry_decode_fetch(struct nvme_dev *dev, struct telemetry_decoder *dec,
+				  __u8 tele_type, __u8 rae, __u8 *buf, __u32 xfer_size,
+				  __u64 offset, __u64 len)
+{
+	__u32 n;
+	int err;
+
+	while (len) {
+		n = min(len, xfer_size);
+		err = get_telemetry_data(dev, 0, tele_type, n, buf, 0, rae, offset);
+		if (err)
+			return err;
+		telemetry_decode(dec, offset, buf, n);
+		offset += n;
+		len -= n;
 	}
+
+	return 0;
 }
-static void print_telemetry_da2_fifo(__u8 *da1_fifo, int tele_type, __u16 buf_size)
+
+static int telemetry_decode_finish(struct nvme_dev *dev, struct telemetry_decoder *dec,
+				   __u8 tele_type, __u8 rae, __u32 xfer_size)
 {
-	if (da1_fifo) {
-		unsigned int i = 0;
-		if (tele_type == TELEMETRY_TYPE_HOST)
-			printf("============ Telemetry Host Data area 1 Statistics ============\n");
-		else
-			printf("========= Telemetry Controller Data area 1 Statistics =========\n");
-		while((i + 4) < buf_size) {
-			printf("Debug Event Class Type         : 0x%x\n", da1_fifo[i]);
-			printf("Event ID         : 0x%x\n", (da1_fifo[i+1] | da1_fifo[i+2] << 8));
-			printf("Event Data Size         : 0x%x\n", da1_fifo[3]);
-			i = 4 + ((da1_fifo[3]) * 4);
+	struct telemetry_section *sec;
+	int i, err = 0;
+	__u8 *buf;
+
+	buf = nvme_alloc(xfer_size);
+	if (!buf)
+		return -ENOMEM;
+
+	if (dec->da1_len < TELEMETRY_DA1_HEADER_SIZE) {
+		dec->da1_len = 0;
+		err = telemetry_decode_fetch(dev, dec, tele_type, rae, buf, xfer_size,
+					     TELEMETRY_HEADER_SIZE, TELEMETRY_DA1_HEADER_SIZE);
+		if (err)
+			goto out;
+	}
+
+	for (i = 0; i < dec->nr_sections; i++) {
+		sec = &dec->sections[i];
+		if (sec->pos == sec->end)
+			continue;
+		/* restart sections the dumped data area only partially covered */
+		if (sec->pos != sec->start) {
+			sec->pos = sec->start;
+			sec->desc_len = 0;
+			sec->skip = 0;
 		}
-		printf("===============================================\n\n");
+		err = telemetry_decode_fetch(dev, dec, tele_type, rae, buf, xfer_size,
+					     sec->start, sec->end - sec->start);
+		if (err)
+			goto out;
 	}
+
+out:
+	free(buf);
+	return err;
 }
 
 static int extract_dump_get_log(struct nvme_dev *dev, char *featurename, char *filename, char *sn,
-				int dumpsize, int transfersize, __u32 nsid, __u8 log_id,
-				__u8 lsp, __u64 offset, bool rae)
+				__u64 dumpsize, __u32 transfersize, __u32 nsid, __u8 log_id,
+				__u8 lsp, __u64 offset, bool rae, struct telemetry_decoder *dec)
 {
-	int i = 0, err = 0;
-
-	char *data = calloc(transfersize, sizeof(char));
 	char filepath[FILE_NAME_SIZE] = {0,};
-	int output = 0;
-	int total_loop_cnt = dumpsize / transfersize;
-	int last_xfer_size = dumpsize % transfersize;
-
-	if (last_xfer_size)
-		total_loop_cnt++;
-	else
-		last_xfer_size = transfersize;
+	struct nvme_writer *output;
+	__u64 done = 0;
+	__u32 len;
+	void *data;
+	int err = 0, ret;
 
 	if (filename == 0)
 		snprintf(filepath, FILE_NAME_SIZE, "%s_%s.bin", featurename, sn);
 	else
 		snprintf(filepath, FILE_NAME_SIZE, "%s%s_%s.bin", filename, featurename, sn);
 
-	for (i = 0; i < total_loop_cnt; i++) {
-		memset(data, 0, transfersize);
+	/* the next chunk is read while the previous one is written out */
+	output = nvme_writer_open(filepath, transfersize, false);
+	if (!output)
+		return -13;
+
+	while (done < dumpsize) {
+		len = min(dumpsize - done, transfersize);
+		data = nvme_writer_get_buf(output);
 
 		struct nvme_get_log_args args = {
 			.lpo = offset,
 			.result = NULL,
-			.log = (void *)data,
+			.log = data,
 			.args_size = sizeof(args),
 			.fd = dev_fd(dev),
 			.lid = log_id,
-			.len = transfersize,
+			.len = len,
 			.nsid = nsid,
 			.lsp = lsp,
 			.uuidx = 0,
@@ -1104,55 +1314,40 @@ static int extract_dump_get_log(struct nvme_dev *dev, char *featurename, char *f
 		};
 
 		err = nvme_get_log(&args);
-		if (err) {
-			if (i > 0)
-				goto close_output;
-			else
-				goto end;
-		}
+		if (err)
+			goto close_output;
 
-		if (i != total_loop_cnt - 1) {
-			if (!i) {
-				output = open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-				if (output < 0) {
-					err = -13;
-					goto end;
-				}
-			}
-			if (write(output, data, transfersize) < 0) {
-				err = -10;
-				goto close_output;
-			}
-		} else {
-			if (write(output, data, last_xfer_size) < 0) {
-				err = -10;
-				goto close_output;
-			}
+		telemetry_decode(dec, offset, data, len);
+
+		if (nvme_writer_commit(output, len)) {
+			err = -10;
+			goto close_output;
 		}
-		offset += transfersize;
-		printf("%d%%\r", (i + 1) * 100 / total_loop_cnt);
+		offset += len;
+		done += len;
+		printf("%d%%\r", (int)(done * 100 / dumpsize));
 	}
-	printf("100%%\nThe log file was saved at \"%s\"\n", filepath);
 
 close_output:
-	close(output);
+	ret = nvme_writer_close(output);
+	if (ret && !err)
+		err = -10;
+	if (!err)
+		printf("100%%\nThe log file was saved at \"%s\"\n", filepath);
 
-end:
-	free(data);
 	return err;
 }
 
 static int get_telemetry_dump(struct nvme_dev *dev, char *filename, char *sn,
-			      enum TELEMETRY_TYPE tele_type, int data_area, bool header_print)
+			      enum TELEMETRY_TYPE tele_type, int data_area, bool header_print,
+			      __u32 xfer_size, struct telemetry_str_index *strs)
 {
 	__u32 err = 0, nsid = 0;
 	__u8 lsp = 0, rae = 0;
-	unsigned int i = 0;
-	char data[TELEMETRY_TRANSFER_SIZE] = { 0 };
-	char data1[1536] = { 0 };
+	char data[TELEMETRY_HEADER_SIZE] = { 0 };
 	char *featurename = 0;
 	struct telemetry_initiated_log *logheader = (struct telemetry_initiated_log *)data;
-	struct telemetry_data_area_1 *da1 = (struct telemetry_data_area_1 *)data1;
+	struct telemetry_decoder *dec;
 	__u64 offset = 0, size = 0;
 	char dumpname[FILE_NAME_SIZE] = { 0 };
 
@@ -1179,43 +1374,6 @@ static int get_telemetry_dump(struct nvme_dev *dev, char *filename, char *sn,
 
 	if (header_print)
 		print_telemetry_header(logheader, tele_type);
-	err = get_telemetry_data(dev, nsid, tele_type, 1536,
-				(void *)data1, lsp, rae, 512);
-	if (err)
-		return err;
-	print_telemetry_data_area_1(da1, tele_type);
-	char *da1_stat = calloc((da1->da1_stat_size * 4), sizeof(char));
-	err = get_telemetry_data(dev, nsid, tele_type, (da1->da1_stat_size) * 4,
-				(void *)da1_stat, lsp, rae, (da1->da1_stat_start) * 4);
-	if (err)
-		return err;
-	print_telemetry_da1_stat((void *)da1_stat, tele_type, (da1->da1_stat_size) * 4);
-	for (i = 0; i < 17 ; i++){
-		if (da1->event_fifo_da[i] == 1){
-			char *da1_fifo = calloc((da1->event_fifo_size[i]) * 4, sizeof(char));
-			err = get_telemetry_data(dev, nsid, tele_type, (da1->event_fifo_size[i]) * 4,
-				(void *)da1_stat, lsp, rae, (da1->event_fifo_start[i]) * 4);
-			if (err)
-				return err;
-			print_telemetry_da1_fifo((void *)da1_fifo, tele_type, (da1->event_fifo_size[i]) * 4);
-		}
-	}
-	char *da2_stat = calloc((da1->da2_stat_size * 4), sizeof(char));
-	err = get_telemetry_data(dev, nsid, tele_type, (da1->da2_stat_size) * 4,
-				(void *)da2_stat, lsp, rae, (da1->da2_stat_start) * 4);
-	if (err)
-		return err;
-	print_telemetry_da2_stat((void *)da2_stat, tele_type, (da1->da2_stat_size) * 4);
-	for (i = 0; i < 17 ; i++){
-		if (da1->event_fifo_da[i] == 2){
-			char *da1_fifo = calloc((da1->event_fifo_size[i]) * 4, sizeof(char));
-			err = get_telemetry_data(dev, nsid, tele_type, (da1->event_fifo_size[i]) * 4,
-				(void *)da1_stat, lsp, rae, (da1->event_fifo_start[i]) * 4);
-			if (err)
-				return err;
-			print_telemetry_da2_fifo((void *)da1_fifo, tele_type, (da1->event_fifo_size[i]) * 4);
-		}
-	}
 
 	switch (data_area) {
 	case 1:
@@ -1238,17 +1396,29 @@ static int get_telemetry_dump(struct nvme_dev *dev, char *filename, char *sn,
 		break;
 	}
 
+	dec = calloc(1, sizeof(*dec));
+	if (!dec)
+		return -ENOMEM;
+	dec->tele_type = tele_type;
+	dec->strs = strs;
+
 	if (!size) {
 		printf("Telemetry %s Area %d is empty.\n", featurename, data_area);
-		return err;
+	} else {
+		snprintf(dumpname, FILE_NAME_SIZE,
+			 "Telemetry_%s_Area_%d", featurename, data_area);
+		err = extract_dump_get_log(dev, dumpname, filename, sn,
+					   size * TELEMETRY_BYTE_PER_BLOCK, xfer_size, nsid,
+					   tele_type, 0, offset, rae, dec);
+		if (err)
+			goto out;
 	}
 
-	snprintf(dumpname, FILE_NAME_SIZE,
-					"Telemetry_%s_Area_%d", featurename, data_area);
-	err = extract_dump_get_log(dev, dumpname, filename, sn, size * TELEMETRY_BYTE_PER_BLOCK,
-			TELEMETRY_TRANSFER_SIZE, nsid, tele_type,
-			0, offset, rae);
+	/* decode what the dumped data area did not cover */
+	err = telemetry_decode_finish(dev, dec, tele_type, rae, xfer_size);
 
+out:
+	free(dec);
 	return err;
 }
 
@@ -1269,6 +1439,8 @@ static int ocp_telemetry_log(int argc, char **argv, struct command *cmd,
 	char sn[21] = {0,};
 	struct nvme_id_ctrl ctrl;
 	bool is_support_telemetry_controller;
+	struct telemetry_str_index *strs;
+	__u32 xfer_size;
 
 	int tele_type = 0;
 	int tele_area = 0;
@@ -1314,6 +1486,11 @@ static int ocp_telemetry_log(int argc, char **argv, struct command *cmd,
 
 	is_support_telemetry_controller = ((ctrl.lpa & 0x8) >> 3);
 
+	/* MDTS is in units of the minimum memory page size, assume 4k */
+	xfer_size = TELEMETRY_MAX_TRANSFER_SIZE;
+	if (ctrl.mdts && ctrl.mdts < 32)
+		xfer_size = min(xfer_size, (1ULL << ctrl.mdts) * 4096);
+
 	if (!cfg.type && !cfg.area) {
 		tele_type = TELEMETRY_TYPE_NONE;
 		tele_area = 0;
@@ -1338,13 +1515,16 @@ static int ocp_telemetry_log(int argc, char **argv, struct command *cmd,
 		return err;
 	}
 
+	/* names for the decoded identifiers, optional */
+	strs = telemetry_str_index_get(dev, &ctrl);
+
 	if (tele_type == TELEMETRY_TYPE_NONE) {
 		printf("\n-------------------------------------------------------------\n");
 		/* Host 0 (lsp == 0) must be executed before Host 1 (lsp == 1). */
 		printf("\nExtracting Telemetry Host 0 Dump (Data Area 1)...\n");
 
 		err = get_telemetry_dump(dev, cfg.file, sn,
-				TELEMETRY_TYPE_HOST_0, 1, true);
+				TELEMETRY_TYPE_HOST_0, 1, true, xfer_size, strs);
 		if (err)
 			fprintf(stderr, "NVMe Status: %s(%x)\n", nvme_status_to_string(err, false), err);
 
@@ -1353,7 +1533,7 @@ static int ocp_telemetry_log(int argc, char **argv, struct command *cmd,
 		printf("\nExtracting Telemetry Host 0 Dump (Data Area 3)...\n");
 
 		err = get_telemetry_dump(dev, cfg.file, sn,
-				TELEMETRY_TYPE_HOST_0, 3, false);
+				TELEMETRY_TYPE_HOST_0, 3, false, xfer_size, strs);
 		if (err)
 			fprintf(stderr, "NVMe Status: %s(%x)\n", nvme_status_to_string(err, false), err);
 
@@ -1362,7 +1542,7 @@ static int ocp_telemetry_log(int argc, char **argv, struct command *cmd,
 		printf("\nExtracting Telemetry Host 1 Dump (Data Area 1)...\n");
 
 		err = get_telemetry_dump(dev, cfg.file, sn,
-				TELEMETRY_TYPE_HOST_1, 1, true);
+				TELEMETRY_TYPE_HOST_1, 1, true, xfer_size, strs);
 		if (err)
 			fprintf(stderr, "NVMe Status: %s(%x)\n", nvme_status_to_string(err, false), err);
 
@@ -1371,7 +1551,7 @@ static int ocp_telemetry_log(int argc, char **argv, struct command *cmd,
 		printf("\nExtracting Telemetry Host 1 Dump (Data Area 3)...\n");
 
 		err = get_telemetry_dump(dev, cfg.file, sn,
-				TELEMETRY_TYPE_HOST_1, 3, false);
+				TELEMETRY_TYPE_HOST_1, 3, false, xfer_size, strs);
 		if (err)
 			fprintf(stderr, "NVMe Status: %s(%x)\n", nvme_status_to_string(err, false), err);
 
@@ -1381,7 +1561,7 @@ static int ocp_telemetry_log(int argc, char **argv, struct command *cmd,
 
 		if (is_support_telemetry_controller == true) {
 			err = get_telemetry_dump(dev, cfg.file, sn,
-					TELEMETRY_TYPE_CONTROLLER, 3, true);
+					TELEMETRY_TYPE_CONTROLLER, 3, true, xfer_size, strs);
 			if (err)
 				fprintf(stderr, "NVMe Status: %s(%x)\n", nvme_status_to_string(err, false), err);
 		}
@@ -1391,7 +1571,7 @@ static int ocp_telemetry_log(int argc, char **argv, struct command *cmd,
 		printf("Extracting Telemetry Controller Dump (Data Area %d)...\n", tele_area);
 
 		if (is_support_telemetry_controller == true) {
-			err = get_telemetry_dump(dev, cfg.file, sn, tele_type, tele_area, true);
+			err = get_telemetry_dump(dev, cfg.file, sn, tele_type, tele_area, true, xfer_size, strs);
 			if (err)
 				fprintf(stderr, "NVMe Status: %s(%x)\n", nvme_status_to_string(err, false), err);
 		}
@@ -1399,11 +1579,13 @@ static int ocp_telemetry_log(int argc, char **argv, struct command *cmd,
 		printf("Extracting Telemetry Host(%d) Dump (Data Area %d)...\n",
 				(tele_type == TELEMETRY_TYPE_HOST_0) ? 0 : 1, tele_area);
 
-		err = get_telemetry_dump(dev, cfg.file, sn, tele_type, tele_area, true);
+		err = get_telemetry_dump(dev, cfg.file, sn, tele_type, tele_area, true, xfer_size, strs);
 		if (err)
 			fprintf(stderr, "NVMe Status: %s(%x)\n", nvme_status_to_string(err, false), err);
 	}
 
+	telemetry_str_index_free(strs);
+
 	printf("telemetry-log done.\n");
 
 return err;
@@ -1498,8 +1680,7 @@ static void ocp_print_C5_log_json(struct unsupported_requirement_log *log_data)
 		guid += sprintf(guid, "%02x", log_data->log_page_guid[j]);
 	json_object_add_value_string(root, "Log page GUID", guid_buf);
 
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 
 	json_free_object(root);
 }
@@ -1563,7 +1744,7 @@ static int get_c5_log_page(struct nvme_dev *dev, char *format)
 			}
 		}
 
-		switch (fmt) {
+		switch (fmt & ~JSON_ENCODINGS) {
 		case NORMAL:
 			ocp_print_C5_log_normal(dev, log_data);
 			break;
@@ -1725,8 +1906,7 @@ static void ocp_print_c1_log_json(struct ocp_error_recovery_log_page *log_data)
 		(uint64_t)le64_to_cpu(*(uint64_t *)&log_data->log_page_guid[0]));
 	json_object_add_value_string(root, "Log page GUID", guid);
 
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 	json_free_object(root);
 }
 
@@ -1788,7 +1968,7 @@ static int get_c1_log_page(struct nvme_dev *dev, char *format)
 			}
 		}
 
-		switch (fmt) {
+		switch (fmt & ~JSON_ENCODINGS) {
 		case NORMAL:
 			ocp_print_c1_log_normal(log_data);
 			break;
@@ -1941,8 +2121,7 @@ static void ocp_print_c4_log_json(struct ocp_device_capabilities_log_page *log_d
 		(uint64_t)le64_to_cpu(*(uint64_t *)&log_data->log_page_guid[0]));
 	json_object_add_value_string(root, "Log page GUID", guid);
 
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 	json_free_object(root);
 }
 
@@ -2004,7 +2183,7 @@ static int get_c4_log_page(struct nvme_dev *dev, char *format)
 			}
 		}
 
-		switch (fmt) {
+		switch (fmt & ~JSON_ENCODINGS) {
 		case NORMAL:
 			ocp_print_c4_log_normal(log_data);
 			break;
@@ -2744,6 +2923,456 @@ struct __attribute__((__packed__)) vu_event_id_str_table_entry {
 	__le32    reserved;
 };
 
+/*
+ * Telemetry string log index
+ *
+ * Sorted tables mapping statistic and event identifiers to their names. The
+ * slots reference the ASCII table of the log, nothing is copied. Header, log
+ * and slots live in one buffer which is also the format of the cache file,
+ * so an index cached for the firmware revision is mapped and used as is.
+ */
+#define C9_STR_INDEX_CACHE_DIR		RUNDIR "/nvme/ocp"
+#define C9_STR_INDEX_MAGIC		"OCPC9IDX"
+#define C9_STR_INDEX_VERSION		1
+#define C9_STR_TABLE_ENTRY_SIZE		16
+
+struct telemetry_str_index_hdr {
+	char	magic[8];
+	__u32	version;
+	__u32	nr[TELEMETRY_STR_TABLE_NUM];
+	__u64	log_len;
+	char	fr[16];
+};
+
+struct telemetry_str_slot {
+	__u32	id;		/* event identifiers are class << 16 | id */
+	__u32	len;
+	__u64	ofst;		/* byte offset of the name into the log */
+};
+
+struct telemetry_str_index {
+	void *buf;
+	size_t len;
+	bool mapped;
+	__u8 *log;
+	__u64 log_len;
+	__u32 nr[TELEMETRY_STR_TABLE_NUM];
+	struct telemetry_str_slot *slots[TELEMETRY_STR_TABLE_NUM];
+};
+
+static size_t telemetry_str_log_ofst(void)
+{
+	return sizeof(struct telemetry_str_index_hdr);
+}
+
+static size_t telemetry_str_slots_ofst(__u64 log_len)
+{
+	return telemetry_str_log_ofst() + ((log_len + 7) & ~7ULL);
+}
+
+static int telemetry_str_slot_cmp(const void *a, const void *b)
+{
+	const struct telemetry_str_slot *sa = a, *sb = b;
+
+	return (sa->id > sb->id) - (sa->id < sb->id);
+}
+
+/* Sets up the table pointers of an index buffer and validates its bounds */
+static int telemetry_str_index_setup(struct telemetry_str_index *idx)
+{
+	struct telemetry_str_index_hdr *hdr = idx->buf;
+	struct telemetry_str_slot *slot;
+	__u64 nr = 0;
+	int i, j;
+
+	if (idx->len < sizeof(*hdr) ||
+	    memcmp(hdr->magic, C9_STR_INDEX_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != C9_STR_INDEX_VERSION ||
+	    hdr->log_len > idx->len)
+		return -EINVAL;
+
+	for (i = 0; i < TELEMETRY_STR_TABLE_NUM; i++)
+		nr += hdr->nr[i];
+	if (telemetry_str_slots_ofst(hdr->log_len) + nr * sizeof(*slot) != idx->len)
+		return -EINVAL;
+
+	idx->log = (__u8 *)idx->buf + telemetry_str_log_ofst();
+	idx->log_len = hdr->log_len;
+	slot = (struct telemetry_str_slot *)((__u8 *)idx->buf +
+					     telemetry_str_slots_ofst(hdr->log_len));
+	for (i = 0; i < TELEMETRY_STR_TABLE_NUM; i++) {
+		idx->nr[i] = hdr->nr[i];
+		idx->slots[i] = slot;
+		for (j = 0; j < idx->nr[i]; j++, slot++) {
+			if (slot->ofst > idx->log_len ||
+			    slot->len > idx->log_len - slot->ofst)
+				return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Adds the entries of one string table of the log to the index. All three
+ * entry formats keep the name length and offset at the same place.
+ */
+static __u32 telemetry_str_table_parse(struct telemetry_str_index *idx,
+				       enum telemetry_str_table table,
+				       struct telemetry_str_slot *slots,
+				       __u64 start, __u64 size, __u64 ascii, __u64 ascii_size)
+{
+	struct statistics_id_str_table_entry *stat;
+	struct event_id_str_table_entry *event;
+	struct vu_event_id_str_table_entry *vu_event;
+	__u64 pos, ofst;
+	__u32 nr = 0, len;
+	__u8 *entry;
+
+	if (start > idx->log_len || size > idx->log_len - start)
+		return 0;
+	if (ascii > idx->log_len || ascii_size > idx->log_len - ascii)
+		return 0;
+
+	for (pos = start; pos + C9_STR_TABLE_ENTRY_SIZE <= start + size;
+	     pos += C9_STR_TABLE_ENTRY_SIZE) {
+		entry = idx->log + pos;
+		switch (table) {
+		case TELEMETRY_STR_STAT:
+			stat = (struct statistics_id_str_table_entry *)entry;
+			slots[nr].id = le16_to_cpu(stat->vs_si);
+			len = stat->ascii_id_len;
+			ofst = le64_to_cpu(stat->ascii_id_ofst);
+			break;
+		case TELEMETRY_STR_EVENT:
+			event = (struct event_id_str_table_entry *)entry;
+			slots[nr].id = event->deb_eve_class << 16 | le16_to_cpu(event->ei);
+			len = event->ascii_id_len;
+			ofst = le64_to_cpu(event->ascii_id_ofst);
+			break;
+		default:
+			vu_event = (struct vu_event_id_str_table_entry *)entry;
+			slots[nr].id = vu_event->deb_eve_class << 16 |
+				le16_to_cpu(vu_event->vu_ei);
+			len = vu_event->ascii_id_len;
+			ofst = le64_to_cpu(vu_event->ascii_id_ofst);
+			break;
+		}
+
+		/* unused entries and names outside of the ASCII table are skipped */
+		if (!len || ofst > ascii_size || len > ascii_size - ofst)
+			continue;
+
+		/* names are padded with spaces */
+		while (len && (idx->log[ascii + ofst + len - 1] == ' ' ||
+			       !idx->log[ascii + ofst + len - 1]))
+			len--;
+		if (!len)
+			continue;
+
+		slots[nr].len = len;
+		slots[nr].ofst = ascii + ofst;
+		nr++;
+	}
+
+	qsort(slots, nr, sizeof(*slots), telemetry_str_slot_cmp);
+
+	return nr;
+}
+
+static int telemetry_str_log_read(struct nvme_dev *dev, __u8 *log, __u64 len)
+{
+	__u64 offset = 0;
+	__u32 n;
+	int err;
+
+	while (offset < len) {
+		n = min(len - offset, 0x1000);
+
+		struct nvme_get_log_args args = {
+			.lpo = offset,
+			.result = NULL,
+			.log = log + offset,
+			.args_size = sizeof(args),
+			.fd = dev_fd(dev),
+			.lid = C9_TELEMETRY_STRING_LOG_ENABLE_OPCODE,
+			.len = n,
+			.nsid = NVME_NSID_ALL,
+			.lsp = NVME_LOG_LSP_NONE,
+			.uuidx = NVME_UUID_NONE,
+			.rae = false,
+			.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
+			.csi = NVME_CSI_NVM,
+			.ot = false,
+		};
+
+		err = nvme_get_log(&args);
+		if (err)
+			return err;
+		offset += n;
+	}
+
+	return 0;
+}
+
+/* Reads the string log from the device and indexes it */
+static struct telemetry_str_index *telemetry_str_index_fetch(struct nvme_dev *dev,
+							     const char *fr)
+{
+	struct telemetry_str_log_format hdr;
+	struct telemetry_str_index_hdr *ihdr;
+	struct telemetry_str_index *idx;
+	__u64 log_len, max_slots, start[TELEMETRY_STR_TABLE_NUM], size[TELEMETRY_STR_TABLE_NUM];
+	struct telemetry_str_slot *slots;
+	__u32 nr = 0;
+	int i;
+
+	if (nvme_get_log_simple(dev_fd(dev), C9_TELEMETRY_STRING_LOG_ENABLE_OPCODE,
+				sizeof(hdr), &hdr))
+		return NULL;
+
+	/* the header fields are in dwords */
+	log_len = le64_to_cpu(hdr.sls) * 4;
+	start[TELEMETRY_STR_STAT] = le64_to_cpu(hdr.sits) * 4;
+	size[TELEMETRY_STR_STAT] = le64_to_cpu(hdr.sitsz) * 4;
+	start[TELEMETRY_STR_EVENT] = le64_to_cpu(hdr.ests) * 4;
+	size[TELEMETRY_STR_EVENT] = le64_to_cpu(hdr.estsz) * 4;
+	start[TELEMETRY_STR_VU_EVENT] = le64_to_cpu(hdr.vu_eve_sts) * 4;
+	size[TELEMETRY_STR_VU_EVENT] = le64_to_cpu(hdr.vu_eve_st_sz) * 4;
+	if (log_len < sizeof(hdr) || log_len > INT_MAX)
+		return NULL;
+
+	max_slots = 0;
+	for (i = 0; i < TELEMETRY_STR_TABLE_NUM; i++)
+		max_slots += min(size[i], log_len) / C9_STR_TABLE_ENTRY_SIZE;
+
+	idx = calloc(1, sizeof(*idx));
+	if (!idx)
+		return NULL;
+
+	idx->len = telemetry_str_slots_ofst(log_len) + max_slots * sizeof(*slots);
+	idx->buf = calloc(1, idx->len);
+	if (!idx->buf)
+		goto free;
+	idx->log = (__u8 *)idx->buf + telemetry_str_log_ofst();
+	idx->log_len = log_len;
+
+	if (telemetry_str_log_read(dev, idx->log, log_len))
+		goto free;
+
+	ihdr = idx->buf;
+	memcpy(ihdr->magic, C9_STR_INDEX_MAGIC, sizeof(ihdr->magic));
+	ihdr->version = C9_STR_INDEX_VERSION;
+	ihdr->log_len = log_len;
+	strncpy(ihdr->fr, fr, sizeof(ihdr->fr) - 1);
+
+	slots = (struct telemetry_str_slot *)((__u8 *)idx->buf +
+					      telemetry_str_slots_ofst(log_len));
+	for (i = 0; i < TELEMETRY_STR_TABLE_NUM; i++) {
+		ihdr->nr[i] = telemetry_str_table_parse(idx, i, slots + nr, start[i],
+							size[i], le64_to_cpu(hdr.ascts) * 4,
+							le64_to_cpu(hdr.asctsz) * 4);
+		nr += ihdr->nr[i];
+	}
+
+	idx->len = telemetry_str_slots_ofst(log_len) + nr * sizeof(*slots);
+	if (telemetry_str_index_setup(idx))
+		goto free;
+
+	return idx;
+
+free:
+	free(idx->buf);
+	free(idx);
+	return NULL;
+}
+
+/* The cache is keyed by model and firmware revision, which define the strings */
+static int telemetry_str_cache_path(struct nvme_id_ctrl *ctrl, char *fr, char *path,
+				    size_t len)
+{
+	char mn[sizeof(ctrl->mn) + 1];
+	int i;
+
+	memcpy(mn, ctrl->mn, sizeof(ctrl->mn));
+	mn[sizeof(ctrl->mn)] = '\0';
+	memcpy(fr, ctrl->fr, sizeof(ctrl->fr));
+	fr[sizeof(ctrl->fr)] = '\0';
+
+	for (i = strlen(mn); i > 0 && mn[i - 1] == ' '; i--)
+		mn[i - 1] = '\0';
+	for (i = strlen(fr); i > 0 && fr[i - 1] == ' '; i--)
+		fr[i - 1] = '\0';
+	if (!strlen(mn) || !strlen(fr))
+		return -EINVAL;
+
+	for (i = 0; mn[i]; i++) {
+		if (mn[i] == '/' || mn[i] == ' ')
+			mn[i] = '_';
+	}
+	for (i = 0; fr[i]; i++) {
+		if (fr[i] == '/' || fr[i] == ' ')
+			fr[i] = '_';
+	}
+
+	if (snprintf(path, len, "%s/c9-%s-%s", C9_STR_INDEX_CACHE_DIR, mn, fr) >= len)
+		return -ENAMETOOLONG;
+
+	return 0;
+}
+
+static struct telemetry_str_index *telemetry_str_cache_load(const char *path,
+							    const char *fr)
+{
+	struct telemetry_str_index_hdr *hdr;
+	struct telemetry_str_index *idx;
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	idx = calloc(1, sizeof(*idx));
+	if (!idx || fstat(fd, &st) || st.st_size < sizeof(*hdr))
+		goto close_fd;
+
+	idx->len = st.st_size;
+	idx->buf = mmap(NULL, idx->len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (idx->buf == MAP_FAILED)
+		goto close_fd;
+	idx->mapped = true;
+	close(fd);
+
+	hdr = idx->buf;
+	if (strncmp(hdr->fr, fr, sizeof(hdr->fr)) || telemetry_str_index_setup(idx)) {
+		telemetry_str_index_free(idx);
+		return NULL;
+	}
+
+	return idx;
+
+close_fd:
+	free(idx);
+	close(fd);
+	return NULL;
+}
+
+static void telemetry_str_cache_store(struct telemetry_str_index *idx, const char *path)
+{
+	char tmp[PATH_MAX + 16];
+	const __u8 *p = idx->buf;
+	size_t len = idx->len;
+	ssize_t ret;
+	int fd;
+
+	/* the cache is best effort, e.g. the rundir is not writable for users */
+	if (mkdir(RUNDIR "/nvme", 0755) && errno != EEXIST)
+		return;
+	if (mkdir(C9_STR_INDEX_CACHE_DIR, 0755) && errno != EEXIST)
+		return;
+
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return;
+
+	while (len) {
+		ret = write(fd, p, len);
+		if (ret <= 0) {
+			if (ret < 0 && errno == EINTR)
+				continue;
+			break;
+		}
+		p += ret;
+		len -= ret;
+	}
+
+	/* rename so that concurrent readers never see a partial index */
+	if (close(fd) || len || rename(tmp, path))
+		unlink(tmp);
+}
+
+/* Whether the controller lists the string log among its supported log pages */
+static bool telemetry_str_log_supported(struct nvme_dev *dev)
+{
+	struct nvme_supported_log_pages *supported;
+	bool ret = false;
+
+	supported = nvme_alloc(sizeof(*supported));
+	if (!supported)
+		return false;
+
+	if (!nvme_get_log_supported_log_pages(dev_fd(dev), false, supported))
+		ret = le32_to_cpu(supported->lid_support[C9_TELEMETRY_STRING_LOG_ENABLE_OPCODE]) & 0x1;
+	free(supported);
+
+	return ret;
+}
+
+/*
+ * Returns the string log index of the device, from the cache if the firmware
+ * revision has been seen before. Returns NULL if the log is not supported,
+ * which is checked first so that other controllers see no failing command.
+ */
+static struct telemetry_str_index *telemetry_str_index_get(struct nvme_dev *dev,
+							   struct nvme_id_ctrl *ctrl)
+{
+	char path[PATH_MAX], fr[sizeof(ctrl->fr) + 1];
+	struct telemetry_str_index *idx;
+	bool cache;
+
+	cache = !telemetry_str_cache_path(ctrl, fr, path, sizeof(path));
+	if (cache) {
+		idx = telemetry_str_cache_load(path, fr);
+		if (idx)
+			return idx;
+	}
+
+	if (!telemetry_str_log_supported(dev))
+		return NULL;
+
+	idx = telemetry_str_index_fetch(dev, fr);
+	if (idx && cache)
+		telemetry_str_cache_store(idx, path);
+
+	return idx;
+}
+
+static void telemetry_str_index_free(struct telemetry_str_index *idx)
+{
+	if (!idx)
+		return;
+
+	if (idx->mapped)
+		munmap(idx->buf, idx->len);
+	else
+		free(idx->buf);
+	free(idx);
+}
+
+/*
+ * Resolves an identifier to its name. The name points into the log and is not
+ * NUL terminated, its length is returned in len.
+ */
+static const char *telemetry_str_lookup(struct telemetry_str_index *idx,
+					enum telemetry_str_table table, __u32 id,
+					__u32 *len)
+{
+	struct telemetry_str_slot key = { .id = id }, *slot;
+
+	if (!idx)
+		return NULL;
+
+	slot = bsearch(&key, idx->slots[table], idx->nr[table], sizeof(key),
+		       telemetry_str_slot_cmp);
+	if (!slot)
+		return NULL;
+
+	*len = slot->len;
+	return (const char *)idx->log + slot->ofst;
+}
+
 /* Function declaration for Telemetry String Log Format (LID:C9h) */
 static int ocp_telemetry_str_log_format(int argc, char **argv, struct command *cmd,
 					struct plugin *plugin);
@@ -3123,8 +3752,7 @@ static int ocp_print_C9_log_json(struct telemetry_str_log_format *log_data,__u8
 		ascii += sprintf(ascii, "%c", ascii_table_info_arr[j]);
 	json_object_add_value_string(root, "ASCII Table", ascii_buf);
 
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 	json_free_object(root);
 	json_free_object(stat_table);
 	json_free_object(eve_table);
@@ -3198,7 +3826,7 @@ static int get_c9_log_page(struct nvme_dev *dev, char *format)
 					  total_log_page_sz, full_log_buf_data);
 
 		if (!ret) {
-			switch (fmt) {
+			switch (fmt & ~JSON_ENCODINGS) {
 			case NORMAL:
 				ocp_print_C9_log_normal(log_data,full_log_buf_data);
 				break;
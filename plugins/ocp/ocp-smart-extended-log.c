@@ -14,55 +14,7 @@
 #include "common.h"
 #include "nvme-print.h"
 
-/* C0 SCAO Log Page */
-#define C0_SMART_CLOUD_ATTR_LEN			0x200
-#define C0_SMART_CLOUD_ATTR_OPCODE		0xC0
-#define C0_GUID_LENGTH				16
-
-static __u8 scao_guid[C0_GUID_LENGTH] = {
-	0xC5, 0xAF, 0x10, 0x28,
-	0xEA, 0xBF, 0xF2, 0xA4,
-	0x9C, 0x4F, 0x6F, 0x7C,
-	0xC9, 0x14, 0xD5, 0xAF
-};
-
-enum {
-	SCAO_PMUW	= 0,	/* Physical media units written */
-	SCAO_PMUR	= 16,	/* Physical media units read */
-	SCAO_BUNBR	= 32,	/* Bad user nand blocks raw */
-	SCAO_BUNBN	= 38,	/* Bad user nand blocks normalized */
-	SCAO_BSNBR	= 40,	/* Bad system nand blocks raw */
-	SCAO_BSNBN	= 46,	/* Bad system nand blocks normalized */
-	SCAO_XRC	= 48,	/* XOR recovery count */
-	SCAO_UREC	= 56,	/* Uncorrectable read error count */
-	SCAO_SEEC	= 64,	/* Soft ecc error count */
-	SCAO_EEDC	= 72,	/* End to end detected errors */
-	SCAO_EECE	= 76,	/* End to end corrected errors */
-	SCAO_SDPU	= 80,	/* System data percent used */
-	SCAO_RFSC	= 81,	/* Refresh counts */
-	SCAO_MXUDEC	= 88,	/* Max User data erase counts */
-	SCAO_MNUDEC	= 92,	/* Min User data erase counts */
-	SCAO_NTTE	= 96,	/* Number of Thermal throttling events */
-	SCAO_CTS	= 97,	/* Current throttling status */
-	SCAO_EVF	= 98,	/* Errata Version Field */
-	SCAO_PVF	= 99,	/* Point Version Field */
-	SCAO_MIVF	= 101,	/* Minor Version Field */
-	SCAO_MAVF	= 103,	/* Major Version Field */
-	SCAO_PCEC	= 104,	/* PCIe correctable error count */
-	SCAO_ICS	= 112,	/* Incomplete shutdowns */
-	SCAO_PFB	= 120,	/* Percent free blocks */
-	SCAO_CPH	= 128,	/* Capacitor health */
-	SCAO_NEV	= 130,  /* NVMe Errata Version */
-	SCAO_UIO	= 136,	/* Unaligned I/O */
-	SCAO_SVN	= 144,	/* Security Version Number */
-	SCAO_NUSE	= 152,	/* NUSE - Namespace utilization */
-	SCAO_PSC	= 160,	/* PLP start count */
-	SCAO_EEST	= 176,	/* Endurance estimate */
-	SCAO_PLRC	= 192,	/* PCIe Link Retraining Count */
-	SCAO_PSCC	= 200,	/* Power State Change Count */
-	SCAO_LPV	= 494,	/* Log page version */
-	SCAO_LPG	= 496,	/* Log page GUID */
-};
+static __u8 scao_guid[C0_GUID_LENGTH] = C0_SMART_CLOUD_ATTR_GUID;
 
 static void ocp_print_C0_log_normal(void *data)
 {
@@ -245,12 +197,12 @@ static void ocp_print_C0_log_json(void *data)
 		json_object_add_value_uint(root, "Power State Change Count",
 					   le64_to_cpu(*(uint64_t *)&log_data[SCAO_PSCC]));
 	}
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 	json_free_object(root);
 }
 
-static int get_c0_log_page(int fd, char *format)
+
+static int get_c0_log_page(int fd, const char *devname, char *format)
 {
 	enum nvme_print_flags fmt;
 	__u8 *data;
@@ -300,13 +252,16 @@ static int get_c0_log_page(int fd, char *format)
 		}
 
 		/* print the data */
-		switch (fmt) {
+		switch (fmt & ~JSON_ENCODINGS) {
 		case NORMAL:
 			ocp_print_C0_log_normal(data);
 			break;
 		case JSON:
 			ocp_print_C0_log_json(data);
 			break;
+		case OPENMETRICS:
+			nvme_show_ocp_smart_openmetrics(data, devname);
+			break;
 		default:
 			break;
 		}
@@ -335,7 +290,7 @@ int ocp_smart_add_log(int argc, char **argv, struct command *cmd,
 	};
 
 	OPT_ARGS(opts) = {
-		OPT_FMT("output-format", 'o', &cfg.output_format, "output Format: normal|json"),
+		OPT_FMT("output-format", 'o', &cfg.output_format, "output Format: normal|json|openmetrics"),
 		OPT_END()
 	};
 
@@ -343,7 +298,7 @@ int ocp_smart_add_log(int argc, char **argv, struct command *cmd,
 	if (ret)
 		return ret;
 
-	ret = get_c0_log_page(dev_fd(dev), cfg.output_format);
+	ret = get_c0_log_page(dev_fd(dev), dev->name, cfg.output_format);
 	if (ret)
 		fprintf(stderr, "ERROR : OCP : Failure reading the C0 Log Page, ret = %d\n",
 			ret);
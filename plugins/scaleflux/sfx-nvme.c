@@ -1,6 +1,8 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #include <fcntl.h>
 #include <errno.h>
+#include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,6 +24,7 @@
 #include "nvme-wrap.h"
 #include "nvme-print.h"
 #include "util/cleanup.h"
+#include "util/writer.h"
 
 #define CREATE_CMD
 #include "sfx-nvme.h"
@@ -317,8 +320,7 @@ static void show_sfx_smart_log_jsn(struct nvme_additional_smart_log *smart,
 
 	json_object_add_value_object(root, "Device stats", dev_stats);
 
-	json_print_object(root, NULL);
-	printf("/n");
+	json_print_line(root);
 	json_free_object(root);
 }
 
@@ -1218,146 +1220,262 @@ static int sfx_get_feature(int argc, char **argv, struct command *cmd, struct pl
 
 }
 
-static int nvme_parse_evtlog(void *pevent_log_info, __u32 log_len, char *output)
+#define SFX_EVTLOG_MAGIC1		0x474F4C545645ULL
+#define SFX_EVTLOG_MAGIC2		0x38B0B3ABA9BAULL
+#define SFX_EVTLOG_STATE_DIR		RUNDIR "/nvme/sfx"
+#define SFX_EVTLOG_OUTPUT_BUF_SIZE	(1024 * 1024)
+
+enum sfx_evtlog_level {
+	sfx_evtlog_level_warning,
+	sfx_evtlog_level_error,
+};
+
+static const char *sfx_evtlog_warning[4] = {
+	"RESERVED",
+	"TOO_MANY_BB",
+	"LOW_SPACE",
+	"HIGH_TEMPERATURE"
+};
+
+static const char *sfx_evtlog_error[14] = {
+	"RESERVED",
+	"HAS_ASSERT",
+	"HAS_PANIC_DUMP",
+	"INVALID_FORMAT_CAPACITY",
+	"MAT_FAILED",
+	"FREEZE_DUE_TO_RECOVERY_FAILED",
+	"RFS_BROKEN",
+	"MEDIA_ERR_ON_PAGE_IN",
+	"MEDIA_ERR_ON_MPAGE_HEADER",
+	"CAPACITOR_BROKEN",
+	"READONLY_DUE_TO_RECOVERY_FAILED",
+	"RD_ERR_IN_GSD_RECOVERY",
+	"RD_ERR_ON_PF_RECOVERY",
+	"MEDIA_ERR_ON_FULL_RECOVERY"
+};
+
+struct sfx_nvme_evtlog_info {
+	__u16     time_stamp[4];
+	__u64     magic1;
+	__u8      reverse[10];
+	char      evt_name[32];
+	__u64     magic2;
+	char      fw_ver[24];
+	char      bl2_ver[32];
+	__u16     code;
+	__u16     assert_id;
+} __packed;
+
+#define SFX_EVTLOG_INFO_SIZE		sizeof(struct sfx_nvme_evtlog_info)
+
+/*
+ * Event records are found by their magic numbers anywhere in the log. The
+ * parser is fed the log chunk by chunk as it is read from the device and
+ * keeps the bytes of a record that may straddle two chunks.
+ */
+struct sfx_evtlog_parser {
+	FILE *out;
+	bool json;
+	bool incremental;
+	__u64 since;		/* firmware timestamp of the last parsed event */
+	__u64 last;		/* latest firmware timestamp seen */
+	__u32 nr_events;
+	__u8 carry[SFX_EVTLOG_INFO_SIZE - 1];
+	__u32 carry_len;
+	int err;
+};
+
+static void sfx_evtlog_json_str(FILE *out, const char *key, const char *str, size_t len)
 {
-	__u32 offset = 0;
-	__u32 length = log_len;
-	__u16 fw_core;
-	__u64 fw_time;
-	__u8  code_level;
-	__u8  code_type;
-	char  str_buffer[512];
-	__u32 str_pos;
-	FILE *fd;
-	int   err = 0;
-
-	enum sfx_evtlog_level {
-		sfx_evtlog_level_warning,
-		sfx_evtlog_level_error,
-	};
+	size_t i;
+
+	fprintf(out, ",\"%s\":\"", key);
+	for (i = 0; i < len && str[i]; i++) {
+		if (str[i] == '"' || str[i] == '\\') {
+			putc('\\', out);
+			putc(str[i], out);
+		} else if ((unsigned char)str[i] < 0x20) {
+			fprintf(out, "\\u%04x", str[i]);
+		} else {
+			putc(str[i], out);
+		}
+	}
+	putc('"', out);
+}
 
-	const char *sfx_evtlog_warning[4] = {
-		"RESERVED",
-		"TOO_MANY_BB",
-		"LOW_SPACE",
-		"HIGH_TEMPERATURE"
-	};
+static void sfx_evtlog_print(struct sfx_evtlog_parser *p, const __u8 *rec)
+{
+	struct sfx_nvme_evtlog_info info;
+	const char *code_str;
+	char ts_buf[128];
+	__u64 fw_time;
+	__u8 code_level;
+	__u8 code_type;
 
-	const char *sfx_evtlog_error[14] = {
-		"RESERVED",
-		"HAS_ASSERT",
-		"HAS_PANIC_DUMP",
-		"INVALID_FORMAT_CAPACITY",
-		"MAT_FAILED",
-		"FREEZE_DUE_TO_RECOVERY_FAILED",
-		"RFS_BROKEN",
-		"MEDIA_ERR_ON_PAGE_IN",
-		"MEDIA_ERR_ON_MPAGE_HEADER",
-		"CAPACITOR_BROKEN",
-		"READONLY_DUE_TO_RECOVERY_FAILED",
-		"RD_ERR_IN_GSD_RECOVERY",
-		"RD_ERR_ON_PF_RECOVERY",
-		"MEDIA_ERR_ON_FULL_RECOVERY"
-	};
+	/* quick reject before the record is copied out of the chunk */
+	if (rec[offsetof(struct sfx_nvme_evtlog_info, magic1)] != 0x45)
+		return;
 
-	struct sfx_nvme_evtlog_info {
-		__u16     time_stamp[4];
-		__u64     magic1;
-		__u8      reverse[10];
-		char      evt_name[32];
-		__u64     magic2;
-		char      fw_ver[24];
-		char      bl2_ver[32];
-		__u16     code;
-		__u16     assert_id;
-	} __packed;
+	memcpy(&info, rec, sizeof(info));
+	if (info.magic1 != SFX_EVTLOG_MAGIC1 || info.magic2 != SFX_EVTLOG_MAGIC2)
+		return;
 
-	struct sfx_nvme_evtlog_info *info = NULL;
+	fw_time = ((__u64)info.time_stamp[2] << 32) + ((__u64)info.time_stamp[1] << 16) +
+		(__u64)info.time_stamp[0];
+	if (fw_time > p->last)
+		p->last = fw_time;
+	if (p->incremental && fw_time <= p->since)
+		return;
 
-	fd = fopen(output, "w+");
-	if (!fd) {
-		fprintf(stderr, "Failed to open %s file to write\n", output);
-		err = ENOENT;
-		goto ret;
+	code_level = (info.code & 0x100) >> 8;
+	code_type  = (info.code % 0x100);
+	if (code_level == sfx_evtlog_level_warning)
+		code_str = code_type < ARRAY_SIZE(sfx_evtlog_warning) ?
+			sfx_evtlog_warning[code_type] : "UNKNOWN";
+	else
+		code_str = code_type < ARRAY_SIZE(sfx_evtlog_error) ?
+			sfx_evtlog_error[code_type] : "UNKNOWN";
+
+	convert_ts(fw_time, ts_buf);
+	p->nr_events++;
+
+	if (p->json) {
+		fprintf(p->out, "{\"core\":%u,\"timestamp\":%"PRIu64",\"time\":\"%s\"",
+			info.time_stamp[3], (uint64_t)fw_time, ts_buf);
+		sfx_evtlog_json_str(p->out, "fw_version", info.fw_ver, sizeof(info.fw_ver));
+		sfx_evtlog_json_str(p->out, "bl2_version", info.bl2_ver, sizeof(info.bl2_ver));
+		fprintf(p->out, ",\"level\":\"%s\",\"error_str\":\"%s\"",
+			code_level == sfx_evtlog_level_warning ? "WARNING" : "ERROR", code_str);
+		if (code_level != sfx_evtlog_level_warning && info.assert_id)
+			fprintf(p->out, ",\"assert_id\":%u", info.assert_id);
+		fputs("}\n", p->out);
+		return;
 	}
 
-	while (length > 0) {
-		info = (struct sfx_nvme_evtlog_info *)(pevent_log_info + offset);
-
-		if ((info->magic1 == 0x474F4C545645) &&
-		    (info->magic2 == 0x38B0B3ABA9BA)) {
-
-			memset(str_buffer, 0, 512);
-			str_pos = 0;
-
-			fw_core = info->time_stamp[3];
-			snprintf(str_buffer + str_pos, 16, "[%d-", fw_core);
-			str_pos = strlen(str_buffer);
-
-			fw_time = ((__u64)info->time_stamp[2] << 32) + ((__u64)info->time_stamp[1] << 16) + (__u64)info->time_stamp[0];
-			convert_ts(fw_time, str_buffer + str_pos);
-			str_pos = strlen(str_buffer);
-
-			strcpy(str_buffer + str_pos, "]    event-log:\n");
-			str_pos = strlen(str_buffer);
-
-			snprintf(str_buffer + str_pos, 128,
-				 "  > fw_version:         %s\n  > bl2_version:        %s\n",
-				 info->fw_ver, info->bl2_ver);
-			str_pos = strlen(str_buffer);
-
-			code_level = (info->code & 0x100) >> 8;
-			code_type  = (info->code % 0x100);
-			if (code_level == sfx_evtlog_level_warning) {
-				snprintf(str_buffer + str_pos, 128,
-					 "  > error_str:          [WARNING][%s]\n\n",
-					 sfx_evtlog_warning[code_type]);
-			} else {
-				if (info->assert_id)
-					snprintf(str_buffer + str_pos, 128,
-						 "  > error_str:          [ERROR][%s]\n  > assert_id:          %d\n\n",
-						 sfx_evtlog_error[code_type], info->assert_id);
-				else
-					snprintf(str_buffer + str_pos, 128,
-						 "  > error_str:          [ERROR][%s]\n\n",
-						 sfx_evtlog_error[code_type]);
-			}
-			str_pos = strlen(str_buffer);
+	fprintf(p->out, "[%d-%s]    event-log:\n", info.time_stamp[3], ts_buf);
+	fprintf(p->out, "  > fw_version:         %.*s\n  > bl2_version:        %.*s\n",
+		(int)strnlen(info.fw_ver, sizeof(info.fw_ver)), info.fw_ver,
+		(int)strnlen(info.bl2_ver, sizeof(info.bl2_ver)), info.bl2_ver);
+	if (code_level == sfx_evtlog_level_warning)
+		fprintf(p->out, "  > error_str:          [WARNING][%s]\n\n", code_str);
+	else if (info.assert_id)
+		fprintf(p->out, "  > error_str:          [ERROR][%s]\n  > assert_id:          %d\n\n",
+			code_str, info.assert_id);
+	else
+		fprintf(p->out, "  > error_str:          [ERROR][%s]\n\n", code_str);
+}
 
-			if (fwrite(str_buffer, 1, str_pos, fd) != str_pos) {
-				fprintf(stderr, "Failed to write parse result to output file\n");
-				goto close_fd;
-			}
+/* Parses the next len bytes of the event log */
+static void sfx_evtlog_parse(struct sfx_evtlog_parser *p, const __u8 *buf, __u32 len)
+{
+	__u8 edge[2 * SFX_EVTLOG_INFO_SIZE];
+	__u32 i, n, checked = 0;
+
+	/* records starting in the bytes kept from the previous chunk */
+	if (p->carry_len) {
+		n = min(len, SFX_EVTLOG_INFO_SIZE - 1);
+		memcpy(edge, p->carry, p->carry_len);
+		memcpy(edge + p->carry_len, buf, n);
+		for (i = 0; i < p->carry_len && i + SFX_EVTLOG_INFO_SIZE <= p->carry_len + n; i++)
+			sfx_evtlog_print(p, edge + i);
+		checked = i;
+
+		if (len == n) {
+			p->carry_len += n - checked;
+			memmove(p->carry, edge + checked, p->carry_len);
+			return;
 		}
+	}
+
+	for (i = 0; i + SFX_EVTLOG_INFO_SIZE <= len; i++)
+		sfx_evtlog_print(p, buf + i);
+
+	p->carry_len = min(len, SFX_EVTLOG_INFO_SIZE - 1);
+	memcpy(p->carry, buf + len - p->carry_len, p->carry_len);
+
+	if (ferror(p->out))
+		p->err = EIO;
+}
 
-		offset++;
-		length--;
+static int sfx_evtlog_state_path(struct nvme_dev *dev, __u32 storage_medium, char *path,
+				 size_t len)
+{
+	struct nvme_id_ctrl ctrl;
+	char sn[sizeof(ctrl.sn) + 1];
+	int i, err;
+
+	err = nvme_identify_ctrl(dev_fd(dev), &ctrl);
+	if (err)
+		return err;
 
-		if (!(offset % (log_len / 100)) || (offset == log_len))
-			util_spinner("Parse", (float) (offset) / (float) (log_len));
+	memcpy(sn, ctrl.sn, sizeof(ctrl.sn));
+	sn[sizeof(ctrl.sn)] = '\0';
+	for (i = strlen(sn); i > 0 && sn[i - 1] == ' '; i--)
+		sn[i - 1] = '\0';
+	for (i = 0; sn[i]; i++) {
+		if (sn[i] == '/' || sn[i] == ' ')
+			sn[i] = '_';
 	}
 
-	printf("\nParse-evtlog: Success\n");
+	if (snprintf(path, len, "%s/evtlog-%s-%u", SFX_EVTLOG_STATE_DIR, sn,
+		     storage_medium) >= len)
+		return -ENAMETOOLONG;
 
-close_fd:
-	fclose(fd);
-ret:
-	return err;
+	return 0;
+}
+
+static __u64 sfx_evtlog_state_load(const char *path)
+{
+	unsigned long long since = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+	if (fscanf(f, "%llu", &since) != 1)
+		since = 0;
+	fclose(f);
+
+	return since;
+}
+
+static void sfx_evtlog_state_store(const char *path, __u64 last)
+{
+	char tmp[PATH_MAX + 16];
+	FILE *f;
+	int ret;
+
+	if (mkdir(RUNDIR "/nvme", 0755) && errno != EEXIST)
+		return;
+	if (mkdir(SFX_EVTLOG_STATE_DIR, 0755) && errno != EEXIST)
+		return;
+
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+	f = fopen(tmp, "w");
+	if (!f)
+		return;
+
+	fprintf(f, "%"PRIu64"\n", (uint64_t)last);
+	ret = fclose(f);
+
+	if (ret || rename(tmp, path))
+		unlink(tmp);
 }
 
 static int nvme_dump_evtlog(struct nvme_dev *dev, __u32 namespace_id, __u32 storage_medium,
-			    char *file, bool parse, char *output)
+			    char *file, bool parse, char *output, bool json, bool since_last)
 {
 	struct nvme_persistent_event_log *pevent;
-	void *pevent_log_info;
-	_cleanup_huge_ struct nvme_mem_huge mh = { 0, };
+	struct sfx_evtlog_parser parser = { 0, };
+	struct nvme_writer *writer = NULL;
+	char state_path[PATH_MAX] = "";
+	char *output_buf = NULL;
 	__u8  lsp_base;
 	__u32 offset = 0;
 	__u32 length = 0;
 	__u32 log_len;
 	__u32 single_len;
 	int  err = 0;
-	FILE *fd = NULL;
 	struct nvme_get_log_args args = {
 		.args_size	= sizeof(args),
 		.fd		= dev_fd(dev),
@@ -1384,6 +1502,16 @@ static int nvme_dump_evtlog(struct nvme_dev *dev, __u32 namespace_id, __u32 stor
 		single_len = 32 * 1024;
 	}
 
+	if (parse && since_last) {
+		err = sfx_evtlog_state_path(dev, storage_medium, state_path, sizeof(state_path));
+		if (err) {
+			fprintf(stderr, "Unable to identify the device for incremental parsing\n");
+			goto ret;
+		}
+		parser.incremental = true;
+		parser.since = sfx_evtlog_state_load(state_path);
+	}
+
 	pevent = calloc(sizeof(*pevent), sizeof(__u8));
 	if (!pevent) {
 		err = -ENOMEM;
@@ -1411,39 +1539,49 @@ static int nvme_dump_evtlog(struct nvme_dev *dev, __u32 namespace_id, __u32 stor
 	if (log_len % 4)
 		log_len = (log_len / 4 + 1) * 4;
 
-	pevent_log_info = nvme_alloc_huge(single_len, &mh);
-	if (!pevent_log_info) {
-		err = -ENOMEM;
-		goto free_pevent;
+	if (parse) {
+		parser.out = fopen(output, "w+");
+		if (!parser.out) {
+			fprintf(stderr, "Failed to open %s file to write\n", output);
+			err = ENOENT;
+			goto free_pevent;
+		}
+		parser.json = json;
+
+		/* one event is formatted per record, write them out in large blocks */
+		output_buf = malloc(SFX_EVTLOG_OUTPUT_BUF_SIZE);
+		if (output_buf)
+			setvbuf(parser.out, output_buf, _IOFBF, SFX_EVTLOG_OUTPUT_BUF_SIZE);
 	}
 
-	fd = fopen(file, "wb+");
-	if (!fd) {
+	/* the next chunk is read while the previous one is written to file */
+	writer = nvme_writer_open(file, single_len, false);
+	if (!writer) {
 		fprintf(stderr, "Failed to open %s file to write\n", file);
 		err = ENOENT;
-		goto free_pevent;
+		goto close_output;
 	}
 
 	args.lsp = lsp_base + NVME_PEVENT_LOG_READ;
-	args.log = pevent_log_info;
 	length = log_len;
 	while (length > 0) {
 		args.lpo = offset;
-		if (length > single_len) {
-			args.len = single_len;
-		} else {
-			memset(args.log, 0, args.len);
-			args.len = length;
-		}
+		args.log = nvme_writer_get_buf(writer);
+		args.len = min(length, single_len);
 		err = nvme_get_log(&args);
 		if (err) {
 			fprintf(stderr, "Unable to get evtlog offset=0x%x len 0x%x ret = 0x%x\n", offset, args.len, err);
-			goto close_fd;
+			goto close_writer;
 		}
 
-		if (fwrite(args.log, 1, args.len, fd) != args.len) {
+		/* parse before the buffer is handed over to the writer */
+		if (parse)
+			sfx_evtlog_parse(&parser, args.log, args.len);
+
+		if (nvme_writer_commit(writer, args.len)) {
 			fprintf(stderr, "Failed to write evtlog to file\n");
-			goto close_fd;
+			err = EIO;
+			goto close_writer;
 		}
 
 		offset  += args.len;
@@ -1451,34 +1589,31 @@ static int nvme_dump_evtlog(struct nvme_dev *dev, __u32 namespace_id, __u32 stor
 		util_spinner("Parse", (float) (offset) / (float) (log_len));
 	}
 
-	printf("\nDump-evtlog: Success\n");
-
+close_writer:
+	if (nvme_writer_close(writer) && !err) {
+		fprintf(stderr, "Failed to write evtlog to file\n");
+		err = EIO;
+	}
+	if (!err)
+		printf("\nDump-evtlog: Success\n");
+close_output:
 	if (parse) {
-		nvme_free_huge(&mh);
-		pevent_log_info = nvme_alloc_huge(log_len, &mh);
-		if (!pevent_log_info) {
-			fprintf(stderr, "Failed to alloc enough memory 0x%x to parse evtlog\n", log_len);
-			err = -ENOMEM;
-			goto close_fd;
+		if (fclose(parser.out) && !parser.err)
+			parser.err = EIO;
+		if (!err && parser.err) {
+			fprintf(stderr, "Failed to write parse result to output file\n");
+			err = parser.err;
 		}
-
-		fclose(fd);
-		fd = fopen(file, "rb");
-		if (!fd) {
-			fprintf(stderr, "Failed to open %s file to read\n", file);
-			err = ENOENT;
-			goto free_pevent;
-		}
-		if (fread(pevent_log_info, 1, log_len, fd) != log_len) {
-			fprintf(stderr, "Failed to read evtlog to buffer\n");
-			goto close_fd;
+		if (!err) {
+			if (parser.incremental) {
+				printf("Parse-evtlog: %u new events\n", parser.nr_events);
+				if (parser.last > parser.since)
+					sfx_evtlog_state_store(state_path, parser.last);
+			}
+			printf("Parse-evtlog: Success\n");
 		}
-
-		err = nvme_parse_evtlog(pevent_log_info, log_len, output);
+		free(output_buf);
 	}
-
-close_fd:
-	fclose(fd);
 free_pevent:
 	free(pevent);
 ret:
@@ -1494,6 +1629,8 @@ static int sfx_dump_evtlog(int argc, char **argv, struct command *cmd, struct pl
 				     "0: nand(default) 1: nor";
 	const char *parse = "parse error & warning evtlog from evtlog file";
 	const char *output = "parse result output file";
+	const char *json = "write the parse result as NDJSON, one event per line";
+	const char *since_last = "only parse events newer than the last parse of this device, requires --parse";
 	struct nvme_dev *dev;
 	int err = 0;
 
@@ -1503,6 +1640,8 @@ static int sfx_dump_evtlog(int argc, char **argv, struct command *cmd, struct pl
 		__u32 storage_medium;
 		bool  parse;
 		char *output;
+		bool  json;
+		bool  since_last;
 	};
 	struct config cfg = {
 		.file = NULL,
@@ -1510,6 +1649,8 @@ static int sfx_dump_evtlog(int argc, char **argv, struct command *cmd, struct pl
 		.storage_medium = 0,
 		.parse = false,
 		.output = NULL,
+		.json = false,
+		.since_last = false,
 	};
 
 	OPT_ARGS(opts) = {
@@ -1518,6 +1659,8 @@ static int sfx_dump_evtlog(int argc, char **argv, struct command *cmd, struct pl
 		OPT_UINT("storage_medium",	    's',	&cfg.storage_medium,    storage_medium),
 		OPT_FLAG("parse",	            'p',	&cfg.parse,             parse),
 		OPT_FILE("output",                  'o',        &cfg.output,            output),
+		OPT_FLAG("json",		    'j',	&cfg.json,		json),
+		OPT_FLAG("since-last",		    'l',	&cfg.since_last,	since_last),
 		OPT_END()
 	};
 
@@ -1537,7 +1680,14 @@ static int sfx_dump_evtlog(int argc, char **argv, struct command *cmd, struct pl
 		goto close_dev;
 	}
 
-	err = nvme_dump_evtlog(dev, cfg.namespace_id, cfg.storage_medium, cfg.file, cfg.parse, cfg.output);
+	if (cfg.since_last && !cfg.parse) {
+		fprintf(stderr, "since-last only applies if evtlog need be parsed\n");
+		err = EINVAL;
+		goto close_dev;
+	}
+
+	err = nvme_dump_evtlog(dev, cfg.namespace_id, cfg.storage_medium, cfg.file, cfg.parse,
+			       cfg.output, cfg.json, cfg.since_last);
 
 close_dev:
 	dev_close(dev);
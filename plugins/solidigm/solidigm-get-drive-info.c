@@ -36,7 +36,7 @@ int sldgm_get_drive_info(int argc, char **argv, struct command *cmd, struct plug
 		return err;
 
 	err = validate_output_format(output_format, &flags);
-	if ((err < 0) || !(flags == NORMAL || flags == JSON)) {
+	if ((err < 0) || !(flags == NORMAL || flags & JSON)) {
 		nvme_show_error("Invalid output format");
 		return err;
 	}
@@ -64,12 +64,11 @@ int sldgm_get_drive_info(int argc, char **argv, struct command *cmd, struct plug
 	lba_size = 1 << ns.lbaf[flbaf_inUse].ds;
 	ftl_unit_size = (le16_to_cpu(ns.npwg) + 1) * lba_size / 1024;
 
-	if (flags == JSON) {
+	if (flags & JSON) {
 		struct json_object *root = json_create_object();
 
 		json_object_add_value_int(root, FTL_unit_size_str, ftl_unit_size);
-		json_print_object(root, NULL);
-		printf("\n");
+		json_print_line(root);
 		json_free_object(root);
 	} else {
 		printf("%s: %d\n", FTL_unit_size_str, ftl_unit_size);
@@ -55,8 +55,6 @@ int sldgm_get_market_log(int argc, char **argv, struct command *command,
 	} else if (err > 0)
 
 	nvme_show_status(err);
-	/* Redundant close() to make static code analysis happy */
-	close(dev->direct.fd);
 	dev_close(dev);
 	return err;
 }
@@ -178,8 +178,6 @@ int solidigm_get_telemetry_log(int argc, char **argv, struct command *cmd, struc
 
 close_fd:
 	if (!cfg.is_input_file) {
-		/* Redundant close() to make static code analysis happy */
-		close(dev->direct.fd);
 		dev_close(dev);
 	}
 ret:
@@ -14,6 +14,7 @@
 #include "nvme.h"
 #include "libnvme.h"
 #include "plugin.h"
+#include "util/hexdump.h"
 #include "util/types.h"
 
 #define CREATE_CMD
@@ -474,39 +475,49 @@ static void vt_build_power_state_descriptor(const struct nvme_id_ctrl *ctrl)
 
 static void vt_dump_hex_data(const unsigned char *pbuff, size_t pbuffsize)
 {
-	char textbuf[33];
-	unsigned long i, j;
+	/* offset, 32 bytes in four groups of eight and the text */
+	char line[24 + 32 * 3 + 4 + 1 + 32 + 1];
+	size_t row, n, i, j;
+	char *p;
 
-	textbuf[32] = '\0';
-	printf("[%08X] ", 0);
-	for (i = 0; i < pbuffsize; i++) {
-		printf("%02X ", pbuff[i]);
+	if (!pbuffsize) {
+		printf("[%08X] ", 0);
+		return;
+	}
 
-		if (pbuff[i] >= ' ' && pbuff[i] <= '~')
-			textbuf[i % 32] = pbuff[i];
-		else
-			textbuf[i % 32] = '.';
-
-		if (!(((i + 1) % 8)) || ((i + 1) == pbuffsize)) {
-			printf(" ");
-			if (!((i + 1) % 32)) {
-				printf(" %s\n", textbuf);
-				if ((i + 1) != pbuffsize)
-					printf("[%08lX] ", (i + 1));
-			} else if (i + 1 == pbuffsize) {
-				textbuf[(i + 1) % 32] = '\0';
-				if (!((i + 1) % 8))
-					printf(" ");
-
-				for (j = ((i + 1) % 32); j < 32; j++) {
-					printf("   ");
-					if (!((j + 1) % 8))
-						printf(" ");
-				}
-
-				printf("%s\n", textbuf);
+	for (row = 0; row < pbuffsize; row += 32) {
+		n = pbuffsize - row < 32 ? pbuffsize - row : 32;
+
+		p = line + sprintf(line, "[%08lX] ", (unsigned long)row);
+		for (i = 0; i < n; i++) {
+			p = util_hex_byte(p, pbuff[row + i], true);
+			*p++ = ' ';
+			if (!((i + 1) % 8) || i + 1 == n)
+				*p++ = ' ';
+		}
+
+		/* line up the text of a short last row */
+		if (n < 32) {
+			if (!(n % 8))
+				*p++ = ' ';
+			for (j = n; j < 32; j++) {
+				memcpy(p, "   ", 3);
+				p += 3;
+				if (!((j + 1) % 8))
+					*p++ = ' ';
 			}
+		} else {
+			*p++ = ' ';
 		}
+
+		for (i = 0; i < n; i++) {
+			unsigned char c = pbuff[row + i];
+
+			*p++ = (c >= ' ' && c <= '~') ? c : '.';
+		}
+		*p++ = '\n';
+
+		fwrite(line, 1, p - line, stdout);
 	}
 }
 
@@ -30,6 +30,7 @@
 #include <limits.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include "common.h"
 #include "nvme.h"
@@ -37,7 +38,9 @@
 #include "plugin.h"
 #include "linux/types.h"
 #include "util/cleanup.h"
+#include "util/cmd-cache.h"
 #include "util/types.h"
+#include "util/writer.h"
 #include "nvme-print.h"
 
 #define CREATE_CMD
@@ -51,6 +54,10 @@
 #define WDC_NVME_LOG_SIZE_DATA_LEN			0x08
 #define WDC_NVME_LOG_SIZE_HDR_LEN			0x08
 
+/* Capability cache */
+#define WDC_CAPS_CACHE_DIR				RUNDIR "/nvme/wdc"
+#define WDC_CAPS_CACHE_VERSION				1
+
 /* Enclosure */
 #define WDC_OPENFLEX_MI_DEVICE_MODEL			"OpenFlex"
 #define WDC_RESULT_MORE_DATA				0x80000000
@@ -1464,8 +1471,82 @@ static double calc_percent(uint64_t numerator, uint64_t denominator)
 		(uint64_t)(((double)numerator / (double)denominator) * 100) : 0;
 }
 
-static int wdc_get_pci_ids(nvme_root_t r, struct nvme_dev *dev,
-			   uint32_t *device_id, uint32_t *vendor_id)
+/*
+ * Identity of the device the current command operates on. Every subcommand
+ * needs the PCI IDs, identify controller data and the capability mask,
+ * often several times, so they are resolved once per process. The
+ * capability mask is additionally cached under the rundir, keyed by PCI
+ * IDs, serial number and firmware revision, since computing it costs a
+ * number of vendor log page reads. The memo is dropped when another device
+ * is opened or an admin command may have changed the identify data, e.g.
+ * by a later command of a batch.
+ */
+struct wdc_dev_info {
+	char *name;
+	unsigned long generation;
+	int pci_ret;
+	uint32_t device_id;
+	uint32_t vendor_id;
+	char sn[NVME_ID_CTRL_SERIAL_NUMBER_SIZE + 1];
+	char fr[sizeof(((struct nvme_id_ctrl *)0)->fr) + 1];
+	bool id_ctrl_valid;
+	struct nvme_id_ctrl id_ctrl;
+	bool caps_valid;
+	__u64 capabilities;
+};
+
+static struct wdc_dev_info wdc_dev_info;
+
+static struct wdc_dev_info *wdc_dev_info_lookup(struct nvme_dev *dev)
+{
+	struct wdc_dev_info *info = &wdc_dev_info;
+	unsigned long generation = nvme_cmd_cache_generation();
+
+	if (!info->name || strcmp(info->name, dev->name) ||
+	    info->generation != generation) {
+		free(info->name);
+		memset(info, 0, sizeof(*info));
+		info->name = strdup(dev->name);
+		info->generation = generation;
+		info->pci_ret = 1;
+	}
+
+	return info;
+}
+
+static void wdc_copy_id_str(char *dst, size_t len, const char *src, size_t src_len)
+{
+	int i;
+
+	memset(dst, 0, len);
+	if (!src)
+		return;
+
+	strncpy(dst, src, min(len - 1, src_len));
+	for (i = strlen(dst) - 1; i >= 0 && dst[i] == ' '; i--)
+		dst[i] = '\0';
+}
+
+static int wdc_identify_ctrl(struct nvme_dev *dev, struct nvme_id_ctrl *ctrl)
+{
+	struct wdc_dev_info *info = wdc_dev_info_lookup(dev);
+	int ret;
+
+	if (!info->id_ctrl_valid) {
+		ret = nvme_identify_ctrl(dev_fd(dev), &info->id_ctrl);
+		if (ret)
+			return ret;
+		info->id_ctrl_valid = true;
+	}
+
+	if (ctrl != &info->id_ctrl)
+		memcpy(ctrl, &info->id_ctrl, sizeof(*ctrl));
+
+	return 0;
+}
+
+static int wdc_read_pci_ids(nvme_root_t r, struct nvme_dev *dev,
+			    struct wdc_dev_info *info)
 {
 	char vid[256], did[256], id[32];
 	nvme_ctrl_t c = NULL;
@@ -1478,6 +1559,11 @@ static int wdc_get_pci_ids(nvme_root_t r, struct nvme_dev *dev,
 			nvme_ctrl_get_sysfs_dir(c));
 		snprintf(did, sizeof(did), "%s/device/device",
 			nvme_ctrl_get_sysfs_dir(c));
+		/* sysfs already has these, no need to identify for the cache key */
+		wdc_copy_id_str(info->sn, sizeof(info->sn), nvme_ctrl_get_serial(c),
+				sizeof(info->sn) - 1);
+		wdc_copy_id_str(info->fr, sizeof(info->fr), nvme_ctrl_get_firmware(c),
+				sizeof(info->fr) - 1);
 		nvme_free_ctrl(c);
 	} else {
 		n = nvme_scan_namespace(dev->name);
@@ -1510,7 +1596,7 @@ static int wdc_get_pci_ids(nvme_root_t r, struct nvme_dev *dev,
 	if (id[strlen(id) - 1] == '\n')
 		id[strlen(id) - 1] = '\0';
 
-	*vendor_id = strtol(id, NULL, 0);
+	info->vendor_id = strtol(id, NULL, 0);
 	ret = 0;
 
 	fd = open(did, O_RDONLY);
@@ -1530,7 +1616,22 @@ static int wdc_get_pci_ids(nvme_root_t r, struct nvme_dev *dev,
 	if (id[strlen(id) - 1] == '\n')
 		id[strlen(id) - 1] = '\0';
 
-	*device_id = strtol(id, NULL, 0);
+	info->device_id = strtol(id, NULL, 0);
+	return 0;
+}
+
+static int wdc_get_pci_ids(nvme_root_t r, struct nvme_dev *dev,
+			   uint32_t *device_id, uint32_t *vendor_id)
+{
+	struct wdc_dev_info *info = wdc_dev_info_lookup(dev);
+
+	if (info->pci_ret > 0)
+		info->pci_ret = wdc_read_pci_ids(r, dev, info);
+	if (info->pci_ret)
+		return info->pci_ret;
+
+	*device_id = info->device_id;
+	*vendor_id = info->vendor_id;
 	return 0;
 }
 
@@ -1540,7 +1641,7 @@ static int wdc_get_vendor_id(struct nvme_dev *dev, uint32_t *vendor_id)
 	struct nvme_id_ctrl ctrl;
 
 	memset(&ctrl, 0, sizeof(struct nvme_id_ctrl));
-	ret = nvme_identify_ctrl(dev_fd(dev), &ctrl);
+	ret = wdc_identify_ctrl(dev, &ctrl);
 	if (ret) {
 		fprintf(stderr, "ERROR: WDC: nvme_identify_ctrl() failed 0x%x\n", ret);
 		return -1;
@@ -1616,7 +1717,7 @@ static int wdc_get_model_number(struct nvme_dev *dev, char *model)
 	struct nvme_id_ctrl ctrl;
 
 	memset(&ctrl, 0, sizeof(struct nvme_id_ctrl));
-	ret = nvme_identify_ctrl(dev_fd(dev), &ctrl);
+	ret = wdc_identify_ctrl(dev, &ctrl);
 	if (ret) {
 		fprintf(stderr, "ERROR: WDC: nvme_identify_ctrl() failed 0x%x\n", ret);
 		return -1;
@@ -1679,7 +1780,7 @@ static bool wdc_enc_check_model(struct nvme_dev *dev)
 	return supported;
 }
 
-static __u64 wdc_get_drive_capabilities(nvme_root_t r, struct nvme_dev *dev)
+static __u64 wdc_probe_drive_capabilities(nvme_root_t r, struct nvme_dev *dev)
 {
 	int ret;
 	uint32_t read_device_id = -1, read_vendor_id = -1;
@@ -2022,6 +2123,120 @@ static __u64 wdc_get_drive_capabilities(nvme_root_t r, struct nvme_dev *dev)
 	return capabilities;
 }
 
+static int wdc_caps_cache_path(struct wdc_dev_info *info, char *path, size_t len)
+{
+	char sn[sizeof(info->sn)];
+	int i;
+
+	if (!strlen(info->sn) || !strlen(info->fr))
+		return -EINVAL;
+
+	/* the serial number is used as file name */
+	strcpy(sn, info->sn);
+	for (i = 0; sn[i]; i++) {
+		if (sn[i] == '/' || sn[i] == ' ')
+			sn[i] = '_';
+	}
+
+	if (snprintf(path, len, "%s/%s", WDC_CAPS_CACHE_DIR, sn) >= len)
+		return -ENAMETOOLONG;
+
+	return 0;
+}
+
+static bool wdc_caps_cache_load(struct wdc_dev_info *info, __u64 *capabilities)
+{
+	char path[PATH_MAX], fr[sizeof(info->fr)];
+	unsigned int version, vendor_id, device_id;
+	unsigned long long caps;
+	FILE *f;
+	int n;
+
+	if (wdc_caps_cache_path(info, path, sizeof(path)))
+		return false;
+
+	f = fopen(path, "r");
+	if (!f)
+		return false;
+
+	n = fscanf(f, "%u %x %x %8s %llx", &version, &vendor_id, &device_id, fr, &caps);
+	fclose(f);
+
+	if (n != 5 || version != WDC_CAPS_CACHE_VERSION ||
+	    vendor_id != info->vendor_id || device_id != info->device_id ||
+	    strcmp(fr, info->fr))
+		return false;
+
+	*capabilities = caps;
+	return true;
+}
+
+static void wdc_caps_cache_store(struct wdc_dev_info *info, __u64 capabilities)
+{
+	char path[PATH_MAX], tmp[PATH_MAX + 8];
+	FILE *f;
+	int ret;
+
+	if (wdc_caps_cache_path(info, path, sizeof(path)))
+		return;
+
+	/* the cache is best effort, e.g. the rundir is not writable for users */
+	if (mkdir(RUNDIR "/nvme", 0755) && errno != EEXIST)
+		return;
+	if (mkdir(WDC_CAPS_CACHE_DIR, 0755) && errno != EEXIST)
+		return;
+
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+	f = fopen(tmp, "w");
+	if (!f)
+		return;
+
+	fprintf(f, "%u 0x%x 0x%x %s 0x%"PRIx64"\n", WDC_CAPS_CACHE_VERSION,
+		info->vendor_id, info->device_id, info->fr, (uint64_t)capabilities);
+	ret = fclose(f);
+
+	/* rename so that concurrent readers never see a partial entry */
+	if (ret || rename(tmp, path))
+		unlink(tmp);
+}
+
+static __u64 wdc_get_drive_capabilities(nvme_root_t r, struct nvme_dev *dev)
+{
+	struct wdc_dev_info *info = wdc_dev_info_lookup(dev);
+	struct nvme_id_ctrl ctrl;
+	__u64 capabilities;
+	uint32_t device_id = -1, vendor_id = -1;
+
+	if (info->caps_valid)
+		return info->capabilities;
+
+	/* NVMeOF devices have no PCI IDs, they are probed every time */
+	if (!wdc_get_pci_ids(r, dev, &device_id, &vendor_id)) {
+		if (!strlen(info->sn) && !wdc_identify_ctrl(dev, &ctrl)) {
+			wdc_copy_id_str(info->sn, sizeof(info->sn), ctrl.sn, sizeof(ctrl.sn));
+			wdc_copy_id_str(info->fr, sizeof(info->fr), ctrl.fr, sizeof(ctrl.fr));
+		}
+
+		if (wdc_caps_cache_load(info, &capabilities)) {
+			info->capabilities = capabilities;
+			info->caps_valid = true;
+			return capabilities;
+		}
+	}
+
+	capabilities = wdc_probe_drive_capabilities(r, dev);
+
+	/* do not remember failures, e.g. an invalid customer id */
+	if (capabilities && capabilities != (__u64)-1) {
+		info->capabilities = capabilities;
+		info->caps_valid = true;
+		if (!info->pci_ret)
+			wdc_caps_cache_store(info, capabilities);
+	}
+
+	return capabilities;
+}
+
 static __u64 wdc_get_enc_drive_capabilities(nvme_root_t r,
 					    struct nvme_dev *dev)
 {
@@ -2105,7 +2320,7 @@ static int wdc_get_serial_name(struct nvme_dev *dev, char *file, size_t len,
 	strncpy(orig, file, PATH_MAX - 1);
 	memset(file, 0, len);
 	memset(&ctrl, 0, sizeof(struct nvme_id_ctrl));
-	ret = nvme_identify_ctrl(dev_fd(dev), &ctrl);
+	ret = wdc_identify_ctrl(dev, &ctrl);
 	if (ret) {
 		fprintf(stderr, "ERROR: WDC: nvme_identify_ctrl() failed 0x%x\n", ret);
 		return -1;
@@ -2790,7 +3005,7 @@ static int wdc_do_cap_telemetry_log(struct nvme_dev *dev, char *file,
 	nvme_root_t r;
 
 	memset(&ctrl, 0, sizeof(struct nvme_id_ctrl));
-	err = nvme_identify_ctrl(dev_fd(dev), &ctrl);
+	err = wdc_identify_ctrl(dev, &ctrl);
 	if (err) {
 		fprintf(stderr, "ERROR: WDC: nvme_identify_ctrl() failed 0x%x\n", err);
 		return err;
@@ -2958,18 +3173,18 @@ out:
 }
 
 static int wdc_do_cap_dui_v1(int fd, char *file, __u32 xfer_size, int data_area, int verbose,
-			     struct wdc_dui_log_hdr *log_hdr, __s64 *total_size)
+			     struct wdc_dui_log_hdr *log_hdr, __s64 *total_size, bool direct)
 {
 	__s32 log_size = 0;
 	__u32 cap_dui_length = le32_to_cpu(log_hdr->log_size);
 	__u32 curr_data_offset = 0;
 	__u8 *buffer_addr;
-	__u8 *dump_data = NULL;
+	struct nvme_writer *output;
 	bool last_xfer = false;
+	__u32 chunk, len;
 	int err;
 	int i;
 	int j;
-	int output;
 	int ret = 0;
 
 	if (verbose) {
@@ -3003,41 +3218,46 @@ static int wdc_do_cap_dui_v1(int fd, char *file, __u32 xfer_size, int data_area,
 
 	*total_size = log_size;
 
-	dump_data = (__u8 *)malloc(sizeof(__u8) * xfer_size);
-	if (!dump_data) {
-		fprintf(stderr, "%s: ERROR: dump data V1 malloc failed : status %s, size = 0x%x\n",
-			__func__, strerror(errno), (unsigned int)xfer_size);
-		return -1;
-	}
-	memset(dump_data, 0, sizeof(__u8) * xfer_size);
-
-	output = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-	if (output < 0) {
+	/* the header is staged through the same buffers as the data */
+	output = nvme_writer_open(file, max(xfer_size, WDC_NVME_CAP_DUI_HEADER_SIZE), direct);
+	if (!output) {
 		fprintf(stderr, "%s: Failed to open output file %s: %s!\n", __func__, file,
 			strerror(errno));
-		free(dump_data);
-		return output;
+		return -1;
 	}
 
 	/* write the telemetry and log headers into the dump_file */
-	err = write(output, (void *)log_hdr, WDC_NVME_CAP_DUI_HEADER_SIZE);
-	if (err != WDC_NVME_CAP_DUI_HEADER_SIZE) {
-		fprintf(stderr, "%s: Failed to flush header data to file!\n", __func__);
-		goto free_mem;
-	}
+	buffer_addr = nvme_writer_get_buf(output);
+	memcpy(buffer_addr, log_hdr, WDC_NVME_CAP_DUI_HEADER_SIZE);
+	len = WDC_NVME_CAP_DUI_HEADER_SIZE;
 
 	log_size -= WDC_NVME_CAP_DUI_HEADER_SIZE;
 	curr_data_offset = WDC_NVME_CAP_DUI_HEADER_SIZE;
-	i = 0;
-	buffer_addr = dump_data;
 
-	for (; log_size > 0; log_size -= xfer_size) {
-		xfer_size = min(xfer_size, log_size);
+	/*
+	 * The first chunk of data fills up the buffer behind the header, so
+	 * that all writes but the last one stay aligned for O_DIRECT.
+	 */
+	if (log_size <= 0 || xfer_size <= len) {
+		err = nvme_writer_commit(output, len);
+		if (err) {
+			fprintf(stderr, "%s: Failed to flush header data to file!\n", __func__);
+			ret = -1;
+			goto close_output;
+		}
+		len = 0;
+	}
 
-		if (log_size <= xfer_size)
+	for (i = 0; log_size > 0; i++) {
+		chunk = min(xfer_size - len, log_size);
+
+		if (log_size <= chunk)
 			last_xfer = true;
 
-		ret = wdc_dump_dui_data(fd, xfer_size, curr_data_offset, buffer_addr, last_xfer);
+		/* fetch into one buffer while the previous chunk is written out */
+		if (!len)
+			buffer_addr = nvme_writer_get_buf(output);
+		ret = wdc_dump_dui_data(fd, chunk, curr_data_offset, buffer_addr + len, last_xfer);
 		if (ret) {
 			fprintf(stderr,
 				"%s: ERROR: WDC: Get chunk %d, size = 0x%"PRIx64", offset = 0x%x, addr = %p\n",
@@ -3047,41 +3267,49 @@ static int wdc_do_cap_dui_v1(int fd, char *file, __u32 xfer_size, int data_area,
 			break;
 		}
 
-		/* write the dump data into the file */
-		err = write(output, (void *)buffer_addr, xfer_size);
-		if (err != xfer_size) {
+		/* queue the dump data for writing into the file */
+		err = nvme_writer_commit(output, len + chunk);
+		if (err) {
 			fprintf(stderr,
-				"%s: ERROR: WDC: Failed to flush DUI data to file! chunk %d, err = 0x%x, xfer_size = 0x%x\n",
-				__func__, i, err, xfer_size);
+				"%s: ERROR: WDC: Failed to flush DUI data to file! chunk %d, err = %s, xfer_size = 0x%x\n",
+				__func__, i, strerror(-err), chunk);
 			ret = -1;
-			goto free_mem;
+			goto close_output;
 		}
 
-		curr_data_offset += xfer_size;
-		i++;
+		curr_data_offset += chunk;
+		log_size -= chunk;
+		len = 0;
 	}
 
-free_mem:
-	close(output);
-	free(dump_data);
+close_output:
+	err = nvme_writer_close(output);
+	if (err && !ret) {
+		fprintf(stderr, "%s: ERROR: WDC: Failed to flush DUI data to file: %s\n",
+			__func__, strerror(-err));
+		ret = -1;
+	}
+
+	/* the header is staged with the first chunk, don't leave a headerless dump */
+	if (ret)
+		unlink(file);
 	return ret;
 }
 
 static int wdc_do_cap_dui_v2_v3(int fd, char *file, __u32 xfer_size, int data_area, int verbose,
 				struct wdc_dui_log_hdr *log_hdr, __s64 *total_size, __u64 file_size,
-				__u64 offset)
+				__u64 offset, bool direct)
 {
 	__u64 cap_dui_length_v3;
 	__u64 curr_data_offset = 0;
 	__s64 log_size = 0;
 	__u64 xfer_size_long = (__u64)xfer_size;
 	__u8 *buffer_addr;
-	__u8 *dump_data = NULL;
+	struct nvme_writer *output;
 	bool last_xfer = false;
 	int err;
 	int i;
 	int j;
-	int output;
 	int ret = 0;
 	struct wdc_dui_log_hdr_v3 *log_hdr_v3 = (struct wdc_dui_log_hdr_v3 *)log_hdr;
 
@@ -3136,21 +3364,11 @@ static int wdc_do_cap_dui_v2_v3(int fd, char *file, __u32 xfer_size, int data_ar
 		return -1;
 	}
 
-	dump_data = (__u8 *)malloc(sizeof(__u8) * xfer_size_long);
-	if (!dump_data) {
-		fprintf(stderr,
-			"%s: ERROR: dump data v3 malloc failed : status %s, size = 0x%"PRIx64"\n",
-			__func__, strerror(errno), (uint64_t)xfer_size_long);
-		return -1;
-	}
-	memset(dump_data, 0, sizeof(__u8) * xfer_size_long);
-
-	output = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-	if (output < 0) {
+	output = nvme_writer_open(file, xfer_size_long, direct);
+	if (!output) {
 		fprintf(stderr, "%s: Failed to open output file %s: %s!\n",
 				__func__, file, strerror(errno));
-		free(dump_data);
-		return output;
+		return -1;
 	}
 
 	curr_data_offset = 0;
@@ -3172,7 +3390,6 @@ static int wdc_do_cap_dui_v2_v3(int fd, char *file, __u32 xfer_size, int data_ar
 	}
 
 	i = 0;
-	buffer_addr = dump_data;
 
 	for (; log_size > 0; log_size -= xfer_size_long) {
 		xfer_size_long = min(xfer_size_long, log_size);
@@ -3180,6 +3397,8 @@ static int wdc_do_cap_dui_v2_v3(int fd, char *file, __u32 xfer_size, int data_ar
 		if (log_size <= xfer_size_long)
 			last_xfer = true;
 
+		/* fetch into one buffer while the previous chunk is written out */
+		buffer_addr = nvme_writer_get_buf(output);
 		ret = wdc_dump_dui_data_v2(fd, (__u32)xfer_size_long, curr_data_offset, buffer_addr,
 					   last_xfer);
 		if (ret) {
@@ -3192,29 +3411,33 @@ static int wdc_do_cap_dui_v2_v3(int fd, char *file, __u32 xfer_size, int data_ar
 			break;
 		}
 
-		/* write the dump data into the file */
-		err = write(output, (void *)buffer_addr, xfer_size_long);
-		if (err != xfer_size_long) {
+		/* queue the dump data for writing into the file */
+		err = nvme_writer_commit(output, xfer_size_long);
+		if (err) {
 			fprintf(stderr,
-				"%s: ERROR: WDC: Failed to flush DUI data to file! chunk %d, err = 0x%x, xfer_size = 0x%"PRIx64"\n",
-				__func__, i, err, (uint64_t)xfer_size_long);
+				"%s: ERROR: WDC: Failed to flush DUI data to file! chunk %d, err = %s, xfer_size = 0x%"PRIx64"\n",
+				__func__, i, strerror(-err), (uint64_t)xfer_size_long);
 			ret = -1;
-			goto free_mem;
+			goto close_output;
 		}
 
 		curr_data_offset += xfer_size_long;
 		i++;
 	}
 
-free_mem:
-	close(output);
-	free(dump_data);
+close_output:
+	err = nvme_writer_close(output);
+	if (err && !ret) {
+		fprintf(stderr, "%s: ERROR: WDC: Failed to flush DUI data to file: %s\n",
+			__func__, strerror(-err));
+		ret = -1;
+	}
 	return ret;
 }
 
 static int wdc_do_cap_dui_v4(int fd, char *file, __u32 xfer_size, int data_area, int verbose,
 			     struct wdc_dui_log_hdr *log_hdr, __s64 *total_size, __u64 file_size,
-			     __u64 offset)
+			     __u64 offset, bool direct)
 {
 	__s64 log_size = 0;
 	__s64 section_size_bytes = 0;
@@ -3222,11 +3445,10 @@ static int wdc_do_cap_dui_v4(int fd, char *file, __u32 xfer_size, int data_area,
 	__u64 cap_dui_length_v4;
 	__u64 curr_data_offset = 0;
 	__u8 *buffer_addr;
-	__u8 *dump_data = NULL;
+	struct nvme_writer *output;
 	int err;
 	int i;
 	int j;
-	int output;
 	int ret = 0;
 	bool last_xfer = false;
 	struct wdc_dui_log_hdr_v4 *log_hdr_v4 = (struct wdc_dui_log_hdr_v4 *)log_hdr;
@@ -3278,20 +3500,11 @@ static int wdc_do_cap_dui_v4(int fd, char *file, __u32 xfer_size, int data_area,
 		return -1;
 	}
 
-	dump_data = (__u8 *)malloc(sizeof(__u8) * xfer_size_long);
-	if (!dump_data) {
-		fprintf(stderr, "%s: ERROR: dump data V4 malloc failed : status %s, size = 0x%x\n",
-			__func__, strerror(errno), (unsigned int)xfer_size_long);
-		return -1;
-	}
-	memset(dump_data, 0, sizeof(__u8) * xfer_size_long);
-
-	output = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-	if (output < 0) {
+	output = nvme_writer_open(file, xfer_size_long, direct);
+	if (!output) {
 		fprintf(stderr, "%s: Failed to open output file %s: %s!\n", __func__, file,
 			strerror(errno));
-		free(dump_data);
-		return output;
+		return -1;
 	}
 
 	curr_data_offset = 0;
@@ -3313,7 +3526,6 @@ static int wdc_do_cap_dui_v4(int fd, char *file, __u32 xfer_size, int data_area,
 	}
 
 	i = 0;
-	buffer_addr = dump_data;
 
 	for (; log_size > 0; log_size -= xfer_size_long) {
 		xfer_size_long = min(xfer_size_long, log_size);
@@ -3321,6 +3533,8 @@ static int wdc_do_cap_dui_v4(int fd, char *file, __u32 xfer_size, int data_area,
 		if (log_size <= xfer_size_long)
 			last_xfer = true;
 
+		/* fetch into one buffer while the previous chunk is written out */
+		buffer_addr = nvme_writer_get_buf(output);
 		ret = wdc_dump_dui_data_v2(fd, (__u32)xfer_size_long, curr_data_offset, buffer_addr, last_xfer);
 		if (ret) {
 			fprintf(stderr,
@@ -3332,28 +3546,32 @@ static int wdc_do_cap_dui_v4(int fd, char *file, __u32 xfer_size, int data_area,
 			break;
 		}
 
-		/* write the dump data into the file */
-		err = write(output, (void *)buffer_addr, xfer_size_long);
-		if (err != xfer_size_long) {
+		/* queue the dump data for writing into the file */
+		err = nvme_writer_commit(output, xfer_size_long);
+		if (err) {
 			fprintf(stderr,
-				"%s: ERROR: WDC: Failed to flush DUI data to file! chunk %d, err = 0x%x, xfer_size_long = 0x%"PRIx64"\n",
-				__func__, i, err, (uint64_t)xfer_size_long);
+				"%s: ERROR: WDC: Failed to flush DUI data to file! chunk %d, err = %s, xfer_size_long = 0x%"PRIx64"\n",
+				__func__, i, strerror(-err), (uint64_t)xfer_size_long);
 			ret = -1;
-			goto free_mem;
+			goto close_output;
 		}
 
 		curr_data_offset += xfer_size_long;
 		i++;
 	}
 
-free_mem:
-	close(output);
-	free(dump_data);
+close_output:
+	err = nvme_writer_close(output);
+	if (err && !ret) {
+		fprintf(stderr, "%s: ERROR: WDC: Failed to flush DUI data to file: %s\n",
+			__func__, strerror(-err));
+		ret = -1;
+	}
 	return ret;
 }
 
 static int wdc_do_cap_dui(int fd, char *file, __u32 xfer_size, int data_area, int verbose,
-			  __u64 file_size, __u64 offset)
+			  __u64 file_size, __u64 offset, bool direct)
 {
 	int ret = 0;
 	__u32 dui_log_hdr_size = WDC_NVME_CAP_DUI_HEADER_SIZE;
@@ -3381,19 +3599,19 @@ static int wdc_do_cap_dui(int fd, char *file, __u32 xfer_size, int data_area, in
 	/* Check the Log Header version */
 	if ((log_hdr->hdr_version & 0xFF) == 0x00 || (log_hdr->hdr_version & 0xFF) == 0x01) {
 		ret = wdc_do_cap_dui_v1(fd, file, xfer_size, data_area, verbose, log_hdr,
-					&total_size);
+					&total_size, direct);
 		if (ret)
 			goto out;
 	} else if ((log_hdr->hdr_version & 0xFF) == 0x02 ||
 		   (log_hdr->hdr_version & 0xFF) == 0x03) {
 		/* Process Version 2 or 3 header */
 		ret = wdc_do_cap_dui_v2_v3(fd, file, xfer_size, data_area, verbose, log_hdr,
-					   &total_size, file_size, offset);
+					   &total_size, file_size, offset, direct);
 		if (ret)
 			goto out;
 	} else if ((log_hdr->hdr_version & 0xFF) == 0x04) {
 		ret = wdc_do_cap_dui_v4(fd, file, xfer_size, data_area, verbose, log_hdr,
-					&total_size, file_size, offset);
+					&total_size, file_size, offset, direct);
 		if (ret)
 			goto out;
 	} else {
@@ -3816,6 +4034,7 @@ static int wdc_vs_internal_fw_log(int argc, char **argv, struct command *command
 	char *offset = "Output file data offset. Currently only supported on the SN340 device.";
 	char *type = "Telemetry type - NONE, HOST, or CONTROLLER. Currently only supported on the SN530, SN640, SN730, SN740, SN810, SN840 and ZN350 devices.";
 	char *verbose = "Display more debug messages.";
+	char *direct_io = "Write the output file with O_DIRECT, bypassing the page cache.";
 	char f[PATH_MAX] = {0};
 	char fb[PATH_MAX/2] = {0};
 	char fileSuffix[PATH_MAX] = {0};
@@ -3839,6 +4058,7 @@ static int wdc_vs_internal_fw_log(int argc, char **argv, struct command *command
 		__u64 offset;
 		char *type;
 		bool verbose;
+		bool direct_io;
 	};
 
 	struct config cfg = {
@@ -3849,6 +4069,7 @@ static int wdc_vs_internal_fw_log(int argc, char **argv, struct command *command
 		.offset = 0,
 		.type = NULL,
 		.verbose = false,
+		.direct_io = false,
 	};
 
 	OPT_ARGS(opts) = {
@@ -3859,6 +4080,7 @@ static int wdc_vs_internal_fw_log(int argc, char **argv, struct command *command
 		OPT_LONG("offset",        'e', &cfg.offset,    offset),
 		OPT_FILE("type",          't', &cfg.type,      type),
 		OPT_FLAG("verbose",       'v', &cfg.verbose,   verbose),
+		OPT_FLAG("direct-io",     'D', &cfg.direct_io, direct_io),
 		OPT_END()
 	};
 
@@ -4041,7 +4263,7 @@ static int wdc_vs_internal_fw_log(int argc, char **argv, struct command *command
 			ret = wdc_do_cap_dui(dev_fd(dev), f, xfer_size,
 					 cfg.data_area,
 					 cfg.verbose, cfg.file_size,
-					 cfg.offset);
+					 cfg.offset, cfg.direct_io);
 			goto out;
 		}
 	}
@@ -4057,7 +4279,7 @@ static int wdc_vs_internal_fw_log(int argc, char **argv, struct command *command
 		} else {
 			ret = wdc_do_cap_dui(dev_fd(dev), f, xfer_size,
 					     WDC_NVME_DUI_MAX_DATA_AREA,
-					     cfg.verbose, 0, 0);
+					     cfg.verbose, 0, 0, cfg.direct_io);
 			goto out;
 		}
 	}
@@ -4631,8 +4853,7 @@ static void wdc_print_log_json(struct wdc_ssd_perf_stats *perf)
 			safe_div_fp((le64_to_cpu(perf->nw_blks)), (le64_to_cpu(perf->nw_cmds))));
 	json_object_add_value_int(root, "NAND Read Before Written",
 			le64_to_cpu(perf->nrbw));
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 	json_free_object(root);
 }
 
@@ -4642,7 +4863,7 @@ static int wdc_print_log(struct wdc_ssd_perf_stats *perf, int fmt)
 		fprintf(stderr, "ERROR: WDC: Invalid buffer to read perf stats\n");
 		return -1;
 	}
-	switch (fmt) {
+	switch (fmt & ~JSON_ENCODINGS) {
 	case NORMAL:
 		wdc_print_log_normal(perf);
 		break;
@@ -4662,7 +4883,7 @@ static int wdc_print_latency_monitor_log_normal(struct nvme_dev *dev,
 	struct nvme_id_ctrl ctrl;
 	char ts_buf[128];
 
-	err = nvme_identify_ctrl(dev_fd(dev), &ctrl);
+	err = wdc_identify_ctrl(dev, &ctrl);
 	if (!err) {
 		printf("  Serial Number:  %-.*s\n", (int)sizeof(ctrl.sn), ctrl.sn);
 	} else {
@@ -4794,8 +5015,7 @@ static void wdc_print_latency_monitor_log_json(struct wdc_ssd_latency_monitor_lo
 		}
 	}
 
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 
 	json_free_object(root);
 }
@@ -4853,8 +5073,7 @@ static void wdc_print_error_rec_log_json(struct wdc_ocp_c1_error_recovery_log *l
 		(uint64_t)le64_to_cpu(*(uint64_t *)&log_data->log_page_guid[0]));
 	json_object_add_value_string(root, "Log page GUID", guid);
 
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 
 	json_free_object(root);
 }
@@ -4915,8 +5134,7 @@ static void wdc_print_dev_cap_log_json(struct wdc_ocp_C4_dev_cap_log *log_data)
 		(uint64_t)le64_to_cpu(*(uint64_t *)&log_data->log_page_guid[0]));
 	json_object_add_value_string(root, "Log page GUID", guid);
 
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 
 	json_free_object(root);
 }
@@ -4966,8 +5184,7 @@ static void wdc_print_unsupported_reqs_log_json(struct wdc_ocp_C5_unsupported_re
 		(uint64_t)le64_to_cpu(*(uint64_t *)&log_data->log_page_guid[0]));
 	json_object_add_value_string(root, "Log page GUID", guid);
 
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 
 	json_free_object(root);
 }
@@ -5090,8 +5307,7 @@ static void wdc_print_fb_ca_log_json(struct wdc_ssd_ca_perf_stats *perf)
 	json_object_add_value_int(root, "PCIe Correctable Error", le64_to_cpu(perf->pcie_corr_error));
 	json_object_add_value_int(root, "Incomplete Shutdown Counte", le32_to_cpu(perf->incomplete_shutdown_count));
 	json_object_add_value_int(root, "Percent Free Blocks", perf->percent_free_blocks);
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 	json_free_object(root);
 }
 
@@ -5374,8 +5590,7 @@ invalid_id:
 	printf("  Invalid Field ID = %d\n", bd_data->field_id);
 
 done:
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 	json_free_object(root);
 
 	return;
@@ -5480,8 +5695,7 @@ static void wdc_print_d0_log_json(struct wdc_ssd_d0_smart_log *perf)
 	json_object_add_value_int(root, "Percentage of P/E Cycles Remaining",
 			le32_to_cpu(perf->percentage_pe_cycles_remaining));
 
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 	json_free_object(root);
 }
 
@@ -5801,8 +6015,7 @@ static void wdc_print_fw_act_history_log_json(__u8 *data, int num_entries,
 				json_object_add_value_string(root, "Result", fail_str);
 			}
 
-			json_print_object(root, NULL);
-			printf("\n");
+			json_print_line(root);
 
 			entryIdx++;
 			if (entryIdx >= WDC_MAX_NUM_ACT_HIST_ENTRIES)
@@ -5863,8 +6076,7 @@ static void wdc_print_fw_act_history_log_json(__u8 *data, int num_entries,
 				json_object_add_value_string(root, "Result", fail_str);
 			}
 
-			json_print_object(root, NULL);
-			printf("\n");
+			json_print_line(root);
 
 			entryIdx++;
 			if (entryIdx >= WDC_MAX_NUM_ACT_HIST_ENTRIES)
@@ -6291,8 +6503,7 @@ static void wdc_print_hw_rev_log_json(void *data)
 		le64_to_cpu(*(uint64_t *)&log_data->hw_rev_guid[0]));
 	json_object_add_value_string(root, "Log Page GUID", json_data);
 
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 	json_free_object(root);
 }
 
@@ -6551,8 +6762,7 @@ static void wdc_print_ext_smart_cloud_log_json(void *data, int mask)
 		json_object_add_value_string(root, "log_page_guid", guid);
 	}
 
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 	json_free_object(root);
 }
 
@@ -6723,8 +6933,7 @@ static void wdc_print_smart_cloud_attr_C0_json(void *data)
 		json_object_add_value_uint64(root, "Power State Change Count",
 				(uint64_t)le64_to_cpu(*(uint64_t *)&log_data[SCAO_PSCC]));
 	}
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 	json_free_object(root);
 }
 
@@ -6772,8 +6981,7 @@ static void wdc_print_eol_c0_json(void *data)
 	json_object_add_value_uint(root, "Raw Read Error Rate",
 			(uint32_t)le32_to_cpu(log_data[EOL_RRER]));
 
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 	json_free_object(root);
 }
 
@@ -6783,7 +6991,7 @@ static int wdc_print_ext_smart_cloud_log(void *data, int fmt)
 		fprintf(stderr, "ERROR: WDC: Invalid buffer to read 0xC0 V1 log\n");
 		return -1;
 	}
-	switch (fmt) {
+	switch (fmt & ~JSON_ENCODINGS) {
 	case NORMAL:
 		wdc_print_ext_smart_cloud_log_normal(data, WDC_SCA_V1_ALL);
 		break;
@@ -6800,7 +7008,7 @@ static int wdc_print_c0_cloud_attr_log(void *data, int fmt)
 		fprintf(stderr, "ERROR: WDC: Invalid buffer to read 0xC0 log\n");
 		return -1;
 	}
-	switch (fmt) {
+	switch (fmt & ~JSON_ENCODINGS) {
 	case NORMAL:
 		wdc_print_smart_cloud_attr_C0_normal(data);
 		break;
@@ -6817,7 +7025,7 @@ static int wdc_print_c0_eol_log(void *data, int fmt)
 		fprintf(stderr, "ERROR: WDC: Invalid buffer to read 0xC0 log\n");
 		return -1;
 	}
-	switch (fmt) {
+	switch (fmt & ~JSON_ENCODINGS) {
 	case NORMAL:
 		wdc_print_eol_c0_normal(data);
 		break;
@@ -7154,7 +7362,7 @@ static int wdc_print_latency_monitor_log(struct nvme_dev *dev,
 		fprintf(stderr, "ERROR: WDC: Invalid C3 log data buffer\n");
 		return -1;
 	}
-	switch (fmt) {
+	switch (fmt & ~JSON_ENCODINGS) {
 	case NORMAL:
 		wdc_print_latency_monitor_log_normal(dev, log_data);
 		break;
@@ -7171,7 +7379,7 @@ static int wdc_print_error_rec_log(struct wdc_ocp_c1_error_recovery_log *log_dat
 		fprintf(stderr, "ERROR: WDC: Invalid C1 log data buffer\n");
 		return -1;
 	}
-	switch (fmt) {
+	switch (fmt & ~JSON_ENCODINGS) {
 	case NORMAL:
 		wdc_print_error_rec_log_normal(log_data);
 		break;
@@ -7188,7 +7396,7 @@ static int wdc_print_dev_cap_log(struct wdc_ocp_C4_dev_cap_log *log_data, int fm
 		fprintf(stderr, "ERROR: WDC: Invalid C4 log data buffer\n");
 		return -1;
 	}
-	switch (fmt) {
+	switch (fmt & ~JSON_ENCODINGS) {
 	case NORMAL:
 		wdc_print_dev_cap_log_normal(log_data);
 		break;
@@ -7205,7 +7413,7 @@ static int wdc_print_unsupported_reqs_log(struct wdc_ocp_C5_unsupported_reqs *lo
 		fprintf(stderr, "ERROR: WDC: Invalid C5 log data buffer\n");
 		return -1;
 	}
-	switch (fmt) {
+	switch (fmt & ~JSON_ENCODINGS) {
 	case NORMAL:
 		wdc_print_unsupported_reqs_log_normal(log_data);
 		break;
@@ -7222,7 +7430,7 @@ static int wdc_print_fb_ca_log(struct wdc_ssd_ca_perf_stats *perf, int fmt)
 		fprintf(stderr, "ERROR: WDC: Invalid buffer to read perf stats\n");
 		return -1;
 	}
-	switch (fmt) {
+	switch (fmt & ~JSON_ENCODINGS) {
 	case NORMAL:
 		wdc_print_fb_ca_log_normal(perf);
 		break;
@@ -7239,7 +7447,7 @@ static int wdc_print_bd_ca_log(struct nvme_dev *dev, void *bd_data, int fmt)
 		fprintf(stderr, "ERROR: WDC: Invalid buffer to read data\n");
 		return -1;
 	}
-	switch (fmt) {
+	switch (fmt & ~JSON_ENCODINGS) {
 	case NORMAL:
 		wdc_print_bd_ca_log_normal(dev, bd_data);
 		break;
@@ -7259,7 +7467,7 @@ static int wdc_print_d0_log(struct wdc_ssd_d0_smart_log *perf, int fmt)
 		fprintf(stderr, "ERROR: WDC: Invalid buffer to read perf stats\n");
 		return -1;
 	}
-	switch (fmt) {
+	switch (fmt & ~JSON_ENCODINGS) {
 	case NORMAL:
 		wdc_print_d0_log_normal(perf);
 		break;
@@ -7279,7 +7487,7 @@ static int wdc_print_fw_act_history_log(__u8 *data, int num_entries, int fmt,
 		return -1;
 	}
 
-	switch (fmt) {
+	switch (fmt & ~JSON_ENCODINGS) {
 	case NORMAL:
 		wdc_print_fw_act_history_log_normal(data, num_entries, cust_id,
 						    vendor_id, device_id);
@@ -7958,8 +8166,7 @@ static void show_cloud_smart_log_json(struct ocp_cloud_smart_log *log)
 	stringify_log_page_guid(log->log_page_guid, buf);
 	json_object_add_value_string(root, "log_page_guid", buf);
 
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 	json_free_object(root);
 }
 
@@ -8172,7 +8379,7 @@ static int wdc_vs_smart_add_log(int argc, char **argv, struct command *command,
 				else {
 					if (fmt == BINARY)
 						d_raw((unsigned char *)&log, sizeof(log));
-					else if (fmt == JSON)
+					else if (fmt & JSON)
 						show_cloud_smart_log_json(&log);
 					else
 						show_cloud_smart_log_normal(&log, dev);
@@ -8344,7 +8551,7 @@ static int wdc_vs_hw_rev_log(int argc, char **argv, struct command *command,
 			ret = -1;
 			goto out;
 		}
-		switch (fmt) {
+		switch (fmt & ~JSON_ENCODINGS) {
 		case NORMAL:
 			wdc_print_hw_rev_log_normal(data);
 			break;
@@ -8472,7 +8679,7 @@ static int wdc_vs_device_waf(int argc, char **argv, struct command *command,
 				(phys_media_units_written_tlc/data_units_written));
 		printf("Device Write Amplification Factor SLC : %4.2Lf\n",
 				(phys_media_units_written_slc/data_units_written));
-	} else if (fmt == JSON) {
+	} else if (fmt & JSON) {
 		root = json_create_object();
 		sprintf(tlc_waf_str, "%4.2Lf", (phys_media_units_written_tlc/data_units_written));
 		sprintf(slc_waf_str, "%4.2Lf", (phys_media_units_written_slc/data_units_written));
@@ -8480,8 +8687,7 @@ static int wdc_vs_device_waf(int argc, char **argv, struct command *command,
 		json_object_add_value_string(root, "Device Write Amplification Factor TLC", tlc_waf_str);
 		json_object_add_value_string(root, "Device Write Amplification Factor SLC", slc_waf_str);
 
-		json_print_object(root, NULL);
-		printf("\n");
+		json_print_line(root);
 
 		json_free_object(root);
 	}
@@ -9322,7 +9528,7 @@ static int wdc_get_serial_and_fw_rev(struct nvme_dev *dev, char *sn, char *fw_re
 	memset(sn, 0, WDC_SERIAL_NO_LEN);
 	memset(fw_rev, 0, WDC_NVME_FIRMWARE_REV_LEN);
 	memset(&ctrl, 0, sizeof(struct nvme_id_ctrl));
-	ret = nvme_identify_ctrl(dev_fd(dev), &ctrl);
+	ret = wdc_identify_ctrl(dev, &ctrl);
 	if (ret) {
 		fprintf(stderr, "ERROR: WDC: nvme_identify_ctrl() failed 0x%x\n", ret);
 		return -1;
@@ -9346,7 +9552,7 @@ static int wdc_get_max_transfer_len(struct nvme_dev *dev, __u32 *maxTransferLen)
 	__u32 maxTransferLenDevice = 0;
 
 	memset(&ctrl, 0, sizeof(struct nvme_id_ctrl));
-	ret = nvme_identify_ctrl(dev_fd(dev), &ctrl);
+	ret = wdc_identify_ctrl(dev, &ctrl);
 	if (ret) {
 		fprintf(stderr, "ERROR: WDC: nvme_identify_ctrl() failed 0x%x\n", ret);
 		return -1;
@@ -9877,7 +10083,7 @@ static int wdc_do_drive_essentials(nvme_root_t r, struct nvme_dev *dev,
 
 	/* Get Identify Controller Data */
 	memset(&ctrl, 0, sizeof(struct nvme_id_ctrl));
-	ret = nvme_identify_ctrl(dev_fd(dev), &ctrl);
+	ret = wdc_identify_ctrl(dev, &ctrl);
 	if (ret) {
 		fprintf(stderr, "ERROR: WDC: nvme_identify_ctrl() failed, ret = %d\n", ret);
 		return -1;
@@ -10458,8 +10664,7 @@ static void __json_log_page_directory(struct log_page_directory *directory)
 		}
 	}
 
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 	json_free_object(root);
 }
 
@@ -10600,8 +10805,7 @@ static int wdc_log_page_directory(int argc, char **argv, struct command *command
 						cbs_data->data[i]);
 				}
 
-				json_print_object(root, NULL);
-				printf("\n");
+				json_print_line(root);
 				json_free_object(root);
 			} else {
 				fprintf(stderr,
@@ -10630,7 +10834,7 @@ static int wdc_log_page_directory(int argc, char **argv, struct command *command
 					0, &result);
 
 			if (!ret) {
-				switch (fmt) {
+				switch (fmt & ~JSON_ENCODINGS) {
 				case BINARY:
 					d_raw((unsigned char *)data, 32);
 					break;
@@ -10665,7 +10869,7 @@ static int wdc_get_drive_reason_id(struct nvme_dev *dev, char *drive_reason_id,
 	j = sizeof(ctrl.mn) - 1;
 	memset(drive_reason_id, 0, len);
 	memset(&ctrl, 0, sizeof(struct nvme_id_ctrl));
-	ret = nvme_identify_ctrl(dev_fd(dev), &ctrl);
+	ret = wdc_identify_ctrl(dev, &ctrl);
 	if (ret) {
 		fprintf(stderr, "ERROR: WDC: nvme_identify_ctrl() failed 0x%x\n", ret);
 		return -1;
@@ -10973,8 +11177,7 @@ static void wdc_print_nand_stats_json(__u16 version, void *data)
 		json_object_add_value_uint64(root, "Number Successful NS Resizing Events",
 				le64_to_cpu(nand_stats->successful_ns_resize_event));
 
-		json_print_object(root, NULL);
-		printf("\n");
+		json_print_line(root);
 		break;
 	case 3:
 		json_object_add_value_uint128(root, "NAND Writes TLC (Bytes)",
@@ -11062,8 +11265,7 @@ static void wdc_print_nand_stats_json(__u16 version, void *data)
 		json_object_add_value_uint(root, "log page version",
 				le16_to_cpu(nand_stats_v3->log_page_version));
 
-		json_print_object(root, NULL);
-		printf("\n");
+		json_print_line(root);
 		break;
 	default:
 		printf("%s: Invalid Stats Version = %d\n", __func__, version);
@@ -11150,8 +11352,7 @@ static void wdc_print_pcie_stats_json(struct wdc_vs_pcie_stats *pcie_stats)
 	json_object_add_value_uint64(root, "Receiver Error Status Counter",
 			le64_to_cpu(pcie_stats->receiverErrStatusCount));
 
-	json_print_object(root, NULL);
-	printf("\n");
+	json_print_line(root);
 
 	json_free_object(root);
 }
@@ -11177,7 +11378,7 @@ static int wdc_do_vs_nand_stats_sn810_2(struct nvme_dev *dev, char *format)
 		}
 
 		/* parse the data */
-		switch (fmt) {
+		switch (fmt & ~JSON_ENCODINGS) {
 		case NORMAL:
 			wdc_print_ext_smart_cloud_log_normal(data, WDC_SCA_V1_NAND_STATS);
 			break;
@@ -11224,7 +11425,7 @@ static int wdc_do_vs_nand_stats(struct nvme_dev *dev, char *format)
 		version = output[WDC_NVME_NAND_STATS_SIZE - 2];
 
 		/* parse the data */
-		switch (fmt) {
+		switch (fmt & ~JSON_ENCODINGS) {
 		case NORMAL:
 			wdc_print_nand_stats_normal(version, output);
 			break;
@@ -11374,7 +11575,7 @@ static int wdc_vs_pcie_stats(int argc, char **argv, struct command *command,
 			fprintf(stderr, "ERROR: WDC: Failure reading PCIE statistics, ret = 0x%x\n", ret);
 		} else {
 			/* parse the data */
-			switch (fmt) {
+			switch (fmt & ~JSON_ENCODINGS) {
 			case NORMAL:
 				wdc_print_pcie_stats_normal(pcieStatsPtr);
 				break;
@@ -11444,7 +11645,7 @@ static int wdc_vs_drive_info(int argc, char **argv,
 	}
 
 	/* get the id ctrl data used to fill in drive info below */
-	ret = nvme_identify_ctrl(dev_fd(dev), &ctrl);
+	ret = wdc_identify_ctrl(dev, &ctrl);
 
 	if (ret) {
 		fprintf(stderr, "ERROR: WDC %s: Identify Controller failed\n", __func__);
@@ -11489,7 +11690,7 @@ static int wdc_vs_drive_info(int argc, char **argv,
 					printf("Drive HW Revision: %4.1f\n", (.1 * rev));
 					printf("FTL Unit Size:     0x%x KB\n", size);
 					printf("Customer SN:        %-.*s\n", (int)sizeof(ctrl.sn), &ctrl.sn[0]);
-				} else if (fmt == JSON) {
+				} else if (fmt & JSON) {
 					root = json_create_object();
 					sprintf(rev_str, "%4.1f", (.1 * rev));
 					json_object_add_value_string(root, "Drive HW Revision", rev_str);
@@ -11498,8 +11699,7 @@ static int wdc_vs_drive_info(int argc, char **argv,
 					wdc_StrFormat(formatter, sizeof(formatter), &ctrl.sn[0], sizeof(ctrl.sn));
 					json_object_add_value_string(root, "Customer SN", formatter);
 
-					json_print_object(root, NULL);
-					printf("\n");
+					json_print_line(root);
 
 					json_free_object(root);
 				}
@@ -11514,15 +11714,14 @@ static int wdc_vs_drive_info(int argc, char **argv,
 			if (fmt == NORMAL) {
 				printf("Drive HW Revision:   %c.%c\n", major_rev, minor_rev);
 				printf("Customer SN:         %-.*s\n", 14, &ctrl.sn[0]);
-			} else if (fmt == JSON) {
+			} else if (fmt & JSON) {
 				root = json_create_object();
 				sprintf(rev_str, "%c.%c", major_rev, minor_rev);
 				json_object_add_value_string(root, "Drive HW Revison", rev_str);
 				wdc_StrFormat(formatter, sizeof(formatter), &ctrl.sn[0], 14);
 				json_object_add_value_string(root, "Customer SN", formatter);
 
-				json_print_object(root, NULL);
-				printf("\n");
+				json_print_line(root);
 
 				json_free_object(root);
 			}
@@ -11579,7 +11778,7 @@ static int wdc_vs_drive_info(int argc, char **argv,
 				printf("HyperScale Boot Version Spec:        %d.%d\n", boot_spec_major, boot_spec_minor);
 				printf("TCG Device Ownership Status:          %2d\n", tcg_dev_ownership);
 
-			} else if (fmt == JSON) {
+			} else if (fmt & JSON) {
 				root = json_create_object();
 
 				json_object_add_value_int(root, "Drive HW Revison", major_rev);
@@ -11588,8 +11787,7 @@ static int wdc_vs_drive_info(int argc, char **argv,
 				json_object_add_value_string(root, "HyperScale Boot Version Spec", rev_str);
 				json_object_add_value_int(root, "TCG Device Ownership Status", tcg_dev_ownership);
 
-				json_print_object(root, NULL);
-				printf("\n");
+				json_print_line(root);
 
 				json_free_object(root);
 			}
@@ -11619,7 +11817,7 @@ static int wdc_vs_drive_info(int argc, char **argv,
 					       hw_rev_major, hw_rev_minor);
 					printf("FTL Unit Size : %" PRIu32 "\n",
 					       le32_to_cpu(info.ftl_unit_size));
-				} else if (fmt == JSON) {
+				} else if (fmt & JSON) {
 					char buf[20];
 
 					root = json_create_object();
@@ -11634,8 +11832,7 @@ static int wdc_vs_drive_info(int argc, char **argv,
 						"ftl_unit_size",
 						le32_to_cpu(info.ftl_unit_size));
 
-					json_print_object(root, NULL);
-					printf("\n");
+					json_print_line(root);
 					json_free_object(root);
 				}
 			}
@@ -11705,7 +11902,7 @@ static int wdc_vs_temperature_stats(int argc, char **argv,
 	}
 
 	/* get the temperature stats or report errors */
-	ret = nvme_identify_ctrl(dev_fd(dev), &id_ctrl);
+	ret = wdc_identify_ctrl(dev, &id_ctrl);
 	if (ret)
 		goto out;
 	ret = nvme_get_log_smart(dev_fd(dev), NVME_NSID_ALL, false,
@@ -11740,7 +11937,7 @@ static int wdc_vs_temperature_stats(int argc, char **argv,
 		printf("TMT2 Transition Counter                 : %"PRIu32"\n", smart_log.thm_temp2_trans_count);
 		printf("TMT2 Total Time                         : %"PRIu32"\n", smart_log.thm_temp2_total_time);
 		printf("Thermal Shutdown Threshold              : 95 °C\n");
-	} else if (fmt == JSON) {
+	} else if (fmt & JSON) {
 		struct json_object *root;
 
 		root = json_create_object();
@@ -11760,8 +11957,7 @@ static int wdc_vs_temperature_stats(int argc, char **argv,
 		json_object_add_value_int(root, "TMT2 Total Time", le32_to_cpu(smart_log.thm_temp2_total_time));
 		json_object_add_value_int(root, "Thermal Shutdown Threshold", 95);
 
-		json_print_object(root, NULL);
-		printf("\n");
+		json_print_line(root);
 
 		json_free_object(root);
 	} else {
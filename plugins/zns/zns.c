@@ -5,14 +5,19 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
 #include <linux/fs.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 
 #include "common.h"
 #include "nvme.h"
 #include "libnvme.h"
 #include "nvme-print.h"
 #include "util/cleanup.h"
+#include "util/crc32.h"
+#include "util/parallel.h"
 
 #define CREATE_CMD
 #include "zns.h"
@@ -20,6 +25,84 @@
 static const char *namespace_id = "Namespace identifier to use";
 static const char dash[100] = { [0 ... 99] = '-' };
 
+#define ZNS_MAP_MAGIC		"NVMEZMAP"
+#define ZNS_MAP_VERSION		1
+
+/*
+ * Compact zone map: the header is followed by one entry per zone up to the
+ * end of the file. All fields are little endian, as in the zone descriptors.
+ */
+struct zns_map_hdr {
+	char	magic[8];
+	__le32	version;
+	__le32	nsid;
+	__le64	zsze;		/* in logical blocks */
+	__le64	nsze;		/* to tell a format with another LBA size */
+};
+
+struct zns_map_entry {
+	__le64	zslba;
+	__le64	wp;
+	__le64	zcap;
+	__u8	zs;		/* zone state in the upper nibble */
+	__u8	zt;
+	__u8	za;
+	__u8	zai;
+	__u8	rsvd[4];
+};
+
+/*
+ * The cached zone map of a namespace, see zone-map. It is named after the
+ * NVM subsystem, so every device the namespace is reached through, e.g.
+ * /dev/nvme0n1, /dev/ng0n1 or /dev/nvme0 -n 1, has the same map. The NQN
+ * is read from sysfs, as every reset drops the map, and only identified
+ * where sysfs does not have it.
+ */
+static int zns_map_cache_path(int fd, __u32 nsid, char *path, size_t len)
+{
+	_cleanup_free_ struct nvme_id_ctrl *ctrl = NULL;
+	_cleanup_free_ char *subnqn = NULL;
+	char dir[64];
+	struct stat st;
+	int err;
+
+	if (fstat(fd, &st))
+		return -errno;
+
+	/* controllers have the attribute, namespaces link to their controller */
+	snprintf(dir, sizeof(dir), "/sys/dev/%s/%u:%u", S_ISBLK(st.st_mode) ? "block" : "char",
+		 major(st.st_rdev), minor(st.st_rdev));
+	subnqn = nvme_get_attr(dir, "subsysnqn");
+	if (!subnqn)
+		subnqn = nvme_get_attr(dir, "device/subsysnqn");
+
+	if (!subnqn) {
+		ctrl = nvme_alloc(sizeof(*ctrl));
+		if (!ctrl)
+			return -ENOMEM;
+		err = nvme_identify_ctrl(fd, ctrl);
+		if (err)
+			return err;
+		subnqn = strndup(ctrl->subnqn, sizeof(ctrl->subnqn));
+		if (!subnqn)
+			return -ENOMEM;
+	}
+
+	snprintf(path, len, "%s/nvme/zones-%08x-%u.map", RUNDIR,
+		 crc32(0, (unsigned char *)subnqn, strlen(subnqn)), nsid);
+
+	return 0;
+}
+
+/* Resets are not in the changed zone list, the map has to be rescanned */
+static void zns_map_cache_invalidate(struct nvme_dev *dev, __u32 nsid)
+{
+	char path[PATH_MAX];
+
+	if (!zns_map_cache_path(dev_fd(dev), nsid, path, sizeof(path)))
+		unlink(path);
+}
+
 static int detect_zns(nvme_ns_t ns, int *out_supported)
 {
 	int err = 0;
@@ -223,12 +306,364 @@ close_dev:
 	return err;
 }
 
+/* Largest transfer, unless the controller limits it further */
+#define ZNS_MAX_XFER	(1 << 20)
+
+struct zns_report {
+	int fd;
+	__u32 nsid;
+	int state;
+	bool extended;
+	bool partial;
+	__u32 desc_len;		/* descriptor and extension */
+	__u32 zdes;		/* extension bytes */
+	enum nvme_print_flags flags;
+	struct json_object *zone_list;
+	FILE *map;
+	int map_err;
+
+	/* the chunk being fetched */
+	void *next;
+	__u64 next_slba;
+	__u32 next_len;
+	int err;
+
+	/* the chunk being printed */
+	void *cur;
+	__u32 cur_descs;
+	__u32 cur_len;
+};
+
+static struct nvme_zns_desc *zns_report_desc(struct zns_report *zr, void *report, __u32 i)
+{
+	return report + sizeof(struct nvme_zone_report) + i * zr->desc_len;
+}
+
+/* Largest transfer the controller takes in one command */
+static __u32 zns_xfer_len(int fd)
+{
+	_cleanup_free_ struct nvme_id_ctrl *ctrl = NULL;
+	__u64 len = ZNS_MAX_XFER;
+
+	ctrl = nvme_alloc(sizeof(*ctrl));
+	if (!ctrl)
+		return len;
+
+	/* the MDTS is in units of the minimum memory page size, at least 4k */
+	if (!nvme_identify_ctrl(fd, ctrl) && ctrl->mdts && ctrl->mdts < 32)
+		len = min(len, (1ULL << ctrl->mdts) * 4096);
+
+	return len;
+}
+
+static int zns_report_fetch(struct zns_report *zr, void *report, __u64 slba, __u32 len,
+			    bool partial)
+{
+	return nvme_zns_report_zones(zr->fd, zr->nsid, slba, zr->state, zr->extended,
+				     partial, len, report, NVME_DEFAULT_IOCTL_TIMEOUT, NULL);
+}
+
+/*
+ * Reports up to nr zones matching the filter in zr->state from slba on, in
+ * chunks of zr->next_len bytes, and calls fn for each until it returns false.
+ */
+static int zns_report_each(struct zns_report *zr, void *report, __u64 slba, __u64 zsze,
+			   __u64 nr, bool (*fn)(struct nvme_zns_desc *desc, void *arg),
+			   void *arg)
+{
+	__u32 max = (zr->next_len - sizeof(struct nvme_zone_report)) / zr->desc_len;
+	struct nvme_zone_report *r = report;
+	__u32 i, n;
+	int err;
+
+	while (nr) {
+		n = min(max, nr);
+		err = zns_report_fetch(zr, report, slba, sizeof(*r) + n * zr->desc_len, true);
+		if (err)
+			return err;
+
+		n = min(n, le64_to_cpu(r->nr_zones));
+		for (i = 0; i < n; i++) {
+			if (!fn(zns_report_desc(zr, report, i), arg))
+				return 0;
+		}
+
+		if (n < min(max, nr))
+			break;
+		nr -= n;
+		slba = le64_to_cpu(zns_report_desc(zr, report, n - 1)->zslba) + zsze;
+	}
+
+	return 0;
+}
+
+/* Zone states as given to the report zones filter, see nvme_zns_report_options */
+static const struct {
+	int filter;
+	__u8 zs;
+} zns_report_states[] = {
+	{ NVME_ZNS_ZRAS_REPORT_EMPTY,		NVME_ZNS_ZS_EMPTY },
+	{ NVME_ZNS_ZRAS_REPORT_IMPL_OPENED,	NVME_ZNS_ZS_IMPL_OPEN },
+	{ NVME_ZNS_ZRAS_REPORT_EXPL_OPENED,	NVME_ZNS_ZS_EXPL_OPEN },
+	{ NVME_ZNS_ZRAS_REPORT_CLOSED,		NVME_ZNS_ZS_CLOSED },
+	{ NVME_ZNS_ZRAS_REPORT_FULL,		NVME_ZNS_ZS_FULL },
+	{ NVME_ZNS_ZRAS_REPORT_READ_ONLY,	NVME_ZNS_ZS_READ_ONLY },
+	{ NVME_ZNS_ZRAS_REPORT_OFFLINE,		NVME_ZNS_ZS_OFFLINE },
+};
+
+/* The state of the zones a report zones filter matches, 0 for all zones */
+static __u8 zns_report_state(int filter)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(zns_report_states); i++) {
+		if (zns_report_states[i].filter == filter)
+			return zns_report_states[i].zs;
+	}
+
+	return 0;
+}
+
+struct zns_bulk {
+	int fd;
+	__u32 nsid;
+	enum nvme_zns_send_action zsa;
+	__u32 timeout;
+	__u64 slba;		/* first and last LBA of the zones to act on */
+	__u64 elba;
+	__u64 *list;		/* sorted zones given by the user, if any */
+	__u32 nr_list;
+	__u8 zs;		/* state of the zones to act on, 0 for any */
+	__u64 *zones;
+	__u32 nr_zones;
+	__u32 alloc;
+	int *errs;
+	int err;
+};
+
+static int zns_bulk_cmp(const void *a, const void *b)
+{
+	const __u64 *x = a, *y = b;
+
+	return *x < *y ? -1 : *x > *y;
+}
+
+static int zns_bulk_push(__u64 **zones, __u32 *nr, __u32 *alloc, __u64 zslba)
+{
+	__u64 *p;
+
+	if (*nr == *alloc) {
+		p = realloc(*zones, (*alloc ? *alloc * 2 : 1024) * sizeof(*p));
+		if (!p)
+			return -ENOMEM;
+		*zones = p;
+		*alloc = *alloc ? *alloc * 2 : 1024;
+	}
+	(*zones)[(*nr)++] = zslba;
+
+	return 0;
+}
+
+static bool zns_bulk_add(struct nvme_zns_desc *desc, void *arg)
+{
+	struct zns_bulk *b = arg;
+	__u64 zslba = le64_to_cpu(desc->zslba);
+
+	if (zslba > b->elba)
+		return false;
+	if (b->zs && desc->zs >> 4 != b->zs)
+		return true;
+	if (b->list && !bsearch(&zslba, b->list, b->nr_list, sizeof(*b->list), zns_bulk_cmp))
+		return true;
+
+	b->err = zns_bulk_push(&b->zones, &b->nr_zones, &b->alloc, zslba);
+	return !b->err;
+}
+
+/* Whitespace separated zone start LBAs, the ones outside of the range are dropped */
+static int zns_bulk_read_list(struct zns_bulk *b, const char *file)
+{
+	__u32 i, n, alloc = 0;
+	char tok[32], *end;
+	int err = 0;
+	__u64 zslba;
+	FILE *f;
+
+	f = fopen(file, "r");
+	if (!f) {
+		err = -errno;
+		perror(file);
+		return err;
+	}
+
+	while (!err && fscanf(f, "%31s", tok) == 1) {
+		errno = 0;
+		zslba = strtoull(tok, &end, 0);
+		if (errno || *end) {
+			fprintf(stderr, "%s: invalid zone start LBA %s\n", file, tok);
+			err = -EINVAL;
+		} else if (zslba >= b->slba && zslba <= b->elba) {
+			err = zns_bulk_push(&b->list, &b->nr_list, &alloc, zslba);
+		}
+	}
+	fclose(f);
+	if (err)
+		return err;
+
+	qsort(b->list, b->nr_list, sizeof(*b->list), zns_bulk_cmp);
+	for (i = 0, n = 0; i < b->nr_list; i++) {
+		if (!n || b->list[n - 1] != b->list[i])
+			b->list[n++] = b->list[i];
+	}
+	b->nr_list = n;
+
+	return 0;
+}
+
+static void zns_bulk_send(int i, void *arg)
+{
+	struct zns_bulk *b = arg;
+	struct nvme_zns_mgmt_send_args args = {
+		.args_size	= sizeof(args),
+		.fd		= b->fd,
+		.nsid		= b->nsid,
+		.slba		= b->zones[i],
+		.zsa		= b->zsa,
+		.select_all	= false,
+		.timeout	= b->timeout,
+		.result		= NULL,
+	};
+
+	b->errs[i] = nvme_zns_mgmt_send(&args);
+	if (b->errs[i] < 0)
+		b->errs[i] = -errno;
+}
+
+/*
+ * Sends the action to the zones in the list, in the range, or in a state,
+ * with up to jobs commands in flight, and reports the zones it failed on.
+ */
+static int zns_mgmt_send_bulk(struct zns_bulk *b, const char *command, int state,
+			      const char *zone_list, unsigned int jobs)
+{
+	_cleanup_huge_ struct nvme_mem_huge mh = { 0, };
+	struct timeval start_time, end_time;
+	struct nvme_zns_id_ns id_zns;
+	struct zns_report zr = { 0 };
+	struct nvme_id_ns id_ns;
+	unsigned long long usecs;
+	__u32 i, failed = 0;
+	__u64 zsze, slba, nr;
+	void *report;
+	__u8 lbaf;
+	int err;
+
+	if (zone_list) {
+		err = zns_bulk_read_list(b, zone_list);
+		if (err)
+			goto free;
+	}
+
+	if (state < 0 && b->list) {
+		b->zones = b->list;
+		b->nr_zones = b->nr_list;
+		b->list = NULL;
+	} else if (!zone_list || b->nr_list) {
+		err = nvme_identify_ns(b->fd, b->nsid, &id_ns);
+		if (!err)
+			err = nvme_zns_identify_ns(b->fd, b->nsid, &id_zns);
+		if (err) {
+			nvme_show_status(err);
+			goto free;
+		}
+		nvme_id_ns_flbas_to_lbaf_inuse(id_ns.flbas, &lbaf);
+		zsze = le64_to_cpu(id_zns.lbafe[lbaf].zsze);
+
+		/*
+		 * The device looks for zones in a state up to the end of the
+		 * namespace. Up to the last zone of the range or the list, all
+		 * of them are reported and filtered here instead.
+		 */
+		if (b->list)
+			b->elba = min(b->elba, b->list[b->nr_list - 1]);
+		slba = b->list ? b->list[0] : b->slba;
+		if (b->elba == ~0ULL || !zsze) {
+			state = max(state, 0);
+			nr = ~0ULL;
+		} else {
+			b->zs = zns_report_state(state);
+			state = NVME_ZNS_ZRAS_REPORT_ALL;
+			nr = b->elba / zsze - min(slba, b->elba) / zsze + 1;
+		}
+
+		zr.fd = b->fd;
+		zr.nsid = b->nsid;
+		zr.state = state;
+		zr.desc_len = sizeof(struct nvme_zns_desc);
+		zr.next_len = sizeof(struct nvme_zone_report) +
+			(zns_xfer_len(b->fd) - sizeof(struct nvme_zone_report)) /
+			zr.desc_len * zr.desc_len;
+		report = nvme_alloc_huge(zr.next_len, &mh);
+		if (!report) {
+			err = -ENOMEM;
+			goto free;
+		}
+
+		err = zns_report_each(&zr, report, slba, zsze, nr, zns_bulk_add, b);
+		if (!err)
+			err = b->err;
+		if (err > 0) {
+			nvme_show_status(err);
+			goto free;
+		} else if (err < 0) {
+			fprintf(stderr, "zns report-zones: %s\n", strerror(-err));
+			goto free;
+		}
+	}
+
+	b->errs = calloc(b->nr_zones, sizeof(*b->errs));
+	if (b->nr_zones && !b->errs) {
+		err = -ENOMEM;
+		goto free;
+	}
+
+	gettimeofday(&start_time, NULL);
+	nvme_parallel_for(b->nr_zones, jobs, zns_bulk_send, b);
+	gettimeofday(&end_time, NULL);
+	usecs = elapsed_utime(start_time, end_time);
+	if (!usecs)
+		usecs = 1;
+
+	for (i = 0; i < b->nr_zones; i++) {
+		if (!b->errs[i])
+			continue;
+		fprintf(stderr, "%s: zone:%"PRIx64" %s\n", command, (uint64_t)b->zones[i],
+			b->errs[i] > 0 ? nvme_status_to_string(b->errs[i], false) :
+			strerror(-b->errs[i]));
+		if (!failed++)
+			err = b->errs[i];
+	}
+
+	printf("%s: action:%d zones:%u failed:%u nsid:%d %.0f ops/s\n", command, b->zsa,
+	       b->nr_zones, failed, b->nsid, (double)b->nr_zones * 1000000 / usecs);
+
+free:
+	free(b->list);
+	free(b->zones);
+	free(b->errs);
+	return err;
+}
+
 static int zns_mgmt_send(int argc, char **argv, struct command *cmd, struct plugin *plugin,
 	const char *desc, enum nvme_zns_send_action zsa)
 {
 	const char *zslba = "starting LBA of the zone for this command";
 	const char *select_all = "send command to all zones";
 	const char *timeout = "timeout value, in milliseconds";
+	const char *state = "act on the zones in this state, as for report-zones";
+	const char *elba = "act on the zones up to this LBA";
+	const char *zone_list = "file with the start LBAs of the zones to act on";
+	const char *jobs = "number of commands in flight with --state, --end-lba or --zone-list";
 	struct nvme_dev *dev;
 	int err, zcapc = 0;
 	char *command;
@@ -239,15 +674,27 @@ static int zns_mgmt_send(int argc, char **argv, struct command *cmd, struct plug
 		__u32	namespace_id;
 		bool	select_all;
 		__u32	timeout;
+		int	state;
+		__u64	elba;
+		char	*zone_list;
+		__u32	jobs;
 	};
 
-	struct config cfg = {};
+	struct config cfg = {
+		.state	= -1,
+		.elba	= ~0ULL,
+		.jobs	= 8,
+	};
 
 	OPT_ARGS(opts) = {
 		OPT_UINT("namespace-id", 'n', &cfg.namespace_id,  namespace_id),
 		OPT_SUFFIX("start-lba",  's', &cfg.zslba,         zslba),
 		OPT_FLAG("select-all",   'a', &cfg.select_all,    select_all),
 		OPT_UINT("timeout",      't', &cfg.timeout,       timeout),
+		OPT_UINT("state",        'S', &cfg.state,         state),
+		OPT_SUFFIX("end-lba",    'e', &cfg.elba,          elba),
+		OPT_FILE("zone-list",    'l', &cfg.zone_list,     zone_list),
+		OPT_UINT("jobs",         'j', &cfg.jobs,          jobs),
 		OPT_END()
 	};
 
@@ -255,6 +702,12 @@ static int zns_mgmt_send(int argc, char **argv, struct command *cmd, struct plug
 	if (err)
 		goto ret;
 
+	if (cfg.state < -1 || cfg.state > NVME_ZNS_ZRAS_REPORT_OFFLINE) {
+		fprintf(stderr, "invalid state %d, as for report-zones\n", cfg.state);
+		err = -EINVAL;
+		goto close_dev;
+	}
+
 	err = asprintf(&command, "%s-%s", plugin->name, cmd->name);
 	if (err < 0)
 		goto close_dev;
@@ -267,6 +720,29 @@ static int zns_mgmt_send(int argc, char **argv, struct command *cmd, struct plug
 		}
 	}
 
+	if (cfg.state >= 0 || cfg.elba != ~0ULL || cfg.zone_list) {
+		struct zns_bulk b = {
+			.fd		= dev_fd(dev),
+			.nsid		= cfg.namespace_id,
+			.zsa		= zsa,
+			.timeout	= cfg.timeout,
+			.slba		= cfg.zslba,
+			.elba		= cfg.elba,
+		};
+
+		if (cfg.select_all) {
+			fprintf(stderr, "select-all cannot be used with a state, end LBA or zone list\n");
+			err = -EINVAL;
+			goto free;
+		}
+
+		err = zns_mgmt_send_bulk(&b, command, cfg.state, cfg.zone_list,
+					 max(cfg.jobs, 1));
+		if (zsa == NVME_ZNS_ZSA_RESET)
+			zns_map_cache_invalidate(dev, cfg.namespace_id);
+		goto free;
+	}
+
 	struct nvme_zns_mgmt_send_args args = {
 		.args_size	= sizeof(args),
 		.fd		= dev_fd(dev),
@@ -281,6 +757,8 @@ static int zns_mgmt_send(int argc, char **argv, struct command *cmd, struct plug
 		.result		= &result,
 	};
 	err = nvme_zns_mgmt_send(&args);
+	if (zsa == NVME_ZNS_ZSA_RESET)
+		zns_map_cache_invalidate(dev, cfg.namespace_id);
 	if (!err) {
 		if (zsa == NVME_ZNS_ZSA_RESET)
 			zcapc = result & 0x1;
@@ -444,6 +922,8 @@ static int zone_mgmt_send(int argc, char **argv, struct command *cmd, struct plu
 		.result		= NULL,
 	};
 	err = nvme_zns_mgmt_send(&args);
+	if (cfg.zsa == NVME_ZNS_ZSA_RESET)
+		zns_map_cache_invalidate(dev, cfg.namespace_id);
 	if (!err)
 		printf("zone-mgmt-send: Success, action:%d zone:%"PRIx64" all:%d nsid:%d\n",
 		       cfg.zsa, (uint64_t)cfg.zslba, (int)cfg.select_all, cfg.namespace_id);
@@ -820,6 +1300,57 @@ close_dev:
 	return err;
 }
 
+static int zns_map_start(FILE *f, __u32 nsid, __u64 zsze, __u64 nsze)
+{
+	struct zns_map_hdr hdr = {
+		.magic = ZNS_MAP_MAGIC,
+		.version = cpu_to_le32(ZNS_MAP_VERSION),
+		.nsid = cpu_to_le32(nsid),
+		.zsze = cpu_to_le64(zsze),
+		.nsze = cpu_to_le64(nsze),
+	};
+
+	return fwrite(&hdr, sizeof(hdr), 1, f) == 1 ? 0 : -EIO;
+}
+
+static int zns_map_add(FILE *f, struct nvme_zns_desc *desc)
+{
+	struct zns_map_entry e = {
+		.zslba = desc->zslba,
+		.wp = desc->wp,
+		.zcap = desc->zcap,
+		.zs = desc->zs,
+		.zt = desc->zt,
+		.za = desc->za,
+		.zai = desc->zai,
+	};
+
+	return fwrite(&e, sizeof(e), 1, f) == 1 ? 0 : -EIO;
+}
+
+static void zns_report_print(struct zns_report *zr)
+{
+	__u32 i;
+
+	nvme_show_zns_report_zones(zr->cur, zr->cur_descs, zr->zdes, zr->cur_len,
+				   zr->zone_list, zr->flags);
+
+	for (i = 0; zr->map && !zr->map_err && i < zr->cur_descs; i++)
+		zr->map_err = zns_map_add(zr->map, zns_report_desc(zr, zr->cur, i));
+}
+
+/* The next chunk is fetched while the current one is printed */
+static void zns_report_step(int i, void *arg)
+{
+	struct zns_report *zr = arg;
+
+	if (i)
+		zns_report_print(zr);
+	else
+		zr->err = zns_report_fetch(zr, zr->next, zr->next_slba, zr->next_len,
+					   zr->partial);
+}
+
 static int report_zones(int argc, char **argv, struct command *cmd, struct plugin *plugin)
 {
 	const char *desc = "Retrieve the Report Zones data structure";
@@ -829,25 +1360,26 @@ static int report_zones(int argc, char **argv, struct command *cmd, struct plugi
 	const char *ext = "set to use the extended report zones";
 	const char *part = "set to use the partial report";
 	const char *verbose = "show report zones verbosity";
+	const char *zone_map = "also write the zones to a compact binary zone map";
 
 	enum nvme_print_flags flags;
-	int zdes = 0, err = -1;
+	int err = -1;
 	struct nvme_dev *dev;
-	__u32 report_size;
-	struct nvme_zone_report *report, *buff;
-	_cleanup_huge_ struct nvme_mem_huge mh = { 0, };
+	struct nvme_zone_report *report;
+	_cleanup_huge_ struct nvme_mem_huge mh0 = { 0, };
+	_cleanup_huge_ struct nvme_mem_huge mh1 = { 0, };
+	void *bufs[2];
 
-	unsigned int nr_zones_chunks = 1024,   /* 1024 entries * 64 bytes per entry = 64k byte transfer */
+	unsigned int nr_zones_chunks,
 			nr_zones_retrieved = 0,
 			nr_zones,
 			log_len;
-	__u64 offset;
-	int total_nr_zones = 0;
+	__u64 total_nr_zones;
 	struct nvme_zns_id_ns id_zns;
 	struct nvme_id_ns id_ns;
 	uint8_t lbaf;
-	__le64	zsze;
-	struct json_object *zone_list = NULL;
+	__u64 zsze;
+	struct zns_report zr = { 0 };
 
 	struct config {
 		char *output_format;
@@ -858,6 +1390,7 @@ static int report_zones(int argc, char **argv, struct command *cmd, struct plugi
 		bool  verbose;
 		bool  extended;
 		bool  partial;
+		char  *zone_map;
 	};
 
 	struct config cfg = {
@@ -874,6 +1407,7 @@ static int report_zones(int argc, char **argv, struct command *cmd, struct plugi
 		OPT_FLAG("verbose",       'v', &cfg.verbose,        verbose),
 		OPT_FLAG("extended",      'e', &cfg.extended,       ext),
 		OPT_FLAG("partial",       'p', &cfg.partial,        part),
+		OPT_FILE("zone-map",      'm', &cfg.zone_map,       zone_map),
 		OPT_END()
 	};
 
@@ -895,14 +1429,6 @@ static int report_zones(int argc, char **argv, struct command *cmd, struct plugi
 		}
 	}
 
-	if (cfg.extended) {
-		zdes = get_zdes_bytes(dev_fd(dev), cfg.namespace_id);
-		if (zdes < 0) {
-			err = zdes;
-			goto close_dev;
-		}
-	}
-
 	err = nvme_identify_ns(dev_fd(dev), cfg.namespace_id, &id_ns);
 	if (err) {
 		nvme_show_status(err);
@@ -910,90 +1436,792 @@ static int report_zones(int argc, char **argv, struct command *cmd, struct plugi
 	}
 
 	err = nvme_zns_identify_ns(dev_fd(dev), cfg.namespace_id, &id_zns);
-	if (!err) {
-		/* get zsze field from zns id ns data - needed for offset calculation */
-		nvme_id_ns_flbas_to_lbaf_inuse(id_ns.flbas, &lbaf);
-		zsze = le64_to_cpu(id_zns.lbafe[lbaf].zsze);
-	} else {
+	if (err) {
 		nvme_show_status(err);
 		goto close_dev;
 	}
 
-	log_len = sizeof(struct nvme_zone_report);
-	buff = calloc(1, log_len);
-	if (!buff) {
+	/* get zsze field from zns id ns data - needed for offset calculation */
+	nvme_id_ns_flbas_to_lbaf_inuse(id_ns.flbas, &lbaf);
+	zsze = le64_to_cpu(id_zns.lbafe[lbaf].zsze);
+
+	zr.fd = dev_fd(dev);
+	zr.nsid = cfg.namespace_id;
+	zr.state = cfg.state;
+	zr.extended = cfg.extended;
+	zr.partial = cfg.partial;
+	zr.zdes = cfg.extended ? id_zns.lbafe[lbaf].zdes << 6 : 0;
+	zr.desc_len = sizeof(struct nvme_zns_desc) + zr.zdes;
+	zr.flags = flags;
+
+	/* as many descriptors as fit into the largest transfer */
+	log_len = zns_xfer_len(dev_fd(dev));
+	nr_zones_chunks = (log_len - sizeof(struct nvme_zone_report)) / zr.desc_len;
+	if (cfg.num_descs >= 0 && (unsigned int)cfg.num_descs < nr_zones_chunks)
+		nr_zones_chunks = max(cfg.num_descs, 1);
+	log_len = sizeof(struct nvme_zone_report) + nr_zones_chunks * zr.desc_len;
+
+	bufs[0] = nvme_alloc_huge(log_len, &mh0);
+	bufs[1] = nvme_alloc_huge(log_len, &mh1);
+	if (!bufs[0] || !bufs[1]) {
+		perror("alloc");
 		err = -ENOMEM;
 		goto close_dev;
 	}
 
-	err = nvme_zns_report_zones(dev_fd(dev), cfg.namespace_id, 0,
-				    cfg.state, false, false,
-				    log_len, buff,
-				    NVME_DEFAULT_IOCTL_TIMEOUT, NULL);
+	if (cfg.zone_map) {
+		zr.map = fopen(cfg.zone_map, "w");
+		if (!zr.map) {
+			err = -errno;
+			perror(cfg.zone_map);
+			goto close_dev;
+		}
+		err = zns_map_start(zr.map, cfg.namespace_id, zsze,
+				    le64_to_cpu(id_ns.nsze));
+		if (err)
+			goto close_map;
+	}
+
+	/* the first chunk is a full report to learn the number of zones */
+	err = zns_report_fetch(&zr, bufs[0], cfg.zslba, log_len, false);
 	if (err > 0) {
 		nvme_show_status(err);
-		goto free_buff;
+		goto close_map;
 	} else if (err < 0) {
 		perror("zns report-zones");
-		goto free_buff;
+		goto close_map;
 	}
 
-	total_nr_zones = le64_to_cpu(buff->nr_zones);
+	total_nr_zones = le64_to_cpu(((struct nvme_zone_report *)bufs[0])->nr_zones);
+	nr_zones = total_nr_zones;
+	if (cfg.num_descs >= 0 && (unsigned int)cfg.num_descs < nr_zones)
+		nr_zones = cfg.num_descs;
 
-	if (cfg.num_descs == -1)
-		cfg.num_descs = total_nr_zones;
+	nvme_zns_start_zone_list(total_nr_zones, &zr.zone_list, flags);
 
-	nr_zones = cfg.num_descs;
-	if (nr_zones < nr_zones_chunks)
-		nr_zones_chunks = nr_zones;
+	zr.cur = bufs[0];
+	zr.cur_len = log_len;
+	while (nr_zones_retrieved < nr_zones) {
+		report = zr.cur;
+		zr.cur_descs = min(le64_to_cpu(report->nr_zones),
+				   (zr.cur_len - sizeof(*report)) / zr.desc_len);
+		zr.cur_descs = min(zr.cur_descs, nr_zones - nr_zones_retrieved);
+		if (!zr.cur_descs)
+			break;
 
-	log_len = sizeof(struct nvme_zone_report) + ((sizeof(struct nvme_zns_desc) * nr_zones_chunks) + (nr_zones_chunks * zdes));
-	report_size = log_len;
+		nr_zones_retrieved += zr.cur_descs;
+		if (nr_zones_retrieved >= nr_zones) {
+			zns_report_print(&zr);
+			break;
+		}
 
-	report = nvme_alloc_huge(report_size, &mh);
-	if (!report) {
-		perror("alloc");
+		zr.next = zr.cur == bufs[0] ? bufs[1] : bufs[0];
+		zr.next_slba = le64_to_cpu(zns_report_desc(&zr, zr.cur,
+							   zr.cur_descs - 1)->zslba) + zsze;
+		zr.next_len = sizeof(*report) +
+			min(nr_zones_chunks, nr_zones - nr_zones_retrieved) * zr.desc_len;
+		nvme_parallel_for(2, 2, zns_report_step, &zr);
+
+		err = zr.err;
+		if (err > 0) {
+			nvme_show_status(err);
+			break;
+		} else if (err < 0) {
+			perror("zns report-zones");
+			break;
+		}
+
+		zr.cur = zr.next;
+		zr.cur_len = zr.next_len;
+	}
+
+	nvme_zns_finish_zone_list(total_nr_zones, zr.zone_list, flags);
+
+	if (!err && zr.map_err) {
+		fprintf(stderr, "%s: %s\n", cfg.zone_map, strerror(-zr.map_err));
+		err = zr.map_err;
+	}
+close_map:
+	if (zr.map && fclose(zr.map) && !err) {
+		err = -errno;
+		perror(cfg.zone_map);
+	}
+close_dev:
+	dev_close(dev);
+	return err;
+}
+
+struct zns_map {
+	struct zns_map_hdr hdr;
+	struct zns_map_entry *zones;
+	__u32 nr_zones;
+	__u64 zsze;
+	__u8 *seen;		/* zones updated by the refresh */
+	__u32 refreshed;
+	void *report;		/* report buffer of zr->next_len bytes */
+};
+
+static bool zns_map_active(__u8 zs)
+{
+	return zs == NVME_ZNS_ZS_IMPL_OPEN || zs == NVME_ZNS_ZS_EXPL_OPEN ||
+		zs == NVME_ZNS_ZS_CLOSED;
+}
+
+static bool zns_map_update(struct nvme_zns_desc *desc, void *arg)
+{
+	struct zns_map *m = arg;
+	__u64 idx = le64_to_cpu(desc->zslba) / m->zsze;
+
+	if (idx >= m->nr_zones)
+		return true;
+
+	m->zones[idx] = (struct zns_map_entry) {
+		.zslba = desc->zslba,
+		.wp = desc->wp,
+		.zcap = desc->zcap,
+		.zs = desc->zs,
+		.zt = desc->zt,
+		.za = desc->za,
+		.zai = desc->zai,
+	};
+	if (!m->seen[idx]) {
+		m->seen[idx] = 1;
+		m->refreshed++;
+	}
+
+	return true;
+}
+
+/* Reports up to nr zones matching the filter from slba on into the map */
+static int zns_map_report(struct zns_report *zr, struct zns_map *m, __u64 slba, int filter,
+			  __u32 nr)
+{
+	zr->state = filter;
+	return zns_report_each(zr, m->report, slba, m->zsze, nr, zns_map_update, m);
+}
+
+/* Number of zones in a state, without transferring their descriptors */
+static int zns_map_count(struct zns_report *zr, struct zns_map *m, int filter, __u64 *nr)
+{
+	struct nvme_zone_report *report = m->report;
+	int err;
+
+	zr->state = filter;
+	err = zns_report_fetch(zr, report, 0, sizeof(*report) + zr->desc_len, false);
+	if (!err)
+		*nr = le64_to_cpu(report->nr_zones);
+
+	return err;
+}
+
+static int zns_map_load(const char *path, struct zns_map *m)
+{
+	_cleanup_file_ int fd = -1;
+	struct stat st;
+	size_t len;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st))
+		return -errno;
+
+	if (st.st_size < sizeof(m->hdr) ||
+	    (st.st_size - sizeof(m->hdr)) % sizeof(*m->zones))
+		return -EINVAL;
+	if ((st.st_size - sizeof(m->hdr)) / sizeof(*m->zones) != m->nr_zones)
+		return -EINVAL;
+
+	len = m->nr_zones * sizeof(*m->zones);
+	if (read(fd, &m->hdr, sizeof(m->hdr)) != sizeof(m->hdr) ||
+	    read(fd, m->zones, len) != len)
+		return -EIO;
+
+	return 0;
+}
+
+/* Saved atomically, readers never see a partial map */
+static int zns_map_save(const char *path, struct zns_map *m)
+{
+	char tmp[PATH_MAX];
+	int err = 0;
+	FILE *f;
+
+	if (mkdir(RUNDIR "/nvme", 0755) && errno != EEXIST)
+		return -errno;
+
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+	f = fopen(tmp, "w");
+	if (!f)
+		return -errno;
+
+	if (fwrite(&m->hdr, sizeof(m->hdr), 1, f) != 1 ||
+	    fwrite(m->zones, sizeof(*m->zones), m->nr_zones, f) != m->nr_zones)
+		err = -EIO;
+	if (fclose(f) && !err)
+		err = -EIO;
+
+	if (!err && rename(tmp, path))
+		err = -errno;
+	if (err)
+		unlink(tmp);
+
+	return err;
+}
+
+/*
+ * The changed zone list only has the zones the controller changed on its
+ * own. Writes move the write pointers of the open and closed zones, which
+ * are few, so these are reported again. A zone written full while another
+ * one is reset keeps the number of zones in each state, so the empty or
+ * the full zones, whichever are fewer, are reported as well. Whatever else
+ * changed has to show in the number of zones in some state, else the map
+ * is rescanned.
+ */
+static int zns_map_refresh(struct zns_report *zr, struct zns_map *m, bool *rescan)
+{
+	_cleanup_free_ struct nvme_zns_changed_zone_log *log = NULL;
+	__u64 idx, nr, cached[16] = { 0 };
+	__u16 nrzid;
+	__u32 i;
+	__u8 zs;
+	int err;
+
+	log = nvme_alloc(sizeof(*log));
+	if (!log)
+		return -ENOMEM;
+
+	/* reading the log clears it, the next refresh only sees new changes */
+	err = nvme_get_log_zns_changed_zones(zr->fd, zr->nsid, false, log);
+	if (err)
+		return err;
+
+	nrzid = le16_to_cpu(log->nrzid);
+	if (nrzid == 0xffff) {
+		*rescan = true;
+		return 0;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(zns_report_states); i++) {
+		if (!zns_map_active(zns_report_states[i].zs))
+			continue;
+		err = zns_map_report(zr, m, 0, zns_report_states[i].filter, m->nr_zones);
+		if (err)
+			return err;
+	}
+
+	/* the zones which were active before, and those the controller changed */
+	for (idx = 0; idx < m->nr_zones; idx++) {
+		if (m->seen[idx] || !zns_map_active(m->zones[idx].zs >> 4))
+			continue;
+		err = zns_map_report(zr, m, idx * m->zsze, NVME_ZNS_ZRAS_REPORT_ALL, 1);
+		if (err)
+			return err;
+	}
+	for (i = 0; i < nrzid; i++) {
+		idx = le64_to_cpu(log->zid[i]) / m->zsze;
+		if (idx >= m->nr_zones || m->seen[idx])
+			continue;
+		err = zns_map_report(zr, m, idx * m->zsze, NVME_ZNS_ZRAS_REPORT_ALL, 1);
+		if (err)
+			return err;
+	}
+
+	for (idx = 0; idx < m->nr_zones; idx++)
+		cached[m->zones[idx].zs >> 4]++;
+
+	/* the zones in the state which are not reported in it left it */
+	zs = cached[NVME_ZNS_ZS_EMPTY] <= cached[NVME_ZNS_ZS_FULL] ?
+		NVME_ZNS_ZS_EMPTY : NVME_ZNS_ZS_FULL;
+	err = zns_map_report(zr, m, 0, zs == NVME_ZNS_ZS_EMPTY ? NVME_ZNS_ZRAS_REPORT_EMPTY :
+			     NVME_ZNS_ZRAS_REPORT_FULL, m->nr_zones);
+	if (err)
+		return err;
+	for (idx = 0; idx < m->nr_zones; idx++) {
+		if (m->seen[idx] || m->zones[idx].zs >> 4 != zs)
+			continue;
+		err = zns_map_report(zr, m, idx * m->zsze, NVME_ZNS_ZRAS_REPORT_ALL, 1);
+		if (err)
+			return err;
+	}
+
+	memset(cached, 0, sizeof(cached));
+	for (idx = 0; idx < m->nr_zones; idx++)
+		cached[m->zones[idx].zs >> 4]++;
+
+	for (i = 0; i < ARRAY_SIZE(zns_report_states); i++) {
+		if (zns_map_active(zns_report_states[i].zs))
+			continue;
+		err = zns_map_count(zr, m, zns_report_states[i].filter, &nr);
+		if (err)
+			return err;
+		if (nr != cached[zns_report_states[i].zs]) {
+			*rescan = true;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static int zone_map_refresh(int argc, char **argv, struct command *cmd, struct plugin *plugin)
+{
+	const char *desc = "Refresh the cached zone map of a namespace. The zones the "
+		"controller changed, as listed in the changed zone list, the open and "
+		"closed zones, and the empty or the full zones, whichever are fewer, are "
+		"reported again. The whole namespace is rescanned when "
+		"this does not account for all changes, after a zone reset or on request.";
+	const char *rescan = "rescan all zones";
+
+	_cleanup_huge_ struct nvme_mem_huge mh = { 0, };
+	_cleanup_free_ struct zns_map_entry *zones = NULL;
+	_cleanup_free_ __u8 *seen = NULL;
+	struct nvme_zns_id_ns id_zns;
+	struct nvme_id_ns id_ns;
+	enum nvme_print_flags flags;
+	struct zns_report zr = { 0 };
+	struct zns_map m = { 0 };
+	char path[PATH_MAX];
+	struct nvme_dev *dev;
+	__u64 nsze;
+	__u32 xfer;
+	__u8 lbaf;
+	int err;
+
+	struct config {
+		char	*output_format;
+		__u32	namespace_id;
+		bool	rescan;
+	};
+
+	struct config cfg = {
+		.output_format = "normal",
+	};
+
+	OPT_ARGS(opts) = {
+		OPT_UINT("namespace-id",  'n', &cfg.namespace_id,   namespace_id),
+		OPT_FLAG("rescan",        'r', &cfg.rescan,         rescan),
+		OPT_FMT("output-format",  'o', &cfg.output_format,  output_format),
+		OPT_END()
+	};
+
+	err = parse_and_open(&dev, argc, argv, desc, opts);
+	if (err)
+		return errno;
+
+	err = validate_output_format(cfg.output_format, &flags);
+	if (err < 0 || (flags != NORMAL && flags != BINARY)) {
+		fprintf(stderr, "zone-map: output format must be normal or binary\n");
+		err = -EINVAL;
+		goto close_dev;
+	}
+
+	if (!cfg.namespace_id) {
+		err = nvme_get_nsid(dev_fd(dev), &cfg.namespace_id);
+		if (err < 0) {
+			perror("get-namespace-id");
+			goto close_dev;
+		}
+	}
+
+	err = nvme_identify_ns(dev_fd(dev), cfg.namespace_id, &id_ns);
+	if (!err)
+		err = nvme_zns_identify_ns(dev_fd(dev), cfg.namespace_id, &id_zns);
+	if (err) {
+		nvme_show_status(err);
+		goto close_dev;
+	}
+
+	nvme_id_ns_flbas_to_lbaf_inuse(id_ns.flbas, &lbaf);
+	m.zsze = le64_to_cpu(id_zns.lbafe[lbaf].zsze);
+	nsze = le64_to_cpu(id_ns.nsze);
+	if (!m.zsze) {
+		fprintf(stderr, "zone-map: zone size is zero\n");
+		err = -EINVAL;
+		goto close_dev;
+	}
+	m.nr_zones = nsze / m.zsze;
+
+	zones = calloc(m.nr_zones, sizeof(*zones));
+	seen = calloc(m.nr_zones, 1);
+	if (m.nr_zones && (!zones || !seen)) {
 		err = -ENOMEM;
 		goto close_dev;
 	}
+	m.zones = zones;
+	m.seen = seen;
+
+	zr.fd = dev_fd(dev);
+	zr.nsid = cfg.namespace_id;
+	zr.desc_len = sizeof(struct nvme_zns_desc);
+	xfer = zns_xfer_len(dev_fd(dev));
+	zr.next_len = sizeof(struct nvme_zone_report) +
+		(xfer - sizeof(struct nvme_zone_report)) / zr.desc_len * zr.desc_len;
+	m.report = nvme_alloc_huge(zr.next_len, &mh);
+	if (!m.report) {
+		err = -ENOMEM;
+		goto close_dev;
+	}
+
+	err = zns_map_cache_path(dev_fd(dev), cfg.namespace_id, path, sizeof(path));
+	if (err) {
+		if (err > 0)
+			nvme_show_status(err);
+		else
+			perror("zns zone-map");
+		goto close_dev;
+	}
+
+	if (!cfg.rescan && !zns_map_load(path, &m) &&
+	    !memcmp(m.hdr.magic, ZNS_MAP_MAGIC, sizeof(m.hdr.magic)) &&
+	    le32_to_cpu(m.hdr.version) == ZNS_MAP_VERSION &&
+	    le32_to_cpu(m.hdr.nsid) == cfg.namespace_id &&
+	    le64_to_cpu(m.hdr.zsze) == m.zsze && le64_to_cpu(m.hdr.nsze) == nsze)
+		err = zns_map_refresh(&zr, &m, &cfg.rescan);
+	else
+		cfg.rescan = true;
 
-	offset = cfg.zslba;
+	if (!err && cfg.rescan) {
+		memset(m.zones, 0, m.nr_zones * sizeof(*m.zones));
+		memset(m.seen, 0, m.nr_zones);
+		m.refreshed = 0;
+		err = zns_map_report(&zr, &m, 0, NVME_ZNS_ZRAS_REPORT_ALL, m.nr_zones);
+	}
+	if (err) {
+		/* the changed zone list may have been consumed already */
+		zns_map_cache_invalidate(dev, cfg.namespace_id);
+		if (err > 0)
+			nvme_show_status(err);
+		else
+			perror("zns zone-map");
+		goto close_dev;
+	}
 
-	nvme_zns_start_zone_list(total_nr_zones, &zone_list, flags);
+	m.hdr = (struct zns_map_hdr) {
+		.magic = ZNS_MAP_MAGIC,
+		.version = cpu_to_le32(ZNS_MAP_VERSION),
+		.nsid = cpu_to_le32(cfg.namespace_id),
+		.zsze = cpu_to_le64(m.zsze),
+		.nsze = cpu_to_le64(nsze),
+	};
+	err = zns_map_save(path, &m);
+	if (err) {
+		fprintf(stderr, "%s: %s\n", path, strerror(-err));
+		goto close_dev;
+	}
 
-	while (nr_zones_retrieved < nr_zones) {
-		if (nr_zones_retrieved >= nr_zones)
+	if (flags == BINARY) {
+		if (fwrite(&m.hdr, sizeof(m.hdr), 1, stdout) != 1 ||
+		    fwrite(m.zones, sizeof(*m.zones), m.nr_zones, stdout) != m.nr_zones)
+			err = -EIO;
+	} else {
+		printf("%s: nsid:%u zones:%u refreshed:%u%s\n", path, cfg.namespace_id,
+		       m.nr_zones, m.refreshed, cfg.rescan ? " rescanned" : "");
+	}
+
+close_dev:
+	dev_close(dev);
+	return err;
+}
+
+/* appends outstanding with --stream at most, each has a thread */
+#define ZNS_APPEND_MAX_WORKERS	256
+
+struct zns_append_slot {
+	__u64 zslba;		/* of the zone the slot appends to */
+	__u64 left;		/* blocks of the zone not handed out yet */
+	int inflight;
+};
+
+struct zns_append_stream {
+	int fd;
+	__u32 nsid;
+	__u16 control;
+	__u32 lba_size;
+	__u32 chunk;		/* largest append in bytes */
+	__u64 zsze;
+	__u64 next_zone;	/* index of the zone to open next */
+	__u64 nr_zones;
+	__u64 zones;		/* appended to */
+	int dfd;
+	__u64 todo;		/* bytes left to read, ~0 until the end of the input */
+	__u64 offset;		/* in the input */
+	bool eof;
+	int err;
+	FILE *extents;
+	struct zns_append_slot *slots;
+	unsigned int nr_slots;
+	__u64 appends;
+	__u64 bytes;
+	unsigned long long usecs;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+/* Called with the lock held, the zones are opened one after the other */
+static int zns_append_next_zone(struct zns_append_stream *s, struct zns_append_slot *slot)
+{
+	struct {
+		struct nvme_zone_report report;
+		struct nvme_zns_desc desc;
+	} r;
+	__u64 zslba, wp;
+	__u8 zs;
+	int err;
+
+	while (s->next_zone < s->nr_zones) {
+		zslba = s->next_zone++ * s->zsze;
+		err = nvme_zns_report_zones(s->fd, s->nsid, zslba, NVME_ZNS_ZRAS_REPORT_ALL,
+					    false, true, sizeof(r), &r,
+					    NVME_DEFAULT_IOCTL_TIMEOUT, NULL);
+		if (err)
+			return err;
+		if (!le64_to_cpu(r.report.nr_zones) || le64_to_cpu(r.desc.zslba) != zslba)
+			continue;
+
+		zs = r.desc.zs >> 4;
+		if (zs != NVME_ZNS_ZS_EMPTY && zs != NVME_ZNS_ZS_IMPL_OPEN &&
+		    zs != NVME_ZNS_ZS_EXPL_OPEN && zs != NVME_ZNS_ZS_CLOSED)
+			continue;
+
+		wp = le64_to_cpu(r.desc.wp);
+		if (wp - zslba >= le64_to_cpu(r.desc.zcap))
+			continue;
+
+		slot->zslba = zslba;
+		slot->left = le64_to_cpu(r.desc.zcap) - (wp - zslba);
+		s->zones++;
+		return 0;
+	}
+
+	return -ENOSPC;
+}
+
+static ssize_t zns_append_read(int fd, void *buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < len) {
+		n = read(fd, buf + done, len - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -errno;
+		if (!n)
 			break;
+		done += n;
+	}
+
+	return done;
+}
+
+/*
+ * Every worker appends to the zone of its slot, so a slot has as many
+ * appends outstanding as it has workers. The input is read with the lock
+ * held, which hands out the capacity of the zones in input order.
+ */
+static void zns_append_worker(int i, void *arg)
+{
+	struct zns_append_stream *s = arg;
+	struct zns_append_slot *slot = &s->slots[i % s->nr_slots];
+	struct timeval start_time, end_time;
+	unsigned long long usecs;
+	__u64 zslba, offset, result;
+	__u32 len, nlb;
+	void *buf;
+	ssize_t n;
+	int err;
+
+	if (posix_memalign(&buf, getpagesize(), s->chunk)) {
+		pthread_mutex_lock(&s->lock);
+		if (!s->err)
+			s->err = -ENOMEM;
+		pthread_mutex_unlock(&s->lock);
+		return;
+	}
 
-		if (nr_zones_retrieved + nr_zones_chunks > nr_zones) {
-			nr_zones_chunks = nr_zones - nr_zones_retrieved;
-			log_len = sizeof(struct nvme_zone_report) + ((sizeof(struct nvme_zns_desc) * nr_zones_chunks) + (nr_zones_chunks * zdes));
+	pthread_mutex_lock(&s->lock);
+	while (!s->err && !s->eof) {
+		if (!slot->left) {
+			/* the previous zone must be full before the next one is opened */
+			if (slot->inflight) {
+				pthread_cond_wait(&s->cond, &s->lock);
+				continue;
+			}
+			err = zns_append_next_zone(s, slot);
+			if (err)
+				s->err = err;
+			continue;
 		}
 
-		err = nvme_zns_report_zones(dev_fd(dev), cfg.namespace_id,
-					    offset,
-					    cfg.state, cfg.extended,
-					    cfg.partial, log_len, report,
-					    NVME_DEFAULT_IOCTL_TIMEOUT, NULL);
-		if (err > 0) {
-			nvme_show_status(err);
+		len = min(s->chunk, slot->left * s->lba_size);
+		len = min(len, s->todo);
+		n = zns_append_read(s->dfd, buf, len);
+		if (n < 0) {
+			s->err = n;
 			break;
 		}
+		if (n < len || (__u64)n == s->todo)
+			s->eof = true;
+		if (!n)
+			break;
 
-		if (!err)
-			nvme_show_zns_report_zones(report, nr_zones_chunks,
-						   zdes, log_len, zone_list, flags);
+		/* the last block of the input is padded */
+		nlb = (n + s->lba_size - 1) / s->lba_size;
+		memset(buf + n, 0, nlb * s->lba_size - n);
+
+		slot->left -= nlb;
+		slot->inflight++;
+		zslba = slot->zslba;
+		offset = s->offset;
+		s->offset += n;
+		s->todo -= n;
+		pthread_mutex_unlock(&s->lock);
+
+		struct nvme_zns_append_args args = {
+			.args_size	= sizeof(args),
+			.fd		= s->fd,
+			.nsid		= s->nsid,
+			.zslba		= zslba,
+			.nlb		= nlb - 1,
+			.control	= s->control,
+			.data_len	= nlb * s->lba_size,
+			.data		= buf,
+			.timeout	= NVME_DEFAULT_IOCTL_TIMEOUT,
+			.result		= &result,
+		};
+
+		gettimeofday(&start_time, NULL);
+		err = nvme_zns_append(&args);
+		gettimeofday(&end_time, NULL);
+		usecs = elapsed_utime(start_time, end_time);
+
+		pthread_mutex_lock(&s->lock);
+		slot->inflight--;
+		pthread_cond_broadcast(&s->cond);
+		if (err) {
+			if (!s->err)
+				s->err = err < 0 ? -errno : err;
+			break;
+		}
 
-		nr_zones_retrieved += nr_zones_chunks;
-		offset = le64_to_cpu(report->entries[nr_zones_chunks-1].zslba) + zsze;
+		s->appends++;
+		s->bytes += n;
+		s->usecs += usecs;
+		if (s->extents)
+			fprintf(s->extents, "%"PRIu64" %zd %#"PRIx64"\n", (uint64_t)offset, n,
+				(uint64_t)result);
 	}
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
 
-	nvme_zns_finish_zone_list(total_nr_zones, zone_list, flags);
+	free(buf);
+}
+
+/* Splits the input into appends to several zones with several appends outstanding */
+static int zns_append_stream(struct zns_append_stream *s, struct nvme_id_ns *ns, __u8 lbaf,
+			     __u64 zslba, unsigned int depth, const char *extent_map,
+			     bool latency)
+{
+	struct timeval start_time, end_time;
+	struct nvme_zns_id_ctrl id_ctrl;
+	struct nvme_zns_id_ns id_zns;
+	unsigned long long usecs;
+	unsigned int nr_workers;
+	__u32 mor, mar;
+	int err;
+
+	err = nvme_zns_identify_ctrl(s->fd, &id_ctrl);
+	if (!err)
+		err = nvme_zns_identify_ns(s->fd, s->nsid, &id_zns);
+	if (err) {
+		nvme_show_status(err);
+		return err;
+	}
+
+	s->zsze = le64_to_cpu(id_zns.lbafe[lbaf].zsze);
+	if (!s->zsze || !s->nr_slots || !depth) {
+		fprintf(stderr, "zns zone-append: invalid zone size, open zones or queue depth\n");
+		return -EINVAL;
+	}
+	s->nr_zones = le64_to_cpu(ns->nsze) / s->zsze;
+	s->next_zone = zslba / s->zsze;
+
+	/* the ZASL is in units of the minimum memory page size, at least 4k */
+	s->chunk = zns_xfer_len(s->fd);
+	if (id_ctrl.zasl)
+		s->chunk = min(s->chunk, (1ULL << id_ctrl.zasl) * 4096);
+	s->chunk -= s->chunk % s->lba_size;
+	if (!s->chunk) {
+		fprintf(stderr, "zns zone-append: blocks larger than an append\n");
+		return -EINVAL;
+	}
+
+	/* the limits are 0's based, all ones for no limit */
+	mor = le32_to_cpu(id_zns.mor);
+	mar = le32_to_cpu(id_zns.mar);
+	if (mar != 0xffffffff && s->nr_slots > mar + 1)
+		s->nr_slots = mar + 1;
+	if (mor != 0xffffffff && s->nr_slots > mor + 1)
+		s->nr_slots = mor + 1;
+	/* each append outstanding has a thread, cap them whatever the limits */
+	if (depth > ZNS_APPEND_MAX_WORKERS || s->nr_slots > ZNS_APPEND_MAX_WORKERS / depth) {
+		depth = min(depth, ZNS_APPEND_MAX_WORKERS);
+		s->nr_slots = min(s->nr_slots, ZNS_APPEND_MAX_WORKERS / depth);
+		fprintf(stderr, "zns zone-append: limited to %u zones with %u appends outstanding\n",
+			s->nr_slots, depth);
+	}
+
+	if (extent_map) {
+		s->extents = fopen(extent_map, "w");
+		if (!s->extents) {
+			err = -errno;
+			perror(extent_map);
+			return err;
+		}
+	}
+
+	s->slots = calloc(s->nr_slots, sizeof(*s->slots));
+	if (!s->slots) {
+		err = -ENOMEM;
+		goto close;
+	}
+
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->cond, NULL);
+
+	nr_workers = s->nr_slots * depth;
+	gettimeofday(&start_time, NULL);
+	nvme_parallel_for(nr_workers, nr_workers, zns_append_worker, s);
+	gettimeofday(&end_time, NULL);
+	usecs = elapsed_utime(start_time, end_time);
+	if (!usecs)
+		usecs = 1;
+
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->lock);
+	free(s->slots);
+
+	printf("appended %"PRIu64" bytes in %"PRIu64" appends to %"PRIu64" zones: %.1f MiB/s, %.0f appends/s\n",
+	       (uint64_t)s->bytes, (uint64_t)s->appends, (uint64_t)s->zones,
+	       (double)s->bytes / (1 << 20) * 1000000 / usecs,
+	       (double)s->appends * 1000000 / usecs);
+	if (latency && s->appends)
+		printf(" latency: zone append: %llu us average\n", s->usecs / s->appends);
+
+	err = s->err;
+	if (err > 0)
+		nvme_show_status(err);
+	else if (err == -ENOSPC)
+		fprintf(stderr, "zns zone-append: no zone left to append to\n");
+	else if (err < 0)
+		fprintf(stderr, "zns zone-append: %s\n", strerror(-err));
+
+close:
+	if (s->extents && fclose(s->extents) && !err) {
+		err = -errno;
+		perror(extent_map);
+	}
 
-free_buff:
-	free(buff);
-close_dev:
-	dev_close(dev);
 	return err;
 }
 
@@ -1015,6 +2243,10 @@ static int zone_append(int argc, char **argv, struct command *cmd, struct plugin
 	const char *metadata_size = "size of metadata in bytes";
 	const char *data_size = "size of data in bytes";
 	const char *latency = "output latency statistics";
+	const char *stream = "append the whole input, split into appends to several zones";
+	const char *open_zones = "number of zones to append to at the same time (stream)";
+	const char *queue_depth = "number of appends outstanding per zone (stream)";
+	const char *extent_map = "file to list the input offset, length and LBA of each append (stream)";
 
 	int err = -1, dfd = STDIN_FILENO, mfd = STDIN_FILENO;
 	unsigned int lba_size, meta_size;
@@ -1042,9 +2274,16 @@ static int zone_append(int argc, char **argv, struct command *cmd, struct plugin
 		__u8   prinfo;
 		bool   piremap;
 		bool   latency;
+		bool   stream;
+		__u32  open_zones;
+		__u32  queue_depth;
+		char  *extent_map;
 	};
 
-	struct config cfg = {};
+	struct config cfg = {
+		.open_zones	= 1,
+		.queue_depth	= 4,
+	};
 
 	OPT_ARGS(opts) = {
 		OPT_UINT("namespace-id", 'n', &cfg.namespace_id,  namespace_id),
@@ -1061,6 +2300,10 @@ static int zone_append(int argc, char **argv, struct command *cmd, struct plugin
 		OPT_BYTE("prinfo",            'p', &cfg.prinfo,        prinfo),
 		OPT_FLAG("piremap",           'P', &cfg.piremap,       piremap),
 		OPT_FLAG("latency",           't', &cfg.latency,       latency),
+		OPT_FLAG("stream",            'S', &cfg.stream,        stream),
+		OPT_UINT("open-zones",        'o', &cfg.open_zones,    open_zones),
+		OPT_UINT("queue-depth",       'q', &cfg.queue_depth,   queue_depth),
+		OPT_FILE("extent-map",        'e', &cfg.extent_map,    extent_map),
 		OPT_END()
 	};
 
@@ -1068,7 +2311,7 @@ static int zone_append(int argc, char **argv, struct command *cmd, struct plugin
 	if (err)
 		return errno;
 
-	if (!cfg.data_size) {
+	if (!cfg.data_size && !cfg.stream) {
 		fprintf(stderr, "Append size not provided\n");
 		errno = EINVAL;
 		goto close_dev;
@@ -1090,7 +2333,7 @@ static int zone_append(int argc, char **argv, struct command *cmd, struct plugin
 
 	nvme_id_ns_flbas_to_lbaf_inuse(ns.flbas, &lba_index);
 	lba_size = 1 << ns.lbaf[lba_index].ds;
-	if (cfg.data_size & (lba_size - 1)) {
+	if (!cfg.stream && cfg.data_size & (lba_size - 1)) {
 		fprintf(stderr,
 			"Data size:%#"PRIx64" not aligned to lba size:%#x\n",
 			(uint64_t)cfg.data_size, lba_size);
@@ -1099,6 +2342,11 @@ static int zone_append(int argc, char **argv, struct command *cmd, struct plugin
 	}
 
 	meta_size = ns.lbaf[lba_index].ms;
+	if (cfg.stream && (cfg.metadata || cfg.metadata_size)) {
+		fprintf(stderr, "Metadata is not supported with --stream\n");
+		errno = EINVAL;
+		goto close_dev;
+	}
 	if (meta_size && !(meta_size == 8 && (cfg.prinfo & 0x8)) &&
 	    (!cfg.metadata_size || cfg.metadata_size % meta_size)) {
 		fprintf(stderr,
@@ -1122,6 +2370,30 @@ static int zone_append(int argc, char **argv, struct command *cmd, struct plugin
 		}
 	}
 
+	control |= (cfg.prinfo << 10);
+	if (cfg.limited_retry)
+		control |= NVME_IO_LR;
+	if (cfg.fua)
+		control |= NVME_IO_FUA;
+	if (cfg.piremap)
+		control |= NVME_IO_ZNS_APPEND_PIREMAP;
+
+	if (cfg.stream) {
+		struct zns_append_stream s = {
+			.fd		= dev_fd(dev),
+			.nsid		= cfg.namespace_id,
+			.control	= control,
+			.lba_size	= lba_size,
+			.dfd		= dfd,
+			.todo		= cfg.data_size ? cfg.data_size : ~0ULL,
+			.nr_slots	= cfg.open_zones,
+		};
+
+		err = zns_append_stream(&s, &ns, lba_index, cfg.zslba, cfg.queue_depth,
+					cfg.extent_map, cfg.latency);
+		goto close_dfd;
+	}
+
 	if (posix_memalign(&buf, getpagesize(), cfg.data_size)) {
 		fprintf(stderr, "No memory for data size:%"PRIx64"\n",
 			(uint64_t)cfg.data_size);
@@ -1161,13 +2433,6 @@ static int zone_append(int argc, char **argv, struct command *cmd, struct plugin
 	}
 
 	nblocks = (cfg.data_size / lba_size) - 1;
-	control |= (cfg.prinfo << 10);
-	if (cfg.limited_retry)
-		control |= NVME_IO_LR;
-	if (cfg.fua)
-		control |= NVME_IO_FUA;
-	if (cfg.piremap)
-		control |= NVME_IO_ZNS_APPEND_PIREMAP;
 
 	struct nvme_zns_append_args args = {
 		.args_size	= sizeof(args),
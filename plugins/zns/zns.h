@@ -24,6 +24,7 @@ PLUGIN(NAME("zns", "Zoned Namespace Command Set", NVME_VERSION),
 		ENTRY("zone-mgmt-recv", "Send the zone management receive command", zone_mgmt_recv)
 		ENTRY("zone-mgmt-send", "Send the zone management send command", zone_mgmt_send)
 		ENTRY("zone-append", "Append data and metadata (if applicable) to a zone", zone_append)
+		ENTRY("zone-map", "Refresh the cached zone map of a namespace", zone_map_refresh)
 	)
 );
 
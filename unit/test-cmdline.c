@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../util/cmdline.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+#define MAX_ARGS 8
+
+struct test_data {
+	const char *line;
+	int ret;
+	const char *argv[MAX_ARGS];
+};
+
+static struct test_data test_data[] = {
+	{ "", 0 },
+	{ "   \t\n", 0 },
+	{ "# comment", 0 },
+	{ "id-ctrl /dev/nvme0", 2, { "id-ctrl", "/dev/nvme0" } },
+	{ "  smart-log\t/dev/nvme0 -o json\n", 4, { "smart-log", "/dev/nvme0", "-o", "json" } },
+	{ "list # all of them", 1, { "list" } },
+	{ "a#b", 1, { "a#b" } },
+	{ "set-feature --data='a b' \"c d\"", 3, { "set-feature", "--data=a b", "c d" } },
+	{ "'it''s' \"\\\"x\\\\\" 'a\\b'", 3, { "its", "\"x\\", "a\\b" } },
+	{ "\"a 'b' c\" a\\ b", 2, { "a 'b' c", "a b" } },
+	{ "\"\\n\" ''", 2, { "\\n", "" } },
+	{ "a\\", 1, { "a\\" } },
+	{ "'unterminated", -EINVAL },
+	{ "a \"unterminated", -EINVAL },
+	{ "1 2 3 4 5 6 7 8", 8, { "1", "2", "3", "4", "5", "6", "7", "8" } },
+	{ "1 2 3 4 5 6 7 8 9", -E2BIG },
+};
+
+static int test_rc;
+
+static void check(struct test_data *test)
+{
+	char *argv[MAX_ARGS + 1];
+	char *line = strdup(test->line);
+	int ret, i;
+
+	if (!line) {
+		test_rc = 1;
+		return;
+	}
+
+	ret = cmdline_split(line, argv, MAX_ARGS);
+	if (ret != test->ret) {
+		printf("ERROR: splitting '%s' returned %d instead of %d\n",
+		       test->line, ret, test->ret);
+		test_rc = 1;
+		goto out;
+	}
+
+	for (i = 0; i < ret; i++) {
+		if (strcmp(argv[i], test->argv[i])) {
+			printf("ERROR: splitting '%s': argument %d is '%s' instead of '%s'\n",
+			       test->line, i, argv[i], test->argv[i]);
+			test_rc = 1;
+		}
+	}
+	if (ret >= 0 && argv[ret]) {
+		printf("ERROR: splitting '%s': argv is not terminated\n", test->line);
+		test_rc = 1;
+	}
+out:
+	free(line);
+}
+
+int main(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(test_data); i++)
+		check(&test_data[i]);
+
+	return test_rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
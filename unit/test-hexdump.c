@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../util/hexdump.h"
+
+static int test_rc;
+
+/* The printf based formatter d() used before, the output has to match it */
+static void ref_hexdump(FILE *f, const unsigned char *buf, int len, int width, int group)
+{
+	int i, offset = 0;
+	char ascii[32 + 1] = { 0 };
+
+	fprintf(f, "     ");
+	for (i = 0; i <= 15; i++)
+		fprintf(f, "%3x", i);
+
+	for (i = 0; i < len; i++) {
+		if (!(i % width))
+			fprintf(f, "\n%04x:", offset);
+		if (i % group)
+			fprintf(f, "%02x", buf[i]);
+		else
+			fprintf(f, " %02x", buf[i]);
+		ascii[i % width] = (buf[i] >= '!' && buf[i] <= '~') ? buf[i] : '.';
+		if (!((i + 1) % width)) {
+			fprintf(f, " \"%.*s\"", width, ascii);
+			offset += width;
+			memset(ascii, 0, sizeof(ascii));
+		}
+	}
+
+	if (strlen(ascii)) {
+		unsigned int b = width - (i % width);
+
+		fprintf(f, " %*s \"%.*s\"", 2 * b + b / group + (b % group ? 1 : 0), "",
+			width, ascii);
+	}
+
+	fprintf(f, "\n");
+}
+
+static char *dump(void (*fn)(FILE *, const unsigned char *, int, int, int),
+		  const unsigned char *buf, int len, int width, int group)
+{
+	size_t size = 0;
+	char *out = NULL;
+	FILE *f;
+
+	f = open_memstream(&out, &size);
+	if (!f)
+		return NULL;
+	fn(f, buf, len, width, group);
+	fclose(f);
+
+	return out;
+}
+
+static void check(const unsigned char *buf, int len, int width, int group)
+{
+	char *expected = dump(ref_hexdump, buf, len, width, group);
+	char *out = dump(util_hexdump, buf, len, width, group);
+
+	if (!expected || !out || strcmp(out, expected)) {
+		printf("ERROR: len %d width %d group %d: got\n%s\nexpected\n%s\n",
+		       len, width, group, out, expected);
+		test_rc = 1;
+	}
+
+	free(expected);
+	free(out);
+}
+
+int main(void)
+{
+	static const int widths[] = { 8, 16, 32 };
+	static const int groups[] = { 1, 2, 3, 4, 8 };
+	unsigned char buf[0x11000];
+	int i, w, g, len;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i * 7;
+
+	for (w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+		for (g = 0; g < sizeof(groups) / sizeof(groups[0]); g++) {
+			for (len = 0; len <= 3 * widths[w] + 1; len++)
+				check(buf, len, widths[w], groups[g]);
+		}
+	}
+
+	/* offsets beyond four digits */
+	check(buf, sizeof(buf), 16, 1);
+
+	return test_rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
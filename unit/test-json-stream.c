@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../util/json-stream.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+
+static int test_rc;
+
+struct json_stream_test {
+	const char *name;
+	enum json_stream_format format;
+	void (*emit)(struct json_stream *s);
+	const char *expected;
+	size_t len;		/* for binary output */
+};
+
+static void emit_nested(struct json_stream *s)
+{
+	json_stream_begin_object(s, NULL);
+	json_stream_add_uint(s, "nr_zones", 2);
+	json_stream_begin_array(s, "zone_list");
+	json_stream_begin_object(s, NULL);
+	json_stream_add_uint(s, "slba", 0);
+	json_stream_add_str(s, "state", "EMPTY");
+	json_stream_end_object(s);
+	json_stream_begin_object(s, NULL);
+	json_stream_add_uint(s, "slba", 18446744073709551615ULL);
+	json_stream_add_int(s, "attrs", -1);
+	json_stream_add_bool(s, "valid", true);
+	json_stream_end_object(s);
+	json_stream_end_array(s);
+	json_stream_end_object(s);
+}
+
+static void emit_empty(struct json_stream *s)
+{
+	json_stream_begin_object(s, NULL);
+	json_stream_begin_array(s, "errors");
+	json_stream_end_array(s);
+	json_stream_begin_object(s, "inner");
+	json_stream_end_object(s);
+	json_stream_end_object(s);
+}
+
+static void emit_escape(struct json_stream *s)
+{
+	json_stream_begin_array(s, NULL);
+	json_stream_add_str(s, NULL, "a\"b\\c/d\n\t\x01");
+	json_stream_add_str(s, NULL, NULL);
+	json_stream_end_array(s);
+}
+
+static void emit_records(struct json_stream *s)
+{
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		json_stream_begin_object(s, NULL);
+		json_stream_add_int(s, "entry", i);
+		json_stream_end_object(s);
+	}
+}
+
+static void emit_unclosed(struct json_stream *s)
+{
+	json_stream_begin_object(s, NULL);
+	json_stream_begin_array(s, "list");
+	json_stream_add_int(s, NULL, 1);
+}
+
+static struct json_stream_test json_stream_tests[] = {
+	{ "nested", JSON_STREAM_PRETTY, emit_nested,
+	  "{\n"
+	  "  \"nr_zones\":2,\n"
+	  "  \"zone_list\":[\n"
+	  "    {\n"
+	  "      \"slba\":0,\n"
+	  "      \"state\":\"EMPTY\"\n"
+	  "    },\n"
+	  "    {\n"
+	  "      \"slba\":18446744073709551615,\n"
+	  "      \"attrs\":-1,\n"
+	  "      \"valid\":true\n"
+	  "    }\n"
+	  "  ]\n"
+	  "}\n" },
+	{ "nested plain", JSON_STREAM_PLAIN, emit_nested,
+	  "{\"nr_zones\":2,\"zone_list\":[{\"slba\":0,\"state\":\"EMPTY\"},"
+	  "{\"slba\":18446744073709551615,\"attrs\":-1,\"valid\":true}]}\n" },
+	{ "empty", JSON_STREAM_PRETTY, emit_empty,
+	  "{\n"
+	  "  \"errors\":[\n"
+	  "  ],\n"
+	  "  \"inner\":{\n"
+	  "  }\n"
+	  "}\n" },
+	{ "escape", JSON_STREAM_PLAIN, emit_escape,
+	  "[\"a\\\"b\\\\c/d\\n\\t\\u0001\",null]\n" },
+	{ "records", JSON_STREAM_PLAIN, emit_records,
+	  "{\"entry\":0}\n{\"entry\":1}\n{\"entry\":2}\n" },
+	{ "unclosed", JSON_STREAM_PLAIN, emit_unclosed,
+	  "{\"list\":[1]}\n" },
+	{ "cbor nested", JSON_STREAM_CBOR, emit_nested,
+	  "\xbf"
+	  "\x68" "nr_zones" "\x02"
+	  "\x69" "zone_list" "\x9f"
+	  "\xbf" "\x64" "slba" "\x00" "\x65" "state" "\x65" "EMPTY" "\xff"
+	  "\xbf" "\x64" "slba" "\x1b\xff\xff\xff\xff\xff\xff\xff\xff"
+	  "\x65" "attrs" "\x20" "\x65" "valid" "\xf5" "\xff"
+	  "\xff"
+	  "\xff", 74 },
+	{ "cbor records", JSON_STREAM_CBOR, emit_records,
+	  "\xbf\x65" "entry" "\x00\xff"
+	  "\xbf\x65" "entry" "\x01\xff"
+	  "\xbf\x65" "entry" "\x02\xff", 27 },
+	{ "cbor unclosed", JSON_STREAM_CBOR, emit_unclosed,
+	  "\xbf\x64" "list" "\x9f\x01\xff\xff", 10 },
+};
+
+static void json_stream_test(struct json_stream_test *test)
+{
+	struct json_stream *s;
+	size_t len = 0;
+	char *buf = NULL;
+	FILE *f;
+	int err;
+
+	f = open_memstream(&buf, &len);
+	if (!f) {
+		test_rc = 1;
+		return;
+	}
+
+	s = json_stream_open(f, test->format);
+	if (!s) {
+		printf("ERROR: %s: open failed\n", test->name);
+		test_rc = 1;
+		fclose(f);
+		free(buf);
+		return;
+	}
+
+	test->emit(s);
+	err = json_stream_close(s);
+	fclose(f);
+
+	if (err) {
+		printf("ERROR: %s: close failed: %s\n", test->name, strerror(-err));
+		test_rc = 1;
+	} else if (test->len && (len != test->len || memcmp(buf, test->expected, len))) {
+		printf("ERROR: %s: got %zu bytes, expected %zu\n", test->name, len,
+		       test->len);
+		test_rc = 1;
+	} else if (!test->len && strcmp(buf, test->expected)) {
+		printf("ERROR: %s: got\n%s\nexpected\n%s\n", test->name, buf,
+		       test->expected);
+		test_rc = 1;
+	}
+
+	free(buf);
+}
+
+/* Output larger than the internal buffer is written out as it is produced */
+static void json_stream_test_large(void)
+{
+	const int entries = 100000;
+	struct json_stream *s;
+	size_t len = 0, flushed = 0;
+	char *buf = NULL;
+	FILE *f;
+	int i;
+
+	f = open_memstream(&buf, &len);
+	if (!f) {
+		test_rc = 1;
+		return;
+	}
+
+	s = json_stream_open(f, JSON_STREAM_PRETTY);
+	if (!s) {
+		test_rc = 1;
+		fclose(f);
+		return;
+	}
+
+	json_stream_begin_object(s, NULL);
+	json_stream_begin_array(s, "errors");
+	for (i = 0; i < entries; i++) {
+		json_stream_begin_object(s, NULL);
+		json_stream_add_uint(s, "error_count", i);
+		json_stream_end_object(s);
+		if (i == entries / 2)
+			flushed = len;
+	}
+	json_stream_end_array(s);
+	json_stream_end_object(s);
+
+	if (json_stream_close(s)) {
+		printf("ERROR: large: close failed\n");
+		test_rc = 1;
+	}
+	fclose(f);
+
+	if (!flushed) {
+		printf("ERROR: large: no output before the end\n");
+		test_rc = 1;
+	}
+	if (len < entries * 20 || strcmp(buf + len - 6, "  ]\n}\n")) {
+		printf("ERROR: large: bad output of %zu bytes\n", len);
+		test_rc = 1;
+	}
+
+	free(buf);
+}
+
+int main(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(json_stream_tests); i++)
+		json_stream_test(&json_stream_tests[i]);
+
+	json_stream_test_large();
+
+	return test_rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../util/openmetrics.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+
+static int test_rc;
+
+struct test_log {
+	unsigned char warning;
+	unsigned char temp[2];
+	unsigned char sensors[3][2];
+	unsigned char units[16];
+};
+
+static const struct om_field test_fields[] = {
+	{ "nvme_warning", OM_GAUGE, "Warning bits", 0, 1, 1, NULL },
+	{ "nvme_temperature_kelvin", OM_GAUGE, "Temperature", 1, 2, 1, NULL },
+	{ "nvme_sensor_kelvin", OM_GAUGE, "Sensors", 3, 2, 3, "sensor" },
+	{ "nvme_units", OM_COUNTER, "Units", 9, 16, 1, NULL },
+};
+
+static void check(const char *name, char *buf, const char *expected)
+{
+	if (strcmp(buf, expected)) {
+		printf("ERROR: %s: got\n%s\nexpected\n%s\n", name, buf, expected);
+		test_rc = 1;
+	}
+	free(buf);
+}
+
+static void test_labels(void)
+{
+	char labels[OM_LABELS_MAX] = { 0 };
+	char serial[8] = "S1 \"x\"";
+	char model[40] = "Model\\1      ";
+	char long_value[2 * OM_LABELS_MAX];
+
+	om_add_label(labels, "device", "nvme0", 5);
+	om_add_label(labels, "serial", serial, sizeof(serial));
+	om_add_label(labels, "model", model, sizeof(model));
+	if (strcmp(labels, "device=\"nvme0\",serial=\"S1 \\\"x\\\"\",model=\"Model\\\\1\"")) {
+		printf("ERROR: labels: got %s\n", labels);
+		test_rc = 1;
+	}
+
+	/* values which do not fit are cut, the label set stays valid */
+	memset(long_value, 'a', sizeof(long_value));
+	om_add_label(labels, "long", long_value, sizeof(long_value));
+	if (strlen(labels) != OM_LABELS_MAX - 1 || labels[OM_LABELS_MAX - 2] != '"') {
+		printf("ERROR: labels: bad truncation, length %zu\n", strlen(labels));
+		test_rc = 1;
+	}
+}
+
+static void test_fields_output(void)
+{
+	struct test_log log[2] = {
+		{ .warning = 1, .temp = { 0x2c, 0x01 }, .sensors = { { 0x2d, 0x01 } },
+		  .units = { [0] = 1, [8] = 1 } },
+		{ .temp = { 0x2e, 0x01 }, .sensors = { { 0 }, { 0x2f, 0x01 } } },
+	};
+	struct om_source src[] = {
+		{ "device=\"nvme0\"", &log[0] },
+		{ "device=\"nvme1\"", NULL },
+		{ "device=\"nvme2\"", &log[1] },
+	};
+	size_t len = 0;
+	char *buf = NULL;
+	FILE *f;
+
+	f = open_memstream(&buf, &len);
+	if (!f) {
+		test_rc = 1;
+		return;
+	}
+	om_fields(f, test_fields, ARRAY_SIZE(test_fields), src, ARRAY_SIZE(src));
+	om_eof(f);
+	fclose(f);
+
+	check("fields", buf,
+	      "# TYPE nvme_warning gauge\n"
+	      "# HELP nvme_warning Warning bits\n"
+	      "nvme_warning{device=\"nvme0\"} 1\n"
+	      "nvme_warning{device=\"nvme2\"} 0\n"
+	      "# TYPE nvme_temperature_kelvin gauge\n"
+	      "# HELP nvme_temperature_kelvin Temperature\n"
+	      "nvme_temperature_kelvin{device=\"nvme0\"} 300\n"
+	      "nvme_temperature_kelvin{device=\"nvme2\"} 302\n"
+	      "# TYPE nvme_sensor_kelvin gauge\n"
+	      "# HELP nvme_sensor_kelvin Sensors\n"
+	      "nvme_sensor_kelvin{device=\"nvme0\",sensor=\"1\"} 301\n"
+	      "nvme_sensor_kelvin{device=\"nvme2\",sensor=\"2\"} 303\n"
+	      "# TYPE nvme_units counter\n"
+	      "# HELP nvme_units Units\n"
+	      "nvme_units_total{device=\"nvme0\"} 18446744073709551617\n"
+	      "nvme_units_total{device=\"nvme2\"} 0\n"
+	      "# EOF\n");
+}
+
+static void test_no_log(void)
+{
+	struct om_source src = { "", NULL };
+	size_t len = 0;
+	char *buf = NULL;
+	FILE *f;
+
+	f = open_memstream(&buf, &len);
+	if (!f) {
+		test_rc = 1;
+		return;
+	}
+	om_fields(f, test_fields, ARRAY_SIZE(test_fields), &src, 1);
+	om_family(f, "nvme_firmware_slot", OM_INFO, "Firmware");
+	om_sample(f, "nvme_firmware_slot", OM_INFO, "", "1");
+	om_eof(f);
+	fclose(f);
+
+	check("no log", buf,
+	      "# TYPE nvme_firmware_slot info\n"
+	      "# HELP nvme_firmware_slot Firmware\n"
+	      "nvme_firmware_slot_info 1\n"
+	      "# EOF\n");
+}
+
+int main(void)
+{
+	test_labels();
+	test_fields_output();
+	test_no_log();
+
+	return test_rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "../util/parallel.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+
+#define MAX_ITEMS	4096
+
+static int test_rc;
+
+struct parallel_test {
+	int nr;
+	int jobs;
+};
+
+static struct parallel_test parallel_tests[] = {
+	{ 0, 4 },
+	{ 1, 4 },
+	{ 3, 0 },
+	{ 7, 1 },
+	{ 5, 16 },
+	{ MAX_ITEMS, 8 },
+};
+
+static int calls[MAX_ITEMS];
+static pthread_mutex_t calls_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void count_call(int i, void *arg)
+{
+	pthread_mutex_lock(&calls_lock);
+	calls[i]++;
+	(*(int *)arg)++;
+	pthread_mutex_unlock(&calls_lock);
+}
+
+static void parallel_test(struct parallel_test *test)
+{
+	int i, total = 0;
+
+	for (i = 0; i < MAX_ITEMS; i++)
+		calls[i] = 0;
+
+	nvme_parallel_for(test->nr, test->jobs, count_call, &total);
+
+	if (total != test->nr) {
+		printf("ERROR: nr %d jobs %d: got %d calls\n", test->nr, test->jobs, total);
+		test_rc = 1;
+		return;
+	}
+
+	for (i = 0; i < test->nr; i++) {
+		if (calls[i] != 1) {
+			printf("ERROR: nr %d jobs %d: item %d called %d times\n",
+			       test->nr, test->jobs, i, calls[i]);
+			test_rc = 1;
+			return;
+		}
+	}
+}
+
+int main(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(parallel_tests); i++)
+		parallel_test(&parallel_tests[i]);
+
+	return test_rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../util/tar.h"
+
+static int test_rc;
+
+static void check(const char *name, int cond)
+{
+	if (!cond) {
+		printf("ERROR: %s\n", name);
+		test_rc = 1;
+	}
+}
+
+static unsigned int header_sum(const unsigned char *h)
+{
+	unsigned int sum = 0;
+	int i;
+
+	for (i = 0; i < TAR_BLOCK_SIZE; i++)
+		sum += (i >= 148 && i < 156) ? ' ' : h[i];
+
+	return sum;
+}
+
+static void test_archive(void)
+{
+	char long_path[200];
+	size_t len = 0;
+	char *buf = NULL;
+	FILE *f;
+
+	memset(long_path, 'a', sizeof(long_path));
+	memcpy(long_path + 120, "/file", 6);
+
+	f = open_memstream(&buf, &len);
+	if (!f) {
+		test_rc = 1;
+		return;
+	}
+	check("add", !tar_add(f, "dir/file.bin", "hello", 5, 1000));
+	check("add empty", !tar_add(f, "dir/empty", NULL, 0, 1000));
+	check("add long", !tar_add(f, long_path, "x", 1, 1000));
+	check("finish", !tar_finish(f));
+	fclose(f);
+
+	/* header and data block of each file, two blocks at the end */
+	check("length", len == 7 * TAR_BLOCK_SIZE);
+	if (len != 7 * TAR_BLOCK_SIZE)
+		goto out;
+
+	check("name", !strcmp(buf, "dir/file.bin"));
+	check("size", !strcmp(buf + 124, "00000000005"));
+	check("mtime", !strcmp(buf + 136, "00000001750"));
+	check("type", buf[156] == '0');
+	check("magic", !memcmp(buf + 257, "ustar\0" "00", 8));
+	check("checksum", strtoul(buf + 148, NULL, 8) ==
+	      header_sum((unsigned char *)buf));
+	check("data", !memcmp(buf + TAR_BLOCK_SIZE, "hello\0", 6));
+
+	check("empty", !strcmp(buf + 2 * TAR_BLOCK_SIZE, "dir/empty"));
+
+	check("long name", !strcmp(buf + 3 * TAR_BLOCK_SIZE, "file"));
+	check("long prefix", strlen(buf + 3 * TAR_BLOCK_SIZE + 345) == 120);
+	check("long checksum", strtoul(buf + 3 * TAR_BLOCK_SIZE + 148, NULL, 8) ==
+	      header_sum((unsigned char *)buf + 3 * TAR_BLOCK_SIZE));
+out:
+	free(buf);
+}
+
+static void test_too_long(void)
+{
+	char path[300];
+	size_t len = 0;
+	char *buf = NULL;
+	FILE *f;
+
+	memset(path, 'a', sizeof(path) - 1);
+	path[sizeof(path) - 1] = '\0';
+
+	f = open_memstream(&buf, &len);
+	if (!f) {
+		test_rc = 1;
+		return;
+	}
+	check("too long", tar_add(f, path, "x", 1, 0) == -ENAMETOOLONG);
+	fclose(f);
+	check("nothing written", !len);
+	free(buf);
+}
+
+int main(void)
+{
+	test_archive();
+	test_too_long();
+
+	return test_rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../util/writer.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+
+#define CHUNK_SIZE	0x10000
+
+static int test_rc;
+
+struct writer_test {
+	const char *name;
+	size_t total;
+	bool direct;
+};
+
+static struct writer_test writer_tests[] = {
+	{ "empty", 0, false },
+	{ "single chunk", CHUNK_SIZE, false },
+	{ "many chunks", 17 * CHUNK_SIZE, false },
+	{ "unaligned tail", 5 * CHUNK_SIZE + 123, false },
+	{ "direct", 8 * CHUNK_SIZE, true },
+	{ "direct unaligned tail", 3 * CHUNK_SIZE + 0x200 + 7, true },
+};
+
+static unsigned char pattern(size_t off)
+{
+	return (off * 7 + (off >> 16)) & 0xff;
+}
+
+static void writer_test(const char *path, struct writer_test *test)
+{
+	struct nvme_writer *w;
+	unsigned char *buf;
+	size_t off = 0, len, i;
+	struct stat st;
+	FILE *f;
+	int c, err;
+
+	w = nvme_writer_open(path, CHUNK_SIZE, test->direct);
+	if (!w) {
+		printf("ERROR: %s: open failed: %s\n", test->name, strerror(errno));
+		test_rc = 1;
+		return;
+	}
+
+	while (off < test->total) {
+		len = test->total - off;
+		if (len > CHUNK_SIZE)
+			len = CHUNK_SIZE;
+
+		buf = nvme_writer_get_buf(w);
+		for (i = 0; i < len; i++)
+			buf[i] = pattern(off + i);
+
+		err = nvme_writer_commit(w, len);
+		if (err) {
+			printf("ERROR: %s: commit failed: %s\n", test->name, strerror(-err));
+			test_rc = 1;
+			break;
+		}
+		off += len;
+	}
+
+	err = nvme_writer_close(w);
+	if (err) {
+		printf("ERROR: %s: close failed: %s\n", test->name, strerror(-err));
+		test_rc = 1;
+		return;
+	}
+
+	if (stat(path, &st) || st.st_size != test->total) {
+		printf("ERROR: %s: got size %lld, expected %zu\n", test->name,
+		       (long long)st.st_size, test->total);
+		test_rc = 1;
+		return;
+	}
+
+	f = fopen(path, "r");
+	if (!f) {
+		test_rc = 1;
+		return;
+	}
+	for (off = 0; (c = fgetc(f)) != EOF; off++) {
+		if (c != pattern(off)) {
+			printf("ERROR: %s: mismatch at offset %zu\n", test->name, off);
+			test_rc = 1;
+			break;
+		}
+	}
+	fclose(f);
+}
+
+int main(void)
+{
+	char path[] = "test-writer-XXXXXX";
+	int fd, i;
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	close(fd);
+
+	for (i = 0; i < ARRAY_SIZE(writer_tests); i++)
+		writer_test(path, &writer_tests[i]);
+
+	unlink(path);
+
+	return test_rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,378 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "cmd-cache.h"
+
+#define CMD_CACHE_BUCKETS	1024
+#define CMD_CACHE_ALIGN(len)	(((len) + 7) & ~(size_t)7)
+
+struct cmd_cache_entry {
+	struct cmd_cache_entry *next;
+	struct nvme_cmd_cache_record rec;
+	const void *data;	/* follows the entry unless loaded */
+};
+
+static struct {
+	bool enabled;
+	int users;
+	unsigned long hits;
+	unsigned long generation;
+	pthread_mutex_t lock;
+	struct cmd_cache_entry *buckets[CMD_CACHE_BUCKETS];
+} cache = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static bool cmd_cache_key(int fd, unsigned long ioctl_cmd,
+			  struct nvme_passthru_cmd *cmd, __u64 *rdev)
+{
+	struct stat st;
+
+	if (!cache.enabled || ioctl_cmd != NVME_IOCTL_ADMIN_CMD ||
+	    cmd->opcode != nvme_admin_identify || !cmd->addr ||
+	    cmd->metadata_len)
+		return false;
+
+	if (fstat(fd, &st))
+		return false;
+
+	*rdev = st.st_rdev;
+	return true;
+}
+
+static unsigned int cmd_cache_hash(__u64 rdev, __u32 nsid, __u32 cdw10, __u32 cdw11)
+{
+	uint64_t h = rdev;
+
+	h = h * 31 + nsid;
+	h = h * 31 + cdw10;
+	h = h * 31 + cdw11;
+
+	return (h ^ (h >> 17)) % CMD_CACHE_BUCKETS;
+}
+
+static bool cmd_cache_match(struct cmd_cache_entry *e, __u64 rdev,
+			    struct nvme_passthru_cmd *cmd)
+{
+	return e->rec.rdev == rdev && e->rec.nsid == cmd->nsid &&
+		e->rec.cdw10 == cmd->cdw10 && e->rec.cdw11 == cmd->cdw11 &&
+		e->rec.cdw14 == cmd->cdw14 && e->rec.data_len == cmd->data_len;
+}
+
+static void cmd_cache_insert(struct cmd_cache_entry *e)
+{
+	unsigned int bucket;
+
+	bucket = cmd_cache_hash(e->rec.rdev, e->rec.nsid, e->rec.cdw10, e->rec.cdw11);
+	pthread_mutex_lock(&cache.lock);
+	e->next = cache.buckets[bucket];
+	cache.buckets[bucket] = e;
+	pthread_mutex_unlock(&cache.lock);
+}
+
+static void cmd_cache_clear(void)
+{
+	struct cmd_cache_entry *e, *next;
+	int i;
+
+	for (i = 0; i < CMD_CACHE_BUCKETS; i++) {
+		for (e = cache.buckets[i]; e; e = next) {
+			next = e->next;
+			free(e);
+		}
+		cache.buckets[i] = NULL;
+	}
+}
+
+/* Windows may nest, the memo lasts until the outermost one is closed */
+void nvme_cmd_cache_enable(void)
+{
+	pthread_mutex_lock(&cache.lock);
+	cache.enabled = true;
+	if (!cache.users++)
+		cache.hits = 0;
+	pthread_mutex_unlock(&cache.lock);
+}
+
+void nvme_cmd_cache_disable(void)
+{
+	pthread_mutex_lock(&cache.lock);
+	if (cache.users && --cache.users) {
+		pthread_mutex_unlock(&cache.lock);
+		return;
+	}
+	cache.enabled = false;
+	cmd_cache_clear();
+	pthread_mutex_unlock(&cache.lock);
+}
+
+bool nvme_cmd_cache_enabled(void)
+{
+	bool enabled;
+
+	pthread_mutex_lock(&cache.lock);
+	enabled = cache.enabled;
+	pthread_mutex_unlock(&cache.lock);
+
+	return enabled;
+}
+
+/*
+ * Tells other nvme processes the namespaces or controllers may have changed,
+ * by counting the change in the stamp. The lock keeps concurrent writers
+ * from losing one.
+ */
+static void cmd_cache_stamp(__u8 opcode)
+{
+	__u64 changes;
+	ssize_t ret;
+	int fd;
+
+	switch (opcode) {
+	case nvme_admin_ns_mgmt:
+	case nvme_admin_ns_attach:
+	case nvme_admin_format_nvm:
+	case nvme_admin_sanitize_nvm:
+	case nvme_admin_fw_commit:
+	case nvme_admin_virtual_mgmt:
+		break;
+	default:
+		return;
+	}
+
+	/* nobody keeps identify data around if the directory is missing */
+	fd = open(NVME_CMD_CACHE_STAMP, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return;
+	if (!flock(fd, LOCK_EX)) {
+		if (pread(fd, &changes, sizeof(changes), 0) != sizeof(changes))
+			changes = 0;
+		changes++;
+		ret = pwrite(fd, &changes, sizeof(changes), 0);
+		(void)ret;
+	}
+	close(fd);
+}
+
+/* Returns the number of changes counted in the stamp, 0 if there is none */
+__u64 nvme_cmd_cache_changes(void)
+{
+	__u64 changes = 0;
+	int fd;
+
+	fd = open(NVME_CMD_CACHE_STAMP, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+	if (flock(fd, LOCK_SH) ||
+	    pread(fd, &changes, sizeof(changes), 0) != sizeof(changes))
+		changes = 0;
+	close(fd);
+
+	return changes;
+}
+
+/*
+ * Drops the memo after an admin command which may have changed identify
+ * data, e.g. a namespace management or format command, completed.
+ */
+void nvme_cmd_cache_invalidate(unsigned long ioctl_cmd, __u8 opcode)
+{
+	if (ioctl_cmd != NVME_IOCTL_ADMIN_CMD && ioctl_cmd != NVME_IOCTL_ADMIN64_CMD)
+		return;
+
+	switch (opcode) {
+	case nvme_admin_identify:
+	case nvme_admin_get_log_page:
+	case nvme_admin_get_features:
+		return;
+	default:
+		break;
+	}
+
+	pthread_mutex_lock(&cache.lock);
+	cache.generation++;
+	if (cache.enabled)
+		cmd_cache_clear();
+	pthread_mutex_unlock(&cache.lock);
+
+	cmd_cache_stamp(opcode);
+}
+
+/* Identify data which changes without any admin command, e.g. with writes */
+static bool cmd_cache_volatile(struct cmd_cache_entry *e)
+{
+	switch (e->rec.cdw10 & 0xff) {
+	case NVME_IDENTIFY_CNS_NS:
+	case NVME_IDENTIFY_CNS_CSI_INDEPENDENT_ID_NS:
+	case NVME_IDENTIFY_CNS_ALLOCATED_NS:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Drops the namespace data, which holds the utilization, once the command
+ * which read it is done. Holders of the memo across commands call this
+ * after each of them.
+ */
+void nvme_cmd_cache_forget_usage(void)
+{
+	struct cmd_cache_entry *e, **pp;
+	int i;
+
+	pthread_mutex_lock(&cache.lock);
+	for (i = 0; i < CMD_CACHE_BUCKETS; i++) {
+		for (pp = &cache.buckets[i]; (e = *pp);) {
+			if (cmd_cache_volatile(e)) {
+				*pp = e->next;
+				free(e);
+			} else {
+				pp = &e->next;
+			}
+		}
+	}
+	pthread_mutex_unlock(&cache.lock);
+}
+
+unsigned long nvme_cmd_cache_generation(void)
+{
+	unsigned long generation;
+
+	pthread_mutex_lock(&cache.lock);
+	generation = cache.generation;
+	pthread_mutex_unlock(&cache.lock);
+
+	return generation;
+}
+
+/* Completes cmd from the memo. Returns false if it has to be submitted. */
+bool nvme_cmd_cache_lookup(int fd, unsigned long ioctl_cmd,
+			   struct nvme_passthru_cmd *cmd)
+{
+	struct cmd_cache_entry *e;
+	bool hit = false;
+	__u64 rdev;
+
+	if (!cmd_cache_key(fd, ioctl_cmd, cmd, &rdev))
+		return false;
+
+	pthread_mutex_lock(&cache.lock);
+	for (e = cache.buckets[cmd_cache_hash(rdev, cmd->nsid, cmd->cdw10, cmd->cdw11)];
+	     e; e = e->next) {
+		if (!cmd_cache_match(e, rdev, cmd))
+			continue;
+		memcpy((void *)(uintptr_t)cmd->addr, e->data, e->rec.data_len);
+		cmd->result = e->rec.result;
+		cache.hits++;
+		hit = true;
+		break;
+	}
+	pthread_mutex_unlock(&cache.lock);
+
+	return hit;
+}
+
+/* Records the response of a successfully completed cmd */
+void nvme_cmd_cache_store(int fd, unsigned long ioctl_cmd,
+			  struct nvme_passthru_cmd *cmd)
+{
+	struct cmd_cache_entry *e;
+	__u64 rdev;
+
+	if (!cmd_cache_key(fd, ioctl_cmd, cmd, &rdev))
+		return;
+
+	e = malloc(sizeof(*e) + cmd->data_len);
+	if (!e)
+		return;
+
+	e->rec.rdev = rdev;
+	e->rec.nsid = cmd->nsid;
+	e->rec.cdw10 = cmd->cdw10;
+	e->rec.cdw11 = cmd->cdw11;
+	e->rec.cdw14 = cmd->cdw14;
+	e->rec.data_len = cmd->data_len;
+	e->rec.result = cmd->result;
+	memcpy(e + 1, (void *)(uintptr_t)cmd->addr, cmd->data_len);
+	e->data = e + 1;
+
+	cmd_cache_insert(e);
+}
+
+unsigned long nvme_cmd_cache_hits(void)
+{
+	unsigned long hits;
+
+	pthread_mutex_lock(&cache.lock);
+	hits = cache.hits;
+	pthread_mutex_unlock(&cache.lock);
+
+	return hits;
+}
+
+/*
+ * Writes all memoized commands to f, each record followed by its data padded
+ * to 8 bytes. Returns 0 or a negative errno.
+ */
+int nvme_cmd_cache_save(FILE *f)
+{
+	static const char pad[8];
+	struct cmd_cache_entry *e;
+	int i, err = 0;
+
+	pthread_mutex_lock(&cache.lock);
+	for (i = 0; i < CMD_CACHE_BUCKETS && !err; i++) {
+		for (e = cache.buckets[i]; e && !err; e = e->next) {
+			if (fwrite(&e->rec, sizeof(e->rec), 1, f) != 1 ||
+			    fwrite(e->data, 1, e->rec.data_len, f) != e->rec.data_len ||
+			    fwrite(pad, 1, CMD_CACHE_ALIGN(e->rec.data_len) - e->rec.data_len, f) !=
+			    CMD_CACHE_ALIGN(e->rec.data_len) - e->rec.data_len)
+				err = -EIO;
+		}
+	}
+	pthread_mutex_unlock(&cache.lock);
+
+	return err;
+}
+
+/*
+ * Adds the records written by nvme_cmd_cache_save() to the memo. The data is
+ * not copied, buf has to stay valid until the memo is disabled. Returns 0 or
+ * -EINVAL if buf is malformed, in which case some records may have been added.
+ */
+int nvme_cmd_cache_load(const void *buf, size_t len)
+{
+	const unsigned char *p = buf, *end = p + len;
+	struct cmd_cache_entry *e;
+
+	while (p < end) {
+		if (end - p < sizeof(e->rec))
+			return -EINVAL;
+
+		e = malloc(sizeof(*e));
+		if (!e)
+			return -ENOMEM;
+
+		memcpy(&e->rec, p, sizeof(e->rec));
+		p += sizeof(e->rec);
+		if (end - p < CMD_CACHE_ALIGN(e->rec.data_len)) {
+			free(e);
+			return -EINVAL;
+		}
+		e->data = p;
+		p += CMD_CACHE_ALIGN(e->rec.data_len);
+
+		cmd_cache_insert(e);
+	}
+
+	return 0;
+}
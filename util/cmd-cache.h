@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef CMD_CACHE_H_
+#define CMD_CACHE_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <libnvme.h>
+
+/*
+ * Memo of identify command responses, keyed by device and command.
+ *
+ * While enabled, successful identify commands submitted through
+ * nvme_submit_passthru() are recorded and repeated ones are answered from
+ * the memo. This lets identify data be prefetched concurrently, or loaded
+ * from a snapshot, before libnvme issues the same commands one after
+ * another, e.g. while scanning the topology. Only enable it for such short
+ * windows. Identify Namespace data holds the utilization, which any write
+ * changes, holders of the memo across commands drop it after each command
+ * with nvme_cmd_cache_forget_usage().
+ *
+ * Other memos of device data check nvme_cmd_cache_generation(), which
+ * changes whenever an admin command may have changed identify data. Admin
+ * commands which may have changed the namespaces or controllers are also
+ * counted in NVME_CMD_CACHE_STAMP, for memos kept by other processes, see
+ * nvme_cmd_cache_changes().
+ */
+
+#define NVME_CMD_CACHE_STAMP	RUNDIR "/nvme/changed"
+
+/* Saved form of a memoized command, followed by its data */
+struct nvme_cmd_cache_record {
+	__u64	rdev;
+	__u32	nsid;
+	__u32	cdw10;
+	__u32	cdw11;
+	__u32	cdw14;
+	__u32	data_len;
+	__u32	result;
+};
+
+void nvme_cmd_cache_enable(void);
+void nvme_cmd_cache_disable(void);
+bool nvme_cmd_cache_enabled(void);
+void nvme_cmd_cache_invalidate(unsigned long ioctl_cmd, __u8 opcode);
+void nvme_cmd_cache_forget_usage(void);
+unsigned long nvme_cmd_cache_generation(void);
+__u64 nvme_cmd_cache_changes(void);
+bool nvme_cmd_cache_lookup(int fd, unsigned long ioctl_cmd,
+			   struct nvme_passthru_cmd *cmd);
+void nvme_cmd_cache_store(int fd, unsigned long ioctl_cmd,
+			  struct nvme_passthru_cmd *cmd);
+unsigned long nvme_cmd_cache_hits(void);
+int nvme_cmd_cache_save(FILE *f);
+int nvme_cmd_cache_load(const void *buf, size_t len);
+
+#endif /* CMD_CACHE_H_ */
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "cmdline.h"
+
+static bool cmdline_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+int cmdline_split(char *line, char **argv, int max)
+{
+	char *in = line, *out;
+	char quote;
+	int argc = 0;
+
+	while (true) {
+		while (cmdline_blank(*in))
+			in++;
+		if (!*in || *in == '#')
+			break;
+
+		if (argc == max)
+			return -E2BIG;
+
+		/* arguments only shrink, so they are copied down in place */
+		argv[argc++] = out = in;
+		quote = '\0';
+		while (*in && (quote || !cmdline_blank(*in))) {
+			if (quote == '\'') {
+				if (*in == '\'')
+					quote = '\0';
+				else
+					*out++ = *in;
+			} else if (*in == '\\' && in[1] &&
+				   (!quote || in[1] == '"' || in[1] == '\\')) {
+				*out++ = *++in;
+			} else if (*in == '"' || (!quote && *in == '\'')) {
+				quote = quote ? '\0' : *in;
+			} else {
+				*out++ = *in;
+			}
+			in++;
+		}
+		if (quote)
+			return -EINVAL;
+
+		/* the terminator may overwrite the blank which ended the argument */
+		if (*in)
+			in++;
+		*out = '\0';
+	}
+
+	argv[argc] = NULL;
+
+	return argc;
+}
@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef CMDLINE_H_
+#define CMDLINE_H_
+
+/*
+ * Splits a command line into arguments in place, the way a shell would
+ * without expansions: blanks separate the arguments, single quotes keep
+ * everything up to the next single quote, double quotes and a backslash
+ * outside quotes escape the next character, and an unquoted '#' at the
+ * start of an argument starts a comment.
+ *
+ * Returns the number of arguments, -EINVAL for an unterminated quote or
+ * -E2BIG if there are more than max arguments. argv[argc] is set to NULL,
+ * so argv must have room for max + 1 pointers.
+ */
+int cmdline_split(char *line, char **argv, int max);
+
+#endif /* CMDLINE_H_ */
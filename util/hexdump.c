@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <assert.h>
+#include <string.h>
+
+#include "hexdump.h"
+
+#define HEXDUMP_MAX_WIDTH	32
+
+/* the column header is the same for all widths */
+static const char hexdump_header[] =
+	"       0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f";
+
+/* At least four digits, as "%04x" would print */
+static char *hexdump_offset(char *p, unsigned int offset)
+{
+	int n = 4;
+
+	while (n < 8 && offset >> (n * 4))
+		n++;
+	while (n--)
+		*p++ = "0123456789abcdef"[(offset >> (n * 4)) & 0xf];
+
+	return p;
+}
+
+void util_hexdump(FILE *f, const unsigned char *buf, int len, int width, int group)
+{
+	/* offset, separators, digits, padding and characters of a row */
+	char line[16 + HEXDUMP_MAX_WIDTH * 7];
+	int row, n, i, b, pad;
+	char *p;
+
+	assert(width <= HEXDUMP_MAX_WIDTH);
+
+	fputs(hexdump_header, f);
+
+	for (row = 0; row < len; row += width) {
+		n = len - row < width ? len - row : width;
+
+		p = line;
+		*p++ = '\n';
+		p = hexdump_offset(p, row);
+		*p++ = ':';
+
+		for (i = row; i < row + n; i++) {
+			if (!(i % group))
+				*p++ = ' ';
+			p = util_hex_byte(p, buf[i], false);
+		}
+
+		/* line up the characters of a short last row */
+		if (n < width) {
+			b = width - n;
+			pad = 2 * b + b / group + (b % group ? 1 : 0);
+			*p++ = ' ';
+			memset(p, ' ', pad);
+			p += pad;
+		}
+
+		*p++ = ' ';
+		*p++ = '"';
+		for (i = row; i < row + n; i++)
+			*p++ = (buf[i] >= '!' && buf[i] <= '~') ? buf[i] : '.';
+		*p++ = '"';
+
+		fwrite(line, 1, p - line, f);
+	}
+
+	fputc('\n', f);
+}
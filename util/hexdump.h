@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef HEXDUMP_H_
+#define HEXDUMP_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Hex dumps are formatted a row at a time into a line buffer, with the
+ * digits looked up in a table, and written out with a single call per row.
+ */
+
+/* Formats a byte as two hex digits, returns the position after them */
+static inline char *util_hex_byte(char *out, unsigned char c, bool upper)
+{
+	const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+
+	out[0] = digits[c >> 4];
+	out[1] = digits[c & 0xf];
+
+	return out + 2;
+}
+
+/*
+ * Dumps len bytes in rows of width bytes, at most 32, with a space in front
+ * of every group of bytes and the printable characters at the end of each
+ * row. This is the layout of d().
+ */
+void util_hexdump(FILE *f, const unsigned char *buf, int len, int width, int group);
+
+#endif /* HEXDUMP_H_ */
@@ -0,0 +1,520 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "json-stream.h"
+
+/* the buffer is written out once it holds this much */
+#define JSON_STREAM_FLUSH	0x10000
+
+/* CBOR major types and simple values */
+#define CBOR_UINT		0x00
+#define CBOR_NEGINT		0x20
+#define CBOR_TEXT		0x60
+#define CBOR_ARRAY		0x80
+#define CBOR_MAP		0xa0
+#define CBOR_INDEFINITE		0x1f
+#define CBOR_FALSE		0xf4
+#define CBOR_TRUE		0xf5
+#define CBOR_NULL		0xf6
+#define CBOR_FLOAT64		0xfb
+#define CBOR_BREAK		0xff
+
+struct json_stream {
+	FILE *f;
+	bool pretty;
+	bool cbor;
+	char *buf;
+	size_t len;
+	size_t alloc;
+	int depth;
+	bool had_children[JSON_STREAM_MAX_DEPTH + 1];
+	bool in_object[JSON_STREAM_MAX_DEPTH + 1];
+	int err;		/* first error, negative errno */
+};
+
+static char *json_stream_reserve(struct json_stream *s, size_t len)
+{
+	size_t alloc;
+	char *buf;
+
+	if (s->err)
+		return NULL;
+
+	if (s->len + len > s->alloc) {
+		alloc = s->alloc;
+		while (alloc < s->len + len)
+			alloc *= 2;
+		buf = realloc(s->buf, alloc);
+		if (!buf) {
+			s->err = -ENOMEM;
+			return NULL;
+		}
+		s->buf = buf;
+		s->alloc = alloc;
+	}
+
+	return s->buf + s->len;
+}
+
+static void json_stream_append(struct json_stream *s, const void *p, size_t len)
+{
+	char *dst = json_stream_reserve(s, len);
+
+	if (!dst)
+		return;
+
+	memcpy(dst, p, len);
+	s->len += len;
+}
+
+static void json_stream_puts(struct json_stream *s, const char *p)
+{
+	json_stream_append(s, p, strlen(p));
+}
+
+static void json_stream_byte(struct json_stream *s, uint8_t b)
+{
+	json_stream_append(s, &b, 1);
+}
+
+/* Encodes a CBOR head, the major type with its argument in network order */
+static void cbor_head(struct json_stream *s, uint8_t major, uint64_t v)
+{
+	uint8_t head[9];
+	int i, len;
+
+	if (v < 24) {
+		json_stream_byte(s, major | v);
+		return;
+	}
+
+	if (v <= UINT8_MAX) {
+		head[0] = major | 24;
+		len = 1;
+	} else if (v <= UINT16_MAX) {
+		head[0] = major | 25;
+		len = 2;
+	} else if (v <= UINT32_MAX) {
+		head[0] = major | 26;
+		len = 4;
+	} else {
+		head[0] = major | 27;
+		len = 8;
+	}
+
+	for (i = len; i > 0; i--) {
+		head[i] = v & 0xff;
+		v >>= 8;
+	}
+
+	json_stream_append(s, head, len + 1);
+}
+
+static void cbor_text(struct json_stream *s, const char *str)
+{
+	size_t len = strlen(str);
+
+	cbor_head(s, CBOR_TEXT, len);
+	json_stream_append(s, str, len);
+}
+
+static void json_stream_indent(struct json_stream *s, int level)
+{
+	char *dst;
+
+	if (!s->pretty)
+		return;
+
+	dst = json_stream_reserve(s, level * 2);
+	if (!dst)
+		return;
+
+	memset(dst, ' ', level * 2);
+	s->len += level * 2;
+}
+
+static void json_stream_escape(struct json_stream *s, const char *str)
+{
+	static const char hex[] = "0123456789abcdef";
+	const char *start = str;
+	char esc[7];
+	unsigned char c;
+
+	if (s->cbor) {
+		cbor_text(s, str);
+		return;
+	}
+
+	json_stream_append(s, "\"", 1);
+	for (; (c = *str); str++) {
+		switch (c) {
+		case '"':
+		case '\\':
+			esc[0] = '\\';
+			esc[1] = c;
+			esc[2] = '\0';
+			break;
+		case '\b':
+			strcpy(esc, "\\b");
+			break;
+		case '\f':
+			strcpy(esc, "\\f");
+			break;
+		case '\n':
+			strcpy(esc, "\\n");
+			break;
+		case '\r':
+			strcpy(esc, "\\r");
+			break;
+		case '\t':
+			strcpy(esc, "\\t");
+			break;
+		default:
+			if (c >= ' ')
+				continue;
+			strcpy(esc, "\\u00");
+			esc[4] = hex[c >> 4];
+			esc[5] = hex[c & 0xf];
+			esc[6] = '\0';
+			break;
+		}
+		json_stream_append(s, start, str - start);
+		json_stream_puts(s, esc);
+		start = str + 1;
+	}
+	json_stream_append(s, start, str - start);
+	json_stream_append(s, "\"", 1);
+}
+
+/* Writes the separator, indentation and key that precede a new value */
+static void json_stream_value_prefix(struct json_stream *s, const char *k)
+{
+	if (!s->depth)
+		return;
+
+	if (s->cbor) {
+		if (s->in_object[s->depth])
+			cbor_text(s, k ? k : "");
+		return;
+	}
+
+	if (s->had_children[s->depth]) {
+		json_stream_append(s, ",", 1);
+		if (s->pretty)
+			json_stream_append(s, "\n", 1);
+	}
+	s->had_children[s->depth] = true;
+	json_stream_indent(s, s->depth);
+
+	if (s->in_object[s->depth]) {
+		json_stream_escape(s, k ? k : "");
+		json_stream_append(s, ":", 1);
+	}
+}
+
+/*
+ * Terminates top level text values with a newline, so a sequence of them
+ * forms newline delimited JSON, and writes out the buffer once it has
+ * filled up.
+ */
+static void json_stream_value_done(struct json_stream *s)
+{
+	if (!s->depth && !s->cbor)
+		json_stream_append(s, "\n", 1);
+	if (s->len >= JSON_STREAM_FLUSH)
+		json_stream_flush(s);
+}
+
+static void json_stream_begin(struct json_stream *s, const char *k, bool object)
+{
+	if (s->depth >= JSON_STREAM_MAX_DEPTH) {
+		s->err = -E2BIG;
+		return;
+	}
+
+	json_stream_value_prefix(s, k);
+	if (s->cbor) {
+		json_stream_byte(s, (object ? CBOR_MAP : CBOR_ARRAY) | CBOR_INDEFINITE);
+	} else {
+		json_stream_append(s, object ? "{" : "[", 1);
+		if (s->pretty)
+			json_stream_append(s, "\n", 1);
+	}
+
+	s->depth++;
+	s->had_children[s->depth] = false;
+	s->in_object[s->depth] = object;
+}
+
+static void json_stream_end(struct json_stream *s, bool object)
+{
+	if (!s->depth || s->in_object[s->depth] != object) {
+		s->err = -EINVAL;
+		return;
+	}
+
+	if (s->cbor) {
+		s->depth--;
+		json_stream_byte(s, CBOR_BREAK);
+		json_stream_value_done(s);
+		return;
+	}
+
+	if (s->pretty && s->had_children[s->depth])
+		json_stream_append(s, "\n", 1);
+	s->depth--;
+	json_stream_indent(s, s->depth);
+	json_stream_append(s, object ? "}" : "]", 1);
+
+	json_stream_value_done(s);
+}
+
+struct json_stream *json_stream_open(FILE *f, enum json_stream_format format)
+{
+	struct json_stream *s = calloc(1, sizeof(*s));
+
+	if (!s)
+		return NULL;
+
+	s->alloc = JSON_STREAM_FLUSH;
+	s->buf = malloc(s->alloc);
+	if (!s->buf) {
+		free(s);
+		return NULL;
+	}
+
+	s->f = f;
+	s->pretty = format == JSON_STREAM_PRETTY;
+	s->cbor = format == JSON_STREAM_CBOR;
+
+	return s;
+}
+
+/*
+ * Writes out the buffered output. Returns the first error encountered while
+ * emitting or writing, or 0.
+ */
+int json_stream_flush(struct json_stream *s)
+{
+	if (!s->err && s->len) {
+		if (fwrite(s->buf, 1, s->len, s->f) != s->len || fflush(s->f))
+			s->err = -EIO;
+	}
+	s->len = 0;
+
+	return s->err;
+}
+
+/*
+ * Closes any objects and arrays left open, writes out the remaining output
+ * and frees the stream. Returns the first error encountered, or 0.
+ */
+int json_stream_close(struct json_stream *s)
+{
+	int err;
+
+	if (!s)
+		return 0;
+
+	while (s->depth && !s->err)
+		json_stream_end(s, s->in_object[s->depth]);
+
+	err = json_stream_flush(s);
+	free(s->buf);
+	free(s);
+
+	return err;
+}
+
+void json_stream_begin_object(struct json_stream *s, const char *k)
+{
+	json_stream_begin(s, k, true);
+}
+
+void json_stream_end_object(struct json_stream *s)
+{
+	json_stream_end(s, true);
+}
+
+void json_stream_begin_array(struct json_stream *s, const char *k)
+{
+	json_stream_begin(s, k, false);
+}
+
+void json_stream_end_array(struct json_stream *s)
+{
+	json_stream_end(s, false);
+}
+
+void json_stream_add_str(struct json_stream *s, const char *k, const char *v)
+{
+	if (!v) {
+		json_stream_add_null(s, k);
+		return;
+	}
+
+	json_stream_value_prefix(s, k);
+	json_stream_escape(s, v);
+	json_stream_value_done(s);
+}
+
+void json_stream_add_int(struct json_stream *s, const char *k, int64_t v)
+{
+	char str[32];
+
+	if (v >= 0) {
+		json_stream_add_uint(s, k, v);
+		return;
+	}
+
+	json_stream_value_prefix(s, k);
+	if (s->cbor) {
+		/* the argument of a negative integer is -1 - v */
+		cbor_head(s, CBOR_NEGINT, ~(uint64_t)v);
+	} else {
+		sprintf(str, "%" PRId64, v);
+		json_stream_puts(s, str);
+	}
+	json_stream_value_done(s);
+}
+
+void json_stream_add_uint(struct json_stream *s, const char *k, uint64_t v)
+{
+	char str[32];
+
+	json_stream_value_prefix(s, k);
+	if (s->cbor) {
+		cbor_head(s, CBOR_UINT, v);
+	} else {
+		sprintf(str, "%" PRIu64, v);
+		json_stream_puts(s, str);
+	}
+	json_stream_value_done(s);
+}
+
+void json_stream_add_bool(struct json_stream *s, const char *k, bool v)
+{
+	json_stream_value_prefix(s, k);
+	if (s->cbor)
+		json_stream_byte(s, v ? CBOR_TRUE : CBOR_FALSE);
+	else
+		json_stream_puts(s, v ? "true" : "false");
+	json_stream_value_done(s);
+}
+
+void json_stream_add_double(struct json_stream *s, const char *k, double v)
+{
+	char str[32];
+	uint64_t bits;
+	int i;
+
+	json_stream_value_prefix(s, k);
+	if (s->cbor) {
+		memcpy(&bits, &v, sizeof(bits));
+		json_stream_byte(s, CBOR_FLOAT64);
+		/* the float argument is always 8 bytes, unlike integers */
+		for (i = 56; i >= 0; i -= 8)
+			json_stream_byte(s, bits >> i);
+	} else {
+		snprintf(str, sizeof(str), "%.17g", v);
+		json_stream_puts(s, str);
+	}
+	json_stream_value_done(s);
+}
+
+void json_stream_add_null(struct json_stream *s, const char *k)
+{
+	json_stream_value_prefix(s, k);
+	if (s->cbor)
+		json_stream_byte(s, CBOR_NULL);
+	else
+		json_stream_puts(s, "null");
+	json_stream_value_done(s);
+}
+
+#ifdef CONFIG_JSONC
+/* Walks a json-c value and encodes it item by item */
+static void json_stream_add_cbor(struct json_stream *s, const char *k, struct json_object *o)
+{
+	size_t i;
+
+	switch (json_object_get_type(o)) {
+	case json_type_null:
+		json_stream_add_null(s, k);
+		break;
+	case json_type_boolean:
+		json_stream_add_bool(s, k, json_object_get_boolean(o));
+		break;
+	case json_type_double:
+		json_stream_add_double(s, k, json_object_get_double(o));
+		break;
+	case json_type_int:
+#ifdef CONFIG_JSONC_14
+		if (json_object_get_int64(o) >= 0) {
+			json_stream_add_uint(s, k, json_object_get_uint64(o));
+			break;
+		}
+#endif
+		json_stream_add_int(s, k, json_object_get_int64(o));
+		break;
+	case json_type_string:
+		json_stream_add_str(s, k, json_object_get_string(o));
+		break;
+	case json_type_object:
+		json_stream_begin_object(s, k);
+		json_stream_add_members(s, o);
+		json_stream_end_object(s);
+		break;
+	case json_type_array:
+		json_stream_begin_array(s, k);
+		for (i = 0; i < json_object_array_length(o); i++)
+			json_stream_add_cbor(s, NULL, json_object_array_get_idx(o, i));
+		json_stream_end_array(s);
+		break;
+	}
+}
+
+void json_stream_add_object(struct json_stream *s, const char *k, struct json_object *o)
+{
+	int flags = JSON_C_TO_STRING_NOSLASHESCAPE;
+	const char *str, *nl;
+
+	if (s->cbor) {
+		json_stream_add_cbor(s, k, o);
+		return;
+	}
+
+	flags |= s->pretty ? JSON_C_TO_STRING_PRETTY : JSON_C_TO_STRING_PLAIN;
+	str = o ? json_object_to_json_string_ext(o, flags) : "null";
+	if (!str) {
+		s->err = -ENOMEM;
+		return;
+	}
+
+	json_stream_value_prefix(s, k);
+
+	/*
+	 * json-c serializes the value as if it was at the top level. The only
+	 * raw newlines in pretty output are line breaks, indent the lines
+	 * following them by the current depth.
+	 */
+	while (s->pretty && (nl = strchr(str, '\n'))) {
+		json_stream_append(s, str, nl + 1 - str);
+		json_stream_indent(s, s->depth);
+		str = nl + 1;
+	}
+	json_stream_puts(s, str);
+
+	json_stream_value_done(s);
+}
+
+void json_stream_add_members(struct json_stream *s, struct json_object *o)
+{
+	json_object_object_foreach(o, key, val)
+		json_stream_add_object(s, key, val);
+}
+#endif /* CONFIG_JSONC */
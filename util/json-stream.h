@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef JSON_STREAM_H_
+#define JSON_STREAM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Streaming JSON emitter.
+ *
+ * Values are formatted into an output buffer as they are added and the
+ * buffer is written out whenever it fills up, so memory use does not depend
+ * on the number of entries and output starts right away. The text layouts
+ * match json-c's JSON_C_TO_STRING_PRETTY and JSON_C_TO_STRING_PLAIN
+ * serializers. Top level values are terminated by a newline.
+ *
+ * The same data model can be encoded as CBOR (RFC 8949) instead. Objects
+ * and arrays use indefinite lengths so that they can be streamed, top level
+ * values form a CBOR sequence.
+ *
+ * Keys are ignored for values added to an array or at the top level.
+ */
+struct json_stream;
+struct json_object;
+
+enum json_stream_format {
+	JSON_STREAM_PRETTY,
+	JSON_STREAM_PLAIN,
+	JSON_STREAM_CBOR,
+};
+
+/* Nesting depth supported by the emitter */
+#define JSON_STREAM_MAX_DEPTH	64
+
+struct json_stream *json_stream_open(FILE *f, enum json_stream_format format);
+int json_stream_close(struct json_stream *s);
+int json_stream_flush(struct json_stream *s);
+
+void json_stream_begin_object(struct json_stream *s, const char *k);
+void json_stream_end_object(struct json_stream *s);
+void json_stream_begin_array(struct json_stream *s, const char *k);
+void json_stream_end_array(struct json_stream *s);
+
+void json_stream_add_str(struct json_stream *s, const char *k, const char *v);
+void json_stream_add_int(struct json_stream *s, const char *k, int64_t v);
+void json_stream_add_uint(struct json_stream *s, const char *k, uint64_t v);
+void json_stream_add_bool(struct json_stream *s, const char *k, bool v);
+void json_stream_add_double(struct json_stream *s, const char *k, double v);
+void json_stream_add_null(struct json_stream *s, const char *k);
+
+#ifdef CONFIG_JSONC
+/* Emits a json-c value, e.g. one entry built with the regular helpers */
+void json_stream_add_object(struct json_stream *s, const char *k, struct json_object *o);
+/* Emits the members of a json-c object into the current object */
+void json_stream_add_members(struct json_stream *s, struct json_object *o);
+#endif
+
+#endif /* JSON_STREAM_H_ */
@@ -1,10 +1,51 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #include <stdio.h>
 #include <errno.h>
+#include <string.h>
 
 #include "json.h"
 #include "types.h"
 
+static enum json_stream_format print_format = JSON_STREAM_PRETTY;
+
+void util_json_set_print_format(enum json_stream_format format)
+{
+	print_format = format;
+}
+
+void util_json_print_object(struct json_object *o)
+{
+	int flags = JSON_C_TO_STRING_NOSLASHESCAPE;
+	struct json_stream *s;
+
+	if (print_format == JSON_STREAM_CBOR) {
+		s = json_stream_open(stdout, JSON_STREAM_CBOR);
+		if (!s) {
+			fprintf(stderr, "Failed to allocate CBOR output: %s\n", strerror(ENOMEM));
+			return;
+		}
+		json_stream_add_object(s, NULL, o);
+		json_stream_close(s);
+		return;
+	}
+
+	/* ndjson: every document is one compact line */
+	if (print_format == JSON_STREAM_PLAIN)
+		flags |= JSON_C_TO_STRING_PLAIN;
+	else
+		flags |= JSON_C_TO_STRING_PRETTY;
+
+	printf("%s", json_object_to_json_string_ext(o, flags));
+}
+
+/* A newline would be a stray byte in a sequence of CBOR items */
+void util_json_print_line(struct json_object *o)
+{
+	util_json_print_object(o);
+	if (print_format != JSON_STREAM_CBOR)
+		printf("\n");
+}
+
 struct json_object *util_json_object_new_double(long double d)
 {
 	struct json_object *obj;
@@ -4,6 +4,7 @@
 
 #ifdef CONFIG_JSONC
 #include <json.h>
+#include "util/json-stream.h"
 #include "util/types.h"
 
 /* Wrappers around json-c's API */
@@ -40,10 +41,15 @@ static inline int json_object_add_value_string(struct json_object *o, const char
 static inline int json_array_add_value_string(struct json_object *o, const char *v) {
 	return json_object_array_add(o, v ? json_object_new_string(v) : NULL);
 }
-#define json_print_object(o, u)						\
-	printf("%s", json_object_to_json_string_ext(o,			\
-		JSON_C_TO_STRING_PRETTY |				\
-		JSON_C_TO_STRING_NOSLASHESCAPE))
+
+/* Prints o in the encoding selected by validate_output_format() */
+#define json_print_object(o, u) util_json_print_object(o)
+/* As json_print_object(), followed by a newline unless it is CBOR */
+#define json_print_line(o) util_json_print_line(o)
+
+void util_json_set_print_format(enum json_stream_format format);
+void util_json_print_object(struct json_object *o);
+void util_json_print_line(struct json_object *o);
 
 struct json_object *util_json_object_new_double(long double d);
 struct json_object *util_json_object_new_uint64(uint64_t i);
@@ -2,6 +2,7 @@
 
 #include <inttypes.h>
 
+#include <pthread.h>
 #include <stdint.h>
 #include <sys/ioctl.h>
 #include <sys/syslog.h>
@@ -10,10 +11,14 @@
 
 #include <libnvme.h>
 
+#include "cmd-cache.h"
 #include "logging.h"
 
 int log_level;
 
+static struct nvme_ioctl_stats ioctl_stats;
+static pthread_mutex_t ioctl_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
 int map_log_level(int verbose, bool quiet)
 {
 	int log_level;
@@ -81,8 +86,23 @@ static void nvme_show_command64(struct nvme_passthru_cmd64 *cmd, int err)
 
 static void nvme_show_latency(struct timeval start, struct timeval end)
 {
-	printf("latency      : %lu us\n",
-	       (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec));
+	unsigned long usecs;
+
+	usecs = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+	printf("latency      : %lu us\n", usecs);
+
+	pthread_mutex_lock(&ioctl_stats_lock);
+	ioctl_stats.nr++;
+	ioctl_stats.usecs += usecs;
+	pthread_mutex_unlock(&ioctl_stats_lock);
+}
+
+/* Totals of the commands timed so far, only collected from LOG_INFO on */
+void nvme_ioctl_stats_get(struct nvme_ioctl_stats *stats)
+{
+	pthread_mutex_lock(&ioctl_stats_lock);
+	*stats = ioctl_stats;
+	pthread_mutex_unlock(&ioctl_stats_lock);
 }
 
 int nvme_submit_passthru(int fd, unsigned long ioctl_cmd,
@@ -92,6 +112,12 @@ int nvme_submit_passthru(int fd, unsigned long ioctl_cmd,
 	struct timeval end;
 	int err;
 
+	if (nvme_cmd_cache_lookup(fd, ioctl_cmd, cmd)) {
+		if (result)
+			*result = cmd->result;
+		return 0;
+	}
+
 	if (log_level >= LOG_INFO)
 		gettimeofday(&start, NULL);
 
@@ -104,6 +130,10 @@ int nvme_submit_passthru(int fd, unsigned long ioctl_cmd,
 		nvme_show_latency(start, end);
 	}
 
+	nvme_cmd_cache_invalidate(ioctl_cmd, cmd->opcode);
+	if (!err)
+		nvme_cmd_cache_store(fd, ioctl_cmd, cmd);
+
 	if (err >= 0 && result)
 		*result = cmd->result;
 
@@ -131,6 +161,8 @@ int nvme_submit_passthru64(int fd, unsigned long ioctl_cmd,
 		nvme_show_latency(start, end);
 	}
 
+	nvme_cmd_cache_invalidate(ioctl_cmd, cmd->opcode);
+
 	if (err >= 0 && result)
 		*result = cmd->result;
 
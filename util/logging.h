@@ -7,6 +7,12 @@
 
 extern int log_level;
 
+struct nvme_ioctl_stats {
+	unsigned long nr;
+	unsigned long long usecs;
+};
+
 int map_log_level(int verbose, bool quiet);
+void nvme_ioctl_stats_get(struct nvme_ioctl_stats *stats);
 
 #endif // DEBUG_H_
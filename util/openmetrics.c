@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <inttypes.h>
+#include <string.h>
+
+#include "openmetrics.h"
+#include "types.h"
+
+static const char * const om_type_names[] = {
+	[OM_GAUGE]	= "gauge",
+	[OM_COUNTER]	= "counter",
+	[OM_INFO]	= "info",
+};
+
+static const char * const om_type_suffixes[] = {
+	[OM_GAUGE]	= "",
+	[OM_COUNTER]	= "_total",
+	[OM_INFO]	= "_info",
+};
+
+/*
+ * Appends a label to a label set of at most OM_LABELS_MAX bytes. The value
+ * is at most len bytes long, trailing blanks as in the space padded strings
+ * of the identify data are dropped. Values which do not fit are truncated.
+ */
+void om_add_label(char *labels, const char *name, const char *value, size_t len)
+{
+	size_t n = strlen(labels);
+	const char *esc;
+	size_t i;
+	char c[2];
+
+	len = strnlen(value, len);
+	while (len && value[len - 1] == ' ')
+		len--;
+
+	/* separator, name, '="', closing quote and terminator */
+	if (n + strlen(name) + 5 > OM_LABELS_MAX)
+		return;
+	n += sprintf(labels + n, "%s%s=\"", n ? "," : "", name);
+
+	for (i = 0; i < len; i++) {
+		switch (value[i]) {
+		case '\\':
+			esc = "\\\\";
+			break;
+		case '"':
+			esc = "\\\"";
+			break;
+		case '\n':
+			esc = "\\n";
+			break;
+		default:
+			c[0] = value[i];
+			c[1] = '\0';
+			esc = c;
+			break;
+		}
+		if (n + strlen(esc) + 2 > OM_LABELS_MAX)
+			break;
+		n += sprintf(labels + n, "%s", esc);
+	}
+
+	sprintf(labels + n, "\"");
+}
+
+void om_family(FILE *f, const char *name, enum om_type type, const char *help)
+{
+	fprintf(f, "# TYPE %s %s\n", name, om_type_names[type]);
+	fprintf(f, "# HELP %s %s\n", name, help);
+}
+
+void om_sample(FILE *f, const char *name, enum om_type type, const char *labels,
+	       const char *value)
+{
+	if (labels && *labels)
+		fprintf(f, "%s%s{%s} %s\n", name, om_type_suffixes[type], labels, value);
+	else
+		fprintf(f, "%s%s %s\n", name, om_type_suffixes[type], value);
+}
+
+/* Formats a little endian value, returns false if it is zero */
+static bool om_value(char *str, const __u8 *p, unsigned int size)
+{
+	uint64_t v = 0;
+	int i;
+
+	if (size == 16) {
+		nvme_uint128_t u = le128_to_cpu((__u8 *)p);
+
+		strcpy(str, uint128_t_to_string(u));
+		return u.words[0] || u.words[1] || u.words[2] || u.words[3];
+	}
+
+	for (i = size - 1; i >= 0; i--)
+		v = v << 8 | p[i];
+	sprintf(str, "%" PRIu64, v);
+
+	return v;
+}
+
+static void om_field(FILE *f, const struct om_field *field, const struct om_source *src)
+{
+	const __u8 *p = (const __u8 *)src->log + field->offset;
+	char labels[OM_LABELS_MAX];
+	char value[64];
+	char index[16];
+	int i;
+
+	if (field->nr <= 1) {
+		om_value(value, p, field->size);
+		om_sample(f, field->name, field->type, src->labels, value);
+		return;
+	}
+
+	/* array entries which are zero are not implemented */
+	for (i = 0; i < field->nr; i++, p += field->size) {
+		if (!om_value(value, p, field->size))
+			continue;
+
+		strcpy(labels, src->labels);
+		sprintf(index, "%d", i + 1);
+		om_add_label(labels, field->index, index, sizeof(index));
+		om_sample(f, field->name, field->type, labels, value);
+	}
+}
+
+void om_fields(FILE *f, const struct om_field *fields, int nr_fields,
+	       const struct om_source *src, int nr_src)
+{
+	int i, j;
+
+	for (i = 0; i < nr_fields; i++) {
+		for (j = 0; j < nr_src; j++) {
+			if (src[j].log)
+				break;
+		}
+		if (j == nr_src)
+			return;
+
+		om_family(f, fields[i].name, fields[i].type, fields[i].help);
+		for (j = 0; j < nr_src; j++) {
+			if (src[j].log)
+				om_field(f, &fields[i], &src[j]);
+		}
+	}
+}
+
+void om_eof(FILE *f)
+{
+	fprintf(f, "# EOF\n");
+}
@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef OPENMETRICS_H_
+#define OPENMETRICS_H_
+
+#include <stdio.h>
+
+/*
+ * OpenMetrics text exposition, the format Prometheus scrapes.
+ *
+ * Log pages are described by tables of little endian fields. Every metric
+ * family is printed once with the samples of all sources below it, so one
+ * exposition can cover many devices. Sources are told apart by their label
+ * sets. The exposition has to be terminated by om_eof().
+ */
+
+/* Room for the device, serial, model and a few small labels */
+#define OM_LABELS_MAX		256
+
+enum om_type {
+	OM_GAUGE,
+	OM_COUNTER,	/* samples get the _total suffix */
+	OM_INFO,	/* samples get the _info suffix, the value is 1 */
+};
+
+struct om_field {
+	const char *name;
+	enum om_type type;
+	const char *help;
+	unsigned int offset;	/* in the log page */
+	unsigned int size;	/* 1 to 8 or 16 bytes */
+	unsigned int nr;	/* > 1 for an array of values, e.g. sensors */
+	const char *index;	/* label of the array index, starting at 1 */
+};
+
+struct om_source {
+	const char *labels;
+	const void *log;	/* NULL if the source has no such log */
+	int entries;		/* for logs with a variable number of entries */
+};
+
+void om_add_label(char *labels, const char *name, const char *value, size_t len);
+
+void om_family(FILE *f, const char *name, enum om_type type, const char *help);
+void om_sample(FILE *f, const char *name, enum om_type type, const char *labels,
+	       const char *value);
+void om_fields(FILE *f, const struct om_field *fields, int nr_fields,
+	       const struct om_source *src, int nr_src);
+void om_eof(FILE *f);
+
+#endif /* OPENMETRICS_H_ */
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "parallel.h"
+
+struct parallel_ctx {
+	int nr;
+	int next;		/* next item to hand out */
+	nvme_parallel_fn fn;
+	void *arg;
+	pthread_mutex_t lock;
+};
+
+static void *parallel_worker(void *arg)
+{
+	struct parallel_ctx *ctx = arg;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&ctx->lock);
+		i = ctx->next++;
+		pthread_mutex_unlock(&ctx->lock);
+
+		if (i >= ctx->nr)
+			break;
+		ctx->fn(i, ctx->arg);
+	}
+
+	return NULL;
+}
+
+/*
+ * Calls fn(i, arg) for every i in [0, nr) on at most jobs threads, including
+ * the calling one, and returns when all calls have finished. The order of the
+ * calls is not defined. If no thread can be started the items are processed
+ * by the calling thread alone.
+ */
+void nvme_parallel_for(int nr, int jobs, nvme_parallel_fn fn, void *arg)
+{
+	struct parallel_ctx ctx = {
+		.nr = nr,
+		.fn = fn,
+		.arg = arg,
+	};
+	pthread_t *threads = NULL;
+	int i, started = 0;
+
+	if (jobs > nr)
+		jobs = nr;
+	if (jobs > 1)
+		threads = calloc(jobs - 1, sizeof(*threads));
+
+	pthread_mutex_init(&ctx.lock, NULL);
+
+	for (i = 0; threads && i < jobs - 1; i++) {
+		if (pthread_create(&threads[i], NULL, parallel_worker, &ctx))
+			break;
+		started++;
+	}
+
+	parallel_worker(&ctx);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&ctx.lock);
+	free(threads);
+}
@@ -0,0 +1,13 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+/*
+ * Bounded worker pool for independent, mostly I/O bound work items such as
+ * per device or per namespace commands.
+ */
+typedef void (*nvme_parallel_fn)(int i, void *arg);
+
+void nvme_parallel_for(int nr, int jobs, nvme_parallel_fn fn, void *arg);
+
+#endif /* PARALLEL_H_ */
@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tar.h"
+
+struct tar_header {
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char chksum[8];
+	char typeflag;
+	char linkname[100];
+	char magic[6];
+	char version[2];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char prefix[155];
+	char pad[12];
+};
+
+_Static_assert(sizeof(struct tar_header) == TAR_BLOCK_SIZE, "ustar header size");
+
+/* Paths longer than the name field are split at a '/' into the prefix */
+static int tar_set_path(struct tar_header *h, const char *path)
+{
+	size_t len = strlen(path);
+	const char *p;
+
+	if (len <= sizeof(h->name)) {
+		memcpy(h->name, path, len);
+		return 0;
+	}
+
+	for (p = path + len - sizeof(h->name) - 1; p < path + len; p++) {
+		if (*p == '/' && p > path && (size_t)(p - path) <= sizeof(h->prefix))
+			break;
+	}
+	if (p >= path + len - 1 || (size_t)(p - path) > sizeof(h->prefix))
+		return -ENAMETOOLONG;
+
+	memcpy(h->prefix, path, p - path);
+	memcpy(h->name, p + 1, path + len - p - 1);
+
+	return 0;
+}
+
+static int tar_write(FILE *f, const void *data, size_t len)
+{
+	static const char zero[TAR_BLOCK_SIZE];
+	size_t pad = -len % TAR_BLOCK_SIZE;
+
+	if (len && fwrite(data, 1, len, f) != len)
+		return -EIO;
+	if (pad && fwrite(zero, 1, pad, f) != pad)
+		return -EIO;
+
+	return 0;
+}
+
+int tar_add(FILE *f, const char *path, const void *data, size_t len, time_t mtime)
+{
+	struct tar_header h = { 0 };
+	const unsigned char *p = (const unsigned char *)&h;
+	unsigned int sum = 0;
+	size_t i;
+	int err;
+
+	err = tar_set_path(&h, path);
+	if (err)
+		return err;
+
+	snprintf(h.mode, sizeof(h.mode), "%07o", 0644);
+	snprintf(h.uid, sizeof(h.uid), "%07o", 0);
+	snprintf(h.gid, sizeof(h.gid), "%07o", 0);
+	snprintf(h.size, sizeof(h.size), "%011llo", (unsigned long long)len);
+	snprintf(h.mtime, sizeof(h.mtime), "%011llo", (unsigned long long)mtime);
+	h.typeflag = '0';
+	memcpy(h.magic, "ustar", 6);
+	memcpy(h.version, "00", 2);
+
+	/* the checksum is computed with its own field set to blanks */
+	memset(h.chksum, ' ', sizeof(h.chksum));
+	for (i = 0; i < sizeof(h); i++)
+		sum += p[i];
+	snprintf(h.chksum, sizeof(h.chksum), "%06o", sum);
+	h.chksum[7] = ' ';
+
+	err = tar_write(f, &h, sizeof(h));
+	if (err)
+		return err;
+
+	return tar_write(f, data, len);
+}
+
+int tar_finish(FILE *f)
+{
+	static const char zero[2 * TAR_BLOCK_SIZE];
+
+	if (fwrite(zero, 1, sizeof(zero), f) != sizeof(zero))
+		return -EIO;
+
+	return 0;
+}
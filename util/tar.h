@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef TAR_H_
+#define TAR_H_
+
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+ * Minimal writer of POSIX ustar archives, for bundling files that are
+ * already in memory. Directories are implied by the paths of the files.
+ * An archive has to be terminated by tar_finish().
+ */
+
+#define TAR_BLOCK_SIZE		512
+
+/* Returns 0 or a negative errno, -ENAMETOOLONG if the path does not fit */
+int tar_add(FILE *f, const char *path, const void *data, size_t len, time_t mtime);
+int tar_finish(FILE *f);
+
+#endif /* TAR_H_ */
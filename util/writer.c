@@ -0,0 +1,222 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "mem.h"
+#include "writer.h"
+
+struct nvme_writer {
+	int fd;
+	bool direct;
+	size_t buf_size;
+	void *buf[2];
+	size_t len[2];		/* committed bytes, 0 if the buffer is free */
+	int fill;		/* buffer the producer fills next */
+	int err;		/* first write error, negative errno */
+	bool done;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, p, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (!ret)
+			return -EIO;
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static int write_buf(struct nvme_writer *w, const void *buf, size_t len)
+{
+	int flags;
+
+	/*
+	 * O_DIRECT needs aligned lengths. Callers keep every chunk but the
+	 * final one aligned, so drop O_DIRECT for the remainder of the file
+	 * instead of bouncing the data.
+	 */
+	if (w->direct && (len & (NVME_WRITER_ALIGN - 1))) {
+		flags = fcntl(w->fd, F_GETFL);
+		if (flags < 0 || fcntl(w->fd, F_SETFL, flags & ~O_DIRECT) < 0)
+			return -errno;
+		w->direct = false;
+	}
+
+	return write_all(w->fd, buf, len);
+}
+
+static void *writer_thread(void *arg)
+{
+	struct nvme_writer *w = arg;
+	bool failed;
+	int idx = 0;
+	size_t len;
+	int err;
+
+	pthread_mutex_lock(&w->lock);
+	for (;;) {
+		while (!w->len[idx] && !w->done)
+			pthread_cond_wait(&w->cond, &w->lock);
+		len = w->len[idx];
+		if (!len)
+			break;
+		failed = w->err;
+		pthread_mutex_unlock(&w->lock);
+
+		err = failed ? 0 : write_buf(w, w->buf[idx], len);
+
+		pthread_mutex_lock(&w->lock);
+		if (err && !w->err)
+			w->err = err;
+		w->len[idx] = 0;
+		idx ^= 1;
+		pthread_cond_broadcast(&w->cond);
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	return NULL;
+}
+
+static void writer_free(struct nvme_writer *w)
+{
+	free(w->buf[0]);
+	free(w->buf[1]);
+	free(w);
+}
+
+struct nvme_writer *nvme_writer_open(const char *path, size_t buf_size,
+				     bool direct)
+{
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+	struct nvme_writer *w;
+	int err;
+
+	w = calloc(1, sizeof(*w));
+	if (!w)
+		return NULL;
+
+	w->buf_size = buf_size;
+	w->buf[0] = nvme_alloc(buf_size);
+	w->buf[1] = nvme_alloc(buf_size);
+	if (!w->buf[0] || !w->buf[1]) {
+		writer_free(w);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	w->fd = -1;
+	if (direct) {
+		w->fd = open(path, flags | O_DIRECT, 0666);
+		/* not every filesystem supports O_DIRECT, e.g. tmpfs */
+		w->direct = w->fd >= 0;
+	}
+	if (w->fd < 0)
+		w->fd = open(path, flags, 0666);
+	if (w->fd < 0) {
+		err = errno;
+		writer_free(w);
+		errno = err;
+		return NULL;
+	}
+
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+
+	err = pthread_create(&w->thread, NULL, writer_thread, w);
+	if (err) {
+		pthread_cond_destroy(&w->cond);
+		pthread_mutex_destroy(&w->lock);
+		close(w->fd);
+		writer_free(w);
+		errno = err;
+		return NULL;
+	}
+
+	return w;
+}
+
+/*
+ * Returns the buffer to fill next, waiting for the writer thread to drain
+ * it if it is still in flight. The buffer holds up to buf_size bytes.
+ */
+void *nvme_writer_get_buf(struct nvme_writer *w)
+{
+	void *buf;
+
+	pthread_mutex_lock(&w->lock);
+	while (w->len[w->fill])
+		pthread_cond_wait(&w->cond, &w->lock);
+	buf = w->buf[w->fill];
+	pthread_mutex_unlock(&w->lock);
+
+	return buf;
+}
+
+/*
+ * Queues the first len bytes of the buffer returned by nvme_writer_get_buf()
+ * for writing. Returns the error of an earlier failed write, if any.
+ */
+int nvme_writer_commit(struct nvme_writer *w, size_t len)
+{
+	int err;
+
+	if (len > w->buf_size)
+		return -EINVAL;
+
+	pthread_mutex_lock(&w->lock);
+	err = w->err;
+	if (!err && len) {
+		w->len[w->fill] = len;
+		w->fill ^= 1;
+		pthread_cond_broadcast(&w->cond);
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	return err;
+}
+
+/*
+ * Waits for all committed data to reach the file and closes it. Returns the
+ * first write error encountered, or 0.
+ */
+int nvme_writer_close(struct nvme_writer *w)
+{
+	int err;
+
+	if (!w)
+		return 0;
+
+	pthread_mutex_lock(&w->lock);
+	w->done = true;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+
+	pthread_join(w->thread, NULL);
+
+	err = w->err;
+	if (close(w->fd) < 0 && !err)
+		err = -errno;
+
+	pthread_cond_destroy(&w->cond);
+	pthread_mutex_destroy(&w->lock);
+	writer_free(w);
+
+	return err;
+}
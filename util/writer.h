@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef WRITER_H_
+#define WRITER_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Double-buffered output file writer.
+ *
+ * The producer fills the buffer returned by nvme_writer_get_buf() and hands
+ * it over with nvme_writer_commit(). A background thread persists the
+ * committed buffer while the producer fills the other one, so fetching data
+ * from the device and writing it to disk overlap.
+ *
+ * With O_DIRECT, every commit but the last has to be a multiple of
+ * NVME_WRITER_ALIGN. An unaligned commit sends the rest of the file
+ * through the page cache.
+ */
+struct nvme_writer;
+
+/* Alignment of buffers, lengths and offsets when writing with O_DIRECT */
+#define NVME_WRITER_ALIGN	0x1000
+
+struct nvme_writer *nvme_writer_open(const char *path, size_t buf_size,
+				     bool direct);
+void *nvme_writer_get_buf(struct nvme_writer *w);
+int nvme_writer_commit(struct nvme_writer *w, size_t len);
+int nvme_writer_close(struct nvme_writer *w);
+
+#endif /* WRITER_H_ */